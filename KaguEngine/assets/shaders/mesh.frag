@@ -1,5 +1,12 @@
 #version 450
 
+// Set per pipeline, see ShaderPermutation
+layout(constant_id = 0) const int MAX_LIGHTS = 10;
+layout(constant_id = 1) const int LIGHT_COUNT = -1; // -1 loops over ubo.numLights
+layout(constant_id = 2) const bool TEXTURED = false;
+layout(constant_id = 3) const bool ALPHA_BLEND = false;
+layout(constant_id = 4) const float GAMMA = 2.2;
+
 layout (set = 1, binding = 0) uniform sampler2D texSampler;
 
 layout (location = 0) in vec3 fragColor;
@@ -19,19 +26,18 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor; // w is intensity
-    PointLight pointLights[10];
     int numLights;
+    PointLight pointLights[MAX_LIGHTS]; // Last, its size is only known once specialized
 } ubo;
 
 layout(push_constant) uniform Push {
     mat4 modelMatrix;
     vec3 modelColor;
     float modelAlpha;
-    float gammaCorrection;
 } push;
 
 vec3 srgbToLinear(vec3 srgb) {
-    return pow(clamp(srgb, 0.0, 1.0), vec3(1.0/push.gammaCorrection));
+    return pow(clamp(srgb, 0.0, 1.0), vec3(1.0/GAMMA));
 }
 
 void main() {
@@ -42,7 +48,9 @@ void main() {
     vec3 cameraPosWorld = ubo.invView[3].xyz;
     vec3 viewDirection = normalize(cameraPosWorld - fragPosWorld);
 
-    for (int i = 0; i < ubo.numLights; i++) {
+    // Constant once specialized, so the loop can be unrolled
+    int lightCount = LIGHT_COUNT >= 0 ? LIGHT_COUNT : ubo.numLights;
+    for (int i = 0; i < lightCount; i++) {
         PointLight light = ubo.pointLights[i];
         vec3 directionToLight = light.position.xyz - fragPosWorld;
         float attenuation = 1.0 / dot(directionToLight, directionToLight); // distance squared
@@ -60,7 +68,9 @@ void main() {
         blinnTerm = pow(blinnTerm, 512.0); // higher values -> sharper highlight
         specularLight += intensity * blinnTerm;
     }
-    vec4 sourceColor = vec4(diffuseLight * fragColor + specularLight * fragColor, push.modelAlpha);
-    vec4 texColor = vec4(srgbToLinear(texture(texSampler, fragTexCoord).rgb), 1.0);
-    outColor = vec4(sourceColor * texColor);
+
+    outColor = vec4(diffuseLight * fragColor + specularLight * fragColor, ALPHA_BLEND ? push.modelAlpha : 1.0);
+    if (TEXTURED) {
+        outColor.rgb *= srgbToLinear(texture(texSampler, fragTexCoord).rgb);
+    }
 }
@@ -1,5 +1,9 @@
 #version 450
 
+// Set per pipeline, see ShaderPermutation
+layout(constant_id = 0) const int MAX_LIGHTS = 10;
+layout(constant_id = 2) const bool TEXTURED = false;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec3 normal;
@@ -20,15 +24,14 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor; // w is intensity
-    PointLight pointLights[10];
     int numLights;
+    PointLight pointLights[MAX_LIGHTS]; // Last, its size is only known once specialized
 } ubo;
 
 layout(push_constant) uniform Push {
     mat4 modelMatrix;
     vec3 modelColor;
     float modelAlpha;
-    float gammaCorrection;
 } push;
 
 void main() {
@@ -39,6 +42,6 @@ void main() {
     fragNormalWorld = normalize(normalMatrix * normal);
 
     fragPosWorld = positionWorld.xyz;
-    fragColor = inColor;
+    fragColor = TEXTURED ? inColor : push.modelColor;
     fragTexCoord = inTexCoord;
 }
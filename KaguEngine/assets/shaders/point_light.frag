@@ -1,5 +1,8 @@
 #version 450
 
+// Set per pipeline, see ShaderPermutation
+layout(constant_id = 0) const int MAX_LIGHTS = 10;
+
 layout (location = 0) in vec2 fragOffset;
 layout (location = 0) out vec4 outColor;
 
@@ -13,8 +16,8 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
-  PointLight pointLights[10];
   int numLights;
+  PointLight pointLights[MAX_LIGHTS]; // Last, its size is only known once specialized
 } ubo;
 
 layout(push_constant) uniform Push {
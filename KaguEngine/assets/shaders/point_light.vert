@@ -1,5 +1,8 @@
 #version 450
 
+// Set per pipeline, see ShaderPermutation
+layout(constant_id = 0) const int MAX_LIGHTS = 10;
+
 const vec2 OFFSETS[6] = vec2[](
   vec2(-1.0, -1.0),
   vec2(-1.0, 1.0),
@@ -21,8 +24,8 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
-  PointLight pointLights[10];
   int numLights;
+  PointLight pointLights[MAX_LIGHTS]; // Last, its size is only known once specialized
 } ubo;
 
 layout(push_constant) uniform Push {
@@ -1,41 +0,0 @@
-#version 450
-
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec3 normal;
-
-layout(location = 0) out vec3 fragColor;
-layout(location = 1) out vec3 fragPosWorld;
-layout(location = 2) out vec3 fragNormalWorld;
-
-struct PointLight {
-    vec4 position; // ignore w
-    vec4 color; // w is intensity
-};
-
-layout(set = 0, binding = 0) uniform GlobalUbo {
-    mat4 projection;
-    mat4 view;
-    mat4 invView;
-    vec4 ambientLightColor; // w is intensity
-    PointLight pointLights[10];
-    int numLights;
-} ubo;
-
-layout(push_constant) uniform Push {
-    mat4 modelMatrix;
-    vec3 modelColor;
-    float modelAlpha;
-    float gammaCorrection;
-} push;
-
-void main() {
-    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
-    gl_Position = ubo.projection * ubo.view * positionWorld;
-
-    mat3 normalMatrix = transpose(inverse(mat3(push.modelMatrix)));
-    fragNormalWorld = normalize(normalMatrix * normal);
-
-    fragPosWorld = positionWorld.xyz;
-    fragColor = push.modelColor;
-}
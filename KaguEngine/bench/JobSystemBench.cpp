@@ -0,0 +1,96 @@
+import KaguEngine.JobSystem;
+
+import std;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t EMPTY_JOBS = 200000;
+constexpr uint32_t RANGE_ITEMS = 1 << 24;
+constexpr uint32_t NESTED_OUTER = 256;
+constexpr uint32_t NESTED_INNER = 4096;
+constexpr int REPEATS = 5;
+
+// Best of REPEATS, in milliseconds
+template<typename Function>
+double measure(Function &&function) {
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < REPEATS; i++) {
+        const auto start = Clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+// Scheduling overhead: every job comes from the main thread, the others can only steal.
+// Past the deque capacity the main thread runs the jobs itself.
+double emptyJobs(KaguEngine::JobSystem &jobSystem) {
+    return measure([&] {
+        KaguEngine::JobCounter counter;
+        for (uint32_t i = 0; i < EMPTY_JOBS; i++) {
+            jobSystem.schedule(counter, [] {});
+        }
+        jobSystem.wait(counter);
+    });
+}
+
+// Throughput of a flat loop with cheap items
+double parallelFor(KaguEngine::JobSystem &jobSystem, std::vector<float> &values) {
+    return measure([&] {
+        jobSystem.parallelFor(RANGE_ITEMS, [&](const uint32_t begin, const uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                values[i] = std::sqrt(static_cast<float>(i)) * 0.5f + values[i] * 0.5f;
+            }
+        });
+    });
+}
+
+// Contention: every worker forks its own loops, so the deques are pushed, popped and stolen from at once
+double nestedFor(KaguEngine::JobSystem &jobSystem, std::atomic<uint64_t> &sink) {
+    return measure([&] {
+        jobSystem.parallelFor(NESTED_OUTER, [&](const uint32_t outerBegin, const uint32_t outerEnd) {
+            for (uint32_t outer = outerBegin; outer < outerEnd; outer++) {
+                jobSystem.parallelFor(NESTED_INNER, [&](const uint32_t begin, const uint32_t end) {
+                    uint64_t sum = 0;
+                    for (uint32_t i = begin; i < end; i++) {
+                        sum += static_cast<uint64_t>(i) * outer;
+                    }
+                    sink.fetch_add(sum, std::memory_order_relaxed);
+                });
+            }
+        });
+    });
+}
+
+} // Anonymous namespace
+
+int main() {
+    const uint32_t maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> values(RANGE_ITEMS, 1.f);
+    std::atomic<uint64_t> sink{0};
+
+    // Powers of two, always ending on every hardware thread
+    std::vector<uint32_t> workerCounts;
+    for (uint32_t workers = 1; workers < maxWorkers; workers *= 2) {
+        workerCounts.push_back(workers);
+    }
+    workerCounts.push_back(maxWorkers);
+
+    std::cout << std::format("{:>8} {:>14} {:>14} {:>14} {:>12} {:>12}\n", "workers", "empty jobs/s",
+                             "items/s", "nested ms", "stolen", "failed");
+    for (const uint32_t workers: workerCounts) {
+        KaguEngine::JobSystem jobSystem{workers};
+
+        const double emptyMs = emptyJobs(jobSystem);
+        const double rangeMs = parallelFor(jobSystem, values);
+        const double nestedMs = nestedFor(jobSystem, sink);
+        const auto stats = jobSystem.getStats();
+
+        std::cout << std::format("{:>8} {:>14.0f} {:>14.0f} {:>14.3f} {:>12} {:>12}\n", workers,
+                                 EMPTY_JOBS / (emptyMs / 1000.0), RANGE_ITEMS / (rangeMs / 1000.0), nestedMs,
+                                 stats.stolen, stats.failedSteals);
+    }
+    return 0;
+}
@@ -0,0 +1,295 @@
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <vulkan/vulkan.h>
+
+import KaguEngine.Buffer;
+import KaguEngine.Camera;
+import KaguEngine.Entity;
+import KaguEngine.FrameArena;
+import KaguEngine.FrameInfo;
+import KaguEngine.Model;
+import KaguEngine.System.PointLight;
+
+import std;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t TRANSFORM_COUNT = 1'000'000;
+constexpr uint32_t POSE_COUNT = 4096;
+constexpr uint32_t RANGE_COUNT = 1024; // Dirty ranges per coalesceRanges() call
+constexpr std::array<uint32_t, 2> LIGHT_COUNTS{KaguEngine::MAX_LIGHTS, 1024};
+constexpr std::array<VkDeviceSize, 5> WRITE_SIZES{64, 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+constexpr VkDeviceSize NON_COHERENT_ATOM_SIZE = 256; // The largest limit drivers report
+constexpr std::array<std::string_view, 3> MODEL_PATHS{
+    "assets/models/obamium_model.obj",
+    "assets/models/viking_room.obj",
+    "assets/models/base.obj"
+};
+
+struct Options {
+    uint32_t samples = 30;
+    double minSampleMs = 10.0; // Each sample repeats the benchmark until it lasts this long
+    std::string filter; // Substring of the names to run, all of them when empty
+};
+
+// Per iteration, over every sample
+struct Measurement {
+    double medianNs = 0.0;
+    double madNs = 0.0; // Median absolute deviation, robust to the outliers of a preempted sample
+    double minNs = 0.0;
+    uint64_t iterations = 0; // Per sample
+};
+
+// Stops the compiler from dropping the work producing value
+template<typename T>
+void keep(const T &value) {
+    static const volatile void *sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+double median(std::vector<double> &values) {
+    std::ranges::sort(values);
+    const size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+// Doubles the iterations until a sample lasts minSampleMs, which warms the caches and the branch predictors
+// up, then takes the median of the samples
+template<typename Function>
+Measurement measure(const Options &options, Function &&function) {
+    const auto runSample = [&](const uint64_t iterations) {
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            function();
+        }
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    Measurement measurement;
+    measurement.iterations = 1;
+    while (runSample(measurement.iterations) < options.minSampleMs && measurement.iterations < (1ull << 32)) {
+        measurement.iterations *= 2;
+    }
+
+    std::vector<double> samples(options.samples);
+    for (double &sample: samples) {
+        sample = runSample(measurement.iterations) * 1e6 / static_cast<double>(measurement.iterations);
+    }
+    measurement.medianNs = median(samples);
+    measurement.minNs = samples.front();
+    for (double &sample: samples) {
+        sample = std::abs(sample - measurement.medianNs);
+    }
+    measurement.madNs = median(samples);
+    return measurement;
+}
+
+class Suite {
+public:
+    explicit Suite(Options options) : m_Options{std::move(options)} {}
+
+    // items: processed by one call of function, for the per item time
+    template<typename Function>
+    void run(const std::string_view name, const uint64_t items, Function &&function) {
+        if (!m_Options.filter.empty() && !name.contains(m_Options.filter)) {
+            return;
+        }
+        const Measurement measurement = measure(m_Options, std::forward<Function>(function));
+        const double deviation = measurement.madNs / measurement.medianNs * 100.0;
+        std::cout << std::format("{:<40} {:>14} {:>7.1f}% {:>14} {:>12} {}", name, formatTime(measurement.medianNs),
+                                 deviation, formatTime(measurement.minNs),
+                                 formatTime(measurement.medianNs / static_cast<double>(items)),
+                                 deviation > NOISY_PERCENT ? "(noisy)" : "") << '\n';
+    }
+
+private:
+    static constexpr double NOISY_PERCENT = 5.0;
+
+    static std::string formatTime(const double nanoseconds) {
+        if (nanoseconds >= 1e6) {
+            return std::format("{:.3f} ms", nanoseconds / 1e6);
+        }
+        if (nanoseconds >= 1e3) {
+            return std::format("{:.3f} us", nanoseconds / 1e3);
+        }
+        return std::format("{:.2f} ns", nanoseconds);
+    }
+
+    Options m_Options;
+};
+
+Options parseOptions(const std::vector<std::string_view> &args) {
+    Options options;
+    const auto next = [&](size_t &i) {
+        if (i + 1 >= args.size()) {
+            throw std::runtime_error("Failed to parse arguments: " + std::string{args[i]} + " needs a value!");
+        }
+        return std::string{args[++i]};
+    };
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--samples") {
+            options.samples = std::max(1u, static_cast<uint32_t>(std::stoul(next(i))));
+        } else if (args[i] == "--min-time") {
+            options.minSampleMs = std::stod(next(i));
+        } else if (args[i] == "--filter") {
+            options.filter = next(i);
+        } else {
+            throw std::runtime_error("Failed to parse arguments: unknown " + std::string{args[i]} + "!");
+        }
+    }
+    return options;
+}
+
+glm::vec3 randomVec3(std::mt19937 &random, const float min, const float max) {
+    std::uniform_real_distribution distribution{min, max};
+    return {distribution(random), distribution(random), distribution(random)};
+}
+
+void transforms(Suite &suite, std::mt19937 &random) {
+    std::vector<KaguEngine::TransformComponent> transforms(TRANSFORM_COUNT);
+    for (KaguEngine::TransformComponent &transform: transforms) {
+        transform.translation = randomVec3(random, -100.f, 100.f);
+        transform.rotation = randomVec3(random, -glm::pi<float>(), glm::pi<float>());
+        transform.scale = randomVec3(random, 0.5f, 2.f);
+    }
+
+    // Written to memory like the draw list, not only computed
+    std::vector<glm::mat4> matrices(TRANSFORM_COUNT);
+    suite.run("TransformComponent::mat4", TRANSFORM_COUNT, [&] {
+        for (uint32_t i = 0; i < TRANSFORM_COUNT; i++) {
+            matrices[i] = transforms[i].mat4();
+        }
+        keep(matrices);
+    });
+    std::vector<glm::mat3> normalMatrices(TRANSFORM_COUNT);
+    suite.run("TransformComponent::normalMatrix", TRANSFORM_COUNT, [&] {
+        for (uint32_t i = 0; i < TRANSFORM_COUNT; i++) {
+            normalMatrices[i] = transforms[i].normalMatrix();
+        }
+        keep(normalMatrices);
+    });
+}
+
+void camera(Suite &suite, std::mt19937 &random) {
+    std::vector<std::pair<glm::vec3, glm::vec3>> poses(POSE_COUNT);
+    std::vector<glm::vec2> projections(POSE_COUNT);
+    std::uniform_real_distribution unit{0.f, 1.f};
+    for (uint32_t i = 0; i < POSE_COUNT; i++) {
+        poses[i] = {randomVec3(random, -10.f, 10.f), randomVec3(random, -glm::pi<float>(), glm::pi<float>())};
+        projections[i] = {glm::radians(30.f + 60.f * unit(random)), 1.f + unit(random)};
+    }
+
+    KaguEngine::Camera camera{};
+    suite.run("Camera::setViewYXZ", POSE_COUNT, [&] {
+        for (const auto &[position, rotation]: poses) {
+            camera.setViewYXZ(position, rotation);
+            keep(camera);
+        }
+    });
+    suite.run("Camera::setPerspectiveProjection", POSE_COUNT, [&] {
+        for (const glm::vec2 &projection: projections) {
+            camera.setPerspectiveProjection(projection.x, projection.y, 0.1f, 100.f);
+            keep(camera);
+        }
+    });
+}
+
+void models(Suite &suite) {
+    for (const std::string_view path: MODEL_PATHS) {
+        const std::string name = std::format("Model::Builder::loadModel {}", std::filesystem::path{path}.filename().string());
+        suite.run(name, 1, [&] {
+            KaguEngine::Model::Builder builder;
+            builder.loadModel(std::string{path});
+            keep(builder);
+        });
+    }
+
+    // Deduplicating the vertices hashes every one of them
+    KaguEngine::Model::Builder builder;
+    builder.loadModel(std::string{MODEL_PATHS[1]});
+    suite.run("hashCombine(Vertex)", builder.vertices.size(), [&] {
+        size_t hash = 0;
+        for (const KaguEngine::Model::Vertex &vertex: builder.vertices) {
+            hash ^= std::hash<KaguEngine::Model::Vertex>{}(vertex);
+        }
+        keep(hash);
+    });
+}
+
+void pointLights(Suite &suite, std::mt19937 &random) {
+    // Reset after every sort, like the frame arena the render thread sorts in
+    KaguEngine::FrameArena arena{1 << 20};
+    for (const uint32_t lightCount: LIGHT_COUNTS) {
+        KaguEngine::RenderPacket packet;
+        packet.cameraPosition = randomVec3(random, -10.f, 10.f);
+        packet.lights.resize(lightCount);
+        for (KaguEngine::LightItem &light: packet.lights) {
+            light.position = randomVec3(random, -10.f, 10.f);
+        }
+        suite.run(std::format("PointLightSystem::sortBackToFront {}", lightCount), lightCount, [&] {
+            const auto sorted = KaguEngine::PointLightSystem::sortBackToFront(packet, &arena);
+            keep(sorted);
+            arena.reset();
+        });
+    }
+}
+
+// Without a device nothing is mapped, the writes go to host memory. Mapped memory is often write combined,
+// these are the best case: the copy, the dirty range flushDirty() takes and the transfer stats.
+void bufferWrites(Suite &suite, std::mt19937 &random) {
+    const VkDeviceSize largest = WRITE_SIZES.back();
+    std::vector<std::byte> source(largest, std::byte{1});
+    std::vector<std::byte> mapped(largest);
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> dirtyRanges;
+    for (const VkDeviceSize size: WRITE_SIZES) {
+        // Non coherent, the path recording dirty ranges. Cleared like flushDirty() does once per frame.
+        suite.run(std::format("Buffer::writeMapped {} B", size), size, [&] {
+            KaguEngine::Buffer::writeMapped(mapped, 0, source.data(), size, 0, false, dirtyRanges);
+            dirtyRanges.clear();
+            keep(mapped);
+        });
+    }
+
+    std::uniform_int_distribution<VkDeviceSize> offset{0, largest - 4096};
+    std::uniform_int_distribution<VkDeviceSize> length{1, 4096};
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> ranges(RANGE_COUNT);
+    for (auto &[begin, end]: ranges) {
+        begin = offset(random);
+        end = begin + length(random);
+    }
+    suite.run("Buffer::coalesceRanges", RANGE_COUNT, [&] {
+        dirtyRanges = ranges;
+        KaguEngine::Buffer::coalesceRanges(dirtyRanges, NON_COHERENT_ATOM_SIZE, largest);
+        keep(dirtyRanges);
+    });
+}
+
+} // Anonymous namespace
+
+// CPU kernels of the engine in isolation, none of them creates a Vulkan device.
+// Median time per call with its deviation, the fastest sample, and the median time per item.
+int main(const int argc, char **argv) {
+    try {
+        Suite suite{parseOptions(std::vector<std::string_view>(argv + 1, argv + argc))};
+        std::mt19937 random{42}; // Same inputs on every run
+
+        std::cout << std::format("{:<40} {:>14} {:>8} {:>14} {:>12}", "Benchmark", "Median", "MAD", "Min", "Per item")
+                  << '\n';
+        transforms(suite, random);
+        camera(suite, random);
+        models(suite);
+        pointLights(suite, random);
+        bufferWrites(suite, random);
+    }
+    catch (std::exception &error) {
+        std::cerr << error.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,303 @@
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <vulkan/vulkan.h>
+
+import App;
+import KaguEngine.AllocationTracker;
+import KaguEngine.Camera;
+import KaguEngine.CommandRecorder;
+
+import std;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr float FRAME_TIME = 1.f / 60.f; // Fixed, every run animates the lights the same way
+constexpr float ORBIT_FRAMES = 600.f;    // Frames of one turn of the camera around the scene
+
+// Metrics compared to the baseline, lower is better
+constexpr std::array<std::string_view, 5> COMPARED_METRICS{
+    "cpu_p50_ms", "cpu_p95_ms", "cpu_p99_ms", "gpu_p50_ms", "gpu_p95_ms"
+};
+// Must match the baseline's, the numbers mean nothing on another scene
+constexpr std::array<std::string_view, 3> SCENE_METRICS{"instances", "lights", "seed"};
+
+struct Options {
+    uint32_t frames = 1000;
+    uint32_t warmup = 60; // Not measured, the first frames compile pipelines and upload the meshes
+    KaguEngine::ProceduralScene scene{};
+    std::filesystem::path output = "bench.json";
+    std::optional<std::filesystem::path> baseline;
+    double threshold = 5.0; // Percent a compared metric may grow over the baseline
+};
+
+// In the order they're written
+using Metrics = std::vector<std::pair<std::string, double>>;
+
+Options parseOptions(const std::vector<std::string_view> &args) {
+    Options options;
+    const auto next = [&](size_t &i) {
+        if (i + 1 >= args.size()) {
+            throw std::runtime_error("Failed to parse arguments: " + std::string{args[i]} + " needs a value!");
+        }
+        return std::string{args[++i]};
+    };
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--frames") {
+            options.frames = static_cast<uint32_t>(std::stoul(next(i)));
+        } else if (args[i] == "--warmup") {
+            options.warmup = static_cast<uint32_t>(std::stoul(next(i)));
+        } else if (args[i] == "--instances") {
+            options.scene.instances = static_cast<uint32_t>(std::stoul(next(i)));
+        } else if (args[i] == "--lights") {
+            options.scene.lights = static_cast<uint32_t>(std::stoul(next(i)));
+        } else if (args[i] == "--seed") {
+            options.scene.seed = static_cast<uint32_t>(std::stoul(next(i)));
+        } else if (args[i] == "--output") {
+            options.output = next(i);
+        } else if (args[i] == "--baseline") {
+            options.baseline = next(i);
+        } else if (args[i] == "--threshold") {
+            options.threshold = std::stod(next(i));
+        } else {
+            throw std::runtime_error("Failed to parse arguments: unknown " + std::string{args[i]} + "!");
+        }
+    }
+    if (options.frames == 0) {
+        throw std::runtime_error("Failed to parse arguments: --frames must be at least 1!");
+    }
+    return options;
+}
+
+// Replaces the keyboard controller: orbits the scene once every ORBIT_FRAMES frames while rising and sinking,
+// always looking at its center
+KaguEngine::Camera cameraAt(const uint32_t frame, const float sceneRadius, const float aspectRatio) {
+    const float angle = glm::two_pi<float>() * static_cast<float>(frame) / ORBIT_FRAMES;
+    const float distance = sceneRadius + 4.f;
+    const glm::vec3 position{distance * std::cos(angle), -2.f - std::sin(2.f * angle), distance * std::sin(angle)};
+
+    KaguEngine::Camera camera{};
+    camera.setViewTarget(position, glm::vec3{0.f});
+    camera.setPerspectiveProjection(glm::radians(60.f), aspectRatio, 0.1f, 2.f * distance + 10.f);
+    return camera;
+}
+
+// Nearest rank, values sorted
+double percentile(const std::vector<double> &values, const double percent) {
+    const auto rank = static_cast<size_t>(std::ceil(percent / 100.0 * static_cast<double>(values.size())));
+    return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+}
+
+double mean(const std::vector<double> &values) {
+    return std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double>(values.size());
+}
+
+Metrics run(const Options &options) {
+    KaguEngine::App app{VkExtent2D{KaguEngine::App::WIDTH, KaguEngine::App::HEIGHT}, options.scene};
+    const float sceneRadius = options.scene.getRadius();
+
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;
+    cpuMs.reserve(options.frames);
+    gpuMs.reserve(options.frames);
+    uint64_t draws = 0;
+    uint64_t arenaAllocations = 0;
+    uint64_t heapAllocations = 0;
+    uint64_t bytesWritten = 0;
+    KaguEngine::CommandStats commands{};
+    uint64_t trackedAllocations = 0;
+    uint64_t trackedBytes = 0;
+    std::vector<std::pair<std::string, uint64_t>> hotSpots; // Allocations of the tags while flagged
+    uint32_t lights = 0;
+
+    for (uint32_t frame = 0; frame < options.warmup + options.frames; frame++) {
+        const KaguEngine::Camera camera = cameraAt(frame, sceneRadius, app.getAspectRatio());
+        // Waits for a free frame slot as well, a GPU bound scene shows up here too
+        const auto start = Clock::now();
+        app.advanceFrame(FRAME_TIME, camera);
+        const double elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (frame < options.warmup) {
+            continue;
+        }
+
+        const KaguEngine::HeadlessFrameStats &stats = app.getFrameStats();
+        cpuMs.push_back(elapsedMs);
+        if (stats.gpuMs) {
+            gpuMs.push_back(*stats.gpuMs);
+        }
+        draws += stats.draws;
+        arenaAllocations += stats.arenaAllocations;
+        heapAllocations += stats.heapAllocations;
+        bytesWritten += stats.bytesWritten;
+        commands += stats.commands;
+        trackedAllocations += stats.trackedAllocations;
+        trackedBytes += stats.trackedBytes;
+        lights = stats.lights;
+        for (const KaguEngine::AllocationTagStats &tag: KaguEngine::AllocationTracker::getFrameStats().tags) {
+            if (!tag.hotSpot) {
+                continue;
+            }
+            auto it = std::ranges::find(hotSpots, tag.tag, [](const auto &hotSpot) {
+                return std::string_view{hotSpot.first};
+            });
+            if (it == hotSpots.end()) {
+                it = hotSpots.insert(hotSpots.end(), {std::string{tag.tag}, 0});
+            }
+            it->second += tag.count;
+        }
+    }
+    app.waitIdle();
+
+    const auto frames = static_cast<double>(options.frames);
+    std::ranges::sort(cpuMs);
+    Metrics metrics{
+        {"frames", frames},
+        {"instances", options.scene.instances},
+        {"lights", lights},
+        {"seed", options.scene.seed},
+        {"cpu_mean_ms", mean(cpuMs)},
+        {"cpu_p50_ms", percentile(cpuMs, 50.0)},
+        {"cpu_p95_ms", percentile(cpuMs, 95.0)},
+        {"cpu_p99_ms", percentile(cpuMs, 99.0)},
+        {"cpu_max_ms", cpuMs.back()},
+    };
+    // Left out without timestamps, or with the GPU profiler disabled in the config
+    if (!gpuMs.empty()) {
+        std::ranges::sort(gpuMs);
+        metrics.emplace_back("gpu_mean_ms", mean(gpuMs));
+        metrics.emplace_back("gpu_p50_ms", percentile(gpuMs, 50.0));
+        metrics.emplace_back("gpu_p95_ms", percentile(gpuMs, 95.0));
+        metrics.emplace_back("gpu_p99_ms", percentile(gpuMs, 99.0));
+    }
+    // Draw items of the mesh pass, the recorded draws below add the point lights
+    metrics.emplace_back("mesh_draws_per_frame", static_cast<double>(draws) / frames);
+    metrics.emplace_back("arena_allocations_per_frame", static_cast<double>(arenaAllocations) / frames);
+    metrics.emplace_back("heap_allocations_per_frame", static_cast<double>(heapAllocations) / frames);
+    metrics.emplace_back("device_allocations", app.getFrameStats().deviceAllocations);
+    metrics.emplace_back("bytes_written_per_frame", static_cast<double>(bytesWritten) / frames);
+    metrics.emplace_back("recorded_draws_per_frame", commands.draws / frames);
+    metrics.emplace_back("triangles_per_frame", static_cast<double>(commands.triangles) / frames);
+    metrics.emplace_back("pipeline_binds_per_frame", commands.pipelineBinds / frames);
+    metrics.emplace_back("descriptor_set_binds_per_frame", commands.descriptorSetBinds / frames);
+    metrics.emplace_back("buffer_binds_per_frame", commands.bufferBinds / frames);
+    metrics.emplace_back("push_constant_bytes_per_frame", static_cast<double>(commands.pushConstantBytes) / frames);
+    metrics.emplace_back("elided_commands_per_frame", commands.elided / frames);
+    // Only built with KAGU_TRACK_ALLOCATIONS, the tags allocating every frame are the ones to remove
+    if constexpr (KaguEngine::AllocationTracker::ENABLED) {
+        metrics.emplace_back("tracked_allocations_per_frame", static_cast<double>(trackedAllocations) / frames);
+        metrics.emplace_back("tracked_bytes_per_frame", static_cast<double>(trackedBytes) / frames);
+        std::ranges::sort(hotSpots, std::greater{}, &decltype(hotSpots)::value_type::second);
+        for (const auto &[tag, count]: hotSpots) {
+            metrics.emplace_back("hot_spot:" + tag, static_cast<double>(count) / frames);
+        }
+    }
+    return metrics;
+}
+
+void writeJson(const Metrics &metrics, const std::filesystem::path &path) {
+    std::string json = "{\n";
+    for (size_t i = 0; i < metrics.size(); i++) {
+        json += std::format("  \"{}\": {:.6g}{}\n", metrics[i].first, metrics[i].second,
+                            i + 1 < metrics.size() ? "," : "");
+    }
+    json += "}\n";
+
+    std::ofstream file{path};
+    if (!file.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+        throw std::runtime_error("Failed to write " + path.string() + "!");
+    }
+}
+
+// Only reads the flat objects writeJson() writes
+Metrics readJson(const std::filesystem::path &path) {
+    std::ifstream file{path};
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path.string() + "!");
+    }
+    const std::string json{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+    Metrics metrics;
+    size_t position = 0;
+    while ((position = json.find('"', position)) != std::string::npos) {
+        const size_t keyEnd = json.find('"', position + 1);
+        const size_t colon = json.find(':', keyEnd);
+        if (keyEnd == std::string::npos || colon == std::string::npos) {
+            throw std::runtime_error("Failed to parse " + path.string() + "!");
+        }
+        size_t valueLength = 0;
+        const double value = std::stod(json.substr(colon + 1), &valueLength);
+        metrics.emplace_back(json.substr(position + 1, keyEnd - position - 1), value);
+        position = colon + 1 + valueLength;
+    }
+    return metrics;
+}
+
+std::optional<double> find(const Metrics &metrics, const std::string_view key) {
+    const auto it = std::ranges::find(metrics, key, &Metrics::value_type::first);
+    return it != metrics.end() ? std::optional{it->second} : std::nullopt;
+}
+
+// Number of metrics past the threshold, the ones missing on either side are skipped
+int compare(const Metrics &metrics, const Metrics &baseline, const double threshold) {
+    for (const std::string_view key: SCENE_METRICS) {
+        if (find(metrics, key) != find(baseline, key)) {
+            throw std::runtime_error("Failed to compare to the baseline: it ran another scene (" + std::string{key} +
+                                     ")!");
+        }
+    }
+
+    int regressions = 0;
+    for (const std::string_view key: COMPARED_METRICS) {
+        const std::optional<double> current = find(metrics, key);
+        const std::optional<double> reference = find(baseline, key);
+        if (!current || !reference || *reference <= 0.0) {
+            continue;
+        }
+        const double change = (*current / *reference - 1.0) * 100.0;
+        const bool regressed = change > threshold;
+        std::cout << std::format("[Bench] {:<11} {:8.3f} ms, baseline {:8.3f} ms ({:+.1f}%){}", key, *current,
+                                 *reference, change, regressed ? " REGRESSION" : "") << '\n';
+        regressions += regressed;
+    }
+    return regressions;
+}
+
+} // Anonymous namespace
+
+// Renders a procedural scene headless for a fixed number of frames and writes the timings as JSON.
+// Exits with 1 when a metric grew past --threshold percent over --baseline, a previous output.
+int main(const int argc, char **argv) {
+    try {
+        const Options options = parseOptions(std::vector<std::string_view>(argv + 1, argv + argc));
+        const Metrics metrics = run(options);
+        writeJson(metrics, options.output);
+
+        std::cout << std::format("[Bench] {} frames, {} instances, {} lights -> {}", options.frames,
+                                 options.scene.instances, *find(metrics, "lights"), options.output.string()) << '\n';
+        std::cout << std::format("[Bench] CPU p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms",
+                                 *find(metrics, "cpu_p50_ms"), *find(metrics, "cpu_p95_ms"),
+                                 *find(metrics, "cpu_p99_ms")) << '\n';
+        if (const std::optional<double> gpuMs = find(metrics, "gpu_p50_ms")) {
+            std::cout << std::format("[Bench] GPU p50 {:.3f} ms, p95 {:.3f} ms", *gpuMs,
+                                     *find(metrics, "gpu_p95_ms")) << '\n';
+        }
+
+        if (options.baseline) {
+            const int regressions = compare(metrics, readJson(*options.baseline), options.threshold);
+            if (regressions > 0) {
+                std::cout << std::format("[Bench] {} metric(s) regressed more than {:.1f}%", regressions,
+                                         options.threshold) << '\n';
+                return 1;
+            }
+        }
+    }
+    catch (std::exception &error) {
+        std::cerr << error.what() << '\n';
+        return 2;
+    }
+    return 0;
+}
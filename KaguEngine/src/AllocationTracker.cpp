@@ -0,0 +1,285 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.AllocationTracker;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the per-thread counters
+constexpr auto UNTAGGED = "Untagged";
+constexpr auto OTHER = "Other";
+
+// Written by its thread only, read by the main thread closing the frame
+struct TagCounter {
+    std::atomic<const char *> tag{nullptr};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+    uint64_t closedCount = 0; // Main thread, at the last endFrame()
+    uint64_t closedBytes = 0;
+};
+
+// Open addressing on the tag's address, the last counter takes the tags that don't fit
+struct ThreadCounters {
+    std::array<TagCounter, AllocationTracker::MAX_TAGS + 1> tags;
+    std::atomic<uint64_t> vulkanCount{0};
+    std::atomic<uint64_t> vulkanBytes{0};
+    uint64_t closedVulkanCount = 0;
+    uint64_t closedVulkanBytes = 0;
+};
+
+// Never freed, the last frame of a thread that exited still counts
+std::array<std::atomic<ThreadCounters *>, AllocationTracker::MAX_THREADS> threads{};
+std::atomic<uint32_t> threadCount{0};
+thread_local ThreadCounters *threadCounters = nullptr;
+
+// Main thread only
+AllocationFrameStats frameStats;
+std::vector<std::pair<std::string, uint32_t>> streaks; // Frames in a row each tag allocated in
+
+ThreadCounters *getThreadCounters() {
+    if (threadCounters == nullptr) {
+        // With malloc, operator new would come back here
+        const uint32_t index = threadCount.fetch_add(1, std::memory_order_relaxed);
+        if (index < AllocationTracker::MAX_THREADS) {
+            if (void *memory = std::malloc(sizeof(ThreadCounters))) {
+                threadCounters = new (memory) ThreadCounters{};
+                threads[index].store(threadCounters, std::memory_order_release);
+            }
+        }
+    }
+    return threadCounters;
+}
+
+void add(std::atomic<uint64_t> &counter, const uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Vulkan passes the alignment again to reallocations but not the size, it's kept in front of the memory
+struct AlignedHeader {
+    std::size_t size;
+    std::size_t offset; // From the start of the malloc'd block
+};
+
+void *alignedAllocate(const std::size_t size, std::size_t alignment) noexcept {
+    alignment = std::max(alignment, alignof(AlignedHeader));
+    auto *block = static_cast<std::byte *>(std::malloc(size + alignment + sizeof(AlignedHeader)));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    const auto address = reinterpret_cast<std::uintptr_t>(block) + sizeof(AlignedHeader);
+    auto *memory = block + ((address + alignment - 1) & ~(alignment - 1)) - reinterpret_cast<std::uintptr_t>(block);
+    auto *header = reinterpret_cast<AlignedHeader *>(memory) - 1;
+    header->size = size;
+    header->offset = static_cast<std::size_t>(memory - block);
+    return memory;
+}
+
+void alignedFree(void *memory) noexcept {
+    if (memory != nullptr) {
+        const auto *header = static_cast<AlignedHeader *>(memory) - 1;
+        std::free(static_cast<std::byte *>(memory) - header->offset);
+    }
+}
+
+void *VKAPI_PTR vulkanAllocate(void *, const std::size_t size, const std::size_t alignment,
+                               VkSystemAllocationScope) {
+    AllocationTracker::record(size, true);
+    return alignedAllocate(size, alignment);
+}
+
+void *VKAPI_PTR vulkanReallocate(void *, void *original, const std::size_t size, const std::size_t alignment,
+                                 VkSystemAllocationScope) {
+    if (size == 0) {
+        alignedFree(original);
+        return nullptr;
+    }
+    AllocationTracker::record(size, true);
+    void *memory = alignedAllocate(size, alignment);
+    if (memory != nullptr && original != nullptr) {
+        std::memcpy(memory, original, std::min(size, (static_cast<AlignedHeader *>(original) - 1)->size));
+        alignedFree(original);
+    }
+    return memory;
+}
+
+void VKAPI_PTR vulkanFree(void *, void *memory) {
+    alignedFree(memory);
+}
+
+// The driver's own allocations, such as executable memory
+void VKAPI_PTR vulkanInternalAllocation(void *, const std::size_t size, VkInternalAllocationType,
+                                        VkSystemAllocationScope) {
+    AllocationTracker::record(size, true);
+}
+
+void VKAPI_PTR vulkanInternalFree(void *, std::size_t, VkInternalAllocationType, VkSystemAllocationScope) {}
+} // Anonymous namespace
+
+thread_local const char *AllocationTracker::t_Tag = nullptr;
+
+const VkAllocationCallbacks AllocationTracker::s_Callbacks{
+    nullptr, vulkanAllocate, vulkanReallocate, vulkanFree, vulkanInternalAllocation, vulkanInternalFree
+};
+
+void AllocationTracker::record(const std::size_t bytes, const bool vulkan) noexcept {
+    ThreadCounters *counters = getThreadCounters();
+    if (counters == nullptr) {
+        return;
+    }
+    if (vulkan) {
+        add(counters->vulkanCount, 1);
+        add(counters->vulkanBytes, bytes);
+    }
+
+    const char *tag = t_Tag != nullptr ? t_Tag : UNTAGGED;
+    const auto hash = static_cast<uint32_t>((reinterpret_cast<std::uintptr_t>(tag) >> 3) * 0x9E3779B97F4A7C15ull >> 32);
+    TagCounter *counter = &counters->tags[MAX_TAGS];
+    for (uint32_t probe = 0; probe < MAX_TAGS; probe++) {
+        TagCounter &candidate = counters->tags[(hash + probe) % MAX_TAGS];
+        const char *candidateTag = candidate.tag.load(std::memory_order_relaxed);
+        if (candidateTag == nullptr) {
+            candidate.tag.store(tag, std::memory_order_release);
+            counter = &candidate;
+            break;
+        }
+        if (candidateTag == tag) {
+            counter = &candidate;
+            break;
+        }
+    }
+    add(counter->count, 1);
+    add(counter->bytes, bytes);
+}
+
+void AllocationTracker::endFrame() {
+    Tag tag{"AllocationTracker::endFrame"};
+    AllocationFrameStats &stats = frameStats;
+    stats.count = stats.bytes = stats.vulkanCount = stats.vulkanBytes = 0;
+    stats.hotSpots = 0;
+    stats.tags.clear();
+
+    const uint32_t registered = std::min(threadCount.load(std::memory_order_acquire), MAX_THREADS);
+    for (uint32_t thread = 0; thread < registered; thread++) {
+        ThreadCounters *counters = threads[thread].load(std::memory_order_acquire);
+        if (counters == nullptr) {
+            continue;
+        }
+        const uint64_t vulkanCount = counters->vulkanCount.load(std::memory_order_relaxed);
+        const uint64_t vulkanBytes = counters->vulkanBytes.load(std::memory_order_relaxed);
+        stats.vulkanCount += vulkanCount - std::exchange(counters->closedVulkanCount, vulkanCount);
+        stats.vulkanBytes += vulkanBytes - std::exchange(counters->closedVulkanBytes, vulkanBytes);
+
+        for (uint32_t i = 0; i <= MAX_TAGS; i++) {
+            TagCounter &counter = counters->tags[i];
+            const char *name = i < MAX_TAGS ? counter.tag.load(std::memory_order_acquire) : OTHER;
+            if (name == nullptr) {
+                continue;
+            }
+            const uint64_t count = counter.count.load(std::memory_order_relaxed);
+            const uint64_t bytes = counter.bytes.load(std::memory_order_relaxed);
+            const uint64_t frameCount = count - std::exchange(counter.closedCount, count);
+            const uint64_t frameBytes = bytes - std::exchange(counter.closedBytes, bytes);
+            if (frameCount == 0) {
+                continue;
+            }
+
+            // The same name can have several addresses, one per translation unit or thread
+            auto it = std::ranges::find(stats.tags, std::string_view{name}, &AllocationTagStats::tag);
+            if (it == stats.tags.end()) {
+                it = stats.tags.insert(stats.tags.end(), AllocationTagStats{name});
+            }
+            it->count += frameCount;
+            it->bytes += frameBytes;
+            stats.count += frameCount;
+            stats.bytes += frameBytes;
+        }
+    }
+
+    // A tag allocating frame after frame is part of the steady state, the loading ones only spike
+    for (auto &[name, frames]: streaks) {
+        const bool allocated = std::ranges::contains(stats.tags, std::string_view{name}, &AllocationTagStats::tag);
+        frames = allocated ? frames + 1 : 0;
+    }
+    for (AllocationTagStats &tagStats: stats.tags) {
+        auto it = std::ranges::find(streaks, tagStats.tag, [](const auto &streak) {
+            return std::string_view{streak.first};
+        });
+        if (it == streaks.end()) {
+            it = streaks.insert(streaks.end(), {std::string{tagStats.tag}, 1});
+        }
+        tagStats.hotSpot = it->second >= Config::allocationHotSpotFrames;
+        stats.hotSpots += tagStats.hotSpot;
+    }
+    std::ranges::sort(stats.tags, std::greater{}, &AllocationTagStats::count);
+}
+
+const AllocationFrameStats &AllocationTracker::getFrameStats() {
+    return frameStats;
+}
+
+} // Namespace KaguEngine
+
+#if defined(KAGU_TRACK_ALLOCATIONS)
+// Replaced for the whole program, a plain linkage specification attaches them to the global module
+extern "C++" {
+void *operator new(const std::size_t size) {
+    KaguEngine::AllocationTracker::record(size);
+    if (void *memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc{};
+}
+void *operator new[](const std::size_t size) {
+    return operator new(size);
+}
+void *operator new(const std::size_t size, const std::align_val_t alignment) {
+    KaguEngine::AllocationTracker::record(size);
+    if (void *memory = KaguEngine::alignedAllocate(size, static_cast<std::size_t>(alignment))) {
+        return memory;
+    }
+    throw std::bad_alloc{};
+}
+void *operator new[](const std::size_t size, const std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+void *operator new(const std::size_t size, const std::nothrow_t &) noexcept {
+    KaguEngine::AllocationTracker::record(size);
+    return std::malloc(size != 0 ? size : 1);
+}
+void *operator new[](const std::size_t size, const std::nothrow_t &) noexcept {
+    return operator new(size, std::nothrow);
+}
+void *operator new(const std::size_t size, const std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    KaguEngine::AllocationTracker::record(size);
+    return KaguEngine::alignedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](const std::size_t size, const std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void *memory, const std::nothrow_t &) noexcept { std::free(memory); }
+void operator delete[](void *memory, const std::nothrow_t &) noexcept { std::free(memory); }
+void operator delete(void *memory, std::align_val_t) noexcept { KaguEngine::alignedFree(memory); }
+void operator delete[](void *memory, std::align_val_t) noexcept { KaguEngine::alignedFree(memory); }
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept { KaguEngine::alignedFree(memory); }
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept { KaguEngine::alignedFree(memory); }
+void operator delete(void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+    KaguEngine::alignedFree(memory);
+}
+void operator delete[](void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+    KaguEngine::alignedFree(memory);
+}
+}
+#endif
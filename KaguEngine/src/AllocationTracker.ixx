@@ -0,0 +1,88 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.AllocationTracker;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+struct AllocationTagStats {
+    std::string_view tag; // Valid while the tag's string is, literals and system names
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    bool hotSpot = false; // Allocated in each of the last Config::allocationHotSpotFrames frames
+};
+
+// Allocations of every thread during one frame
+struct AllocationFrameStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t vulkanCount = 0; // Host memory of the driver, included in count
+    uint64_t vulkanBytes = 0;
+    uint32_t hotSpots = 0;
+    std::vector<AllocationTagStats> tags; // Most allocations first
+};
+
+// Counts the heap allocations of every thread, through the replaced operator new and the Vulkan allocation
+// callbacks, and attributes them to the innermost tag of the allocating thread. Built with
+// KAGU_TRACK_ALLOCATIONS only, without it the tags do nothing and Vulkan gets no callbacks.
+class AllocationTracker {
+public:
+#if defined(KAGU_TRACK_ALLOCATIONS)
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+    static constexpr uint32_t MAX_TAGS = 256; // Per thread, the allocations of the ones past it count as "Other"
+    static constexpr uint32_t MAX_THREADS = 256; // The threads past it aren't counted
+
+    // Attributes the thread's allocations to name until the end of the scope. name must live as long as the
+    // process, a literal or an interned string. CpuProfiler zones and scheduler systems are tags as well.
+    class Tag {
+    public:
+        explicit Tag(const char *name) noexcept {
+            if constexpr (ENABLED) {
+                m_Previous = t_Tag;
+                t_Tag = name;
+            }
+        }
+        ~Tag() {
+            if constexpr (ENABLED) {
+                t_Tag = m_Previous;
+            }
+        }
+
+        Tag(const Tag &) = delete;
+        Tag &operator=(const Tag &) = delete;
+
+    private:
+        const char *m_Previous = nullptr;
+    };
+
+    // pAllocator of every vkCreate*, vkAllocateMemory and of the calls destroying what they made. Null without
+    // tracking, the driver then uses its own allocator.
+    [[nodiscard]] static const VkAllocationCallbacks *callbacks() {
+        if constexpr (ENABLED) {
+            return &s_Callbacks;
+        } else {
+            return nullptr;
+        }
+    }
+
+    // From the allocation functions, never allocates
+    static void record(std::size_t bytes, bool vulkan = false) noexcept;
+    // Main thread, once per frame. Closes the frame's counters, the allocations of every thread since the last call.
+    static void endFrame();
+    // The last closed frame
+    [[nodiscard]] static const AllocationFrameStats &getFrameStats();
+
+private:
+    static thread_local const char *t_Tag;
+    static const VkAllocationCallbacks s_Callbacks;
+};
+
+} // Namespace KaguEngine
@@ -1,5 +1,8 @@
 module;
 
+// config
+#include "include/config.hpp"
+
 // libs
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -15,53 +18,224 @@ module App;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
 import KaguEngine.Buffer;
 import KaguEngine.Camera;
+import KaguEngine.CommandRecorder;
+import KaguEngine.CpuProfiler;
+import KaguEngine.Defragmenter;
 import KaguEngine.Descriptor;
 import KaguEngine.Device;
 import KaguEngine.Entity;
+import KaguEngine.FileWatcher;
+import KaguEngine.FrameArena;
 import KaguEngine.FrameInfo;
+import KaguEngine.FramePacer;
+import KaguEngine.GpuProfiler;
 import KaguEngine.ImGuiContext;
+import KaguEngine.JobSystem;
 import KaguEngine.Model;
 import KaguEngine.MovementController;
+import KaguEngine.PipelineBuilder;
+import KaguEngine.PipelineCache;
+import KaguEngine.PipelineLayoutCache;
 import KaguEngine.Renderer;
+import KaguEngine.RenderGraph;
+import KaguEngine.RenderThread;
+import KaguEngine.ShaderCache;
 import KaguEngine.System.PointLight;
 import KaguEngine.System.Render;
 import KaguEngine.SwapChain;
+import KaguEngine.SystemScheduler;
 import KaguEngine.Texture;
 import KaguEngine.Window;
 
 namespace KaguEngine {
 
-void App::run() {
-    std::vector<std::unique_ptr<Buffer>> uboBuffers(SwapChain::MAX_FRAMES_IN_FLIGHT);
-    for (auto& uboBuffer : uboBuffers) {
+namespace { // Anonymous namespace for the scene loading
+constexpr std::array<std::string_view, 3> MODEL_PATHS{
+    "assets/models/obamium_model.obj",
+    "assets/models/viking_room.obj",
+    "assets/models/base.obj"
+};
+// Turns each model upright, in the order of MODEL_PATHS
+constexpr std::array<glm::vec3, MODEL_PATHS.size()> MODEL_ROTATIONS{
+    glm::vec3{0.f, 0.f, glm::pi<float>()},
+    glm::vec3{glm::pi<float>() / 2.f, 0.f, glm::pi<float>()},
+    glm::vec3{0.f}
+};
+
+// Parsing the OBJ files is the slow part, it runs on the job system while the uploads stay on the caller's thread
+std::array<Model::Builder, MODEL_PATHS.size()> parseModels(JobSystem &jobSystem) {
+    std::array<Model::Builder, MODEL_PATHS.size()> modelBuilders{};
+    std::array<std::exception_ptr, MODEL_PATHS.size()> loadErrors{};
+    jobSystem.parallelFor(static_cast<uint32_t>(MODEL_PATHS.size()), [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            try {
+                modelBuilders[i].loadModel(std::string{MODEL_PATHS[i]});
+            } catch (...) {
+                loadErrors[i] = std::current_exception();
+            }
+        }
+    }, 1);
+    for (const auto &error: loadErrors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return modelBuilders;
+}
+} // Anonymous namespace
+
+struct App::FrameResources {
+    std::vector<std::unique_ptr<Buffer>> uboBuffers;
+    std::vector<VkDescriptorSet> globalDescriptorSets;
+    std::unique_ptr<RenderSystem> renderSystem;
+    std::unique_ptr<PointLightSystem> pointLightSystem;
+    VkPipelineLayout globalPipelineLayout = VK_NULL_HANDLE; // Owned by the layout cache
+    RenderPacket packet; // Headless only, the render thread's slots hold them otherwise
+    uint64_t frame = 0;  // Headless only
+    uint64_t lastGpuFrame = 0; // Headless only, the last one in the GPU profiler's history
+};
+
+App::App(std::unique_ptr<Window> window, const VkExtent2D extent, const std::optional<ProceduralScene> &scene) :
+    m_Window{std::move(window)},
+    m_Device{m_Window ? Device{*m_Window} : Device{}},
+    m_Renderer{m_Window ? Renderer{*m_Window, m_Device} : Renderer{m_Device, extent}} {
+    // Defined like the layouts reflected from the shaders, so the sets allocated here are compatible
+    m_GlobalSetLayout = DescriptorSetLayout::Builder(m_Device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, PipelineLayoutCache::STAGES)
+        .build();
+    m_MaterialSetLayout = DescriptorSetLayout::Builder(m_Device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, PipelineLayoutCache::STAGES)
+        .build();
+    m_DescriptorPool = DescriptorPool::Builder(m_Device)
+        .setMaxSets(1000) // Arbitrary value
+        .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_SAMPLER, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000)
+        .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+        .build();
+    if (scene) {
+        loadProceduralScene(*scene);
+    } else {
+        loadGameObjects();
+    }
+    createFrameResources();
+}
+
+App::~App() {
+    waitIdle();
+    std::erase_if(m_SceneEntities, [](const auto&) { return true; });
+}
+
+void App::createFrameResources() {
+    m_Frame = std::make_unique<FrameResources>();
+    m_Frame->uboBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto& uboBuffer : m_Frame->uboBuffers) {
         uboBuffer = std::make_unique<Buffer>(m_Device, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
         uboBuffer->map();
     }
 
-    std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
-    for (unsigned int i = 0; i < globalDescriptorSets.size(); i++) {
-        auto bufferInfo = uboBuffers[i]->descriptorInfo();
+    m_Frame->globalDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (unsigned int i = 0; i < m_Frame->globalDescriptorSets.size(); i++) {
+        auto bufferInfo = m_Frame->uboBuffers[i]->descriptorInfo();
         DescriptorWriter(*m_GlobalSetLayout, *m_DescriptorPool)
             .writeBuffer(0, &bufferInfo)
-            .build(globalDescriptorSets[i]);
+            .build(m_Frame->globalDescriptorSets[i]);
     }
 
-    RenderSystem renderSystem{
+    m_Frame->renderSystem = std::make_unique<RenderSystem>(
         m_Device,
+        m_JobSystem,
+        m_PipelineBuilder,
         m_Renderer.getFormat(),
         m_Renderer.getDepthFormat(),
-        m_GlobalSetLayout->getDescriptorSetLayout(),    // set = 0 (UBO)
-        m_MaterialSetLayout->getDescriptorSetLayout()   // set = 1 (textures)
-    };
-    PointLightSystem pointLightSystem{
+        m_MaterialSetLayout->getDescriptorSetLayout(),  // set = 1 (textures)
+        m_DescriptorPool->getDescriptorPool()
+    );
+    m_Frame->pointLightSystem = std::make_unique<PointLightSystem>(
         m_Device,
+        m_PipelineBuilder,
         m_Renderer.getFormat(),
-        m_Renderer.getDepthFormat(),
-        m_GlobalSetLayout->getDescriptorSetLayout()
-    };
+        m_Renderer.getDepthFormat()
+    );
+    // Only binds the global set, compatible with every system's layout for set = 0
+    m_Frame->globalPipelineLayout = m_PipelineBuilder.getLayoutCache().getPipelineLayout(
+        std::array{m_GlobalSetLayout->getDescriptorSetLayout()});
+}
+
+RenderGraph &App::beginSceneGraph(const FrameInfo &frameInfo) {
+    FrameResources &frame = *m_Frame;
+    frame.uboBuffers[frameInfo.frameIndex]->writeToBuffer(&frameInfo.packet.ubo);
+    if (frame.uboBuffers[frameInfo.frameIndex]->flushDirty() != VK_SUCCESS)
+        throw std::runtime_error("Couldn't flush the ubo for one frame!");
+
+    RenderGraph &graph = m_Renderer.beginGraph();
+    const TransientImageDesc colorDesc{m_Renderer.getExtent(), m_Renderer.getFormat(), m_Device.getSampleCount()};
+    const TransientImageDesc depthDesc{m_Renderer.getExtent(), m_Renderer.getDepthFormat(), m_Device.getSampleCount()};
+    const RenderResource sceneImage = m_Renderer.getSceneImage();
+    const RenderResource sceneColor = graph.createImage("Scene color", colorDesc);
+    const RenderResource sceneDepth = graph.createImage("Scene depth", depthDesc);
+
+    graph.addPass("Scene", [&, sceneImage, sceneColor, sceneDepth](const VkCommandBuffer passCommandBuffer) {
+        const auto beginScene = [&](const VkRenderingFlags flags) {
+            m_Renderer.beginRendering(passCommandBuffer, graph.getImageView(sceneColor),
+                                      graph.getImageView(sceneImage), graph.getImageView(sceneDepth),
+                                      frameInfo.packet.clearColor, flags);
+        };
+        beginScene(RenderSystem::RENDERING_FLAGS);
+        frame.renderSystem->renderGameObjects(frameInfo);
+        Renderer::endRendering(passCommandBuffer);
+        beginScene(VK_RENDERING_RESUMING_BIT);
+        // Executing secondaries leaves the bindings undefined, the systems drawing inline share this one
+        vkCmdBindDescriptorSets(passCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frame.globalPipelineLayout, 0, 1,
+                                &frameInfo.globalDescriptorSet, 0, nullptr);
+        {
+            // Not around the meshes, nothing can be recorded next to the secondaries of a suspended pass
+            GpuProfiler::Scope scope{m_Renderer.getGpuProfiler(), passCommandBuffer, "Point lights"};
+            frame.pointLightSystem->render(frameInfo);
+        }
+        Renderer::endRendering(passCommandBuffer);
+    })
+        .write(sceneColor, ImageUsage::ColorAttachment)
+        .write(sceneDepth, ImageUsage::DepthAttachment)
+        .write(sceneImage, ImageUsage::ColorAttachment);
+    return graph;
+}
+
+void App::endFrame() {
+    CpuProfiler::Zone zone{"App::endFrame"};
+    const FramePacer &framePacer = m_Renderer.getFramePacer();
+    m_PipelineBuilder.update(framePacer.submittedValue(), framePacer.completedValue());
+    m_Device.collectUploads();
+    m_Device.residency().endFrame(framePacer.completedValue());
+    Buffer::endFrameStats();
+    CommandRecorder::endFrameStats();
+    FrameArena::resetAll();
+    m_Defragmenter.update();
+    AllocationTracker::endFrame();
+}
+
+void App::waitIdle() const {
+    m_Renderer.getFramePacer().waitIdle();
+}
+
+void App::run() {
+    if (isHeadless()) {
+        throw std::runtime_error("Failed to run: the app is headless, use advanceFrame()!");
+    }
+    FrameResources &frameResources = *m_Frame;
+
     Camera camera{};
 
     std::vector<Entity> views;
@@ -75,115 +249,369 @@ void App::run() {
     views.emplace_back(std::move(otherView));
 
     glm::vec4 ambientLightColor = { 0.2f, 0.2f, 0.2f, 1.0f };
+    glm::vec4 clearColor = m_Renderer.clearColor; // Edited here, the render thread gets it through the packet
     ImGuiContext imGuiContext(
-        m_Window, *m_Renderer.getSwapChain(), m_Device,
+        *m_Window, *m_Renderer.getSwapChain(), m_Device,
         m_DescriptorPool,
-        m_SceneEntities, views, camera, ambientLightColor, m_Renderer.clearColor
+        m_SceneEntities, views, camera, ambientLightColor, clearColor
     );
 
+    // Recording and submission, from the packets the main thread hands over
+    std::vector<double> recordingTimings; // Read once the render thread is idle
+    RenderThread renderThread{[&](RenderSlot &slot) {
+        CpuProfiler::Zone frameZone{"Record frame"};
+        const auto commandBuffer = m_Renderer.beginFrame();
+        if (!commandBuffer) {
+            return;
+        }
+
+        const RenderPacket &packet = slot.packet;
+        const int frameIndex = m_Renderer.getFrameIndex();
+        const FrameInfo frameInfo{
+            frameIndex, packet.frameTime, commandBuffer, frameResources.globalDescriptorSets[frameIndex], packet,
+            m_Renderer.getExtent()
+        };
+
+        // Scene and UI never overlap, so their attachments share memory
+        RenderGraph &graph = beginSceneGraph(frameInfo);
+        const TransientImageDesc colorDesc{m_Renderer.getExtent(), m_Renderer.getFormat(), m_Device.getSampleCount()};
+        const TransientImageDesc depthDesc{m_Renderer.getExtent(), m_Renderer.getDepthFormat(), m_Device.getSampleCount()};
+        const RenderResource sceneImage = m_Renderer.getSceneImage();
+        const RenderResource uiColor = graph.createImage("UI color", colorDesc);
+        const RenderResource uiDepth = graph.createImage("UI depth", depthDesc);
+
+        graph.addPass("UI", [&](const VkCommandBuffer passCommandBuffer) {
+            m_Renderer.beginRendering(passCommandBuffer, graph.getImageView(uiColor),
+                                      graph.getImageView(m_Renderer.getBackBuffer()), graph.getImageView(uiDepth),
+                                      glm::vec4{0.f});
+            imGuiContext.recordDrawData(slot.ui, passCommandBuffer);
+            Renderer::endRendering(passCommandBuffer);
+        })
+            .read(sceneImage, ImageUsage::Sampled)
+            .write(uiColor, ImageUsage::ColorAttachment)
+            .write(uiDepth, ImageUsage::DepthAttachment)
+            .write(m_Renderer.getBackBuffer(), ImageUsage::ColorAttachment);
+
+        {
+            CpuProfiler::Zone zone{"Render graph"};
+            m_Renderer.executeGraph(commandBuffer);
+        }
+
+        if (packet.benchmarkRecording) {
+            recordingTimings = frameResources.renderSystem->benchmarkRecording(frameInfo,
+                                                                              Config::recordingBenchmarkDraws);
+        }
+
+        CpuProfiler::Zone zone{"Submit"};
+        m_Renderer.endFrame();
+        m_Device.residency().frameSubmitted(packet.residencyFrame, m_Renderer.getFramePacer().submittedValue());
+    }};
+
+    // Per-frame systems, what they read and write decides which ones run concurrently
+    KeyboardMovementController cameraController{};
+    float frameTime = 0.f;
+    uint64_t frame = 0;
+    RenderSlot *slot = nullptr; // Only valid while the scheduler runs
+    SystemScheduler scheduler{m_JobSystem};
+
+    scheduler.addSystem("Camera", Component::Ui, Component::Camera, [&] {
+        cameraController.moveInPlaneXZ(m_Window->getGLFWwindow(), frameTime, imGuiContext.getView());
+        camera.setViewYXZ(imGuiContext.getView().transform.translation, imGuiContext.getView().transform.rotation);
+        camera.setPerspectiveProjection(imGuiContext.getFovY(), m_Renderer.getAspectRatio(), 0.1f,
+                                        imGuiContext.getDepth());
+    }, SystemAffinity::MainThread);
+    scheduler.addSystem("Point lights", {}, Component::Lights, [&] {
+        PointLightSystem::update(m_SceneEntities, frameTime);
+    });
+    // The light count picks the shader permutations
+    // Refaulted textures allocate descriptor sets from a pool the main thread owns
+    scheduler.addSystem("Draw list", Component::Transforms | Component::Lights,
+                        Component::Models | Component::RenderPacket, [&] {
+        frameResources.renderSystem->snapshot(m_SceneEntities, slot->packet);
+    }, SystemAffinity::MainThread);
+    scheduler.addSystem("Frame globals", Component::Camera | Component::Lights | Component::Ui,
+                        Component::GlobalUbo | Component::RenderPacket, [&] {
+        RenderPacket &packet = slot->packet;
+        packet.frame = frame;
+        packet.frameTime = frameTime;
+        packet.ubo.projection = camera.getProjection();
+        packet.ubo.view = camera.getView();
+        packet.ubo.inverseView = camera.getInverseView();
+        packet.ubo.ambientLightColor = imGuiContext.getAmbientLightColor();
+        packet.cameraPosition = camera.getPosition();
+        packet.clearColor = imGuiContext.getClearColor();
+        PointLightSystem::snapshot(m_SceneEntities, packet);
+    });
+    // The editor can change anything, so it goes last and its edits reach the next packet
+    scheduler.addSystem("ImGui", ALL_COMPONENTS, ALL_COMPONENTS, [&] {
+        imGuiContext.buildFrame(m_Renderer, slot->ui);
+        slot->packet.benchmarkRecording = imGuiContext.consumeRecordingBenchmark();
+    }, SystemAffinity::MainThread);
+
+    // Shaders edited on disk are rebuilt in the background, then swapped between two frames
+    std::optional<FileWatcher> shaderWatcher;
+    if (Config::shaderHotReload && std::filesystem::is_directory(ShaderCache::getWatchedDirectory())) {
+        shaderWatcher.emplace(ShaderCache::getWatchedDirectory());
+    }
+
+    float pipelineCacheTimer = 0.f;
+    bool pipelinesLogged = false;
+    CpuProfiler::setThreadName("Main");
     auto currentTime = std::chrono::high_resolution_clock::now();
-    while (!m_Window.shouldClose() && m_IsRunning) {
-        KeyboardMovementController cameraController{};
-        glfwPollEvents();
+    while (!m_Window->shouldClose() && m_IsRunning) {
+        // Outside the frame's zones, a capture only keeps the zones that ended before it did
+        if (const std::optional<CpuTraceResult> trace = CpuProfiler::endFrame()) {
+            const std::string line = std::format("[Profiler] {} CPU frames, {} zones ({} overwritten) -> {}",
+                trace->frames, trace->zones, trace->overwritten, trace->path.string());
+            std::cout << line << '\n';
+            imGuiContext.addLog(line.c_str());
+        }
+        CpuProfiler::Zone frameZone{"Frame"};
 
-        if (m_Window.windowResized()) {
-            m_Renderer.recreateSwapChain();
-            ImGuiContext::recreateSwapChain();
-            m_Window.resetWindowResizedFlag();
+        // Low latency gives up the overlap with the render thread: input is sampled once the GPU is done
+        if (m_Renderer.getFramePacer().getMode() == PacingMode::LowLatency) {
+            CpuProfiler::Zone zone{"Wait for GPU"};
+            renderThread.waitIdle();
+            m_Renderer.getFramePacer().waitForInput();
+        }
+
+        {
+            CpuProfiler::Zone zone{"Poll events"};
+            glfwPollEvents();
         }
 
         auto newTime = std::chrono::high_resolution_clock::now();
-        float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
+        frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
         currentTime = newTime;
 
-        cameraController.moveInPlaneXZ(m_Window.getGLFWwindow(), frameTime, imGuiContext.getView());
-        camera.setViewYXZ(imGuiContext.getView().transform.translation, imGuiContext.getView().transform.rotation);
+        // Simulates this frame while the render thread records the previous one
+        {
+            CpuProfiler::Zone zone{"Simulate"};
+            slot = &renderThread.acquireSlot();
+            scheduler.run();
+            slot = nullptr;
+        }
 
-        float aspect = m_Renderer.getAspectRatio();
-        camera.setPerspectiveProjection(imGuiContext.getFovY(), aspect, 0.1f, imGuiContext.getDepth());
-
-        if (auto commandBuffer = m_Renderer.beginFrame()) {
-            int frameIndex = m_Renderer.getFrameIndex();
-            FrameInfo frameInfo{
-                frameIndex, frameTime, commandBuffer, camera, globalDescriptorSets[frameIndex], m_SceneEntities
-            };
-
-            // update
-            GlobalUbo ubo{};
-            ubo.projection = camera.getProjection();
-            ubo.view = camera.getView();
-            ubo.inverseView = camera.getInverseView();
-            ubo.ambientLightColor = imGuiContext.getAmbientLightColor();
-            m_Renderer.clearColor = imGuiContext.getClearColor();
-            PointLightSystem::update(frameInfo, ubo);
-            uboBuffers[frameIndex]->writeToBuffer(&ubo);
-            if(uboBuffers[frameIndex]->flush() != VK_SUCCESS)
-                throw std::runtime_error("Couldn't flush the ubo for one frame!");
-
-            // Offscreen rendering
-            m_Renderer.beginOffscreenRendering(commandBuffer);
-            renderSystem.renderGameObjects(frameInfo);
-            pointLightSystem.render(frameInfo);
-            m_Renderer.endOffscreenRendering(commandBuffer);
-
-            // ImGui rendering
-            m_Renderer.beginRendering(commandBuffer);
-            imGuiContext.render(m_Renderer, commandBuffer);
-            m_Renderer.endRendering(commandBuffer);
-
-            m_Renderer.endFrame();
+        // Nothing is recording until submit(), the swap chain and the resources can change
+        {
+            CpuProfiler::Zone zone{"Wait for render thread"};
+            renderThread.waitIdle();
+        }
+        if (m_Renderer.refreshSwapChain()) {
+            ImGuiContext::recreateSwapChain();
         }
+        imGuiContext.syncFramePacer(m_Renderer.getFramePacer());
+        imGuiContext.syncGpuProfiler(m_Renderer.getGpuProfiler());
+        imGuiContext.syncAllocations(AllocationTracker::getFrameStats());
+
+        if (shaderWatcher) {
+            for (const std::filesystem::path &path: shaderWatcher->poll()) {
+                m_PipelineBuilder.reloadShader(ShaderCache::getSpirvPath(path));
+            }
+        }
+
+        for (size_t i = 0; i < recordingTimings.size(); i++) {
+            const std::string line = std::format("[Bench] {} draws, {} thread(s): {:.2f} ms ({:.2f}x)",
+                Config::recordingBenchmarkDraws, i + 1, recordingTimings[i], recordingTimings[0] / recordingTimings[i]);
+            std::cout << line << '\n';
+            imGuiContext.addLog(line.c_str());
+        }
+        recordingTimings.clear();
+
+        if (const GpuProfiler *gpuProfiler = m_Renderer.getGpuProfiler();
+            gpuProfiler && imGuiContext.consumeGpuProfileExport()) {
+            gpuProfiler->exportCsv(Config::gpuProfileCsvPath);
+            const std::string line = std::format("[Profiler] {} GPU frames -> {}", gpuProfiler->getHistory().size(),
+                                                 Config::gpuProfileCsvPath);
+            std::cout << line << '\n';
+            imGuiContext.addLog(line.c_str());
+        }
+
+        if (imGuiContext.consumeScheduleDump()) {
+            std::ofstream{"schedule.dot"} << scheduler.dumpGraphviz();
+            const CriticalPath criticalPath = scheduler.getCriticalPath();
+            std::string line = std::format("[Schedule] Frame {:.3f} ms, critical path {:.3f} ms:",
+                                           scheduler.getFrameMs(), criticalPath.durationMs);
+            for (const uint32_t system: criticalPath.systems) {
+                line += std::format(" {} ({:.3f} ms)", scheduler.getName(system),
+                                    scheduler.getTiming(system).durationMs);
+            }
+            std::cout << line << " -> schedule.dot\n";
+            imGuiContext.addLog(line.c_str());
+
+            const RenderGraph &renderGraph = m_Renderer.getRenderGraph();
+            std::ofstream{"render_graph.dot"} << renderGraph.dumpGraphviz();
+            const TransientStats &transientStats = renderGraph.getTransientStats();
+            line = std::format("[RenderGraph] {} transient images in {:.1f} MiB ({:.1f} MiB without aliasing)",
+                               transientStats.imageCount,
+                               static_cast<double>(transientStats.heapBytes) / (1024.0 * 1024.0),
+                               static_cast<double>(transientStats.unaliasedBytes) / (1024.0 * 1024.0));
+            std::cout << line << " -> render_graph.dot\n";
+            imGuiContext.addLog(line.c_str());
+        }
+
+        // The systems draw with whatever compiled, the startup batch is reported once it's complete
+        if (!pipelinesLogged && m_PipelineBuilder.isIdle()) {
+            const PipelineCacheStats cacheStats = m_Device.pipelineCache().getStats();
+            const PipelineBuilderStats builderStats = m_PipelineBuilder.getStats();
+            const std::string line = std::format("[PipelineCache] {} pipelines in {:.2f} ms ({:.2f} ms on {} workers), {}",
+                cacheStats.pipelineCount, builderStats.wallMs, cacheStats.creationMs, m_JobSystem.getWorkerCount(),
+                cacheStats.warm ? std::format("warm ({} KiB loaded)", cacheStats.loadedBytes / 1024) : "cold");
+            std::cout << line << '\n';
+            imGuiContext.addLog(line.c_str());
+            if constexpr (ShaderCache::CAN_COMPILE) {
+                const ShaderCacheStats shaderStats = m_PipelineBuilder.getShaderCacheStats();
+                const std::string shaderLine = std::format("[ShaderCache] {} cached, {} compiled in {:.2f} ms",
+                    shaderStats.hits, shaderStats.compiled, shaderStats.compileMs);
+                std::cout << shaderLine << '\n';
+                imGuiContext.addLog(shaderLine.c_str());
+            }
+            pipelinesLogged = true;
+        }
+
+        // Pipelines compiled since the last save survive a crash
+        pipelineCacheTimer += frameTime;
+        if (pipelineCacheTimer >= Config::pipelineCacheSaveInterval) {
+            m_Device.pipelineCache().saveIfChanged();
+            pipelineCacheTimer = 0.f;
+        }
+
+        endFrame();
         m_IsRunning = imGuiContext.isRunning();
+
+        renderThread.submit();
+        frame++;
     }
 
+    renderThread.waitIdle();
     vkDeviceWaitIdle(m_Device.device());
 }
 
+void App::runHeadless(const uint32_t frameCount) {
+    CpuProfiler::setThreadName("Main");
+    // Fixed time step and camera, from the editor's default view
+    constexpr float frameTime = 1.f / 60.f;
+    Camera camera{};
+    camera.setViewYXZ({0.f, -0.5f, -3.f}, glm::vec3{0.f});
+    camera.setPerspectiveProjection(glm::radians(70.f), m_Renderer.getAspectRatio(), 0.1f, 100.f);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frameCount; i++) {
+        advanceFrame(frameTime, camera);
+    }
+    waitIdle();
+    const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("[Headless] {} frames in {:.2f} ms ({:.3f} ms per frame)", frameCount, elapsedMs,
+                             frameCount ? elapsedMs / frameCount : 0.0) << '\n';
+}
+
+void App::advanceFrame(const float frameTime, const Camera &camera) {
+    if (!isHeadless()) {
+        throw std::runtime_error("Failed to advance frame: the app has a window, use run()!");
+    }
+    FrameResources &frameResources = *m_Frame;
+    if (const std::optional<CpuTraceResult> trace = CpuProfiler::endFrame()) {
+        std::cout << std::format("[Profiler] {} CPU frames, {} zones ({} overwritten) -> {}", trace->frames,
+                                 trace->zones, trace->overwritten, trace->path.string()) << '\n';
+    }
+    CpuProfiler::Zone frameZone{"Frame"};
+
+    // The windowed scheduler's systems, in order on this thread
+    RenderPacket &packet = frameResources.packet;
+    PointLightSystem::update(m_SceneEntities, frameTime);
+    frameResources.renderSystem->snapshot(m_SceneEntities, packet);
+    packet.frame = frameResources.frame;
+    packet.frameTime = frameTime;
+    packet.ubo.projection = camera.getProjection();
+    packet.ubo.view = camera.getView();
+    packet.ubo.inverseView = camera.getInverseView();
+    packet.cameraPosition = camera.getPosition();
+    packet.clearColor = m_Renderer.clearColor;
+    PointLightSystem::snapshot(m_SceneEntities, packet);
+    // The draws of the permutations still compiling are left out, the frame would depend on the timing
+    if (!m_PipelineBuilder.isIdle()) {
+        m_PipelineBuilder.waitIdle();
+        frameResources.renderSystem->snapshot(m_SceneEntities, packet);
+    }
+
+    const auto commandBuffer = m_Renderer.beginFrame();
+    const int frameIndex = m_Renderer.getFrameIndex();
+    const FrameInfo frameInfo{
+        frameIndex, frameTime, commandBuffer, frameResources.globalDescriptorSets[frameIndex], packet,
+        m_Renderer.getExtent()
+    };
+    beginSceneGraph(frameInfo);
+    m_Renderer.executeGraph(commandBuffer);
+    m_Renderer.endFrame();
+    m_Device.residency().frameSubmitted(packet.residencyFrame, m_Renderer.getFramePacer().submittedValue());
+
+    endFrame();
+    frameResources.frame++;
+
+    // Frame stats were closed by endFrame()
+    const FrameArenaStats arenaStats = FrameArena::getFrameStats();
+    m_FrameStats.draws = static_cast<uint32_t>(packet.draws.size());
+    m_FrameStats.lights = static_cast<uint32_t>(packet.lights.size());
+    m_FrameStats.arenaAllocations = arenaStats.allocations;
+    m_FrameStats.heapAllocations = arenaStats.heapAllocations;
+    m_FrameStats.deviceAllocations = m_Device.allocator().getStats().allocationCount;
+    m_FrameStats.bytesWritten = Buffer::getFrameStats().bytesWritten;
+    m_FrameStats.trackedAllocations = AllocationTracker::getFrameStats().count;
+    m_FrameStats.trackedBytes = AllocationTracker::getFrameStats().bytes;
+    m_FrameStats.commands = CommandRecorder::getFrameStats();
+    m_FrameStats.gpuMs.reset();
+    if (const GpuProfiler *gpuProfiler = m_Renderer.getGpuProfiler();
+        gpuProfiler && !gpuProfiler->getHistory().empty() &&
+        gpuProfiler->getHistory().back().frame != frameResources.lastGpuFrame) {
+        frameResources.lastGpuFrame = gpuProfiler->getHistory().back().frame;
+        m_FrameStats.gpuMs = gpuProfiler->getHistory().back().milliseconds;
+    }
+}
+
 void App::loadGameObjects() {
+    std::array<Model::Builder, MODEL_PATHS.size()> modelBuilders = parseModels(m_JobSystem);
+
     std::shared_ptr<Model> loadedModel;
 
     // Obamium
-    auto obamiumTexture = Texture::createTextureFromFile(m_Device, *m_Renderer.getSwapChain(),
+    auto obamiumTexture = Texture::createTextureFromFile(m_Device,
         "assets/textures/obamium_texture.png", m_MaterialSetLayout->getDescriptorSetLayout(),
         m_DescriptorPool->getDescriptorPool()
     );
-    loadedModel = Model::createModelFromFile(m_Device, "assets/models/obamium_model.obj");
+    loadedModel = std::make_unique<Model>(m_Device, modelBuilders[0]);
 
     auto centralObamium = Entity::createEntity();
     centralObamium.name = "Obamium";
     centralObamium.model = loadedModel;
     centralObamium.texture = std::move(obamiumTexture);
-    centralObamium.material = centralObamium.texture->getMaterial();
     centralObamium.transform.translation = {0.0f, 0.0f, 0.0f};
     centralObamium.transform.scale = {1.f, 1.f, 1.f};
-    centralObamium.transform.rotation = {0.f, 0.f, glm::pi<float>()};
+    centralObamium.transform.rotation = MODEL_ROTATIONS[0];
     m_SceneEntities.emplace(centralObamium.getId(), std::move(centralObamium));
 
     // Viking room
-    auto vikingRoomTexture = Texture::createTextureFromFile(m_Device, *m_Renderer.getSwapChain(),
+    auto vikingRoomTexture = Texture::createTextureFromFile(m_Device,
         "assets/textures/viking_room.png", m_MaterialSetLayout->getDescriptorSetLayout(),
         m_DescriptorPool->getDescriptorPool()
     );
-    loadedModel = Model::createModelFromFile(m_Device, "assets/models/viking_room.obj");
+    loadedModel = std::make_unique<Model>(m_Device, modelBuilders[1]);
 
     auto vikingRoom = Entity::createEntity();
     vikingRoom.name = "Viking Room";
     vikingRoom.model = loadedModel;
     vikingRoom.texture = std::move(vikingRoomTexture);
-    vikingRoom.material = vikingRoom.texture->getMaterial();
     vikingRoom.transform.translation = {2.f, 0.f, 2.f};
     vikingRoom.transform.scale = {1.f, 1.f, 1.f};
-    vikingRoom.transform.rotation = {glm::pi<float>() / 2.f, 0.f, glm::pi<float>()};
+    vikingRoom.transform.rotation = MODEL_ROTATIONS[1];
     m_SceneEntities.emplace(vikingRoom.getId(), std::move(vikingRoom));
 
     // Floor
-    loadedModel = Model::createModelFromFile(m_Device, "assets/models/base.obj");
+    loadedModel = std::make_unique<Model>(m_Device, modelBuilders[2]);
     auto floor = Entity::createEntity();
     floor.name = "Base";
     floor.model = loadedModel;
     floor.color = {0.596f, 0.765f, 1.0f};
     floor.texture = nullptr;
-    floor.material = {};
     floor.transform.translation = {0.f, 0.5f, 0.f};
     floor.transform.scale = {1.f, 1.f, 1.f};
     m_SceneEntities.emplace(floor.getId(), std::move(floor));
@@ -210,4 +638,43 @@ void App::loadGameObjects() {
     }
 }
 
+void App::loadProceduralScene(const ProceduralScene &scene) {
+    std::array<Model::Builder, MODEL_PATHS.size()> modelBuilders = parseModels(m_JobSystem);
+    std::array<std::shared_ptr<Model>, MODEL_PATHS.size()> models;
+    for (size_t i = 0; i < models.size(); i++) {
+        models[i] = std::make_shared<Model>(m_Device, modelBuilders[i]);
+    }
+
+    // Textures are owned by their entity, the instances are tinted instead of loading one each
+    std::mt19937 random{scene.seed};
+    std::uniform_real_distribution unit{0.f, 1.f};
+    std::uniform_int_distribution<size_t> modelIndex{0, models.size() - 1};
+    const float radius = scene.getRadius();
+    for (uint32_t i = 0; i < scene.instances; i++) {
+        const size_t model = modelIndex(random);
+        const float distance = radius * std::sqrt(unit(random));
+        const float angle = glm::two_pi<float>() * unit(random);
+
+        auto instance = Entity::createEntity();
+        instance.name = "Instance " + std::to_string(i + 1);
+        instance.model = models[model];
+        instance.color = {unit(random), unit(random), unit(random)};
+        instance.transform.translation = {distance * std::cos(angle), 0.f, distance * std::sin(angle)};
+        instance.transform.scale = glm::vec3{0.5f + unit(random)};
+        instance.transform.rotation = MODEL_ROTATIONS[model] + glm::vec3{0.f, glm::two_pi<float>() * unit(random), 0.f};
+        m_SceneEntities.emplace(instance.getId(), std::move(instance));
+    }
+
+    const uint32_t lightCount = std::min<uint32_t>(scene.lights, MAX_LIGHTS);
+    for (uint32_t i = 0; i < lightCount; i++) {
+        auto pointLight = Entity::makePointLight(0.2f + unit(random));
+        pointLight.color = {unit(random), unit(random), unit(random)};
+        pointLight.name = "Point Light " + std::to_string(i + 1);
+        const float distance = radius * std::sqrt(unit(random));
+        const float angle = glm::two_pi<float>() * unit(random);
+        pointLight.transform.translation = {distance * std::cos(angle), -1.f - unit(random), distance * std::sin(angle)};
+        m_SceneEntities.emplace(pointLight.getId(), std::move(pointLight));
+    }
+}
+
 } // Namespace KaguEngine
\ No newline at end of file
@@ -1,5 +1,8 @@
 module;
 
+// config
+#include "include/config.hpp"
+
 // libs
 #include <vulkan/vulkan.h>
 
@@ -8,67 +11,114 @@ export module App;
 // std - exported for convenience in main.cpp
 export import std;
 
+import KaguEngine.Camera;
+import KaguEngine.CommandRecorder;
+import KaguEngine.Defragmenter;
 import KaguEngine.Descriptor;
 import KaguEngine.Device;
 import KaguEngine.Entity;
+import KaguEngine.FrameCapture;
+import KaguEngine.FrameInfo;
+import KaguEngine.JobSystem;
+import KaguEngine.PipelineBuilder;
 import KaguEngine.Renderer;
+import KaguEngine.RenderGraph;
 import KaguEngine.Window;
 
 export namespace KaguEngine {
 
+// Generated in place of the default scene, for the benchmarks
+struct ProceduralScene {
+    uint32_t instances = 100; // Of the bundled models, picked at random
+    uint32_t lights = MAX_LIGHTS; // Clamped to MAX_LIGHTS
+    uint32_t seed = 0; // Same seed, same scene
+
+    // Of the disc the instances are spread on, about one instance per 4 square units
+    [[nodiscard]] float getRadius() const {
+        return 2.f * std::sqrt(static_cast<float>(instances) / std::numbers::pi_v<float>);
+    }
+};
+
+// Headless, measured by the last advanceFrame()
+struct HeadlessFrameStats {
+    uint32_t draws = 0;
+    uint32_t lights = 0;
+    uint64_t arenaAllocations = 0;
+    uint64_t heapAllocations = 0; // Frame arenas full, see FrameArenaStats
+    uint32_t deviceAllocations = 0; // Live in the memory allocator
+    uint64_t bytesWritten = 0; // To mapped buffers
+    uint64_t trackedAllocations = 0; // Of the heap and the driver, 0 without KAGU_TRACK_ALLOCATIONS
+    uint64_t trackedBytes = 0;
+    CommandStats commands{}; // Recorded for this frame, what the recorders elided isn't in it
+    std::optional<double> gpuMs; // Of an earlier frame, the one collected while this one began
+};
+
 class App {
 public:
     static constexpr int WIDTH = 1600;
     static constexpr int HEIGHT = 900;
 
-    App() {
-        m_GlobalSetLayout = DescriptorSetLayout::Builder(m_Device)
-            .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .build();
-        m_MaterialSetLayout = DescriptorSetLayout::Builder(m_Device)
-            .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .build();
-        m_DescriptorPool = DescriptorPool::Builder(m_Device)
-            .setMaxSets(1000) // Arbitrary value
-            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_SAMPLER, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000)
-            .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
-            .build();
-        loadGameObjects();
-    };
-    ~App() {
-        std::erase_if(m_SceneEntities, [](const auto&) { return true; });
-    }
+    App() : App{std::make_unique<Window>(WIDTH, HEIGHT, "Kagu Engine"), {}} {}
+    // Headless: no window, swap chain or ImGui, the frames end in the offscreen scene image.
+    // They only advance through advanceFrame(), a software driver such as lavapipe is enough.
+    explicit App(const VkExtent2D extent) : App{nullptr, extent} {}
+    // Headless, drawing scene instead of the default one
+    App(const VkExtent2D extent, const ProceduralScene &scene) : App{nullptr, extent, scene} {}
+    ~App();
 
     App(const App &) = delete;
     App &operator=(const App &) = delete;
 
+    // Windowed, until the window is closed
     void run();
+    // Headless, frameCount frames with a fixed time step and camera
+    void runHeadless(uint32_t frameCount);
+    // Headless: simulates one frame seen from camera and submits it. Waits for the pipelines it needs,
+    // so the same calls render the same frames.
+    void advanceFrame(float frameTime, const Camera &camera);
+    // Waits for the frames submitted so far
+    void waitIdle() const;
+    // Writes every Config::captureInterval-th frame to directory, before the first frame
+    void enableCapture(const std::filesystem::path &directory, const CaptureFormat format) {
+        m_Renderer.enableCapture(directory, Config::captureInterval, format);
+    }
+
+    [[nodiscard]] bool isHeadless() const { return m_Window == nullptr; }
+    [[nodiscard]] const HeadlessFrameStats &getFrameStats() const { return m_FrameStats; }
+    [[nodiscard]] float getAspectRatio() const { return m_Renderer.getAspectRatio(); }
 
 private:
+    // Everything the frames draw with, shared by the windowed and the headless loops
+    struct FrameResources;
+
+    // Defined with FrameResources, which is incomplete here
+    App(std::unique_ptr<Window> window, VkExtent2D extent, const std::optional<ProceduralScene> &scene = {});
+
     void loadGameObjects();
+    void loadProceduralScene(const ProceduralScene &scene);
+    void createFrameResources();
+    // Writes the frame's globals and adds the scene pass, the graph executes before frameInfo goes out of scope
+    RenderGraph &beginSceneGraph(const FrameInfo &frameInfo);
+    // Between two frames, nothing may be recording
+    void endFrame();
     bool m_IsRunning = true;
 
-    Window m_Window{WIDTH, HEIGHT, "Kagu Engine"};
-    Device m_Device{m_Window};
-    Renderer m_Renderer{m_Window, m_Device};
+    JobSystem m_JobSystem{Config::jobWorkerCount}; // First, the main thread becomes its worker 0
+    std::unique_ptr<Window> m_Window; // Null when headless
+    Device m_Device;
+    Renderer m_Renderer;
+    PipelineBuilder m_PipelineBuilder{m_Device, m_JobSystem};
 
     // note: order of declarations matters
     //  - class destroyed from bottom to top
-    //  - entities -> pool -> material set -> global set
+    //  - frame resources -> defragmenter -> entities -> pool -> material set -> global set
     std::unique_ptr<DescriptorSetLayout> m_GlobalSetLayout{};
     std::unique_ptr<DescriptorSetLayout> m_MaterialSetLayout{};
     std::unique_ptr<DescriptorPool> m_DescriptorPool{};
     Entity::Map m_SceneEntities;
+    Defragmenter m_Defragmenter{m_Device};
+    std::unique_ptr<FrameResources> m_Frame;
+    HeadlessFrameStats m_FrameStats{};
 };
 
 } // Namespace KaguEngine
\ No newline at end of file
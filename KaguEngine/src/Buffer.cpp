@@ -11,10 +11,49 @@ module KaguEngine.Buffer;
 // std
 import std.compat; // For memcpy()
 
+import KaguEngine.AllocationTracker;
 import KaguEngine.Device;
+import KaguEngine.Memory;
 
 namespace KaguEngine {
 
+namespace { // Anonymous namespace for frame counters
+std::atomic<VkDeviceSize> bytesWritten{0};
+std::atomic<VkDeviceSize> bytesFlushed{0};
+std::atomic<uint32_t> flushCalls{0};
+BufferTransferStats lastFrameStats{};
+}
+
+BufferTransferStats Buffer::getFrameStats() { return lastFrameStats; }
+
+void Buffer::endFrameStats() {
+    lastFrameStats.bytesWritten = bytesWritten.exchange(0);
+    lastFrameStats.bytesFlushed = bytesFlushed.exchange(0);
+    lastFrameStats.flushCalls = flushCalls.exchange(0);
+}
+
+void Buffer::coalesceRanges(std::vector<std::pair<VkDeviceSize, VkDeviceSize>> &ranges, const VkDeviceSize atomSize,
+                            const VkDeviceSize limit) {
+    for (auto &[begin, end]: ranges) {
+        begin = begin / atomSize * atomSize;
+        end = std::min((end + atomSize - 1) / atomSize * atomSize, limit);
+    }
+    std::ranges::sort(ranges);
+
+    // Overlapping and touching ranges are merged in place
+    size_t merged = 0;
+    for (size_t i = 1; i < ranges.size(); i++) {
+        if (ranges[i].first <= ranges[merged].second) {
+            ranges[merged].second = std::max(ranges[merged].second, ranges[i].second);
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    if (!ranges.empty()) {
+        ranges.resize(merged + 1);
+    }
+}
+
 VkDeviceSize Buffer::getAlignment(const VkDeviceSize instanceSize, const VkDeviceSize minOffsetAlignment) {
     if (minOffsetAlignment > 0) {
         return (instanceSize + minOffsetAlignment - 1) & ~(minOffsetAlignment - 1);
@@ -32,55 +71,141 @@ Buffer::Buffer(Device &device,
 {
     m_AlignmentSize = getAlignment(instanceSize, minOffsetAlignment);
     m_BufferSize = m_AlignmentSize * instanceCount;
-    device.createBuffer(m_BufferSize, usageFlags, memoryPropertyFlags, m_Buffer, m_Memory);
+
+    if (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        device.createBuffer(m_BufferSize, usageFlags, memoryPropertyFlags, m_Buffer, m_Allocation);
+        m_IsCoherent = device.allocator().isHostCoherent(m_Allocation.memoryTypeIndex);
+    } else {
+        // Relocating a buffer copies it, so it has to be usable on both ends of a transfer
+        m_UsageFlags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        device.createBuffer(m_BufferSize, m_UsageFlags, memoryPropertyFlags, m_Buffer, m_Allocation, this);
+    }
 }
 
 Buffer::~Buffer() {
     unmap();
-    vkDestroyBuffer(deviceRef.device(), m_Buffer, nullptr);
-    vkFreeMemory(deviceRef.device(), m_Memory, nullptr);
+    // The Defragmenter's copy still uses both buffers, they go once its batch completed
+    if (m_RelocatedBuffer != VK_NULL_HANDLE) {
+        deviceRef.allocator().cancelMove(m_Allocation, [device = deviceRef.device(), source = m_Buffer,
+                                                        destination = m_RelocatedBuffer] {
+            vkDestroyBuffer(device, source, AllocationTracker::callbacks());
+            vkDestroyBuffer(device, destination, AllocationTracker::callbacks());
+        });
+        return;
+    }
+    vkDestroyBuffer(deviceRef.device(), m_Buffer, AllocationTracker::callbacks());
+    deviceRef.allocator().free(m_Allocation);
 }
 
 VkResult Buffer::map(const VkDeviceSize size, const VkDeviceSize offset) {
-    assert(m_Buffer && m_Memory && "Called map on buffer before create");
-    return vkMapMemory(deviceRef.device(), m_Memory, offset, size, 0, &m_IsMapped);
+    assert(m_Buffer && m_Allocation.isValid() && "Called map on buffer before create");
+    // Host visible blocks are persistently mapped by the allocator
+    if (m_Allocation.mapped == nullptr) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    m_IsMapped = static_cast<char *>(m_Allocation.mapped) + offset;
+    m_MappedOffset = offset;
+    return VK_SUCCESS;
 }
 
 void Buffer::unmap() {
-    if (m_IsMapped) {
-        vkUnmapMemory(deviceRef.device(), m_Memory);
-        m_IsMapped = nullptr;
-    }
+    m_IsMapped = nullptr;
+    m_MappedOffset = 0;
 }
 
-void Buffer::writeToBuffer(const void *data, const VkDeviceSize size, const VkDeviceSize offset) const {
+void Buffer::writeToBuffer(const void *data, const VkDeviceSize size, const VkDeviceSize offset) {
     assert(m_IsMapped && "Cannot copy to unmapped buffer");
+    writeMapped({static_cast<std::byte *>(m_IsMapped), m_BufferSize - m_MappedOffset}, m_MappedOffset, data, size,
+                offset, m_IsCoherent, m_DirtyRanges);
+}
 
+void Buffer::writeMapped(const std::span<std::byte> mapped, const VkDeviceSize mappedOffset, const void *data,
+                         const VkDeviceSize size, const VkDeviceSize offset, const bool coherent,
+                         std::vector<std::pair<VkDeviceSize, VkDeviceSize>> &dirtyRanges) {
+    VkDeviceSize begin = mappedOffset;
+    VkDeviceSize end = mappedOffset + mapped.size();
     if (size == VK_WHOLE_SIZE) {
-        memcpy(m_IsMapped, data, m_BufferSize);
+        memcpy(mapped.data(), data, mapped.size());
     } else {
-        auto memOffset = static_cast<char *>(m_IsMapped);
-        memOffset += offset;
-        memcpy(memOffset, data, size);
+        memcpy(mapped.data() + offset, data, size);
+        begin += offset;
+        end = begin + size;
+    }
+
+    bytesWritten.fetch_add(end - begin, std::memory_order_relaxed);
+    if (!coherent) {
+        dirtyRanges.emplace_back(begin, end);
+    }
+}
+
+VkResult Buffer::flushDirty() {
+    if (m_DirtyRanges.empty()) {
+        return VK_SUCCESS;
+    }
+
+    // Ranges are aligned on the whole memory block, the allocation itself starts on an atom boundary
+    for (auto &[begin, end]: m_DirtyRanges) {
+        begin += m_Allocation.offset;
+        end += m_Allocation.offset;
     }
+    coalesceRanges(m_DirtyRanges, deviceRef.allocator().getNonCoherentAtomSize(),
+                   m_Allocation.offset + m_Allocation.size);
+
+    m_FlushRanges.clear();
+    VkDeviceSize flushedBytes = 0;
+    for (const auto &[begin, end]: m_DirtyRanges) {
+        VkMappedMemoryRange range = {};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = m_Allocation.memory;
+        range.offset = begin;
+        range.size = end - begin;
+        m_FlushRanges.push_back(range);
+        flushedBytes += range.size;
+    }
+    m_DirtyRanges.clear();
+
+    bytesFlushed.fetch_add(flushedBytes, std::memory_order_relaxed);
+    flushCalls.fetch_add(1, std::memory_order_relaxed);
+    return vkFlushMappedMemoryRanges(deviceRef.device(), static_cast<uint32_t>(m_FlushRanges.size()),
+                                     m_FlushRanges.data());
+}
+
+VkMappedMemoryRange Buffer::mappedRange(const VkDeviceSize size, const VkDeviceSize offset) const {
+    // The buffer only owns part of the memory block, so whole size means up to the end of the allocation
+    const VkDeviceSize atomSize = deviceRef.allocator().getNonCoherentAtomSize();
+    const VkDeviceSize begin = (m_Allocation.offset + offset) / atomSize * atomSize;
+    const VkDeviceSize allocationEnd = m_Allocation.offset + m_Allocation.size;
+    const VkDeviceSize end = size == VK_WHOLE_SIZE
+                                 ? allocationEnd
+                                 : std::min((m_Allocation.offset + offset + size + atomSize - 1) / atomSize * atomSize,
+                                            allocationEnd);
+
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = m_Allocation.memory;
+    range.offset = begin;
+    range.size = end - begin;
+    return range;
 }
 
 VkResult Buffer::flush(const VkDeviceSize size, const VkDeviceSize offset) const {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = m_Memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkFlushMappedMemoryRanges(deviceRef.device(), 1, &mappedRange);
+    if (m_IsCoherent) {
+        return VK_SUCCESS;
+    }
+
+    const VkMappedMemoryRange range = mappedRange(size, offset);
+    bytesFlushed.fetch_add(range.size, std::memory_order_relaxed);
+    flushCalls.fetch_add(1, std::memory_order_relaxed);
+    return vkFlushMappedMemoryRanges(deviceRef.device(), 1, &range);
 }
 
 VkResult Buffer::invalidate(const VkDeviceSize size, const VkDeviceSize offset) const {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = m_Memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkInvalidateMappedMemoryRanges(deviceRef.device(), 1, &mappedRange);
+    if (m_IsCoherent) {
+        return VK_SUCCESS;
+    }
+
+    const VkMappedMemoryRange range = mappedRange(size, offset);
+    return vkInvalidateMappedMemoryRanges(deviceRef.device(), 1, &range);
 }
 
 VkDescriptorBufferInfo Buffer::descriptorInfo(const VkDeviceSize size, const VkDeviceSize offset) const {
@@ -91,7 +216,7 @@ VkDescriptorBufferInfo Buffer::descriptorInfo(const VkDeviceSize size, const VkD
     };
 }
 
-void Buffer::writeToIndex(const void *data, const int index) const {
+void Buffer::writeToIndex(const void *data, const int index) {
     writeToBuffer(data, m_InstanceSize, index * m_AlignmentSize);
 }
 
@@ -107,4 +232,33 @@ VkResult Buffer::invalidateIndex(const int index) const {
     return invalidate(m_AlignmentSize, index * m_AlignmentSize);
 }
 
+void Buffer::recordRelocation(const VkCommandBuffer commandBuffer, const Allocation &destination) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_BufferSize;
+    bufferInfo.usage = m_UsageFlags;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(deviceRef.device(), &bufferInfo,
+                       AllocationTracker::callbacks(), &m_RelocatedBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create relocated buffer!");
+    }
+    vkBindBufferMemory(deviceRef.device(), m_RelocatedBuffer, destination.memory, destination.offset);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = m_BufferSize;
+    vkCmdCopyBuffer(commandBuffer, m_Buffer, m_RelocatedBuffer, 1, &copyRegion);
+}
+
+std::function<void()> Buffer::commitRelocation(const Allocation &destination) {
+    const VkBuffer oldBuffer = m_Buffer;
+    m_Buffer = m_RelocatedBuffer;
+    m_RelocatedBuffer = VK_NULL_HANDLE;
+    m_Allocation = destination;
+
+    return [device = deviceRef.device(), oldBuffer] {
+        vkDestroyBuffer(device, oldBuffer, AllocationTracker::callbacks());
+    };
+}
+
 } // Namespace KaguEngine
\ No newline at end of file
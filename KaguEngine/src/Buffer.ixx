@@ -5,15 +5,27 @@ module;
 
 export module KaguEngine.Buffer;
 
+// std
+import std;
+
 import KaguEngine.Device;
+import KaguEngine.Memory;
 
 export namespace KaguEngine {
 
-class Buffer {
+// Host to device traffic of every mapped Buffer, for a single frame
+struct BufferTransferStats {
+    VkDeviceSize bytesWritten = 0;
+    VkDeviceSize bytesFlushed = 0;
+    uint32_t flushCalls = 0;
+};
+
+// Device local buffers can be moved around by the Defragmenter, host visible ones stay where they are
+class Buffer final : public Relocatable {
 public:
     Buffer(Device& device, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usageFlags,
            VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize minOffsetAlignment = 1);
-    ~Buffer();
+    ~Buffer() override;
 
     // Non copyable
     Buffer(const Buffer&) = delete;
@@ -22,12 +34,14 @@ public:
     VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
     void unmap();
 
-    void writeToBuffer(const void *data, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
+    // Writes are recorded as dirty ranges, flushDirty() then makes all of them visible in a single call
+    void writeToBuffer(const void *data, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+    [[nodiscard]] VkResult flushDirty();
     [[nodiscard]] VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
     [[nodiscard]] VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
     [[nodiscard]] VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
 
-    void writeToIndex(const void *data, int index) const;
+    void writeToIndex(const void *data, int index);
     [[nodiscard]] VkResult flushIndex(int index) const;
     [[nodiscard]] VkDescriptorBufferInfo descriptorInfoForIndex(int index) const;
     [[nodiscard]] VkResult invalidateIndex(int index) const;
@@ -40,14 +54,39 @@ public:
     [[nodiscard]] VkBufferUsageFlags getUsageFlags()             const { return m_UsageFlags; }
     [[nodiscard]] VkMemoryPropertyFlags getMemoryPropertyFlags() const { return m_MemoryPropertyFlags; }
     [[nodiscard]] VkDeviceSize getBufferSize()                   const { return m_BufferSize; }
+    [[nodiscard]] const Allocation& getAllocation()              const { return m_Allocation; }
+    [[nodiscard]] bool isRelocating()                            const { return m_RelocatedBuffer != VK_NULL_HANDLE; }
+    [[nodiscard]] bool isCoherent()                              const { return m_IsCoherent; }
+
+    // Stats of the last completed frame, endFrameStats() starts a new one
+    [[nodiscard]] static BufferTransferStats getFrameStats();
+    static void endFrameStats();
+
+    // Host side of writeToBuffer(), no device involved. mapped starts at mappedOffset in the buffer and runs to its
+    // end, the dirty range is recorded unless the memory is coherent.
+    static void writeMapped(std::span<std::byte> mapped, VkDeviceSize mappedOffset, const void *data,
+                            VkDeviceSize size, VkDeviceSize offset, bool coherent,
+                            std::vector<std::pair<VkDeviceSize, VkDeviceSize>> &dirtyRanges);
+    // Aligns [begin, end) ranges to atomSize, clamps them to limit, then sorts and merges them
+    static void coalesceRanges(std::vector<std::pair<VkDeviceSize, VkDeviceSize>> &ranges, VkDeviceSize atomSize,
+                               VkDeviceSize limit);
+
+    void recordRelocation(VkCommandBuffer commandBuffer, const Allocation &destination) override;
+    std::function<void()> commitRelocation(const Allocation &destination) override;
 
 private:
     static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
+    [[nodiscard]] VkMappedMemoryRange mappedRange(VkDeviceSize size, VkDeviceSize offset) const;
 
     Device& deviceRef;
     void* m_IsMapped = nullptr;
+    VkDeviceSize m_MappedOffset = 0;
+    bool m_IsCoherent = false;
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> m_DirtyRanges; // [begin, end) from the buffer start
+    std::vector<VkMappedMemoryRange> m_FlushRanges; // Reused between flushes
     VkBuffer m_Buffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_Memory = VK_NULL_HANDLE;
+    Allocation m_Allocation{};
+    VkBuffer m_RelocatedBuffer = VK_NULL_HANDLE;
 
     VkDeviceSize m_BufferSize;
     uint32_t m_InstanceCount;
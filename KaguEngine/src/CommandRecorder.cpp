@@ -0,0 +1,139 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.CommandRecorder;
+
+// std
+import std.compat; // For memcmp()
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for frame counters
+// Recorders end on every recording thread
+std::mutex frameStatsMutex;
+CommandStats frameStats{};
+CommandStats lastFrameStats{};
+}
+
+CommandStats &CommandStats::operator+=(const CommandStats &other) {
+    draws += other.draws;
+    triangles += other.triangles;
+    pipelineBinds += other.pipelineBinds;
+    descriptorSetBinds += other.descriptorSetBinds;
+    bufferBinds += other.bufferBinds;
+    pushConstantCalls += other.pushConstantCalls;
+    pushConstantBytes += other.pushConstantBytes;
+    elided += other.elided;
+    return *this;
+}
+
+CommandRecorder::~CommandRecorder() {
+    std::scoped_lock lock{frameStatsMutex};
+    frameStats += m_Stats;
+}
+
+CommandStats CommandRecorder::getFrameStats() {
+    std::scoped_lock lock{frameStatsMutex};
+    return lastFrameStats;
+}
+
+void CommandRecorder::endFrameStats() {
+    std::scoped_lock lock{frameStatsMutex};
+    lastFrameStats = std::exchange(frameStats, {});
+}
+
+void CommandRecorder::bindPipeline(const VkPipeline pipeline) {
+    if (pipeline == m_Pipeline) {
+        m_Stats.elided++;
+        return;
+    }
+    vkCmdBindPipeline(m_CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    m_Pipeline = pipeline;
+    m_Stats.pipelineBinds++;
+    // Only kept by a compatible layout, pushed again rather than checked
+    m_PushConstants.size = 0;
+}
+
+void CommandRecorder::bindDescriptorSet(const VkPipelineLayout layout, const uint32_t set,
+                                        const VkDescriptorSet descriptorSet) {
+    if (set < MAX_DESCRIPTOR_SETS && m_Sets[set].layout == layout && m_Sets[set].set == descriptorSet) {
+        m_Stats.elided++;
+        return;
+    }
+    vkCmdBindDescriptorSets(m_CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set, 1, &descriptorSet, 0,
+                            nullptr);
+    m_Stats.descriptorSetBinds++;
+    if (set >= MAX_DESCRIPTOR_SETS) {
+        return;
+    }
+    // Another layout can disturb the other sets, they're forgotten unless bound with the same one
+    for (BoundSet &bound: m_Sets) {
+        if (bound.layout != layout) {
+            bound = {};
+        }
+    }
+    m_Sets[set] = {layout, descriptorSet};
+}
+
+void CommandRecorder::bindVertexBuffer(const VkBuffer buffer, const VkDeviceSize offset) {
+    if (buffer == m_VertexBuffer && offset == m_VertexOffset) {
+        m_Stats.elided++;
+        return;
+    }
+    vkCmdBindVertexBuffers(m_CommandBuffer, 0, 1, &buffer, &offset);
+    m_VertexBuffer = buffer;
+    m_VertexOffset = offset;
+    m_Stats.bufferBinds++;
+}
+
+void CommandRecorder::bindIndexBuffer(const VkBuffer buffer, const VkDeviceSize offset, const VkIndexType indexType) {
+    if (buffer == m_IndexBuffer && offset == m_IndexOffset && indexType == m_IndexType) {
+        m_Stats.elided++;
+        return;
+    }
+    vkCmdBindIndexBuffer(m_CommandBuffer, buffer, offset, indexType);
+    m_IndexBuffer = buffer;
+    m_IndexOffset = offset;
+    m_IndexType = indexType;
+    m_Stats.bufferBinds++;
+}
+
+void CommandRecorder::pushConstants(const VkPipelineLayout layout, const VkShaderStageFlags stages,
+                                    const uint32_t offset, const uint32_t size, const void *data) {
+    PushedConstants &pushed = m_PushConstants;
+    if (pushed.size == size && pushed.layout == layout && pushed.stages == stages && pushed.offset == offset &&
+        std::memcmp(pushed.data.data(), data, size) == 0) {
+        m_Stats.elided++;
+        return;
+    }
+    vkCmdPushConstants(m_CommandBuffer, layout, stages, offset, size, data);
+    m_Stats.pushConstantCalls++;
+    m_Stats.pushConstantBytes += size;
+
+    // A single range is cached, the last one pushed
+    if (size <= MAX_PUSH_CONSTANT_SIZE) {
+        pushed.layout = layout;
+        pushed.stages = stages;
+        pushed.offset = offset;
+        pushed.size = size;
+        std::memcpy(pushed.data.data(), data, size);
+    } else {
+        pushed.size = 0;
+    }
+}
+
+void CommandRecorder::draw(const uint32_t vertexCount, const uint32_t instanceCount) {
+    vkCmdDraw(m_CommandBuffer, vertexCount, instanceCount, 0, 0);
+    m_Stats.draws++;
+    m_Stats.triangles += static_cast<uint64_t>(vertexCount / 3) * instanceCount;
+}
+
+void CommandRecorder::drawIndexed(const uint32_t indexCount, const uint32_t instanceCount) {
+    vkCmdDrawIndexed(m_CommandBuffer, indexCount, instanceCount, 0, 0, 0);
+    m_Stats.draws++;
+    m_Stats.triangles += static_cast<uint64_t>(indexCount / 3) * instanceCount;
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,83 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.CommandRecorder;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+// Commands reaching the command buffers, the elided ones aren't in the other counts
+struct CommandStats {
+    uint32_t draws = 0;
+    uint64_t triangles = 0; // Triangle lists only, the topology of every pipeline
+    uint32_t pipelineBinds = 0;
+    uint32_t descriptorSetBinds = 0;
+    uint32_t bufferBinds = 0; // Vertex and index
+    uint32_t pushConstantCalls = 0;
+    uint64_t pushConstantBytes = 0;
+    uint32_t elided = 0; // Binds and pushes skipped, the state was already there
+
+    CommandStats &operator+=(const CommandStats &other);
+};
+
+// Records graphics commands into a command buffer it doesn't own, skipping the binds and pushes that wouldn't
+// change anything. Only knows what went through it: one per command buffer, from its beginning, so a secondary
+// starts with nothing bound. Its counts go to the frame's when it's destroyed.
+class CommandRecorder {
+public:
+    static constexpr uint32_t MAX_DESCRIPTOR_SETS = 4; // Sets past it are always bound
+    static constexpr uint32_t MAX_PUSH_CONSTANT_SIZE = 128; // The guaranteed minimum, larger pushes aren't cached
+
+    explicit CommandRecorder(VkCommandBuffer commandBuffer) : m_CommandBuffer{commandBuffer} {}
+    ~CommandRecorder();
+
+    CommandRecorder(const CommandRecorder &) = delete;
+    CommandRecorder &operator=(const CommandRecorder &) = delete;
+
+    [[nodiscard]] VkCommandBuffer getCommandBuffer() const { return m_CommandBuffer; }
+    [[nodiscard]] const CommandStats &getStats() const { return m_Stats; }
+
+    void bindPipeline(VkPipeline pipeline);
+    void bindDescriptorSet(VkPipelineLayout layout, uint32_t set, VkDescriptorSet descriptorSet);
+    void bindVertexBuffer(VkBuffer buffer, VkDeviceSize offset = 0);
+    void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+    void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size,
+                       const void *data);
+    void draw(uint32_t vertexCount, uint32_t instanceCount = 1);
+    void drawIndexed(uint32_t indexCount, uint32_t instanceCount = 1);
+
+    // Stats of the last completed frame, endFrameStats() starts a new one
+    [[nodiscard]] static CommandStats getFrameStats();
+    static void endFrameStats();
+
+private:
+    struct BoundSet {
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+    };
+    struct PushedConstants {
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkShaderStageFlags stages = 0;
+        uint32_t offset = 0;
+        uint32_t size = 0; // 0 when nothing is cached
+        std::array<std::byte, MAX_PUSH_CONSTANT_SIZE> data{};
+    };
+
+    VkCommandBuffer m_CommandBuffer;
+    CommandStats m_Stats{};
+
+    VkPipeline m_Pipeline = VK_NULL_HANDLE;
+    std::array<BoundSet, MAX_DESCRIPTOR_SETS> m_Sets{};
+    VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize m_VertexOffset = 0;
+    VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize m_IndexOffset = 0;
+    VkIndexType m_IndexType = VK_INDEX_TYPE_UINT32;
+    PushedConstants m_PushConstants{};
+};
+
+} // Namespace KaguEngine
@@ -0,0 +1,180 @@
+module KaguEngine.CpuProfiler;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the per-thread rings
+struct ZoneEvent {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Written by its thread only, read by the thread ending the capture
+struct ThreadRing {
+    std::string name;
+    std::unique_ptr<ZoneEvent[]> events;
+    std::atomic<uint64_t> head{0}; // Zones ever recorded
+    uint64_t captureStartHead = 0; // Under registryMutex
+};
+
+struct PendingCapture {
+    uint32_t frames;
+    std::filesystem::path path;
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadRing>> rings;
+thread_local ThreadRing *threadRing = nullptr; // Created by the first zone the thread records
+thread_local std::string threadName;           // Until the ring exists
+
+// Main thread only, but requested from anywhere
+std::mutex captureMutex;
+std::optional<PendingCapture> pendingCapture;
+std::optional<PendingCapture> runningCapture;
+std::atomic<uint32_t> remainingFrames{0};
+uint64_t captureStartTicks = 0;
+std::chrono::steady_clock::time_point captureStartTime;
+
+ThreadRing &getThreadRing() {
+    if (threadRing == nullptr) {
+        std::scoped_lock lock{registryMutex};
+        auto &ring = rings.emplace_back(std::make_unique<ThreadRing>());
+        ring->name = threadName.empty() ? std::format("Thread {}", rings.size()) : threadName;
+        ring->events = std::make_unique<ZoneEvent[]>(CpuProfiler::RING_SIZE);
+        threadRing = ring.get();
+    }
+    return *threadRing;
+}
+
+void appendEscaped(std::string &output, const std::string_view text) {
+    for (const char c: text) {
+        if (c == '"' || c == '\\') {
+            output += '\\';
+        }
+        output += c;
+    }
+}
+}
+
+std::atomic<bool> CpuProfiler::s_Capturing{false};
+
+void CpuProfiler::setThreadName(std::string name) {
+    if (threadRing == nullptr) {
+        threadName = std::move(name);
+        return;
+    }
+    std::scoped_lock lock{registryMutex};
+    threadRing->name = std::move(name);
+}
+
+void CpuProfiler::requestCapture(const uint32_t frameCount, std::filesystem::path path) {
+    std::scoped_lock lock{captureMutex};
+    if (!runningCapture && frameCount > 0) {
+        pendingCapture = PendingCapture{frameCount, std::move(path)};
+    }
+}
+
+uint32_t CpuProfiler::getRemainingFrames() {
+    return remainingFrames.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::record(const char *name, const uint64_t begin, const uint64_t end) {
+    ThreadRing &ring = getThreadRing();
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % RING_SIZE] = {name, begin, end};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+std::optional<CpuTraceResult> CpuProfiler::endFrame() {
+    std::unique_lock lock{captureMutex};
+    if (!runningCapture) {
+        if (pendingCapture) {
+            runningCapture = std::move(pendingCapture);
+            pendingCapture.reset();
+            remainingFrames.store(runningCapture->frames, std::memory_order_relaxed);
+            {
+                std::scoped_lock registryLock{registryMutex};
+                for (const auto &ring: rings) {
+                    ring->captureStartHead = ring->head.load(std::memory_order_acquire);
+                }
+            }
+            captureStartTime = std::chrono::steady_clock::now();
+            captureStartTicks = now();
+            s_Capturing.store(true, std::memory_order_relaxed);
+        }
+        return std::nullopt;
+    }
+    if (remainingFrames.fetch_sub(1, std::memory_order_relaxed) > 1) {
+        return std::nullopt;
+    }
+
+    // Zones still open keep recording, the ones ending after this are left out
+    s_Capturing.store(false, std::memory_order_relaxed);
+    const uint64_t captureEndTicks = now();
+    const auto captureEndTime = std::chrono::steady_clock::now();
+    const PendingCapture capture = std::move(*runningCapture);
+    runningCapture.reset();
+    lock.unlock();
+
+    const double elapsedUs = std::chrono::duration<double, std::micro>(captureEndTime - captureStartTime).count();
+    const double ticksPerUs = static_cast<double>(captureEndTicks - captureStartTicks) / std::max(elapsedUs, 1.0);
+
+    CpuTraceResult result{capture.path, capture.frames};
+    std::string json = "{\"traceEvents\":[\n";
+    {
+        std::scoped_lock registryLock{registryMutex};
+        for (size_t thread = 0; thread < rings.size(); thread++) {
+            const ThreadRing &ring = *rings[thread];
+            json += std::format("{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":{},\"args\":{{\"name\":\"",
+                                thread);
+            appendEscaped(json, ring.name);
+            json += "\"}},\n";
+
+            // Copied first, the entries the thread reused meanwhile are dropped after
+            const uint64_t head = ring.head.load(std::memory_order_acquire);
+            const uint64_t first = std::max(ring.captureStartHead, head > RING_SIZE ? head - RING_SIZE : 0);
+            result.overwritten += first - ring.captureStartHead;
+            std::vector<ZoneEvent> events;
+            events.reserve(head - first);
+            for (uint64_t i = first; i < head; i++) {
+                events.push_back(ring.events[i % RING_SIZE]);
+            }
+            const uint64_t newHead = ring.head.load(std::memory_order_acquire);
+            const uint64_t reused = newHead > RING_SIZE ? newHead - RING_SIZE : 0;
+
+            for (uint64_t i = first; i < head; i++) {
+                const ZoneEvent &event = events[i - first];
+                if (i < reused) {
+                    result.overwritten++;
+                    continue;
+                }
+                // Begun by an earlier capture, or ended after this one
+                if (event.begin < captureStartTicks || event.end > captureEndTicks) {
+                    continue;
+                }
+                json += "{\"ph\":\"X\",\"name\":\"";
+                appendEscaped(json, event.name);
+                json += std::format("\",\"pid\":0,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}},\n", thread,
+                                    static_cast<double>(event.begin - captureStartTicks) / ticksPerUs,
+                                    static_cast<double>(event.end - event.begin) / ticksPerUs);
+                result.zones++;
+            }
+        }
+    }
+    // No trailing comma in JSON
+    if (json.ends_with(",\n")) {
+        json.resize(json.size() - 2);
+    }
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    std::ofstream file{capture.path};
+    if (!file.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+        throw std::runtime_error("Failed to write " + capture.path.string() + "!");
+    }
+    return result;
+}
+
+} // Namespace KaguEngine
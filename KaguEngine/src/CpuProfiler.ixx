@@ -0,0 +1,84 @@
+module;
+
+// libs
+#if defined(__x86_64__) || defined(_M_X64)
+    #define KAGU_PROFILER_RDTSC
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+
+export module KaguEngine.CpuProfiler;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+
+export namespace KaguEngine {
+
+// Written once a capture's last frame ended
+struct CpuTraceResult {
+    std::filesystem::path path;
+    uint32_t frames = 0;
+    uint64_t zones = 0;
+    uint64_t overwritten = 0; // Lost to a full ring, a thread recorded more than RING_SIZE zones
+};
+
+// Scoped zones recorded into a lock-free ring per thread, only while a capture runs. Outside of one, a zone
+// costs a relaxed load and a branch. Captures cover whole frames and are written as a Chrome trace.
+class CpuProfiler {
+public:
+    static constexpr uint32_t RING_SIZE = 1 << 15; // Zones per thread, the oldest are overwritten
+
+    // name must outlive the capture, a string literal. Tags the allocations of its scope as well.
+    class Zone {
+    public:
+        explicit Zone(const char *name) noexcept : m_Name{name}, m_Tag{name} {
+            if (isCapturing()) {
+                m_Begin = now();
+            }
+        }
+        ~Zone() {
+            if (m_Begin != 0) {
+                record(m_Name, m_Begin, now());
+            }
+        }
+
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+    private:
+        const char *m_Name;
+        uint64_t m_Begin = 0;
+        AllocationTracker::Tag m_Tag;
+    };
+
+    [[nodiscard]] static bool isCapturing() noexcept { return s_Capturing.load(std::memory_order_relaxed); }
+    // Time stamp counter where there is one, calibrated against the steady clock by every capture
+    [[nodiscard]] static uint64_t now() noexcept {
+#if defined(KAGU_PROFILER_RDTSC)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    // Shown in the trace, "Thread N" otherwise
+    static void setThreadName(std::string name);
+    // Captures the next frameCount frames, ignored while a capture runs
+    static void requestCapture(uint32_t frameCount, std::filesystem::path path);
+    // Frames left to capture, 0 when none runs
+    [[nodiscard]] static uint32_t getRemainingFrames();
+    // Main thread, once per frame. Starts a requested capture, or ends and writes the running one.
+    static std::optional<CpuTraceResult> endFrame();
+
+private:
+    static void record(const char *name, uint64_t begin, uint64_t end);
+
+    static std::atomic<bool> s_Capturing;
+};
+
+} // Namespace KaguEngine
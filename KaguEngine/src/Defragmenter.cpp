@@ -0,0 +1,242 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.Defragmenter;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+import KaguEngine.Memory;
+import KaguEngine.SwapChain;
+
+namespace KaguEngine {
+
+Defragmenter::Defragmenter(Device &device) : deviceRef{device} {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = deviceRef.getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(deviceRef.device(), &allocInfo, &m_CommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate defragmentation command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(deviceRef.device(), &fenceInfo, AllocationTracker::callbacks(), &m_Fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create defragmentation fence!");
+    }
+}
+
+Defragmenter::~Defragmenter() {
+    if (m_BatchInFlight) {
+        vkWaitForFences(deviceRef.device(), 1, &m_Fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        finishBatch();
+    }
+    vkDeviceWaitIdle(deviceRef.device());
+    releaseRetired(true);
+
+    vkDestroyFence(deviceRef.device(), m_Fence, AllocationTracker::callbacks());
+    vkFreeCommandBuffers(deviceRef.device(), deviceRef.getCommandPool(), 1, &m_CommandBuffer);
+}
+
+void Defragmenter::beginPass() {
+    if (m_PassRunning) {
+        return;
+    }
+
+    // Blocks are grouped by what they can hold, moves never cross groups
+    std::map<std::pair<uint32_t, bool>, std::vector<MemoryBlockInfo>> groups;
+    for (const auto &block: deviceRef.allocator().getBlocks()) {
+        if (block.size <= deviceRef.allocator().getBlockSize()) {
+            groups[{block.memoryTypeIndex, block.linear}].push_back(block);
+        }
+    }
+
+    m_Candidates.clear();
+    for (auto &blocks: groups | std::views::values) {
+        std::ranges::sort(blocks, {}, [](const MemoryBlockInfo &block) {
+            return static_cast<double>(block.usedBytes) / static_cast<double>(block.size);
+        });
+        // The fullest block of a group is where the others get emptied into
+        blocks.pop_back();
+
+        for (const auto &block: blocks) {
+            const float usage = static_cast<float>(block.usedBytes) / static_cast<float>(block.size);
+            if (usage < Config::defragSparseThreshold && block.relocatableBytes == block.usedBytes) {
+                m_Candidates.push_back(block.blockId);
+            }
+        }
+    }
+
+    m_LastPassFrame = m_FrameCount;
+    if (m_Candidates.empty()) {
+        return;
+    }
+
+    m_PassRunning = true;
+    m_PassStart = m_Stats;
+}
+
+void Defragmenter::update() {
+    m_FrameCount++;
+
+    if (m_BatchInFlight) {
+        if (vkGetFenceStatus(deviceRef.device(), m_Fence) != VK_SUCCESS) {
+            releaseRetired(false);
+            return;
+        }
+        finishBatch();
+    }
+    releaseRetired(false);
+
+    if (!m_Candidates.empty()) {
+        recordBatch();
+    } else if (m_PassRunning && m_Retired.empty()) {
+        endPass();
+    } else if (!m_PassRunning && m_FrameCount - m_LastPassFrame >= Config::defragPassCooldown) {
+        beginPass();
+    }
+}
+
+void Defragmenter::recordBatch() {
+    MemoryAllocator &allocator = deviceRef.allocator();
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(m_CommandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording defragmentation command buffer!");
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(m_CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    // At least one move per batch, so resources bigger than the budget still get through
+    VkDeviceSize recordedBytes = 0;
+    while (!m_Candidates.empty()) {
+        const auto relocatables = allocator.getRelocatables(m_Candidates.front());
+        if (relocatables.empty()) {
+            m_Candidates.erase(m_Candidates.begin());
+            continue;
+        }
+
+        bool budgetReached = false;
+        for (const auto &[source, owner]: relocatables) {
+            if (!m_Moves.empty() && recordedBytes + source.size > Config::defragBytesPerFrame) {
+                budgetReached = true;
+                break;
+            }
+
+            const auto destination = allocator.allocateForMove(source, m_Candidates);
+            if (!destination) {
+                break;
+            }
+
+            allocator.beginMove(source);
+            owner->recordRelocation(m_CommandBuffer, *destination);
+            m_Moves.push_back({source, *destination, owner});
+            recordedBytes += source.size;
+        }
+
+        if (budgetReached) {
+            break;
+        }
+        // Either the block got fully scheduled or the other blocks are too full to take the rest
+        m_Candidates.erase(m_Candidates.begin());
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(m_CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (vkEndCommandBuffer(m_CommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record defragmentation command buffer!");
+    }
+
+    if (m_Moves.empty()) {
+        return;
+    }
+
+    // Submitted after the frame, queue order keeps it behind every draw reading the old copies
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_CommandBuffer;
+
+    vkResetFences(deviceRef.device(), 1, &m_Fence);
+    if (const auto queueLock = deviceRef.lockGraphicsQueue();
+        vkQueueSubmit(deviceRef.graphicsQueue(), 1, &submitInfo, m_Fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit defragmentation command buffer!");
+    }
+    m_BatchInFlight = true;
+}
+
+void Defragmenter::finishBatch() {
+    MemoryAllocator &allocator = deviceRef.allocator();
+
+    for (const auto &move: m_Moves) {
+        // The owner got destroyed while its copy was in flight, nothing reads either end anymore
+        if (std::function<void()> destroyCancelled; !allocator.completeMove(move.source, destroyCancelled)) {
+            if (destroyCancelled) {
+                destroyCancelled();
+            }
+            allocator.free(move.destination);
+            allocator.free(move.source);
+            m_Stats.movesCancelled++;
+            continue;
+        }
+
+        m_Retired.push_back({m_FrameCount, move.source, move.owner->commitRelocation(move.destination)});
+        m_Stats.movesCompleted++;
+        m_Stats.bytesMoved += move.source.size;
+    }
+
+    m_Moves.clear();
+    m_BatchInFlight = false;
+}
+
+void Defragmenter::releaseRetired(const bool all) {
+    MemoryAllocator &allocator = deviceRef.allocator();
+
+    // Frames recorded before the switch still use the old handles until their fence signals
+    while (!m_Retired.empty() &&
+           (all || m_FrameCount - m_Retired.front().frame >= SwapChain::MAX_FRAMES_IN_FLIGHT)) {
+        const Retired &retired = m_Retired.front();
+        retired.destroy();
+
+        const VkDeviceSize releasedBefore = allocator.getStats().releasedBytes;
+        allocator.free(retired.source);
+        m_Stats.bytesReclaimed += allocator.getStats().releasedBytes - releasedBefore;
+
+        m_Retired.pop_front();
+    }
+}
+
+void Defragmenter::endPass() {
+    m_PassRunning = false;
+    m_Stats.passesCompleted++;
+
+    const uint64_t moves = m_Stats.movesCompleted - m_PassStart.movesCompleted;
+    const VkDeviceSize moved = m_Stats.bytesMoved - m_PassStart.bytesMoved;
+    const VkDeviceSize reclaimed = m_Stats.bytesReclaimed - m_PassStart.bytesReclaimed;
+    std::cout << "Defragmentation pass done: " << moves << " moves, " << moved / 1024 << " KiB moved, "
+              << reclaimed / 1024 << " KiB reclaimed" << '\n';
+}
+
+} // Namespace KaguEngine
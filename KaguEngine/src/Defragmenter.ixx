@@ -0,0 +1,77 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.Defragmenter;
+
+// std
+import std;
+
+import KaguEngine.Device;
+import KaguEngine.Memory;
+
+export namespace KaguEngine {
+
+struct DefragmentationStats {
+    uint32_t passesCompleted = 0;
+    uint64_t movesCompleted = 0;
+    uint64_t movesCancelled = 0;
+    VkDeviceSize bytesMoved = 0;
+    VkDeviceSize bytesReclaimed = 0;
+};
+
+// Compacts sparse memory blocks a few megabytes per frame, so that long sessions
+// give memory back to the driver without ever stalling a frame.
+class Defragmenter {
+public:
+    explicit Defragmenter(Device &device);
+    ~Defragmenter();
+
+    // Non copyable
+    Defragmenter(const Defragmenter &) = delete;
+    Defragmenter &operator=(const Defragmenter &) = delete;
+
+    // Picks the blocks to empty, the moves themselves are spread over the next update() calls
+    void beginPass();
+    // Must be called once per frame, outside of frame recording
+    void update();
+
+    [[nodiscard]] bool isPassRunning()                    const { return m_PassRunning; }
+    [[nodiscard]] const DefragmentationStats& getStats() const { return m_Stats; }
+
+private:
+    struct Move {
+        Allocation source;
+        Allocation destination;
+        Relocatable *owner;
+    };
+
+    struct Retired {
+        uint64_t frame;
+        Allocation source;
+        std::function<void()> destroy;
+    };
+
+    void recordBatch();
+    void finishBatch();
+    void endPass();
+    void releaseRetired(bool all);
+
+    Device &deviceRef;
+    VkCommandBuffer m_CommandBuffer = VK_NULL_HANDLE;
+    VkFence m_Fence = VK_NULL_HANDLE;
+
+    std::vector<uint32_t> m_Candidates; // Block ids, emptiest first
+    std::vector<Move> m_Moves;          // Recorded in the batch currently on the GPU
+    std::deque<Retired> m_Retired;      // Old handles waiting for the frames still using them
+    bool m_BatchInFlight = false;
+    bool m_PassRunning = false;
+
+    uint64_t m_FrameCount = 0;
+    uint64_t m_LastPassFrame = 0;
+    DefragmentationStats m_PassStart{};
+    DefragmentationStats m_Stats{};
+};
+
+} // Namespace KaguEngine
@@ -10,6 +10,7 @@ module KaguEngine.Descriptor;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
 import KaguEngine.Device;
 
 namespace KaguEngine {
@@ -45,14 +46,15 @@ DescriptorSetLayout::DescriptorSetLayout(Device &m_Device,
     descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
     descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
 
-    if (vkCreateDescriptorSetLayout(m_Device.device(), &descriptorSetLayoutInfo, nullptr, &m_DescriptorSetLayout) !=
+    if (vkCreateDescriptorSetLayout(m_Device.device(), &descriptorSetLayoutInfo,
+                                    AllocationTracker::callbacks(), &m_DescriptorSetLayout) !=
         VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
 }
 
 DescriptorSetLayout::~DescriptorSetLayout() {
-    vkDestroyDescriptorSetLayout(deviceRef.device(), m_DescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(deviceRef.device(), m_DescriptorSetLayout, AllocationTracker::callbacks());
 }
 
 DescriptorPool::Builder &DescriptorPool::Builder::addPoolSize(const VkDescriptorType descriptorType,
@@ -84,12 +86,15 @@ DescriptorPool::DescriptorPool(Device &device, const uint32_t maxSets, const VkD
     descriptorPoolInfo.maxSets = maxSets;
     descriptorPoolInfo.flags = poolFlags;
 
-    if (vkCreateDescriptorPool(deviceRef.device(), &descriptorPoolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+    if (vkCreateDescriptorPool(deviceRef.device(), &descriptorPoolInfo,
+                               AllocationTracker::callbacks(), &m_DescriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor pool!");
     }
 }
 
-DescriptorPool::~DescriptorPool() { vkDestroyDescriptorPool(deviceRef.device(), m_DescriptorPool, nullptr); }
+DescriptorPool::~DescriptorPool() {
+    vkDestroyDescriptorPool(deviceRef.device(), m_DescriptorPool, AllocationTracker::callbacks());
+}
 
 bool DescriptorPool::allocateDescriptor(const VkDescriptorSetLayout descriptorSetLayout,
                                         VkDescriptorSet &descriptor) const {
@@ -12,6 +12,10 @@ module KaguEngine.Device;
 // std
 import std.compat; // For strcmp()
 
+import KaguEngine.AllocationTracker;
+import KaguEngine.Memory;
+import KaguEngine.PipelineCache;
+import KaguEngine.Residency;
 import KaguEngine.Window;
 
 namespace KaguEngine {
@@ -48,25 +52,42 @@ void DestroyDebugUtilsMessengerEXT(const VkInstance instance, const VkDebugUtils
     }
 }
 
-Device::Device(Window &window) : windowRef{window} {
+Device::Device(Window &window) : Device{&window} {}
+
+Device::Device() : Device{nullptr} {}
+
+Device::Device(Window *window) : m_Window{window} {
     createInstance();
     setupDebugMessenger();
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
     createCommandPool();
+    createAllocator();
+    createPipelineCache();
+    createUploadResources();
 }
 
 Device::~Device() {
-    vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
-    vkDestroyDevice(m_Device, nullptr);
+    // Runs the staging cleanups, acquires never submitted are dropped with their resources
+    waitForUploads();
+    vkDestroySemaphore(m_Device, m_AcquireSemaphore, AllocationTracker::callbacks());
+    vkDestroySemaphore(m_Device, m_UploadSemaphore, AllocationTracker::callbacks());
+    vkDestroyCommandPool(m_Device, m_AcquireCommandPool, AllocationTracker::callbacks());
+    vkDestroyCommandPool(m_Device, m_TransferCommandPool, AllocationTracker::callbacks());
+
+    m_PipelineCache.reset(); // Saved to disk
+    m_Residency.reset();
+    m_Allocator.reset();
+    vkDestroyCommandPool(m_Device, m_CommandPool, AllocationTracker::callbacks());
+    vkDestroyDevice(m_Device, AllocationTracker::callbacks());
 
     if constexpr (Config::enableValidationLayers) {
-        DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, nullptr);
+        DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, AllocationTracker::callbacks());
     }
 
-    vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
-    vkDestroyInstance(m_Instance, nullptr);
+    vkDestroySurfaceKHR(m_Instance, m_Surface, AllocationTracker::callbacks());
+    vkDestroyInstance(m_Instance, AllocationTracker::callbacks());
 }
 
 void Device::createInstance() {
@@ -102,7 +123,7 @@ void Device::createInstance() {
         createInfo.pNext = nullptr;
     }
 
-    if (vkCreateInstance(&createInfo, nullptr, &m_Instance) != VK_SUCCESS) {
+    if (vkCreateInstance(&createInfo, AllocationTracker::callbacks(), &m_Instance) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create instance!");
     }
 
@@ -138,14 +159,72 @@ void Device::pickPhysicalDevice() {
 
     std::cout << " - Chosen device is " << properties.deviceName << " with a score of " << candidates.rbegin()->first << '\n';
     std::cout << " - MSAAx" << getMaxUsableSampleCount() << '\n';
+
+    queryDynamicStateSupport();
+    queryProfilingSupport();
+}
+
+void Device::queryDynamicStateSupport() {
+    // Without it, every combination of the state is its own pipeline
+    if (!Config::extendedDynamicState) {
+        return;
+    }
+    m_DynamicState.rasterization = true;
+
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    const bool hasExtendedDynamicState3 = std::ranges::any_of(availableExtensions, [](const auto &extension) {
+        return strcmp(extension.extensionName, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) == 0;
+    });
+    if (hasExtendedDynamicState3) {
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT features3{};
+        features3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features3;
+        vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features2);
+        m_DynamicState.colorBlendEnable = features3.extendedDynamicState3ColorBlendEnable;
+    }
+
+    std::cout << " - Dynamic rasterization state" << (m_DynamicState.colorBlendEnable ? " and blending" : "") << '\n';
+}
+
+void Device::queryProfilingSupport() {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // Without timestampComputeAndGraphics, only some families can write timestamps
+    const uint32_t graphicsFamily = findQueueFamilies(m_PhysicalDevice).graphicsFamily;
+    m_QuerySupport.timestampValidBits = queueFamilies[graphicsFamily].timestampValidBits;
+    m_QuerySupport.timestampPeriod = properties.limits.timestampPeriod;
+
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &features);
+    if (features.pipelineStatisticsQuery && features.inheritedQueries) {
+        m_QuerySupport.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+                                            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+                                            VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                                            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+                                            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    }
+
+    std::cout << " - GPU timestamps: " << (m_QuerySupport.timestampValidBits ? "yes" : "no")
+              << " | Pipeline statistics: " << (m_QuerySupport.pipelineStatistics ? "yes" : "no") << '\n';
 }
 
 int Device::rateDeviceSuitability(const VkPhysicalDevice device) const {
     VkPhysicalDeviceProperties supportedProperties;
     vkGetPhysicalDeviceProperties(device, &supportedProperties);
 
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     VkPhysicalDeviceVulkan13Features features13{};
     features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features13.pNext = &features12;
     VkPhysicalDeviceFeatures2 features2{};
     features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     features2.pNext = &features13;
@@ -154,8 +233,8 @@ int Device::rateDeviceSuitability(const VkPhysicalDevice device) const {
     const QueueFamilyIndices indices = findQueueFamilies(device);
 
     const bool extensionsSupported = checkDeviceExtensionSupport(device);
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = isHeadless();
+    if (extensionsSupported && !isHeadless()) {
         const SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -169,7 +248,8 @@ int Device::rateDeviceSuitability(const VkPhysicalDevice device) const {
 
     // Check for needed features, the engine can't work without them.
     if (!(indices.isComplete() && extensionsSupported && swapChainAdequate &&
-        features2.features.samplerAnisotropy && features13.dynamicRendering)) {
+        features2.features.samplerAnisotropy && features13.dynamicRendering && features13.synchronization2 &&
+        features12.timelineSemaphore)) {
         return 0;
     }
 
@@ -180,7 +260,9 @@ void Device::createLogicalDevice() {
     QueueFamilyIndices indices = findQueueFamilies(m_PhysicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+    m_GraphicsFamily = indices.graphicsFamily;
+    m_TransferFamily = indices.transferFamilyHasValue ? indices.transferFamily : indices.graphicsFamily;
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily, m_TransferFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily: uniqueQueueFamilies) {
@@ -192,14 +274,27 @@ void Device::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT deviceFeatures3{};
+    deviceFeatures3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+    deviceFeatures3.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+
+    VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+    deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    deviceFeatures12.pNext = m_DynamicState.colorBlendEnable ? &deviceFeatures3 : nullptr;
+    deviceFeatures12.timelineSemaphore = VK_TRUE;
+
     VkPhysicalDeviceVulkan13Features deviceFeatures13{};
     deviceFeatures13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    deviceFeatures13.pNext = &deviceFeatures12;
     deviceFeatures13.dynamicRendering = VK_TRUE;
+    deviceFeatures13.synchronization2 = VK_TRUE; // Render graph barriers
 
     VkPhysicalDeviceFeatures2 deviceFeatures2{};
     deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     deviceFeatures2.pNext = &deviceFeatures13;
     deviceFeatures2.features.samplerAnisotropy = VK_TRUE;
+    deviceFeatures2.features.pipelineStatisticsQuery = m_QuerySupport.pipelineStatistics != 0;
+    deviceFeatures2.features.inheritedQueries = m_QuerySupport.pipelineStatistics != 0;
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -208,16 +303,32 @@ void Device::createLogicalDevice() {
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+    std::vector<const char *> extensions = getDeviceExtensions();
+    if (m_DynamicState.colorBlendEnable) {
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+    }
+
     createInfo.pEnabledFeatures = nullptr; // This must be null if pNext is used
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(m_DeviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = m_DeviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
-    if (vkCreateDevice(m_PhysicalDevice, &createInfo, nullptr, &m_Device) != VK_SUCCESS) {
+    if (vkCreateDevice(m_PhysicalDevice, &createInfo, AllocationTracker::callbacks(), &m_Device) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create logical device!");
     }
 
     vkGetDeviceQueue(m_Device, indices.graphicsFamily, 0, &m_GraphicsQueue);
     vkGetDeviceQueue(m_Device, indices.presentFamily, 0, &m_PresentQueue);
+    vkGetDeviceQueue(m_Device, m_TransferFamily, 0, &m_TransferQueue);
+
+    if (m_DynamicState.colorBlendEnable) {
+        m_DynamicState.cmdSetColorBlendEnable = reinterpret_cast<PFN_vkCmdSetColorBlendEnableEXT>(
+            vkGetDeviceProcAddr(m_Device, "vkCmdSetColorBlendEnableEXT"));
+        m_DynamicState.colorBlendEnable = m_DynamicState.cmdSetColorBlendEnable != nullptr;
+    }
+
+    if (hasDedicatedTransferQueue()) {
+        std::cout << " - Dedicated transfer queue (family " << m_TransferFamily << ")" << '\n';
+    }
 }
 
 void Device::createCommandPool() {
@@ -228,12 +339,58 @@ void Device::createCommandPool() {
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-    if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS) {
+    if (vkCreateCommandPool(m_Device, &poolInfo, AllocationTracker::callbacks(), &m_CommandPool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create command pool!");
     }
 }
 
-void Device::createSurface() { windowRef.createWindowSurface(m_Instance, &m_Surface); }
+void Device::createAllocator() {
+    m_Allocator = std::make_unique<MemoryAllocator>(m_PhysicalDevice, m_Device, Config::memoryBlockSize);
+    m_Residency = std::make_unique<ResidencyManager>(Config::residencyBudget);
+}
+
+void Device::createPipelineCache() {
+    m_PipelineCache = std::make_unique<PipelineCache>(m_Device, properties, Config::pipelineCachePath);
+}
+
+void Device::createUploadResources() {
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_TransferFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    if (vkCreateCommandPool(m_Device, &poolInfo,
+                            AllocationTracker::callbacks(), &m_TransferCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create transfer command pool!");
+    }
+
+    // The render thread records the acquires while the main thread uses the device pool
+    poolInfo.queueFamilyIndex = m_GraphicsFamily;
+    if (vkCreateCommandPool(m_Device, &poolInfo, AllocationTracker::callbacks(), &m_AcquireCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create acquire command pool!");
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+
+    if (vkCreateSemaphore(m_Device, &semaphoreInfo, AllocationTracker::callbacks(), &m_UploadSemaphore) != VK_SUCCESS ||
+        vkCreateSemaphore(m_Device, &semaphoreInfo,
+                          AllocationTracker::callbacks(), &m_AcquireSemaphore) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload semaphores!");
+    }
+}
+
+void Device::createSurface() {
+    if (m_Window) {
+        m_Window->createWindowSurface(m_Instance, &m_Surface);
+    }
+}
 
 void Device::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
     createInfo = {};
@@ -252,7 +409,8 @@ void Device::setupDebugMessenger() {
         return;
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     populateDebugMessengerCreateInfo(createInfo);
-    if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfo, nullptr, &m_DebugMessenger) != VK_SUCCESS) {
+    if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfo,
+                                     AllocationTracker::callbacks(), &m_DebugMessenger) != VK_SUCCESS) {
         throw std::runtime_error("Failed to set up debug messenger!");
     }
 }
@@ -283,10 +441,13 @@ bool Device::checkValidationLayerSupport() const {
 }
 
 std::vector<const char *> Device::getRequiredExtensions() const {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    // GLFW isn't initialized without a window, and no surface extension is needed
+    if (m_Window) {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if constexpr (Config::enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -317,6 +478,10 @@ void Device::hasGLFWRequiredInstanceExtensions() const {
     }
 }
 
+std::vector<const char *> Device::getDeviceExtensions() const {
+    return isHeadless() ? std::vector<const char *>{} : m_DeviceExtensions;
+}
+
 bool Device::checkDeviceExtensionSupport(const VkPhysicalDevice device) const {
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -324,7 +489,8 @@ bool Device::checkDeviceExtensionSupport(const VkPhysicalDevice device) const {
     std::vector<VkExtensionProperties> availableExtensions(extensionCount);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-    std::set<std::string> requiredExtensions(m_DeviceExtensions.begin(), m_DeviceExtensions.end());
+    const std::vector<const char *> deviceExtensions = getDeviceExtensions();
+    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
     for (const auto &[extensionName, specVersion]: availableExtensions) {
         requiredExtensions.erase(extensionName);
@@ -342,25 +508,42 @@ QueueFamilyIndices Device::findQueueFamilies(const VkPhysicalDevice device) cons
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-    int i = 0;
+    // Transfer-only families are the DMA engines, a compute family without graphics comes second
+    int transferScore = 0;
+    uint32_t i = 0;
     for (const auto &queueFamily: queueFamilies) {
-        if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT &&
+            !indices.graphicsFamilyHasValue) {
             indices.graphicsFamily = i;
             indices.graphicsFamilyHasValue = true;
         }
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_Surface, &presentSupport);
-        if (queueFamily.queueCount > 0 && presentSupport) {
+        if (!isHeadless()) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_Surface, &presentSupport);
+        }
+        if (queueFamily.queueCount > 0 && presentSupport && !indices.presentFamilyHasValue) {
             indices.presentFamily = i;
             indices.presentFamilyHasValue = true;
         }
-        if (indices.isComplete()) {
-            break;
+        if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+            !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            const int score = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT ? 1 : 2;
+            if (score > transferScore) {
+                indices.transferFamily = i;
+                indices.transferFamilyHasValue = true;
+                transferScore = score;
+            }
         }
 
         i++;
     }
 
+    // Nothing is presented, the graphics queue stands in for the present queue
+    if (isHeadless() && indices.graphicsFamilyHasValue) {
+        indices.presentFamily = indices.graphicsFamily;
+        indices.presentFamilyHasValue = true;
+    }
+
     return indices;
 }
 
@@ -424,7 +607,7 @@ void Device::createBuffer(const VkDeviceSize size, const VkBufferUsageFlags usag
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateBuffer(m_Device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+    if (vkCreateBuffer(m_Device, &bufferInfo, AllocationTracker::callbacks(), &buffer) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create vertex buffer!");
     }
 
@@ -436,13 +619,33 @@ void Device::createBuffer(const VkDeviceSize size, const VkBufferUsageFlags usag
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+    if (vkAllocateMemory(m_Device, &allocInfo, AllocationTracker::callbacks(), &bufferMemory) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate vertex buffer memory!");
     }
 
     vkBindBufferMemory(m_Device, buffer, bufferMemory, 0);
 }
 
+void Device::createBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage,
+                          const VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                          Allocation &allocation, Relocatable *owner) const {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(m_Device, &bufferInfo, AllocationTracker::callbacks(), &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(m_Device, buffer, &memRequirements);
+
+    allocation = m_Allocator->allocate(memRequirements, properties, true, owner);
+    vkBindBufferMemory(m_Device, buffer, allocation.memory, allocation.offset);
+}
+
 VkCommandBuffer Device::beginSingleTimeCommands() const {
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -469,8 +672,11 @@ void Device::endSingleTimeCommands(const VkCommandBuffer commandBuffer) const {
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_GraphicsQueue);
+    {
+        const auto queueLock = lockGraphicsQueue();
+        vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(m_GraphicsQueue);
+    }
 
     vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &commandBuffer);
 }
@@ -508,9 +714,215 @@ void Device::copyBufferToImage(const VkBuffer buffer, const VkImage image, const
     endSingleTimeCommands(commandBuffer);
 }
 
+uint64_t Device::submitUpload(const std::function<void(VkCommandBuffer)> &record,
+                              std::function<void(VkCommandBuffer)> acquire, std::function<void()> onComplete) {
+    // Completions are left to collectUploads(), this can run on any thread
+    std::scoped_lock lock{m_UploadMutex};
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = m_TransferCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    record(commandBuffer);
+    vkEndCommandBuffer(commandBuffer);
+
+    const uint64_t value = m_UploadValue + 1;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &value;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_UploadSemaphore;
+
+    // Without a transfer family the render thread submits and presents on the same queue
+    std::unique_lock<std::mutex> queueLock;
+    if (!hasDedicatedTransferQueue()) {
+        queueLock = lockGraphicsQueue();
+    }
+    if (vkQueueSubmit(m_TransferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        vkFreeCommandBuffers(m_Device, m_TransferCommandPool, 1, &commandBuffer);
+        throw std::runtime_error("Failed to submit upload command buffer!");
+    }
+    queueLock = {};
+
+    m_UploadValue = value;
+    m_PendingUploads.push_back({value, commandBuffer, std::move(onComplete)});
+    if (acquire) {
+        m_AcquireWork.push_back(std::move(acquire));
+    }
+    return value;
+}
+
+void Device::uploadBuffer(const VkBuffer buffer, const void *data, const VkDeviceSize size,
+                          const VkAccessFlags dstAccess, const VkPipelineStageFlags dstStage) {
+    VkBuffer stagingBuffer;
+    Allocation stagingAllocation;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer, stagingAllocation);
+    memcpy(stagingAllocation.mapped, data, size);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    if (hasDedicatedTransferQueue()) {
+        // Queue family ownership transfer, the release and acquire barriers must match
+        barrier.srcQueueFamilyIndex = m_TransferFamily;
+        barrier.dstQueueFamilyIndex = m_GraphicsFamily;
+    }
+
+    submitUpload(
+        [&](const VkCommandBuffer commandBuffer) {
+            VkBufferCopy copyRegion{};
+            copyRegion.size = size;
+            vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+            if (hasDedicatedTransferQueue()) {
+                VkBufferMemoryBarrier release = barrier;
+                release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                release.dstAccessMask = 0;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+            }
+        },
+        [barrier, dstAccess, dstStage, dedicated = hasDedicatedTransferQueue()](const VkCommandBuffer commandBuffer) {
+            VkBufferMemoryBarrier acquire = barrier;
+            acquire.srcAccessMask = dedicated ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+            acquire.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1,
+                                 &acquire, 0, nullptr);
+        },
+        [this, stagingBuffer, stagingAllocation] {
+            vkDestroyBuffer(m_Device, stagingBuffer, AllocationTracker::callbacks());
+            m_Allocator->free(stagingAllocation);
+        });
+}
+
+uint64_t Device::submitPendingAcquires() {
+    std::scoped_lock lock{m_UploadMutex};
+    if (m_AcquireWork.empty()) {
+        return m_UploadValue;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = m_AcquireCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate acquire command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    for (const auto &work: m_AcquireWork) {
+        work(commandBuffer);
+    }
+    vkEndCommandBuffer(commandBuffer);
+    m_AcquireWork.clear();
+
+    // Waiting on the transfers here rather than in the frame keeps the acquire barriers after the releases
+    const uint64_t signalValue = m_AcquireValue + 1;
+    constexpr VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &m_UploadValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &m_UploadSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_AcquireSemaphore;
+
+    if (const auto queueLock = lockGraphicsQueue();
+        vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        vkFreeCommandBuffers(m_Device, m_AcquireCommandPool, 1, &commandBuffer);
+        throw std::runtime_error("Failed to submit acquire command buffer!");
+    }
+
+    m_AcquireValue = signalValue;
+    m_PendingAcquires.push_back({signalValue, commandBuffer, {}});
+    return m_UploadValue;
+}
+
+void Device::waitForUploads() {
+    std::scoped_lock lock{m_UploadMutex};
+
+    const std::array semaphores{m_UploadSemaphore, m_AcquireSemaphore};
+    const std::array values{m_UploadValue, m_AcquireValue};
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+    waitInfo.pSemaphores = semaphores.data();
+    waitInfo.pValues = values.data();
+    vkWaitSemaphores(m_Device, &waitInfo, std::numeric_limits<uint64_t>::max());
+
+    collectUploadsLocked();
+}
+
+void Device::collectUploads() {
+    std::scoped_lock lock{m_UploadMutex};
+    collectUploadsLocked();
+}
+
+void Device::collectUploadsLocked() {
+    uint64_t uploadValue = 0;
+    vkGetSemaphoreCounterValue(m_Device, m_UploadSemaphore, &uploadValue);
+    while (!m_PendingUploads.empty() && m_PendingUploads.front().value <= uploadValue) {
+        auto &[value, commandBuffer, onComplete] = m_PendingUploads.front();
+        if (onComplete) {
+            onComplete();
+        }
+        vkFreeCommandBuffers(m_Device, m_TransferCommandPool, 1, &commandBuffer);
+        m_PendingUploads.pop_front();
+    }
+
+    uint64_t acquireValue = 0;
+    vkGetSemaphoreCounterValue(m_Device, m_AcquireSemaphore, &acquireValue);
+    while (!m_PendingAcquires.empty() && m_PendingAcquires.front().value <= acquireValue) {
+        vkFreeCommandBuffers(m_Device, m_AcquireCommandPool, 1, &m_PendingAcquires.front().commandBuffer);
+        m_PendingAcquires.pop_front();
+    }
+}
+
 void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, const VkMemoryPropertyFlags properties,
                                  VkImage &image, VkDeviceMemory &imageMemory) const {
-    if (vkCreateImage(m_Device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    if (vkCreateImage(m_Device, &imageInfo, AllocationTracker::callbacks(), &image) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create image!");
     }
 
@@ -522,7 +934,7 @@ void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, const VkMem
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+    if (vkAllocateMemory(m_Device, &allocInfo, AllocationTracker::callbacks(), &imageMemory) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate image memory!");
     }
 
@@ -531,6 +943,22 @@ void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, const VkMem
     }
 }
 
+void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, const VkMemoryPropertyFlags properties,
+                                 VkImage &image, Allocation &allocation, Relocatable *owner) const {
+    if (vkCreateImage(m_Device, &imageInfo, AllocationTracker::callbacks(), &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(m_Device, image, &memRequirements);
+
+    allocation = m_Allocator->allocate(memRequirements, properties,
+                                       imageInfo.tiling == VK_IMAGE_TILING_LINEAR, owner);
+    if (vkBindImageMemory(m_Device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind image memory!");
+    }
+}
+
 VkSampleCountFlagBits Device::getMaxUsableSampleCount() const {
     VkPhysicalDeviceProperties physicalDeviceProperties;
     vkGetPhysicalDeviceProperties(m_PhysicalDevice, &physicalDeviceProperties);
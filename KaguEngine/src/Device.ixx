@@ -8,6 +8,9 @@ export module KaguEngine.Device;
 // std
 import std;
 
+import KaguEngine.Memory;
+import KaguEngine.PipelineCache;
+import KaguEngine.Residency;
 import KaguEngine.Window;
 
 export namespace KaguEngine {
@@ -21,14 +24,34 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
+    uint32_t transferFamily; // Only set for a family without graphics support
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
+    bool transferFamilyHasValue = false;
     [[nodiscard]] bool isComplete() const { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
+// Pipeline state that can be set per draw instead of being baked in, see Pipeline::enableDynamicState
+struct DynamicStateSupport {
+    bool rasterization = false;    // Cull mode, front face and depth state, core in Vulkan 1.3
+    bool colorBlendEnable = false; // VK_EXT_extended_dynamic_state3
+    PFN_vkCmdSetColorBlendEnableEXT cmdSetColorBlendEnable = nullptr;
+};
+
+// Queries the GPU profiler can use, on the graphics queue
+struct QuerySupport {
+    uint32_t timestampValidBits = 0; // 0 when the graphics family can't write timestamps
+    float timestampPeriod = 0.f;     // Nanoseconds per timestamp tick
+    // Counted by the pipeline statistics queries, 0 when unsupported. Secondaries executed while
+    // one is active inherit them, so this also needs inheritedQueries.
+    VkQueryPipelineStatisticFlags pipelineStatistics = 0;
+};
+
 class Device {
 public:
     explicit Device(Window &window);
+    // Headless: no surface, so no swap chain and no present support needed
+    Device();
     ~Device();
 
     // Not copyable or movable
@@ -43,7 +66,15 @@ public:
     [[nodiscard]] VkSurfaceKHR surface() const { return m_Surface; }
     [[nodiscard]] VkQueue graphicsQueue() const { return m_GraphicsQueue; }
     [[nodiscard]] VkQueue presentQueue() const { return m_PresentQueue; }
+    [[nodiscard]] VkQueue transferQueue() const { return m_TransferQueue; }
+    [[nodiscard]] uint32_t graphicsFamily() const { return m_GraphicsFamily; }
+    [[nodiscard]] uint32_t transferFamily() const { return m_TransferFamily; }
+    [[nodiscard]] bool hasDedicatedTransferQueue() const { return m_TransferFamily != m_GraphicsFamily; }
+    [[nodiscard]] VkSemaphore uploadSemaphore() const { return m_UploadSemaphore; }
     [[nodiscard]] VkInstance instance() const { return m_Instance; }
+    [[nodiscard]] bool isHeadless() const { return m_Window == nullptr; }
+    // Frames are submitted and presented from the render thread, everything else submits from the main thread
+    [[nodiscard]] std::unique_lock<std::mutex> lockGraphicsQueue() const { return std::unique_lock{m_GraphicsQueueMutex}; }
 
     [[nodiscard]] SwapChainSupportDetails getSwapChainSupport() const { return querySwapChainSupport(m_PhysicalDevice); }
     [[nodiscard]] uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
@@ -51,10 +82,17 @@ public:
     [[nodiscard]] VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
                                  VkFormatFeatureFlags features) const;
     [[nodiscard]] const VkSampleCountFlagBits& getSampleCount() const { return m_MSAASamples; }
+    [[nodiscard]] const DynamicStateSupport& getDynamicStateSupport() const { return m_DynamicState; }
+    [[nodiscard]] const QuerySupport& getQuerySupport() const { return m_QuerySupport; }
+    [[nodiscard]] MemoryAllocator& allocator() const { return *m_Allocator; }
+    [[nodiscard]] ResidencyManager& residency() const { return *m_Residency; }
+    [[nodiscard]] PipelineCache& pipelineCache() const { return *m_PipelineCache; }
 
     // Buffer Helper Functions
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
                       VkBuffer &buffer, VkDeviceMemory &bufferMemory) const;
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                      VkBuffer &buffer, Allocation &allocation, Relocatable *owner = nullptr) const;
     [[nodiscard]] VkCommandBuffer beginSingleTimeCommands() const;
     void endSingleTimeCommands(VkCommandBuffer commandBuffer) const;
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) const;
@@ -63,20 +101,48 @@ public:
 
     void createImageWithInfo(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image,
                              VkDeviceMemory &imageMemory) const;
+    void createImageWithInfo(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image,
+                             Allocation &allocation, Relocatable *owner = nullptr) const;
+
+    // Asynchronous uploads, on the dedicated transfer queue when the hardware has one. Thread safe.
+    // record is submitted right away, acquire is recorded on the graphics queue before the next frame
+    // and onComplete runs on the main thread once the transfer is done, to release the staging memory.
+    // Returns the upload semaphore value signalled by the transfer.
+    uint64_t submitUpload(const std::function<void(VkCommandBuffer)> &record,
+                          std::function<void(VkCommandBuffer)> acquire, std::function<void()> onComplete);
+    // Copies data to a device local buffer, usable from dstStage by the next frame submitted
+    void uploadBuffer(VkBuffer buffer, const void *data, VkDeviceSize size, VkAccessFlags dstAccess,
+                      VkPipelineStageFlags dstStage);
+    // Submits the acquire side of the pending uploads, returns the upload value the frame has to wait on.
+    // Safe from the render thread, it only records the acquires from their own pool.
+    uint64_t submitPendingAcquires();
+    // Runs onComplete for the finished uploads and frees their command buffers, main thread only.
+    // The only place completions run, with waitForUploads().
+    void collectUploads();
+    void waitForUploads();
 
     VkPhysicalDeviceProperties properties;
 
 private:
+    explicit Device(Window *window);
+
     void createInstance();
     void setupDebugMessenger();
     void createSurface();
     void pickPhysicalDevice();
+    void queryDynamicStateSupport();
+    void queryProfilingSupport();
     void createLogicalDevice();
     void createCommandPool();
+    void createAllocator();
+    void createPipelineCache();
+    void createUploadResources();
+    void collectUploadsLocked(); // m_UploadMutex held
 
     // helper functions
     int rateDeviceSuitability(VkPhysicalDevice device) const;
     [[nodiscard]] std::vector<const char *> getRequiredExtensions() const;
+    [[nodiscard]] std::vector<const char *> getDeviceExtensions() const;
     [[nodiscard]] bool checkValidationLayerSupport() const;
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) const;
     [[nodiscard]] VkSampleCountFlagBits getMaxUsableSampleCount() const;
@@ -89,14 +155,40 @@ private:
     VkInstance m_Instance;
     VkDebugUtilsMessengerEXT m_DebugMessenger;
     VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
-    Window &windowRef;
+    Window *m_Window; // Null when headless
     VkCommandPool m_CommandPool;
+    std::unique_ptr<MemoryAllocator> m_Allocator;
+    std::unique_ptr<ResidencyManager> m_Residency;
+    std::unique_ptr<PipelineCache> m_PipelineCache;
 
     VkDevice m_Device;
-    VkSurfaceKHR m_Surface;
+    VkSurfaceKHR m_Surface = VK_NULL_HANDLE;
     VkQueue m_GraphicsQueue;
     VkQueue m_PresentQueue;
+    VkQueue m_TransferQueue;
+    uint32_t m_GraphicsFamily;
+    uint32_t m_TransferFamily;
     VkSampleCountFlagBits m_MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+    DynamicStateSupport m_DynamicState{};
+    QuerySupport m_QuerySupport{};
+
+    struct PendingSubmit {
+        uint64_t value;
+        VkCommandBuffer commandBuffer;
+        std::function<void()> onComplete;
+    };
+
+    mutable std::mutex m_GraphicsQueueMutex;
+    std::mutex m_UploadMutex;
+    VkCommandPool m_TransferCommandPool;
+    VkCommandPool m_AcquireCommandPool; // Graphics family, only used under m_UploadMutex
+    VkSemaphore m_UploadSemaphore;  // Timeline, signalled by the transfer queue
+    VkSemaphore m_AcquireSemaphore; // Timeline, signalled by the acquire submissions
+    uint64_t m_UploadValue = 0;
+    uint64_t m_AcquireValue = 0;
+    std::deque<PendingSubmit> m_PendingUploads;
+    std::deque<PendingSubmit> m_PendingAcquires;
+    std::vector<std::function<void(VkCommandBuffer)>> m_AcquireWork;
 
     const std::vector<const char *> m_ValidationLayers = {"VK_LAYER_KHRONOS_validation"};
     const std::vector<const char *> m_DeviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
@@ -52,7 +52,6 @@ public:
         transform  = other.transform;
         texture    = std::move(other.texture);
         model      = std::move(other.model);
-        material   = other.material;
         pointLight = std::move(other.pointLight);
     }
     Entity &operator=(Entity &&) = default;
@@ -66,7 +65,6 @@ public:
     // Optional pointer components
     std::unique_ptr<Texture> texture = nullptr;
     std::shared_ptr<Model> model{};
-    Texture::Material material{};
     std::unique_ptr<PointLightComponent> pointLight = nullptr;
 
 private:
@@ -0,0 +1,88 @@
+module;
+
+// libs
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+module KaguEngine.FileWatcher;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+FileWatcher::FileWatcher(std::filesystem::path directory) : m_Directory{std::move(directory)} {
+#if defined(__linux__)
+    // Editors either write in place or rename a temporary file over the original
+    m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_Inotify < 0) {
+        throw std::runtime_error("Failed to watch directory: " + m_Directory.string());
+    }
+    // The destructor doesn't run for a throwing constructor
+    if (inotify_add_watch(m_Inotify, m_Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(m_Inotify);
+        throw std::runtime_error("Failed to watch directory: " + m_Directory.string());
+    }
+#else
+    static_cast<void>(scan()); // Only the writes after this count
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#if defined(__linux__)
+    if (m_Inotify >= 0) {
+        close(m_Inotify);
+    }
+#endif
+}
+
+std::vector<std::filesystem::path> FileWatcher::poll() {
+    std::vector<std::filesystem::path> changed;
+#if defined(__linux__)
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(m_Inotify, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+            if (event->len > 0) {
+                std::filesystem::path path = m_Directory / event->name;
+                if (std::ranges::find(changed, path) == changed.end()) {
+                    changed.push_back(std::move(path));
+                }
+            }
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        }
+    }
+#else
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_LastScan >= SCAN_INTERVAL) {
+        m_LastScan = now;
+        changed = scan();
+    }
+#endif
+    return changed;
+}
+
+std::vector<std::filesystem::path> FileWatcher::scan() {
+    std::vector<std::filesystem::path> changed;
+    std::error_code error;
+    for (const auto &entry: std::filesystem::directory_iterator{m_Directory, error}) {
+        if (!entry.is_regular_file(error)) {
+            continue;
+        }
+        const auto writeTime = entry.last_write_time(error);
+        if (error) {
+            continue; // Deleted while iterating
+        }
+        auto [it, inserted] = m_WriteTimes.try_emplace(entry.path().string(), writeTime);
+        if (!inserted && it->second != writeTime) {
+            it->second = writeTime;
+            changed.push_back(entry.path());
+        }
+    }
+    return changed;
+}
+
+} // Namespace KaguEngine
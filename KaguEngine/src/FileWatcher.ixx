@@ -0,0 +1,33 @@
+export module KaguEngine.FileWatcher;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+// Reports the files of one directory written since the last poll. Uses inotify on Linux, elsewhere it
+// compares the write times of the files, at most once per scan interval.
+class FileWatcher {
+public:
+    static constexpr std::chrono::milliseconds SCAN_INTERVAL{500};
+
+    explicit FileWatcher(std::filesystem::path directory);
+    ~FileWatcher();
+
+    // Non copyable
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    // Never blocks, each file is reported once however many times it was written
+    [[nodiscard]] std::vector<std::filesystem::path> poll();
+
+private:
+    [[nodiscard]] std::vector<std::filesystem::path> scan();
+
+    std::filesystem::path m_Directory;
+    int m_Inotify = -1;
+    std::unordered_map<std::string, std::filesystem::file_time_type> m_WriteTimes;
+    std::chrono::steady_clock::time_point m_LastScan{};
+};
+
+} // Namespace KaguEngine
@@ -0,0 +1,85 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+module KaguEngine.FrameArena;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the per-thread registry
+std::mutex registryMutex;
+std::vector<std::unique_ptr<FrameArena>> arenas;
+thread_local FrameArena *threadArena = nullptr;
+FrameArenaStats lastFrameStats{};
+}
+
+FrameArena::FrameArena(const std::size_t capacity) :
+    m_Capacity{capacity}, m_Buffer{std::make_unique<std::byte[]>(capacity)} {
+    m_Resource.emplace(m_Buffer.get(), m_Capacity, &m_Heap);
+}
+
+FrameArena &FrameArena::get() {
+    if (threadArena == nullptr) {
+        std::scoped_lock lock{registryMutex};
+        threadArena = arenas.emplace_back(std::make_unique<FrameArena>(Config::frameArenaSize)).get();
+    }
+    return *threadArena;
+}
+
+void FrameArena::resetAll() {
+    std::scoped_lock lock{registryMutex};
+
+    FrameArenaStats stats{};
+    stats.arenaCount = static_cast<uint32_t>(arenas.size());
+    for (const auto &arena: arenas) {
+        stats.allocations += arena->m_Allocations;
+        stats.bytesAllocated += arena->m_BytesAllocated;
+        stats.heapAllocations += arena->m_Heap.allocations;
+        arena->reset();
+    }
+    lastFrameStats = stats;
+}
+
+FrameArenaStats FrameArena::getFrameStats() {
+    std::scoped_lock lock{registryMutex};
+    return lastFrameStats;
+}
+
+void FrameArena::reset() {
+    m_Resource->release();
+
+    // Grow past what this frame needed, so the next ones stay off the heap
+    if (m_Heap.allocations > 0) {
+        m_Capacity = std::max(m_Capacity * 2, m_Capacity + m_Heap.bytes);
+        m_Resource.reset();
+        m_Buffer = std::make_unique<std::byte[]>(m_Capacity);
+        m_Resource.emplace(m_Buffer.get(), m_Capacity, &m_Heap);
+    }
+
+    m_Heap.allocations = 0;
+    m_Heap.bytes = 0;
+    m_Allocations = 0;
+    m_BytesAllocated = 0;
+}
+
+void *FrameArena::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+    m_Allocations++;
+    m_BytesAllocated += bytes;
+    return m_Resource->allocate(bytes, alignment);
+}
+
+void *FrameArena::HeapResource::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+    allocations++;
+    this->bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void FrameArena::HeapResource::do_deallocate(void *p, const std::size_t bytes, const std::size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+} // Namespace KaguEngine
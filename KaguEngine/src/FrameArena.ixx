@@ -0,0 +1,60 @@
+export module KaguEngine.FrameArena;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+struct FrameArenaStats {
+    uint64_t allocations = 0;    // Served by the arenas
+    uint64_t bytesAllocated = 0;
+    uint64_t heapAllocations = 0; // Arena full, had to go to the heap
+    uint32_t arenaCount = 0;
+};
+
+// Linear allocator for scratch memory that only lives until the end of the frame.
+// Deallocation is a no-op, everything is released at once by reset().
+class FrameArena final : public std::pmr::memory_resource {
+public:
+    explicit FrameArena(std::size_t capacity);
+
+    // Non copyable
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    // Arena of the calling thread, created on first use
+    static FrameArena &get();
+    // Resets the arenas of every thread, no scratch container may outlive this call
+    static void resetAll();
+    // Totals of the last completed frame
+    [[nodiscard]] static FrameArenaStats getFrameStats();
+
+    void reset();
+
+private:
+    // Counts what the arena couldn't fit, those allocations hit the heap
+    class HeapResource final : public std::pmr::memory_resource {
+    public:
+        uint64_t allocations = 0;
+        std::size_t bytes = 0;
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+        [[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override { return this == &other; }
+    };
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+    [[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override { return this == &other; }
+
+    std::size_t m_Capacity;
+    std::unique_ptr<std::byte[]> m_Buffer;
+    HeapResource m_Heap;
+    std::optional<std::pmr::monotonic_buffer_resource> m_Resource;
+
+    uint64_t m_Allocations = 0;
+    uint64_t m_BytesAllocated = 0;
+};
+
+} // Namespace KaguEngine
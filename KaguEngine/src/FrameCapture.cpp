@@ -0,0 +1,226 @@
+module;
+
+// libs
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <vulkan/vulkan.h>
+
+module KaguEngine.FrameCapture;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.CpuProfiler;
+import KaguEngine.Device;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the readback memory
+// Cached memory is read much faster by the CPU, every device has host visible and coherent memory
+VkMemoryPropertyFlags getReadbackProperties(const VkPhysicalDevice physicalDevice) {
+    constexpr VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    constexpr VkMemoryPropertyFlags cached = coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((memoryProperties.memoryTypes[i].propertyFlags & cached) == cached) {
+            return cached;
+        }
+    }
+    return coherent;
+}
+
+bool isBgra(const VkFormat format) {
+    return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+}
+
+FrameCapture::FrameCapture(Device &device, const VkSemaphore frameSemaphore, std::filesystem::path directory,
+                           const uint32_t interval, const CaptureFormat format) :
+    deviceRef{device}, m_FrameSemaphore{frameSemaphore}, m_Directory{std::move(directory)},
+    m_Interval{std::max(interval, 1u)}, m_Format{format},
+    m_MemoryProperties{getReadbackProperties(device.getPhysicalDevice())} {
+    std::filesystem::create_directories(m_Directory);
+    m_Worker = std::jthread{[this](const std::stop_token &stopToken) { writeLoop(stopToken); }};
+}
+
+FrameCapture::~FrameCapture() {
+    m_Worker.request_stop();
+    m_Worker.join();
+    for (Slot &slot: m_Slots) {
+        destroyBuffer(slot);
+    }
+}
+
+bool FrameCapture::isSupported(const VkFormat format) {
+    return isBgra(format) || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+void FrameCapture::record(const VkCommandBuffer commandBuffer, const VkImage image, const VkExtent2D extent,
+                          const VkFormat format, const uint64_t frameValue) {
+    if (!isSupported(format)) {
+        throw std::runtime_error("Failed to capture frame: unsupported image format!");
+    }
+
+    // A copy recorded by a frame that was never submitted is overwritten
+    std::optional<uint32_t> slotIndex = std::exchange(m_Recorded, std::nullopt);
+    {
+        std::lock_guard lock{m_Mutex};
+        if (!slotIndex) {
+            for (uint32_t i = 0; i < RING_SIZE; i++) {
+                if (!m_Slots[i].busy) {
+                    slotIndex = i;
+                    break;
+                }
+            }
+        }
+        if (!slotIndex) {
+            m_Stats.dropped++;
+            return;
+        }
+        m_Slots[*slotIndex].busy = true;
+    }
+
+    // Free slots belong to this thread, the worker only reads the busy ones
+    Slot &slot = m_Slots[*slotIndex];
+    const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    if (slot.size < size) {
+        destroyBuffer(slot);
+        deviceRef.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_MemoryProperties, slot.buffer, slot.memory);
+        void *data;
+        if (vkMapMemory(deviceRef.device(), slot.memory, 0, size, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to map capture buffer!");
+        }
+        slot.data = static_cast<const std::byte *>(data);
+        slot.size = size;
+    }
+    slot.extent = extent;
+    slot.format = format;
+    slot.frameValue = frameValue;
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+    // The host reads it once the frame's semaphore is signalled
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+    m_Recorded = slotIndex;
+}
+
+void FrameCapture::submit() {
+    if (!m_Recorded) {
+        return;
+    }
+    {
+        std::lock_guard lock{m_Mutex};
+        m_Queue.push_back(*std::exchange(m_Recorded, std::nullopt));
+    }
+    m_Condition.notify_one();
+}
+
+CaptureStats FrameCapture::getStats() const {
+    std::lock_guard lock{m_Mutex};
+    return m_Stats;
+}
+
+void FrameCapture::writeLoop(const std::stop_token &stopToken) {
+    CpuProfiler::setThreadName("Capture");
+    while (true) {
+        uint32_t slotIndex;
+        {
+            std::unique_lock lock{m_Mutex};
+            m_Condition.wait(lock, stopToken, [this] { return !m_Queue.empty(); });
+            // Stopping, but the submitted frames are still written
+            if (m_Queue.empty()) {
+                return;
+            }
+            slotIndex = m_Queue.front();
+            m_Queue.pop_front();
+        }
+
+        const Slot &slot = m_Slots[slotIndex];
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &m_FrameSemaphore;
+        waitInfo.pValues = &slot.frameValue;
+        const bool ready = vkWaitSemaphores(deviceRef.device(), &waitInfo, std::numeric_limits<uint64_t>::max()) == VK_SUCCESS;
+
+        bool written = false;
+        if (ready) {
+            try {
+                write(slot);
+                written = true;
+            } catch (const std::exception &exception) {
+                std::cout << "[Capture] " << exception.what() << '\n';
+            }
+        }
+
+        std::lock_guard lock{m_Mutex};
+        m_Slots[slotIndex].busy = false;
+        (written ? m_Stats.written : m_Stats.dropped)++;
+    }
+}
+
+void FrameCapture::write(const Slot &slot) {
+    CpuProfiler::Zone zone{"FrameCapture::write"};
+    const auto [width, height] = slot.extent;
+    const size_t size = static_cast<size_t>(width) * height * 4;
+
+    // Opaque RGBA whatever the image format, the alpha of the scene isn't meaningful
+    m_Pixels.resize(size);
+    std::memcpy(m_Pixels.data(), slot.data, size);
+    const bool bgra = isBgra(slot.format);
+    for (size_t i = 0; i < size; i += 4) {
+        if (bgra) {
+            std::swap(m_Pixels[i], m_Pixels[i + 2]);
+        }
+        m_Pixels[i + 3] = 255;
+    }
+
+    if (m_Format == CaptureFormat::Png) {
+        const std::filesystem::path path = m_Directory / std::format("frame_{:06}.png", slot.frameValue);
+        if (!stbi_write_png(path.string().c_str(), static_cast<int>(width), static_cast<int>(height), 4,
+                            m_Pixels.data(), static_cast<int>(width * 4))) {
+            throw std::runtime_error("Failed to write " + path.string());
+        }
+        return;
+    }
+
+    const std::filesystem::path path = m_Directory / std::format("frame_{:06}_{}x{}.raw", slot.frameValue, width, height);
+    std::ofstream file{path, std::ios::binary};
+    if (!file.write(reinterpret_cast<const char *>(m_Pixels.data()), static_cast<std::streamsize>(size))) {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+}
+
+void FrameCapture::destroyBuffer(Slot &slot) const {
+    if (slot.buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    vkUnmapMemory(deviceRef.device(), slot.memory);
+    vkDestroyBuffer(deviceRef.device(), slot.buffer, AllocationTracker::callbacks());
+    vkFreeMemory(deviceRef.device(), slot.memory, AllocationTracker::callbacks());
+    slot.buffer = VK_NULL_HANDLE;
+    slot.memory = VK_NULL_HANDLE;
+    slot.size = 0;
+    slot.data = nullptr;
+}
+
+} // Namespace KaguEngine
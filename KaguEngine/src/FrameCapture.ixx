@@ -0,0 +1,85 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.FrameCapture;
+
+// std
+import std;
+
+import KaguEngine.Device;
+
+export namespace KaguEngine {
+
+enum class CaptureFormat : uint8_t {
+    Png,
+    Raw // RGBA8 rows without a header, the size is in the file name
+};
+
+struct CaptureStats {
+    uint32_t written = 0;
+    uint32_t dropped = 0; // Every buffer was still waiting for its frame or being written
+};
+
+// Reads frames back through a ring of host visible buffers. The frame only records a copy, a worker thread
+// waits for the frame's timeline value and writes the file, so neither the CPU nor the GPU ever stalls on it.
+class FrameCapture {
+public:
+    static constexpr uint32_t RING_SIZE = 4;
+
+    // Captures every interval-th value of the frame timeline semaphore
+    FrameCapture(Device &device, VkSemaphore frameSemaphore, std::filesystem::path directory, uint32_t interval,
+                 CaptureFormat format);
+    ~FrameCapture(); // Writes the frames already submitted
+
+    // Non copyable
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    [[nodiscard]] static bool isSupported(VkFormat format);
+    [[nodiscard]] bool isDue(const uint64_t frameValue) const { return frameValue % m_Interval == 0; }
+
+    // Render thread: copies image, in the transfer source layout, to a free buffer. Dropped when none is.
+    void record(VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, VkFormat format, uint64_t frameValue);
+    // Render thread: the frame of the last copy was submitted, the worker can wait for it
+    void submit();
+
+    [[nodiscard]] CaptureStats getStats() const;
+
+private:
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        const std::byte *data = nullptr; // Persistently mapped
+        VkExtent2D extent{};
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint64_t frameValue = 0;
+        bool busy = false; // From record() until the worker wrote it
+    };
+
+    void writeLoop(const std::stop_token &stopToken);
+    void write(const Slot &slot);
+    void destroyBuffer(Slot &slot) const;
+
+    Device &deviceRef;
+    VkSemaphore m_FrameSemaphore;
+    std::filesystem::path m_Directory;
+    uint32_t m_Interval;
+    CaptureFormat m_Format;
+    VkMemoryPropertyFlags m_MemoryProperties;
+
+    std::array<Slot, RING_SIZE> m_Slots{};
+    std::optional<uint32_t> m_Recorded; // Copied by the frame being recorded, not submitted yet
+    std::vector<uint8_t> m_Pixels; // Worker only
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable_any m_Condition;
+    std::deque<uint32_t> m_Queue; // Submitted slots, in frame order
+    CaptureStats m_Stats{};
+
+    std::jthread m_Worker; // Last, so it's stopped before anything else goes away
+};
+
+} // Namespace KaguEngine
@@ -6,12 +6,16 @@ module;
 
 export module KaguEngine.FrameInfo;
 
-import KaguEngine.Camera;
-import KaguEngine.Entity;
+// std
+import std;
+
+import KaguEngine.Model;
+import KaguEngine.Pipeline;
+import KaguEngine.Texture;
 
 export namespace KaguEngine {
 
-constexpr int MAX_LIGHTS = 10;
+constexpr int MAX_LIGHTS = 10; // Passed to the shaders as a specialization constant
 
 struct PointLight {
     glm::vec4 position{}; // ignore w
@@ -23,17 +27,48 @@ struct GlobalUbo {
     glm::mat4 view{1.f};
     glm::mat4 inverseView{1.f};
     glm::vec4 ambientLightColor{0.2f, 0.2f, 0.2f, 1.f}; // w is intensity
-    PointLight pointLights[MAX_LIGHTS];
     int numLights;
+    alignas(16) PointLight pointLights[MAX_LIGHTS]; // Last, the shaders size it with a specialization constant
+};
+
+// Model and texture are owned by their entity, entities are only removed while the render thread is idle
+struct DrawItem {
+    glm::mat4 modelMatrix{1.f};
+    glm::vec3 color{1.f};
+    float alpha = 1.f;
+    Model *model = nullptr;
+    Texture *texture = nullptr; // The white texture when the entity has none
+    const Pipeline *pipeline = nullptr; // Permutation picked by the main thread, always compiled
+    RasterState rasterState{}; // Baked in the pipeline when the device can't set it per draw
+};
+
+struct LightItem {
+    glm::vec3 position{};
+    glm::vec3 color{};
+    float intensity = 1.f;
+    float radius = 0.1f;
+};
+
+// Copy of everything a frame draws, written by the main thread and only read by the render thread
+struct RenderPacket {
+    uint64_t frame = 0;
+    uint64_t residencyFrame = 0; // Of the touches, see ResidencyManager::frameSubmitted()
+    float frameTime = 0.f;
+    GlobalUbo ubo{};
+    glm::vec3 cameraPosition{0.f};
+    glm::vec4 clearColor{0.f};
+    std::vector<DrawItem> draws; // Cleared, not freed, every frame
+    std::vector<LightItem> lights;
+    bool benchmarkRecording = false;
 };
 
 struct FrameInfo {
     int frameIndex;
     float frameTime;
     VkCommandBuffer commandBuffer;
-    Camera &cameraRef;
     VkDescriptorSet globalDescriptorSet;
-    Entity::Map &sceneEntitiesRef;
+    const RenderPacket &packet;
+    VkExtent2D extent;
 };
 
-} // Namespace KaguEngine
+} // Namespace KaguEngine
\ No newline at end of file
@@ -0,0 +1,138 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.FramePacer;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the stats smoothing
+constexpr float statsSmoothing = 0.05f;
+
+void smooth(float &average, const float sample) {
+    average = average == 0.0f ? sample : std::lerp(average, sample, statsSmoothing);
+}
+}
+
+FramePacer::FramePacer(Device &device, const PacingMode mode) : deviceRef{device}, m_Mode{mode} {
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+
+    if (vkCreateSemaphore(deviceRef.device(), &semaphoreInfo,
+                          AllocationTracker::callbacks(), &m_Semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create frame timeline semaphore!");
+    }
+}
+
+FramePacer::~FramePacer() {
+    waitIdle();
+    vkDestroySemaphore(deviceRef.device(), m_Semaphore, AllocationTracker::callbacks());
+}
+
+const char *FramePacer::getModeName(const PacingMode mode) {
+    switch (mode) {
+        case PacingMode::LowLatency: return "Low latency";
+        case PacingMode::Throughput: return "Throughput";
+        case PacingMode::Uncapped:   return "Uncapped";
+        default:                     return "Unknown";
+    }
+}
+
+uint32_t FramePacer::getFramesInFlight(const PacingMode mode) {
+    return mode == PacingMode::LowLatency ? 1 : MAX_FRAMES_IN_FLIGHT;
+}
+
+void FramePacer::setMode(const PacingMode mode) {
+    if (mode == m_Mode) {
+        return;
+    }
+    m_Mode = mode;
+    m_ModeChanged = true;
+}
+
+void FramePacer::waitForFrameSlot() {
+    if (m_SlotReady) {
+        return;
+    }
+
+    // The slot's own resources must be free, and no more than framesInFlight - 1 frames may still run
+    const uint32_t frames = framesInFlight();
+    uint64_t waitValue = m_SlotValues[m_FrameIndex];
+    if (m_SubmittedValue >= frames) {
+        waitValue = std::max(waitValue, m_SubmittedValue - frames + 1);
+    }
+    waitForValue(waitValue);
+    collectLatencies();
+
+    const auto now = std::chrono::steady_clock::now();
+    if (m_InputTime != std::chrono::steady_clock::time_point{}) {
+        smooth(m_Stats[static_cast<size_t>(m_Mode)].frameTimeMs,
+               std::chrono::duration<float, std::milli>(now - m_InputTime).count());
+    }
+    m_InputTime = std::exchange(m_SampledInput, std::nullopt).value_or(now);
+    m_SlotReady = true;
+}
+
+void FramePacer::waitForInput() {
+    waitForValue(m_SubmittedValue);
+    m_SampledInput = std::chrono::steady_clock::now();
+}
+
+uint64_t FramePacer::beginSubmit() {
+    const uint64_t value = ++m_SubmittedValue;
+    m_SlotValues[m_FrameIndex] = value;
+    m_InFlight.push_back({value, m_Mode, m_InputTime});
+
+    m_FrameIndex = (m_FrameIndex + 1) % framesInFlight();
+    m_SlotReady = false;
+    return value;
+}
+
+uint64_t FramePacer::completedValue() const {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(deviceRef.device(), m_Semaphore, &completed);
+    return completed;
+}
+
+void FramePacer::waitForValue(const uint64_t value) const {
+    if (value == 0) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_Semaphore;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(deviceRef.device(), &waitInfo, std::numeric_limits<uint64_t>::max());
+}
+
+void FramePacer::collectLatencies() {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(deviceRef.device(), m_Semaphore, &completed);
+
+    // Completion is only observed here, so frames that finished earlier are measured a bit long
+    const auto now = std::chrono::steady_clock::now();
+    while (!m_InFlight.empty() && m_InFlight.front().value <= completed) {
+        const auto &[value, mode, inputTime] = m_InFlight.front();
+        auto &stats = m_Stats[static_cast<size_t>(mode)];
+        smooth(stats.latencyMs, std::chrono::duration<float, std::milli>(now - inputTime).count());
+        stats.frames++;
+        m_InFlight.pop_front();
+    }
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,93 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.FramePacer;
+
+// std
+import std;
+
+import KaguEngine.Device;
+
+export namespace KaguEngine {
+
+enum class PacingMode : uint8_t {
+    LowLatency, // 1 frame in flight, FIFO, waits for the GPU before sampling input
+    Throughput, // 3 frames in flight, MAILBOX
+    Uncapped,   // 3 frames in flight, IMMEDIATE, for benchmarking
+    Count
+};
+
+struct PacingStats {
+    float latencyMs = 0.0f;   // From input sampling to the GPU finishing the frame
+    float frameTimeMs = 0.0f;
+    uint64_t frames = 0;
+};
+
+// Limits how far the CPU runs ahead of the GPU, every frame submission signals one timeline semaphore
+class FramePacer {
+public:
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+    explicit FramePacer(Device &device, PacingMode mode = PacingMode::Throughput);
+    ~FramePacer();
+
+    // Non copyable
+    FramePacer(const FramePacer &) = delete;
+    FramePacer &operator=(const FramePacer &) = delete;
+
+    [[nodiscard]] static const char *getModeName(PacingMode mode);
+    [[nodiscard]] static uint32_t getFramesInFlight(PacingMode mode);
+
+    [[nodiscard]] PacingMode getMode()        const { return m_Mode; }
+    [[nodiscard]] uint32_t framesInFlight()   const { return getFramesInFlight(m_Mode); }
+    [[nodiscard]] uint32_t frameIndex()       const { return m_FrameIndex; }
+    [[nodiscard]] VkSemaphore semaphore()     const { return m_Semaphore; }
+    [[nodiscard]] uint64_t submittedValue()   const { return m_SubmittedValue; }
+    // Value of the last frame the GPU finished, doesn't wait
+    [[nodiscard]] uint64_t completedValue() const;
+    [[nodiscard]] const PacingStats &getStats(const PacingMode mode) const {
+        return m_Stats[static_cast<size_t>(mode)];
+    }
+
+    // The swap chain has to be recreated for the new present mode before the next frame
+    void setMode(PacingMode mode);
+    [[nodiscard]] bool consumeModeChange() { return std::exchange(m_ModeChanged, false); }
+
+    // Blocks until the next frame slot is free, does nothing if the slot was already waited for
+    void waitForFrameSlot();
+    // Main thread in low latency mode, before polling input, with the submitting thread idle. Waits for the last
+    // submitted frame, the next slot wait then returns right away and the latency counts from the input.
+    void waitForInput();
+    // Value the frame being submitted signals, moves on to the next slot
+    uint64_t beginSubmit();
+    void waitForValue(uint64_t value) const;
+    void waitIdle() const { waitForValue(m_SubmittedValue); }
+
+private:
+    struct InFlightFrame {
+        uint64_t value;
+        PacingMode mode;
+        std::chrono::steady_clock::time_point inputTime;
+    };
+
+    void collectLatencies();
+
+    Device &deviceRef;
+    PacingMode m_Mode;
+    bool m_ModeChanged = false;
+
+    VkSemaphore m_Semaphore;
+    uint64_t m_SubmittedValue = 0;
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> m_SlotValues{}; // Last value signalled by each slot
+    uint32_t m_FrameIndex = 0;
+    bool m_SlotReady = false;
+
+    std::chrono::steady_clock::time_point m_InputTime{};
+    std::optional<std::chrono::steady_clock::time_point> m_SampledInput; // Set by waitForInput()
+    std::deque<InFlightFrame> m_InFlight;
+    std::array<PacingStats, static_cast<size_t>(PacingMode::Count)> m_Stats{};
+};
+
+} // Namespace KaguEngine
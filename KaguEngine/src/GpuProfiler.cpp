@@ -0,0 +1,208 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.GpuProfiler;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+
+namespace KaguEngine {
+
+GpuProfiler::GpuProfiler(Device &device, const uint32_t framesInFlight) : deviceRef{device}, m_Slots(framesInFlight) {
+    if (!isSupported(device)) {
+        throw std::runtime_error("Failed to create GPU profiler: the graphics queue has no timestamps!");
+    }
+    const QuerySupport &support = device.getQuerySupport();
+    // Timestamps wrap around past their valid bits
+    m_TimestampMask = support.timestampValidBits >= 64 ? ~0ull : (1ull << support.timestampValidBits) - 1;
+    m_NanosecondsPerTick = support.timestampPeriod;
+    m_StatisticsValueCount = static_cast<uint32_t>(std::popcount(support.pipelineStatistics));
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = framesInFlight * MAX_SCOPES * 2;
+    if (vkCreateQueryPool(device.device(), &poolInfo, AllocationTracker::callbacks(), &m_TimestampPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
+
+    if (support.pipelineStatistics) {
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = framesInFlight * MAX_SCOPES;
+        poolInfo.pipelineStatistics = support.pipelineStatistics;
+        if (vkCreateQueryPool(device.device(), &poolInfo,
+                              AllocationTracker::callbacks(), &m_StatisticsPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline statistics query pool!");
+        }
+    }
+
+    for (FrameSlot &slot: m_Slots) {
+        slot.scopes.reserve(MAX_SCOPES);
+    }
+}
+
+GpuProfiler::~GpuProfiler() {
+    vkDestroyQueryPool(deviceRef.device(), m_StatisticsPool, AllocationTracker::callbacks());
+    vkDestroyQueryPool(deviceRef.device(), m_TimestampPool, AllocationTracker::callbacks());
+}
+
+void GpuProfiler::beginFrame(const VkCommandBuffer commandBuffer, const uint32_t frameIndex,
+                             const uint64_t frameValue) {
+    if (!m_OpenScopes.empty()) {
+        throw std::runtime_error("Failed to begin GPU profiler frame: a scope of the last one is still open!");
+    }
+
+    FrameSlot &slot = m_Slots[frameIndex];
+    if (slot.recorded) {
+        collect(slot, frameIndex);
+    }
+
+    vkCmdResetQueryPool(commandBuffer, m_TimestampPool, frameIndex * MAX_SCOPES * 2, MAX_SCOPES * 2);
+    if (m_StatisticsPool) {
+        vkCmdResetQueryPool(commandBuffer, m_StatisticsPool, frameIndex * MAX_SCOPES, MAX_SCOPES);
+    }
+    slot.frameValue = frameValue;
+    slot.recorded = false;
+    slot.scopes.clear();
+    slot.statisticsCount = 0;
+    m_Current = &slot;
+    m_CurrentIndex = frameIndex;
+}
+
+void GpuProfiler::beginScope(const VkCommandBuffer commandBuffer, const std::string_view name) {
+    if (!m_Current || m_Current->scopes.size() == MAX_SCOPES) {
+        m_OpenScopes.push_back(MAX_SCOPES);
+        return;
+    }
+
+    const auto index = static_cast<uint32_t>(m_Current->scopes.size());
+    ScopeQuery &scope = m_Current->scopes.emplace_back();
+    scope.name = name;
+    scope.depth = static_cast<uint32_t>(m_OpenScopes.size());
+    m_OpenScopes.push_back(index);
+
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, m_TimestampPool,
+                         (m_CurrentIndex * MAX_SCOPES + index) * 2);
+    if (m_StatisticsPool && scope.depth == 0) {
+        scope.statistics = m_Current->statisticsCount++;
+        vkCmdBeginQuery(commandBuffer, m_StatisticsPool, m_CurrentIndex * MAX_SCOPES + *scope.statistics, 0);
+    }
+}
+
+void GpuProfiler::endScope(const VkCommandBuffer commandBuffer) {
+    if (m_OpenScopes.empty()) {
+        throw std::runtime_error("Failed to end GPU profiler scope: none is open!");
+    }
+    const uint32_t index = m_OpenScopes.back();
+    m_OpenScopes.pop_back();
+    if (index == MAX_SCOPES) {
+        return;
+    }
+
+    const ScopeQuery &scope = m_Current->scopes[index];
+    if (scope.statistics) {
+        vkCmdEndQuery(commandBuffer, m_StatisticsPool, m_CurrentIndex * MAX_SCOPES + *scope.statistics);
+    }
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, m_TimestampPool,
+                         (m_CurrentIndex * MAX_SCOPES + index) * 2 + 1);
+    m_Current->recorded = true;
+}
+
+void GpuProfiler::collect(FrameSlot &slot, const uint32_t frameIndex) {
+    constexpr VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+    // Each query is followed by its availability, non zero once written
+    const auto readResults = [&](const VkQueryPool pool, const uint32_t firstQuery, const uint32_t queryCount,
+                                 const uint32_t valueCount) {
+        const uint32_t stride = valueCount + 1;
+        m_Results.assign(static_cast<size_t>(queryCount) * stride, 0);
+        const VkResult result = vkGetQueryPoolResults(deviceRef.device(), pool, firstQuery, queryCount,
+                                                      m_Results.size() * sizeof(uint64_t), m_Results.data(),
+                                                      stride * sizeof(uint64_t), flags);
+        if (result != VK_SUCCESS && result != VK_NOT_READY) {
+            throw std::runtime_error("Failed to read GPU profiler queries!");
+        }
+        for (uint32_t i = 0; i < queryCount; i++) {
+            if (m_Results[i * stride + valueCount] == 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // The slot's last frame was waited for before the slot came back, so this shouldn't miss
+    const auto scopeCount = static_cast<uint32_t>(slot.scopes.size());
+    if (!readResults(m_TimestampPool, frameIndex * MAX_SCOPES * 2, scopeCount * 2, 1)) {
+        m_DroppedFrames++;
+        return;
+    }
+
+    GpuFrameResult frame;
+    frame.frame = slot.frameValue;
+    frame.scopes.reserve(scopeCount);
+    std::optional<uint64_t> firstTimestamp;
+    uint64_t lastTimestamp = 0;
+    const auto toMilliseconds = [&](const uint64_t begin, const uint64_t end) {
+        return static_cast<double>((end - begin) & m_TimestampMask) * m_NanosecondsPerTick / 1e6;
+    };
+    for (uint32_t i = 0; i < scopeCount; i++) {
+        const uint64_t begin = m_Results[i * 4];
+        const uint64_t end = m_Results[i * 4 + 2];
+        GpuScopeResult &result = frame.scopes.emplace_back();
+        result.name = std::move(slot.scopes[i].name);
+        result.depth = slot.scopes[i].depth;
+        result.milliseconds = toMilliseconds(begin, end);
+        if (result.depth == 0) {
+            firstTimestamp = firstTimestamp.value_or(begin);
+            lastTimestamp = end;
+        }
+    }
+    if (firstTimestamp) {
+        frame.milliseconds = toMilliseconds(*firstTimestamp, lastTimestamp);
+    }
+
+    // Values in the order of the flag bits, the ones of QuerySupport
+    if (slot.statisticsCount > 0 &&
+        readResults(m_StatisticsPool, frameIndex * MAX_SCOPES, slot.statisticsCount, m_StatisticsValueCount)) {
+        const uint32_t stride = m_StatisticsValueCount + 1;
+        for (uint32_t i = 0; i < scopeCount; i++) {
+            if (const std::optional<uint32_t> query = slot.scopes[i].statistics) {
+                const uint64_t *values = m_Results.data() + static_cast<size_t>(*query) * stride;
+                frame.scopes[i].stats = GpuPipelineStats{values[0], values[1], values[2], values[3], values[4]};
+            }
+        }
+    }
+
+    m_History.push_back(std::move(frame));
+    if (m_History.size() > HISTORY_SIZE) {
+        m_History.pop_front();
+    }
+}
+
+void GpuProfiler::exportCsv(const std::filesystem::path &path) const {
+    std::ofstream file{path};
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path.string() + "!");
+    }
+
+    file << "frame,scope,depth,gpu_ms,input_vertices,input_primitives,vertex_invocations,clipping_primitives,"
+            "fragment_invocations\n";
+    for (const GpuFrameResult &frame: m_History) {
+        for (const GpuScopeResult &scope: frame.scopes) {
+            file << std::format("{},\"{}\",{},{:.4f}", frame.frame, scope.name, scope.depth, scope.milliseconds);
+            if (scope.stats) {
+                const GpuPipelineStats &stats = *scope.stats;
+                file << std::format(",{},{},{},{},{}\n", stats.inputVertices, stats.inputPrimitives,
+                                    stats.vertexInvocations, stats.clippingPrimitives, stats.fragmentInvocations);
+            } else {
+                file << ",,,,,\n";
+            }
+        }
+    }
+}
+
+} // Namespace KaguEngine
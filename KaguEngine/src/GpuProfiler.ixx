@@ -0,0 +1,128 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.GpuProfiler;
+
+// std
+import std;
+
+import KaguEngine.Device;
+
+export namespace KaguEngine {
+
+// Counted by the pipeline statistics queries, see QuerySupport
+struct GpuPipelineStats {
+    uint64_t inputVertices = 0;
+    uint64_t inputPrimitives = 0;
+    uint64_t vertexInvocations = 0;
+    uint64_t clippingPrimitives = 0; // Out of the clipper
+    uint64_t fragmentInvocations = 0;
+};
+
+struct GpuScopeResult {
+    std::string name;
+    uint32_t depth = 0; // 0 for the render graph passes
+    double milliseconds = 0.0;
+    std::optional<GpuPipelineStats> stats; // Top level scopes only
+};
+
+struct GpuFrameResult {
+    uint64_t frame = 0; // Value of the frame timeline semaphore
+    double milliseconds = 0.0; // From the first top level scope to the end of the last one
+    std::vector<GpuScopeResult> scopes; // In the order they began
+};
+
+// Named scopes timed with timestamp queries, one set of query pools per frame slot. A slot's results are read
+// when the slot is reused, its frame completed by then, so reading them never waits on the GPU.
+class GpuProfiler {
+public:
+    static constexpr uint32_t MAX_SCOPES = 64; // Per frame, the scopes past it aren't timed
+    static constexpr uint32_t HISTORY_SIZE = 240; // Frames kept for the UI and the CSV export
+
+    // Needs timestamps on the graphics queue, see isSupported()
+    GpuProfiler(Device &device, uint32_t framesInFlight);
+    ~GpuProfiler();
+
+    // Non copyable
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    [[nodiscard]] static bool isSupported(const Device &device) {
+        return device.getQuerySupport().timestampValidBits != 0;
+    }
+    [[nodiscard]] bool hasPipelineStatistics() const { return m_StatisticsPool != VK_NULL_HANDLE; }
+
+    // Render thread, before the frame's first scope and outside any rendering.
+    // Collects what frameIndex measured last time, then resets its queries for frameValue.
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint64_t frameValue);
+    // Scopes nest. Only the top level ones count pipeline statistics, one query of a type can be active at once.
+    // Not between a suspended rendering pass and the one resuming it.
+    void beginScope(VkCommandBuffer commandBuffer, std::string_view name);
+    void endScope(VkCommandBuffer commandBuffer);
+
+    // Ends with its C++ scope, does nothing with a null profiler
+    class Scope {
+    public:
+        Scope(GpuProfiler *profiler, const VkCommandBuffer commandBuffer, const std::string_view name) :
+            m_Profiler{profiler}, m_CommandBuffer{commandBuffer} {
+            if (m_Profiler) {
+                m_Profiler->beginScope(m_CommandBuffer, name);
+            }
+        }
+        ~Scope() {
+            if (m_Profiler) {
+                m_Profiler->endScope(m_CommandBuffer);
+            }
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        GpuProfiler *m_Profiler;
+        VkCommandBuffer m_CommandBuffer;
+    };
+
+    // The render thread must be idle
+    [[nodiscard]] const std::deque<GpuFrameResult> &getHistory() const { return m_History; }
+    [[nodiscard]] uint64_t getDroppedFrames() const { return m_DroppedFrames; }
+    // One line per scope of every frame in the history
+    void exportCsv(const std::filesystem::path &path) const;
+
+private:
+    struct ScopeQuery {
+        std::string name;
+        uint32_t depth = 0;
+        std::optional<uint32_t> statistics; // Index in the slot's statistics queries
+    };
+
+    struct FrameSlot {
+        uint64_t frameValue = 0;
+        bool recorded = false; // Queries written since the last reset
+        std::vector<ScopeQuery> scopes;
+        uint32_t statisticsCount = 0;
+    };
+
+    void collect(FrameSlot &slot, uint32_t frameIndex);
+
+    Device &deviceRef;
+    uint64_t m_TimestampMask;
+    double m_NanosecondsPerTick;
+    uint32_t m_StatisticsValueCount; // One per bit of the flags
+
+    VkQueryPool m_TimestampPool = VK_NULL_HANDLE; // 2 * MAX_SCOPES per slot, begin and end
+    VkQueryPool m_StatisticsPool = VK_NULL_HANDLE; // MAX_SCOPES per slot, null without statistics
+
+    std::vector<FrameSlot> m_Slots;
+    FrameSlot *m_Current = nullptr; // Between beginFrame() and the next one
+    uint32_t m_CurrentIndex = 0;
+    std::vector<uint32_t> m_OpenScopes; // Indices in m_Current->scopes, or MAX_SCOPES when not timed
+    std::vector<uint64_t> m_Results; // Readback scratch
+
+    std::deque<GpuFrameResult> m_History;
+    uint64_t m_DroppedFrames = 0; // Results not available when the slot came back
+};
+
+} // Namespace KaguEngine
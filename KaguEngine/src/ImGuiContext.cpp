@@ -11,11 +11,20 @@ module;
 
 module KaguEngine.ImGuiContext;
 
+import KaguEngine.AllocationTracker;
+import KaguEngine.Buffer;
 import KaguEngine.Camera;
+import KaguEngine.CommandRecorder;
+import KaguEngine.CpuProfiler;
 import KaguEngine.Device;
 import KaguEngine.Entity;
+import KaguEngine.FrameArena;
+import KaguEngine.FramePacer;
+import KaguEngine.GpuProfiler;
+import KaguEngine.PipelineCache;
 import KaguEngine.SwapChain;
 import KaguEngine.Renderer;
+import KaguEngine.Residency;
 import KaguEngine.Window;
 
 namespace KaguEngine {
@@ -100,6 +109,42 @@ namespace UI_Helpers {
     }
 }
 
+namespace { // Anonymous namespace for the draw data copies
+template<typename T>
+void copyVector(ImVector<T> &destination, const ImVector<T> &source) {
+    // resize() keeps the capacity, assigning an ImVector would reallocate it
+    destination.resize(source.Size);
+    if (source.Size > 0) {
+        std::memcpy(destination.Data, source.Data, source.size_in_bytes());
+    }
+}
+}
+
+void UiDrawData::capture(const ImDrawData &drawData) {
+    m_DrawData.Valid = drawData.Valid;
+    m_DrawData.CmdListsCount = drawData.CmdListsCount;
+    m_DrawData.TotalIdxCount = drawData.TotalIdxCount;
+    m_DrawData.TotalVtxCount = drawData.TotalVtxCount;
+    m_DrawData.DisplayPos = drawData.DisplayPos;
+    m_DrawData.DisplaySize = drawData.DisplaySize;
+    m_DrawData.FramebufferScale = drawData.FramebufferScale;
+    m_DrawData.OwnerViewport = drawData.OwnerViewport;
+
+    while (m_Lists.size() < static_cast<size_t>(drawData.CmdListsCount)) {
+        m_Lists.push_back(std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData()));
+    }
+    m_DrawData.CmdLists.resize(drawData.CmdListsCount);
+    for (int i = 0; i < drawData.CmdListsCount; i++) {
+        const ImDrawList &source = *drawData.CmdLists[i];
+        ImDrawList &list = *m_Lists[i];
+        copyVector(list.CmdBuffer, source.CmdBuffer);
+        copyVector(list.IdxBuffer, source.IdxBuffer);
+        copyVector(list.VtxBuffer, source.VtxBuffer);
+        list.Flags = source.Flags;
+        m_DrawData.CmdLists[i] = &list;
+    }
+}
+
 ImGuiContext::ImGuiContext(
     Window &window, SwapChain &swapChain, Device &device,
     std::unique_ptr<DescriptorPool> &pool,
@@ -167,9 +212,9 @@ void ImGuiContext::setupContext() const {
     init_info.Device = deviceRef.device();
     init_info.QueueFamily = indices.graphicsFamily;
     init_info.Queue = deviceRef.graphicsQueue();
-    init_info.PipelineCache = VK_NULL_HANDLE;
+    init_info.PipelineCache = deviceRef.pipelineCache().get();
     init_info.DescriptorPool = poolRef->getDescriptorPool();
-    init_info.Allocator = nullptr;
+    init_info.Allocator = AllocationTracker::callbacks();
     init_info.Subpass = 0;
     init_info.MSAASamples = deviceRef.getSampleCount();
     init_info.MinImageCount = 3;
@@ -178,7 +223,7 @@ void ImGuiContext::setupContext() const {
     init_info.PipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
     init_info.PipelineRenderingCreateInfo.colorAttachmentCount = 1;
     init_info.PipelineRenderingCreateInfo.pColorAttachmentFormats = swapChainRef.getSwapChainImageFormat();
-    init_info.PipelineRenderingCreateInfo.depthAttachmentFormat = swapChainRef.findDepthFormat();
+    init_info.PipelineRenderingCreateInfo.depthAttachmentFormat = SwapChain::findDepthFormat(deviceRef);
     ImGui_ImplVulkan_Init(&init_info);
     ImGui_ImplVulkan_CreateFontsTexture();
 }
@@ -230,14 +275,66 @@ void ImGuiContext::setStyleVars() {
     style.ButtonTextAlign   = ImVec2(0.5f, 0.5f);
 }
 
-void ImGuiContext::render(const Renderer& renderer, VkCommandBuffer commandBuffer) {
+void ImGuiContext::buildFrame(const Renderer& renderer, UiDrawData& output) {
+    std::scoped_lock lock{m_BackendMutex};
     beginRender();
     onRender(renderer);
     ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+    output.capture(*ImGui::GetDrawData());
     endRender();
 }
 
+void ImGuiContext::recordDrawData(UiDrawData& drawData, VkCommandBuffer commandBuffer) {
+    std::scoped_lock lock{m_BackendMutex};
+    if (ImDrawData* data = drawData.get()) {
+        ImGui_ImplVulkan_RenderDrawData(data, commandBuffer);
+    }
+}
+
+void ImGuiContext::syncFramePacer(FramePacer& framePacer) {
+    if (m_RequestedPacingMode) {
+        framePacer.setMode(*m_RequestedPacingMode);
+        m_RequestedPacingMode.reset();
+    }
+    m_PacingMode = framePacer.getMode();
+    for (int i = 0; i < static_cast<int>(PacingMode::Count); i++) {
+        m_PacingStats[i] = framePacer.getStats(static_cast<PacingMode>(i));
+    }
+}
+
+void ImGuiContext::syncGpuProfiler(const GpuProfiler* profiler) {
+    m_GpuProfilerAvailable = profiler != nullptr;
+    if (!profiler) {
+        return;
+    }
+    const uint64_t lastFrame = m_GpuFrames.empty() ? 0 : m_GpuFrames.back().frame;
+    for (const GpuFrameResult& frame : profiler->getHistory()) {
+        if (frame.frame > lastFrame) {
+            m_GpuFrames.push_back(frame);
+        }
+    }
+    while (m_GpuFrames.size() > GpuProfiler::HISTORY_SIZE) {
+        m_GpuFrames.pop_front();
+    }
+}
+
+void ImGuiContext::syncAllocations(const AllocationFrameStats& stats) {
+    m_Allocations.count = stats.count;
+    m_Allocations.bytes = stats.bytes;
+    m_Allocations.vulkanCount = stats.vulkanCount;
+    m_Allocations.vulkanBytes = stats.vulkanBytes;
+    m_Allocations.hotSpots = stats.hotSpots;
+    m_AllocationRows.resize(stats.tags.size());
+    for (size_t i = 0; i < stats.tags.size(); i++) {
+        m_AllocationRows[i].tag.assign(stats.tags[i].tag);
+        m_AllocationRows[i].count = stats.tags[i].count;
+        m_AllocationRows[i].bytes = stats.tags[i].bytes;
+        m_AllocationRows[i].hotSpot = stats.tags[i].hotSpot;
+    }
+    m_AllocationHistory[m_AllocationHistoryOffset] = static_cast<float>(stats.count);
+    m_AllocationHistoryOffset = (m_AllocationHistoryOffset + 1) % ALLOCATION_HISTORY_SIZE;
+}
+
 void ImGuiContext::beginRender() {
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -259,6 +356,8 @@ void ImGuiContext::onRender(const Renderer& renderer) {
     renderSceneHierarchyPanel();
     renderPropertiesPanel();
     renderVisualsPanel();
+    renderGpuProfilerPanel();
+    renderAllocationsPanel();
     renderConsole();
     renderStatusBar();
 }
@@ -340,6 +439,8 @@ void ImGuiContext::initializeDockspace(const ImGuiID& dockspace_id, const ImGuiV
     ImGui::DockBuilderDockWindow("Properties", dock_id_properties);
     ImGui::DockBuilderDockWindow("3D Scene", dock_id_viewport);
     ImGui::DockBuilderDockWindow("Visuals", dock_id_right);
+    ImGui::DockBuilderDockWindow("GPU Profiler", dock_id_right);
+    ImGui::DockBuilderDockWindow("Allocations", dock_id_right);
     ImGui::DockBuilderDockWindow("Console", dock_id_console);
 
     ImGui::DockBuilderFinish(dockspace_id);
@@ -381,7 +482,9 @@ void ImGuiContext::renderSceneHierarchyPanel() {
 
     if (ImGui::TreeNodeEx("Scene", ImGuiTreeNodeFlags_DefaultOpen)) {
         for (auto& [id, entity] : entitiesRef) {
-            std::string name = entity.pointLight != nullptr ? std::string(ICON_FA_LIGHTBULB_O) + " " : std::string(ICON_FA_CUBE) + " ";
+            std::pmr::string name{&FrameArena::get()};
+            name += entity.pointLight != nullptr ? ICON_FA_LIGHTBULB_O : ICON_FA_CUBE;
+            name += " ";
             name += entity.name;
 
             bool is_selected = (m_SelectedEntityID == id);
@@ -461,6 +564,197 @@ void ImGuiContext::renderVisualsPanel() {
     ImGui::ColorEdit4("Ambient Light", glm::value_ptr(ambientLightColorRef));
     ImGui::ColorEdit4("Clear color", glm::value_ptr(clearColorRef));
 
+    ImGui::Separator();
+
+    ImGui::Text("Frame pacing");
+    // The render thread owns the pacer, the mode is applied between two frames
+    int pacingMode = static_cast<int>(m_RequestedPacingMode.value_or(m_PacingMode));
+    if (ImGui::Combo("Mode", &pacingMode, "Low latency\0Throughput\0Uncapped\0")) {
+        m_RequestedPacingMode = static_cast<PacingMode>(pacingMode);
+    }
+    for (int i = 0; i < static_cast<int>(PacingMode::Count); i++) {
+        const auto mode = static_cast<PacingMode>(i);
+        const PacingStats& stats = m_PacingStats[i];
+        if (stats.frames == 0) {
+            continue;
+        }
+        ImGui::Text("%s (%u in flight): %.2f ms latency | %.2f ms frame", FramePacer::getModeName(mode),
+                    FramePacer::getFramesInFlight(mode), stats.latencyMs, stats.frameTimeMs);
+    }
+
+    if (ImGui::Button("Benchmark recording")) {
+        m_RecordingBenchmarkRequested = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Dump frame graphs")) { // System schedule and render graph
+        m_ScheduleDumpRequested = true;
+    }
+
+    ImGui::Separator();
+
+    ImGui::Text("Residency");
+    const ResidencyStats residency = deviceRef.residency().getStats();
+    int budgetMiB = static_cast<int>(residency.budget >> 20);
+    if (ImGui::DragInt("Budget (MiB)", &budgetMiB, 1.0f, 1, 16384)) {
+        deviceRef.residency().setBudget(static_cast<VkDeviceSize>(budgetMiB) << 20);
+    }
+    ImGui::Text("Resident: %.1f MiB (%u resources)", static_cast<double>(residency.residentBytes) / (1 << 20),
+                residency.residentCount);
+    ImGui::Text("Evicted: %u resources", residency.evictedCount);
+    ImGui::Text("Evictions: %llu | Refaults: %llu", static_cast<unsigned long long>(residency.evictions),
+                static_cast<unsigned long long>(residency.refaults));
+
+    const BufferTransferStats transfers = Buffer::getFrameStats();
+    ImGui::Text("Mapped writes: %.1f KiB | Flushed: %.1f KiB (%u calls)",
+                static_cast<double>(transfers.bytesWritten) / 1024.0,
+                static_cast<double>(transfers.bytesFlushed) / 1024.0, transfers.flushCalls);
+
+    const CommandStats commands = CommandRecorder::getFrameStats();
+    ImGui::Text("Draws: %u | Triangles: %llu", commands.draws, static_cast<unsigned long long>(commands.triangles));
+    ImGui::Text("Binds: %u pipelines, %u sets, %u buffers | Elided: %u", commands.pipelineBinds,
+                commands.descriptorSetBinds, commands.bufferBinds, commands.elided);
+    ImGui::Text("Push constants: %u calls, %.1f KiB", commands.pushConstantCalls,
+                static_cast<double>(commands.pushConstantBytes) / 1024.0);
+
+    const FrameArenaStats arena = FrameArena::getFrameStats();
+    ImGui::Text("Frame arena: %llu allocations, %.1f KiB | Heap fallbacks: %llu",
+                static_cast<unsigned long long>(arena.allocations),
+                static_cast<double>(arena.bytesAllocated) / 1024.0,
+                static_cast<unsigned long long>(arena.heapAllocations));
+
+    ImGui::End();
+}
+
+void ImGuiContext::renderGpuProfilerPanel() {
+    ImGui::Begin("GPU Profiler");
+
+    if (!m_GpuProfilerAvailable || m_GpuFrames.empty()) {
+        ImGui::TextUnformatted(m_GpuProfilerAvailable ? "Waiting for the first frames..."
+                                                      : "Disabled, or no timestamps on the graphics queue.");
+        ImGui::End();
+        return;
+    }
+
+    // Milliseconds of a scope in every frame of the history, oldest first. The whole frame without a name.
+    std::array<float, GpuProfiler::HISTORY_SIZE> values{};
+    const auto fillHistory = [&](const std::string_view name) {
+        int count = 0;
+        for (const GpuFrameResult& frame : m_GpuFrames) {
+            if (name.empty()) {
+                values[count++] = static_cast<float>(frame.milliseconds);
+                continue;
+            }
+            const auto scope = std::ranges::find(frame.scopes, name, &GpuScopeResult::name);
+            if (scope != frame.scopes.end()) {
+                values[count++] = static_cast<float>(scope->milliseconds);
+            }
+        }
+        return count;
+    };
+    const auto average = [&](const int count) {
+        return count ? std::accumulate(values.begin(), values.begin() + count, 0.0) / count : 0.0;
+    };
+
+    const GpuFrameResult& latest = m_GpuFrames.back();
+    int count = fillHistory({});
+    ImGui::Text("Frame %llu: %.3f ms | Average: %.3f ms", static_cast<unsigned long long>(latest.frame),
+                latest.milliseconds, average(count));
+    ImGui::PlotLines("##GpuFrame", values.data(), count, 0, nullptr, 0.f, std::numeric_limits<float>::max(),
+                     ImVec2(-1.f, 60.f));
+    if (ImGui::Button("Export CSV")) {
+        m_GpuProfileExportRequested = true;
+    }
+
+    // Per pass breakdown, the statistics only exist for the passes
+    const bool hasStats = std::ranges::any_of(latest.scopes, [](const GpuScopeResult& scope) {
+        return scope.stats.has_value();
+    });
+    if (ImGui::BeginTable("GpuScopes", hasStats ? 5 : 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Average");
+        if (hasStats) {
+            ImGui::TableSetupColumn("Primitives");
+            ImGui::TableSetupColumn("Fragments");
+        }
+        ImGui::TableHeadersRow();
+
+        for (const GpuScopeResult& scope : latest.scopes) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            const float indent = static_cast<float>(scope.depth) * ImGui::GetStyle().IndentSpacing;
+            if (indent > 0.f) { ImGui::Indent(indent); }
+            if (ImGui::Selectable(scope.name.c_str(), m_PlottedGpuScope == scope.name, ImGuiSelectableFlags_SpanAllColumns)) {
+                m_PlottedGpuScope = scope.name;
+            }
+            if (indent > 0.f) { ImGui::Unindent(indent); }
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", scope.milliseconds);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", average(fillHistory(scope.name)));
+            if (hasStats) {
+                ImGui::TableNextColumn();
+                if (scope.stats) { ImGui::Text("%llu", static_cast<unsigned long long>(scope.stats->clippingPrimitives)); }
+                ImGui::TableNextColumn();
+                if (scope.stats) { ImGui::Text("%llu", static_cast<unsigned long long>(scope.stats->fragmentInvocations)); }
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    if (!m_PlottedGpuScope.empty()) {
+        count = fillHistory(m_PlottedGpuScope);
+        ImGui::PlotLines("##GpuScope", values.data(), count, 0, m_PlottedGpuScope.c_str(), 0.f,
+                         std::numeric_limits<float>::max(), ImVec2(-1.f, 60.f));
+    }
+
+    ImGui::End();
+}
+
+void ImGuiContext::renderAllocationsPanel() {
+    ImGui::Begin("Allocations");
+
+    if constexpr (!AllocationTracker::ENABLED) {
+        ImGui::TextUnformatted("Build with KAGU_TRACK_ALLOCATIONS to count the heap allocations.");
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("Frame: %llu allocations, %.1f KiB", static_cast<unsigned long long>(m_Allocations.count),
+                static_cast<double>(m_Allocations.bytes) / 1024.0);
+    ImGui::Text("Vulkan: %llu allocations, %.1f KiB", static_cast<unsigned long long>(m_Allocations.vulkanCount),
+                static_cast<double>(m_Allocations.vulkanBytes) / 1024.0);
+    ImGui::PlotLines("##Allocations", m_AllocationHistory.data(), static_cast<int>(ALLOCATION_HISTORY_SIZE),
+                     static_cast<int>(m_AllocationHistoryOffset), nullptr, 0.f, std::numeric_limits<float>::max(),
+                     ImVec2(-1.f, 60.f));
+
+    // The steady state frame loop should allocate nothing, what does every frame is a hot spot
+    if (m_Allocations.hotSpots > 0) {
+        ImGui::TextColored(ImVec4(1.f, 0.4f, 0.3f, 1.f), "%u hot spot(s), allocating for %u frames in a row",
+                           m_Allocations.hotSpots, Config::allocationHotSpotFrames);
+    }
+    if (ImGui::BeginTable("AllocationTags", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Tag");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("KiB");
+        ImGui::TableHeadersRow();
+
+        for (const AllocationRow& row : m_AllocationRows) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (row.hotSpot) {
+                ImGui::TextColored(ImVec4(1.f, 0.4f, 0.3f, 1.f), "%s", row.tag.c_str());
+            } else {
+                ImGui::TextUnformatted(row.tag.c_str());
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(row.count));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", static_cast<double>(row.bytes) / 1024.0);
+        }
+        ImGui::EndTable();
+    }
+
     ImGui::End();
 }
 
@@ -541,6 +835,16 @@ void ImGuiContext::renderStatusBar() {
             ImGui::Text("|");
             ImGui::SameLine();
             UI_Helpers::ImGui_Text(Config::compiler);
+            ImGui::SameLine();
+            ImGui::Text("|");
+
+            // --- CPU Trace: written by the main loop once the frames are captured ---
+            ImGui::SameLine();
+            if (const uint32_t remainingFrames = CpuProfiler::getRemainingFrames(); remainingFrames > 0) {
+                ImGui::Text("Tracing, %u frames left", remainingFrames);
+            } else if (ImGui::SmallButton("CPU trace")) {
+                CpuProfiler::requestCapture(Config::cpuTraceFrames, Config::cpuTracePath);
+            }
 
             // --- Right Side: Frame Rate ---
             const std::string framerate = std::to_string(static_cast<int>(1.0f / ImGui::GetIO().DeltaTime)) + " FPS";
@@ -556,9 +860,11 @@ void ImGuiContext::renderStatusBar() {
     }
 }
 
-void ImGuiContext::endRender() {
+void ImGuiContext::endRender() const {
     ImGuiIO& io = ImGui::GetIO();
     if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+        // The other windows are submitted and presented right away, next to the render thread's frames
+        const auto queueLock = deviceRef.lockGraphicsQueue();
         ImGui::UpdatePlatformWindows();
         ImGui::RenderPlatformWindowsDefault();
     }
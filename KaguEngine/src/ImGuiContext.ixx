@@ -10,16 +10,37 @@ export module KaguEngine.ImGuiContext;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
 import KaguEngine.Camera;
 import KaguEngine.Descriptor;
 import KaguEngine.Device;
 import KaguEngine.Entity;
+import KaguEngine.FramePacer;
+import KaguEngine.GpuProfiler;
 import KaguEngine.SwapChain;
 import KaguEngine.Renderer;
 import KaguEngine.Window;
 
 export namespace KaguEngine {
 
+// Copy of a frame's ImGui draw data, recorded by the render thread while the main thread builds the next one.
+// The draw lists are kept, so their buffers only grow.
+class UiDrawData {
+public:
+    UiDrawData() = default;
+
+    // Non copyable
+    UiDrawData(const UiDrawData &) = delete;
+    UiDrawData &operator=(const UiDrawData &) = delete;
+
+    void capture(const ImDrawData &drawData);
+    [[nodiscard]] ImDrawData *get() { return m_DrawData.Valid ? &m_DrawData : nullptr; }
+
+private:
+    ImDrawData m_DrawData;
+    std::vector<std::unique_ptr<ImDrawList>> m_Lists;
+};
+
 class ImGuiContext {
 
 public:
@@ -32,7 +53,16 @@ public:
     ~ImGuiContext();
 
     static void recreateSwapChain() ;
-    void render(const Renderer& renderer, VkCommandBuffer commandBuffer);
+    // Main thread: builds the UI, renders the other platform windows and copies the draw data to output
+    void buildFrame(const Renderer& renderer, UiDrawData& output);
+    // Render thread
+    void recordDrawData(UiDrawData& drawData, VkCommandBuffer commandBuffer);
+    // Applies the pacing mode picked in the UI and copies the stats shown, the pacer must be idle
+    void syncFramePacer(FramePacer& framePacer);
+    // Copies the frames the GPU profiler read back since the last call, the render thread must be idle
+    void syncGpuProfiler(const GpuProfiler* profiler);
+    // Copies the allocations of the frame that just closed, see AllocationTracker::endFrame()
+    void syncAllocations(const AllocationFrameStats& stats);
 
     // Specs
     [[nodiscard]] float getDepth()                  const { return m_MaxDepth[m_CamIdx]; }
@@ -43,6 +73,9 @@ public:
     [[nodiscard]] glm::vec4& getAmbientLightColor() const { return ambientLightColorRef; }
     [[nodiscard]] glm::vec4& getClearColor()        const { return clearColorRef; }
     [[nodiscard]] bool isRunning()                  const { return m_IsRunning; }
+    [[nodiscard]] bool consumeRecordingBenchmark()        { return std::exchange(m_RecordingBenchmarkRequested, false); }
+    [[nodiscard]] bool consumeScheduleDump()              { return std::exchange(m_ScheduleDumpRequested, false); }
+    [[nodiscard]] bool consumeGpuProfileExport()          { return std::exchange(m_GpuProfileExportRequested, false); }
 
     // Console
     void addLog(const char* msg) { m_Items.emplace_back(msg); }
@@ -59,7 +92,7 @@ private:
     // --- Main Rendering Flow ---
     static void beginRender();
     void onRender(const Renderer& renderer);
-    static void endRender();
+    void endRender() const;
 
     // --- UI Panel Rendering ---
     static ImGuiViewport* setupViewport();
@@ -69,11 +102,20 @@ private:
     void renderSceneHierarchyPanel();
     void renderPropertiesPanel();
     void renderVisualsPanel();
+    void renderGpuProfilerPanel();
+    void renderAllocationsPanel();
     void renderConsole();
     void renderStatusBar();
 
     // --- State ---
     bool m_IsRunning = true;
+    bool m_RecordingBenchmarkRequested = false;
+    bool m_ScheduleDumpRequested = false;
+    bool m_GpuProfileExportRequested = false;
+    std::optional<PacingMode> m_RequestedPacingMode;
+    PacingMode m_PacingMode = PacingMode::Throughput;
+    std::array<PacingStats, static_cast<size_t>(PacingMode::Count)> m_PacingStats{};
+    std::mutex m_BackendMutex; // Building a frame and recording one both go through the Vulkan backend
     Entity::id_t m_SelectedEntityID = std::numeric_limits<Entity::id_t>::max();
 
     // --- Lvalue References to Engine State ---
@@ -93,6 +135,24 @@ private:
     std::vector<float> m_FovX = { 90.f, 90.f };
     int m_CamIdx = 0;
 
+    // --- GPU Profiler State ---
+    bool m_GpuProfilerAvailable = false;
+    std::deque<GpuFrameResult> m_GpuFrames; // Oldest first, up to GpuProfiler::HISTORY_SIZE
+    std::string m_PlottedGpuScope; // Its history is plotted under the breakdown
+
+    // --- Allocation Tracker State ---
+    struct AllocationRow {
+        std::string tag;
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+        bool hotSpot = false;
+    };
+    static constexpr size_t ALLOCATION_HISTORY_SIZE = 240;
+    AllocationFrameStats m_Allocations; // Without the tags, they're copied to the rows
+    std::vector<AllocationRow> m_AllocationRows; // Reused, so syncing doesn't allocate once they all exist
+    std::array<float, ALLOCATION_HISTORY_SIZE> m_AllocationHistory{}; // Allocations per frame, a ring
+    size_t m_AllocationHistoryOffset = 0;
+
     // --- Console State ---
     bool m_ConsoleOpened = true;
     char m_InputBuffer[256] = "";
@@ -0,0 +1,408 @@
+module;
+
+// libs
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+module KaguEngine.JobSystem;
+
+// std
+import std;
+
+import KaguEngine.CpuProfiler;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the calling thread's worker identity
+
+thread_local const JobSystem *workerSystem = nullptr;
+thread_local uint32_t workerIndex = JobSystem::INVALID_WORKER;
+thread_local uint32_t stealSeed = 1;
+
+// xorshift32, only used to spread the thieves over the victims
+uint32_t nextStealSeed() {
+    stealSeed ^= stealSeed << 13;
+    stealSeed ^= stealSeed >> 17;
+    stealSeed ^= stealSeed << 5;
+    return stealSeed;
+}
+
+// Best effort, the scheduler works the same when the OS doesn't allow it
+void pinToCore(std::jthread &thread, const uint32_t core) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{1} << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)core;
+#endif
+}
+
+} // Anonymous namespace
+
+// --- WorkQueue ---
+
+bool JobSystem::WorkQueue::push(Job *job) {
+    const int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+    const int64_t top = m_Top.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY) {
+        return false;
+    }
+    m_Jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    m_Bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+Job *JobSystem::WorkQueue::pop() {
+    const int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+    m_Bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_Top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        // Empty
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = m_Jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // Last job, thieves may be racing for it
+        if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job *JobSystem::WorkQueue::steal(bool &failed) {
+    int64_t top = m_Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    Job *job = m_Jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        failed = true;
+        return nullptr;
+    }
+    return job;
+}
+
+// --- JobSystem ---
+
+JobSystem::JobSystem(const uint32_t workerCount) {
+    if (workerSystem != nullptr) {
+        throw std::runtime_error("Failed to create job system, the calling thread already is a worker!");
+    }
+
+    const uint32_t count = workerCount != 0 ? workerCount : std::max(1u, std::thread::hardware_concurrency());
+    m_States.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        m_States.push_back(std::make_unique<WorkerState>());
+    }
+
+    workerSystem = this;
+    workerIndex = 0;
+
+    // The creating thread keeps its affinity, the others get a core each
+    m_Workers.reserve(count - 1);
+    for (uint32_t i = 1; i < count; i++) {
+        m_Workers.emplace_back([this, i] { workerLoop(i); });
+        pinToCore(m_Workers.back(), i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    m_Stopping.store(true, std::memory_order_seq_cst);
+    m_QueuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    m_QueuedJobs.notify_all();
+    m_Workers.clear();
+
+    // Jobs nobody waited for
+    for (const auto &state: m_States) {
+        while (const Job *job = state->queue.pop()) {
+            delete job;
+        }
+    }
+    for (const Job *job: m_Injected) {
+        delete job;
+    }
+    for (const Job *job: m_Background) {
+        delete job;
+    }
+
+    workerSystem = nullptr;
+    workerIndex = INVALID_WORKER;
+}
+
+uint32_t JobSystem::getWorkerIndex() {
+    return workerIndex;
+}
+
+uint32_t JobSystem::currentWorker() const {
+    return workerSystem == this ? workerIndex : INVALID_WORKER;
+}
+
+JobSystemStats JobSystem::getStats() const {
+    JobSystemStats stats{};
+    for (const auto &state: m_States) {
+        stats.executed += state->executed.load(std::memory_order_relaxed);
+        stats.stolen += state->stolen.load(std::memory_order_relaxed);
+        stats.failedSteals += state->failedSteals.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void JobSystem::schedule(JobCounter &counter, Task task) {
+    counter.m_Pending.fetch_add(1, std::memory_order_relaxed);
+    enqueue(new Job{std::move(task), &counter});
+}
+
+void JobSystem::scheduleBackground(JobCounter &counter, Task task) {
+    if (getWorkerCount() == 1) {
+        // Nobody else would ever run it
+        schedule(counter, std::move(task));
+        return;
+    }
+
+    counter.m_Pending.fetch_add(1, std::memory_order_relaxed);
+    counter.m_Background.store(true, std::memory_order_relaxed);
+    {
+        std::scoped_lock lock{m_BackgroundMutex};
+        m_Background.push_back(new Job{std::move(task), &counter});
+        m_HasBackground.store(true, std::memory_order_release);
+    }
+
+    m_QueuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    if (m_SleepingWorkers.load(std::memory_order_seq_cst) != 0) {
+        m_QueuedJobs.notify_one();
+    }
+}
+
+void JobSystem::scheduleAfter(JobCounter &dependency, JobCounter &counter, Task task) {
+    counter.m_Pending.fetch_add(1, std::memory_order_relaxed);
+    auto *job = new Job{std::move(task), &counter};
+    {
+        // The last decrement happens under this lock, the dependency can't complete in between
+        std::scoped_lock lock{dependency.m_Mutex};
+        if (dependency.m_Pending.load(std::memory_order_acquire) != 0) {
+            dependency.m_Continuations.push_back(job);
+            return;
+        }
+    }
+    enqueue(job);
+}
+
+void JobSystem::wait(const JobCounter &counter) {
+    const uint32_t index = currentWorker();
+    const bool background = counter.m_Background.load(std::memory_order_relaxed);
+    while (!counter.isDone()) {
+        Job *job = findJob(index);
+        if (job == nullptr && background) {
+            job = findBackgroundJob();
+        }
+        if (job != nullptr) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    // The thread that released the counter may still be unlocking it
+    std::scoped_lock lock{counter.m_Mutex};
+}
+
+bool JobSystem::tryRunJob() {
+    Job *job = findJob(currentWorker());
+    if (job == nullptr) {
+        return false;
+    }
+    execute(job);
+    return true;
+}
+
+void JobSystem::parallelFor(const uint32_t count, const RangeFunction &function, uint32_t grain) {
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        // A few chunks per worker leaves room to rebalance without drowning in tiny jobs
+        grain = std::max(1u, count / (getWorkerCount() * 4));
+    }
+    if (count <= grain) {
+        function(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    splitRange(counter, function, 0, count, grain);
+    wait(counter);
+}
+
+void JobSystem::splitRange(JobCounter &counter, const RangeFunction &function, const uint32_t begin, uint32_t end,
+                           const uint32_t grain) {
+    // Hands out the upper half and keeps halving the lower one, the oldest jobs thieves take are the biggest
+    while (end - begin > grain) {
+        const uint32_t middle = begin + (end - begin) / 2;
+        schedule(counter, [this, &counter, &function, middle, end, grain] {
+            splitRange(counter, function, middle, end, grain);
+        });
+        end = middle;
+    }
+    function(begin, end);
+}
+
+void JobSystem::workerLoop(const uint32_t index) {
+    workerSystem = this;
+    workerIndex = index;
+    stealSeed = index * 0x9E3779B9u;
+    CpuProfiler::setThreadName(std::format("Worker {}", index));
+
+    while (!m_Stopping.load(std::memory_order_acquire)) {
+        // Frame work first, a background job only starts on a worker that has nothing else to do
+        Job *job = findJob(index);
+        if (job == nullptr) {
+            job = findBackgroundJob();
+        }
+        if (job != nullptr) {
+            execute(job);
+            continue;
+        }
+        if (m_QueuedJobs.load(std::memory_order_seq_cst) != 0) {
+            // Queued but not visible yet, or another thief got there first
+            std::this_thread::yield();
+            continue;
+        }
+
+        m_SleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        m_QueuedJobs.wait(0, std::memory_order_seq_cst);
+        m_SleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void JobSystem::enqueue(Job *job) {
+    if (const uint32_t index = currentWorker(); index != INVALID_WORKER) {
+        if (!m_States[index]->queue.push(job)) {
+            // Deque full, running the job right away keeps memory bounded
+            m_QueuedJobs.fetch_add(1, std::memory_order_relaxed);
+            execute(job);
+            return;
+        }
+    } else {
+        std::scoped_lock lock{m_InjectedMutex};
+        m_Injected.push_back(job);
+        m_HasInjected.store(true, std::memory_order_release);
+    }
+
+    // Pairs with the sleeping worker incrementing m_SleepingWorkers before checking m_QueuedJobs
+    m_QueuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    if (m_SleepingWorkers.load(std::memory_order_seq_cst) != 0) {
+        m_QueuedJobs.notify_one();
+    }
+}
+
+Job *JobSystem::findJob(const uint32_t index) {
+    if (index != INVALID_WORKER) {
+        if (Job *job = m_States[index]->queue.pop()) {
+            return job;
+        }
+    }
+
+    if (m_HasInjected.load(std::memory_order_acquire)) {
+        std::scoped_lock lock{m_InjectedMutex};
+        if (!m_Injected.empty()) {
+            Job *job = m_Injected.front();
+            m_Injected.pop_front();
+            m_HasInjected.store(!m_Injected.empty(), std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    // Starts at a random victim so thieves don't all hammer the same deque
+    const uint32_t count = getWorkerCount();
+    const uint32_t start = nextStealSeed() % count;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t victim = (start + i) % count;
+        if (victim == index) {
+            continue;
+        }
+
+        bool failed = false;
+        Job *job = m_States[victim]->queue.steal(failed);
+        if (index != INVALID_WORKER) {
+            auto &counter = job != nullptr ? m_States[index]->stolen : m_States[index]->failedSteals;
+            if (job != nullptr || failed) {
+                counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+        if (job != nullptr) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+Job *JobSystem::findBackgroundJob() {
+    if (!m_HasBackground.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    std::scoped_lock lock{m_BackgroundMutex};
+    if (m_Background.empty()) {
+        return nullptr;
+    }
+    Job *job = m_Background.front();
+    m_Background.pop_front();
+    m_HasBackground.store(!m_Background.empty(), std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::execute(Job *job) {
+    m_QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    job->task();
+
+    JobCounter &counter = *job->counter;
+    delete job;
+    release(counter);
+
+    if (const uint32_t index = currentWorker(); index != INVALID_WORKER) {
+        auto &executed = m_States[index]->executed;
+        executed.store(executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+void JobSystem::release(JobCounter &counter) {
+    // Any decrement but the last one skips the lock
+    uint32_t pending = counter.m_Pending.load(std::memory_order_relaxed);
+    while (pending > 1) {
+        if (counter.m_Pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel,
+                                                    std::memory_order_relaxed)) {
+            return;
+        }
+    }
+
+    std::vector<Job *> continuations;
+    {
+        std::scoped_lock lock{counter.m_Mutex};
+        if (counter.m_Pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            continuations.swap(counter.m_Continuations);
+        }
+    }
+    for (Job *job: continuations) {
+        enqueue(job);
+    }
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,138 @@
+export module KaguEngine.JobSystem;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+class JobCounter;
+
+// Unit of work handed to the job system
+struct Job {
+    std::move_only_function<void()> task;
+    JobCounter *counter;
+};
+
+// Number of unfinished jobs, waiting on it runs other jobs instead of blocking the thread.
+// Jobs scheduled after a counter are released by the thread bringing it to zero.
+class JobCounter {
+public:
+    JobCounter() = default;
+
+    // Non copyable
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    [[nodiscard]] bool isDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+    [[nodiscard]] uint32_t pending() const { return m_Pending.load(std::memory_order_relaxed); }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> m_Pending{0};
+    std::atomic<bool> m_Background{false}; // Had background jobs, waiting on it may run them
+    mutable std::mutex m_Mutex; // Guards the continuations and the last decrement
+    std::vector<Job *> m_Continuations;
+};
+
+struct JobSystemStats {
+    uint64_t executed = 0;
+    uint64_t stolen = 0;
+    uint64_t failedSteals = 0; // Lost the race on a victim's last job
+};
+
+// Fixed pool of workers, one per core, each owning a Chase-Lev deque it pushes and pops at the bottom
+// while idle workers steal the oldest jobs from the top. The thread creating the system is worker 0
+// and takes part whenever it waits on a counter.
+class JobSystem {
+public:
+    using Task = decltype(Job::task);
+    // Processes the items [begin, end)
+    using RangeFunction = std::function<void(uint32_t begin, uint32_t end)>;
+
+    static constexpr uint32_t INVALID_WORKER = ~0u;
+
+    // workerCount includes the calling thread, 0 uses every hardware thread
+    explicit JobSystem(uint32_t workerCount = 0);
+    ~JobSystem();
+
+    // Non copyable
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    [[nodiscard]] uint32_t getWorkerCount() const { return static_cast<uint32_t>(m_States.size()); }
+    // Index of the calling thread in [0, getWorkerCount()), INVALID_WORKER outside the system
+    [[nodiscard]] static uint32_t getWorkerIndex();
+    [[nodiscard]] JobSystemStats getStats() const;
+
+    // counter is incremented now and decremented once task returned
+    void schedule(JobCounter &counter, Task task);
+    // Long jobs no frame should wait behind, only taken by idle workers and by waits on their own counter.
+    // Falls back to schedule() when the calling thread is the only worker.
+    void scheduleBackground(JobCounter &counter, Task task);
+    // Same, but task only becomes runnable once dependency reached zero
+    void scheduleAfter(JobCounter &dependency, JobCounter &counter, Task task);
+    // Runs jobs until counter reaches zero, a counter must be waited on before it's destroyed
+    void wait(const JobCounter &counter);
+    // Runs one queued job, false when there was none to take. Never a background one.
+    bool tryRunJob();
+    // Splits [0, count) in halves until they are grain items or less, thieves taking the biggest halves.
+    // A grain of 0 picks one from count and the worker count. Returns once every item was processed.
+    void parallelFor(uint32_t count, const RangeFunction &function, uint32_t grain = 0);
+
+private:
+    // Bounded Chase-Lev deque (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models")
+    class WorkQueue {
+    public:
+        static constexpr int64_t CAPACITY = 4096;
+
+        // Owner only, false when full
+        bool push(Job *job);
+        // Owner only, newest job first
+        Job *pop();
+        // Any thread, oldest job first, failed is set when another thread won the race for it
+        Job *steal(bool &failed);
+
+    private:
+        alignas(64) std::atomic<int64_t> m_Top{0};
+        alignas(64) std::atomic<int64_t> m_Bottom{0};
+        std::array<std::atomic<Job *>, CAPACITY> m_Jobs{};
+    };
+
+    // Only written by the owning worker, so counting doesn't bounce cache lines between cores
+    struct alignas(64) WorkerState {
+        WorkQueue queue;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> failedSteals{0};
+    };
+
+    // Index of the calling thread in this system, INVALID_WORKER for threads of another one
+    [[nodiscard]] uint32_t currentWorker() const;
+    void workerLoop(uint32_t workerIndex);
+    void enqueue(Job *job);
+    [[nodiscard]] Job *findJob(uint32_t workerIndex);
+    [[nodiscard]] Job *findBackgroundJob();
+    void execute(Job *job);
+    void release(JobCounter &counter);
+    void splitRange(JobCounter &counter, const RangeFunction &function, uint32_t begin, uint32_t end, uint32_t grain);
+
+    std::vector<std::unique_ptr<WorkerState>> m_States;
+    // Jobs scheduled from threads that aren't workers
+    std::mutex m_InjectedMutex;
+    std::deque<Job *> m_Injected;
+    std::atomic<bool> m_HasInjected{false};
+    // Background jobs, FIFO so compiles finish in submission order
+    std::mutex m_BackgroundMutex;
+    std::deque<Job *> m_Background;
+    std::atomic<bool> m_HasBackground{false};
+
+    // Jobs queued and not started yet, idle workers sleep on it
+    std::atomic<uint32_t> m_QueuedJobs{0};
+    std::atomic<uint32_t> m_SleepingWorkers{0};
+    std::atomic<bool> m_Stopping{false};
+
+    std::vector<std::jthread> m_Workers; // Last, so they are stopped before anything else goes away
+};
+
+} // Namespace KaguEngine
@@ -0,0 +1,350 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cassert>
+
+module KaguEngine.Memory;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for internal helpers
+VkDeviceSize alignUp(const VkDeviceSize value, const VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+MemoryAllocator::MemoryAllocator(const VkPhysicalDevice physicalDevice, const VkDevice device,
+                                 const VkDeviceSize blockSize) :
+    m_Device{device}, m_BlockSize{blockSize} {
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_MemoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_NonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+}
+
+MemoryAllocator::~MemoryAllocator() {
+    for (auto &block: m_Blocks | std::views::values) {
+        if (block.mapped) {
+            vkUnmapMemory(m_Device, block.memory);
+        }
+        vkFreeMemory(m_Device, block.memory, AllocationTracker::callbacks());
+    }
+    m_Blocks.clear();
+}
+
+uint32_t MemoryAllocator::findMemoryType(const uint32_t typeFilter, const VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++) {
+        if (typeFilter & 1 << i && (m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+bool MemoryAllocator::isHostCoherent(const uint32_t memoryTypeIndex) const {
+    return m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+bool MemoryAllocator::isNonCoherent(const uint32_t memoryTypeIndex) const {
+    const auto flags = m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                     const VkMemoryPropertyFlags properties, const bool linear,
+                                     Relocatable *owner) {
+    const uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+    VkDeviceSize size = requirements.size;
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    // Flushes and invalidations work on whole atoms, so non-coherent ranges never share one
+    if (isNonCoherent(memoryTypeIndex)) {
+        alignment = std::max(alignment, m_NonCoherentAtomSize);
+        size = alignUp(size, m_NonCoherentAtomSize);
+    }
+
+    std::scoped_lock lock{m_Mutex};
+
+    // Resources larger than half a block get their own memory
+    if (size > m_BlockSize / 2) {
+        Block &block = createBlock(memoryTypeIndex, linear, size, true);
+        takeRange(block, 0, size);
+        block.allocations.emplace(0, Suballocation{size, alignment, owner});
+        block.usedBytes += size;
+        return makeAllocation(m_NextBlockId - 1, block, 0);
+    }
+
+    for (auto &[blockId, block]: m_Blocks) {
+        if (block.dedicated || block.memoryTypeIndex != memoryTypeIndex || block.linear != linear) {
+            continue;
+        }
+        if (const auto offset = findFreeRange(block, size, alignment)) {
+            takeRange(block, *offset, size);
+            block.allocations.emplace(*offset, Suballocation{size, alignment, owner});
+            block.usedBytes += size;
+            return makeAllocation(blockId, block, *offset);
+        }
+    }
+
+    Block &block = createBlock(memoryTypeIndex, linear, m_BlockSize, false);
+    takeRange(block, 0, size);
+    block.allocations.emplace(0, Suballocation{size, alignment, owner});
+    block.usedBytes += size;
+    return makeAllocation(m_NextBlockId - 1, block, 0);
+}
+
+void MemoryAllocator::free(const Allocation &allocation) {
+    if (!allocation.isValid()) {
+        return;
+    }
+
+    std::scoped_lock lock{m_Mutex};
+
+    const auto blockIt = m_Blocks.find(allocation.blockId);
+    assert(blockIt != m_Blocks.end() && "Freeing an allocation from an unknown block");
+    Block &block = blockIt->second;
+
+    const auto it = block.allocations.find(allocation.offset);
+    assert(it != block.allocations.end() && "Freeing an unknown allocation");
+    // The copy still reads it, completeMove() hands it back to the Defragmenter to free
+    if (it->second.moving) {
+        it->second.owner = nullptr;
+        m_CancelledMoves.try_emplace(std::pair{allocation.blockId, allocation.offset});
+        return;
+    }
+
+    const VkDeviceSize size = it->second.size;
+    block.allocations.erase(it);
+    block.usedBytes -= size;
+    returnRange(block, allocation.offset, size);
+
+    if (block.allocations.empty()) {
+        releaseBlock(allocation.blockId);
+    }
+}
+
+MemoryStats MemoryAllocator::getStats() const {
+    std::scoped_lock lock{m_Mutex};
+
+    MemoryStats stats{};
+    stats.releasedBytes = m_ReleasedBytes;
+    for (const auto &block: m_Blocks | std::views::values) {
+        stats.blockCount++;
+        stats.allocationCount += static_cast<uint32_t>(block.allocations.size());
+        stats.reservedBytes += block.size;
+        stats.usedBytes += block.usedBytes;
+    }
+    return stats;
+}
+
+std::vector<MemoryBlockInfo> MemoryAllocator::getBlocks() const {
+    std::scoped_lock lock{m_Mutex};
+
+    std::vector<MemoryBlockInfo> blocks;
+    blocks.reserve(m_Blocks.size());
+    for (const auto &[blockId, block]: m_Blocks) {
+        VkDeviceSize relocatableBytes = 0;
+        for (const auto &suballocation: block.allocations | std::views::values) {
+            if (suballocation.owner != nullptr) {
+                relocatableBytes += suballocation.size;
+            }
+        }
+        blocks.push_back({blockId, block.memoryTypeIndex, block.linear, block.size, block.usedBytes, relocatableBytes});
+    }
+    return blocks;
+}
+
+std::vector<std::pair<Allocation, Relocatable *>> MemoryAllocator::getRelocatables(const uint32_t blockId) const {
+    std::scoped_lock lock{m_Mutex};
+
+    std::vector<std::pair<Allocation, Relocatable *>> relocatables;
+    const auto blockIt = m_Blocks.find(blockId);
+    if (blockIt == m_Blocks.end()) {
+        return relocatables;
+    }
+
+    for (const auto &[offset, suballocation]: blockIt->second.allocations) {
+        if (suballocation.owner != nullptr && !suballocation.moving) {
+            relocatables.emplace_back(makeAllocation(blockId, blockIt->second, offset), suballocation.owner);
+        }
+    }
+    return relocatables;
+}
+
+std::optional<Allocation> MemoryAllocator::allocateForMove(const Allocation &source,
+                                                           const std::span<const uint32_t> excludedBlocks) {
+    std::scoped_lock lock{m_Mutex};
+
+    const Block &sourceBlock = m_Blocks.at(source.blockId);
+    const Suballocation &suballocation = sourceBlock.allocations.at(source.offset);
+
+    // Fill the fullest blocks first so the sparse ones can drain completely
+    std::vector<std::pair<uint32_t, Block *>> targets;
+    for (auto &[blockId, block]: m_Blocks) {
+        if (block.dedicated || block.memoryTypeIndex != sourceBlock.memoryTypeIndex ||
+            block.linear != sourceBlock.linear || std::ranges::contains(excludedBlocks, blockId)) {
+            continue;
+        }
+        targets.emplace_back(blockId, &block);
+    }
+    std::ranges::sort(targets, std::greater{}, [](const auto &target) { return target.second->usedBytes; });
+
+    for (auto &[blockId, block]: targets) {
+        if (const auto offset = findFreeRange(*block, suballocation.size, suballocation.alignment)) {
+            takeRange(*block, *offset, suballocation.size);
+            block->allocations.emplace(*offset, Suballocation{suballocation.size, suballocation.alignment,
+                                                              suballocation.owner});
+            block->usedBytes += suballocation.size;
+            return makeAllocation(blockId, *block, *offset);
+        }
+    }
+    return std::nullopt;
+}
+
+void MemoryAllocator::beginMove(const Allocation &source) {
+    std::scoped_lock lock{m_Mutex};
+    m_Blocks.at(source.blockId).allocations.at(source.offset).moving = true;
+}
+
+void MemoryAllocator::cancelMove(const Allocation &source, std::function<void()> destroy) {
+    free(source);
+
+    std::scoped_lock lock{m_Mutex};
+    const auto it = m_CancelledMoves.find({source.blockId, source.offset});
+    assert(it != m_CancelledMoves.end() && "Cancelling a move that isn't in flight");
+    it->second = std::move(destroy);
+}
+
+bool MemoryAllocator::completeMove(const Allocation &source, std::function<void()> &destroyCancelled) {
+    std::scoped_lock lock{m_Mutex};
+
+    // The source now only holds the stale copy, it can't be moved again
+    auto &suballocation = m_Blocks.at(source.blockId).allocations.at(source.offset);
+    suballocation.moving = false;
+    suballocation.owner = nullptr;
+
+    if (const auto it = m_CancelledMoves.find({source.blockId, source.offset}); it != m_CancelledMoves.end()) {
+        destroyCancelled = std::move(it->second);
+        m_CancelledMoves.erase(it);
+        return false;
+    }
+    return true;
+}
+
+Allocation MemoryAllocator::makeAllocation(const uint32_t blockId, const Block &block,
+                                           const VkDeviceSize offset) const {
+    Allocation allocation{};
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = block.allocations.at(offset).size;
+    allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + offset : nullptr;
+    allocation.memoryTypeIndex = block.memoryTypeIndex;
+    allocation.blockId = blockId;
+    return allocation;
+}
+
+MemoryAllocator::Block &MemoryAllocator::createBlock(const uint32_t memoryTypeIndex, const bool linear,
+                                                     const VkDeviceSize size, const bool dedicated) {
+    Block block{};
+    block.size = size;
+    block.memoryTypeIndex = memoryTypeIndex;
+    block.linear = linear;
+    block.dedicated = dedicated;
+    block.freeRanges.emplace(0, size);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    if (vkAllocateMemory(m_Device, &allocInfo, AllocationTracker::callbacks(), &block.memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory block!");
+    }
+
+    // Host visible blocks stay mapped for their whole lifetime
+    if (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(m_Device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+            vkFreeMemory(m_Device, block.memory, AllocationTracker::callbacks());
+            throw std::runtime_error("Failed to map device memory block!");
+        }
+    }
+
+    return m_Blocks.emplace(m_NextBlockId++, std::move(block)).first->second;
+}
+
+void MemoryAllocator::releaseBlock(const uint32_t blockId) {
+    const auto it = m_Blocks.find(blockId);
+    if (it->second.mapped) {
+        vkUnmapMemory(m_Device, it->second.memory);
+    }
+    vkFreeMemory(m_Device, it->second.memory, AllocationTracker::callbacks());
+    m_ReleasedBytes += it->second.size;
+    m_Blocks.erase(it);
+}
+
+std::optional<VkDeviceSize> MemoryAllocator::findFreeRange(const Block &block, const VkDeviceSize size,
+                                                           const VkDeviceSize alignment) {
+    // Best fit: the range leaving the smallest remainder wins
+    std::optional<VkDeviceSize> best;
+    VkDeviceSize bestRemainder = std::numeric_limits<VkDeviceSize>::max();
+    for (const auto &[offset, rangeSize]: block.freeRanges) {
+        const VkDeviceSize alignedOffset = alignUp(offset, alignment);
+        const VkDeviceSize padding = alignedOffset - offset;
+        if (padding + size > rangeSize) {
+            continue;
+        }
+        if (const VkDeviceSize remainder = rangeSize - padding - size; remainder < bestRemainder) {
+            best = alignedOffset;
+            bestRemainder = remainder;
+        }
+    }
+    return best;
+}
+
+void MemoryAllocator::takeRange(Block &block, const VkDeviceSize offset, const VkDeviceSize size) {
+    auto it = block.freeRanges.upper_bound(offset);
+    assert(it != block.freeRanges.begin() && "Taking a range that isn't free");
+    --it;
+
+    const VkDeviceSize rangeOffset = it->first;
+    const VkDeviceSize rangeSize = it->second;
+    assert(offset + size <= rangeOffset + rangeSize && "Taking a range that isn't free");
+    block.freeRanges.erase(it);
+
+    if (offset > rangeOffset) {
+        block.freeRanges.emplace(rangeOffset, offset - rangeOffset);
+    }
+    if (offset + size < rangeOffset + rangeSize) {
+        block.freeRanges.emplace(offset + size, rangeOffset + rangeSize - offset - size);
+    }
+}
+
+void MemoryAllocator::returnRange(Block &block, VkDeviceSize offset, VkDeviceSize size) {
+    // Merge with the following free range
+    if (const auto next = block.freeRanges.find(offset + size); next != block.freeRanges.end()) {
+        size += next->second;
+        block.freeRanges.erase(next);
+    }
+    // Merge with the preceding free range
+    if (auto prev = block.freeRanges.lower_bound(offset); prev != block.freeRanges.begin()) {
+        --prev;
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            block.freeRanges.erase(prev);
+        }
+    }
+    block.freeRanges.emplace(offset, size);
+}
+
+} // Namespace KaguEngine
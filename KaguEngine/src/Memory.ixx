@@ -0,0 +1,133 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.Memory;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+// A range of a device memory block handed out by the MemoryAllocator
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr; // Host pointer to offset, only for host visible memory
+    uint32_t memoryTypeIndex = 0;
+    uint32_t blockId = 0;
+
+    [[nodiscard]] bool isValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+// Implemented by resources the Defragmenter is allowed to move to another allocation
+class Relocatable {
+public:
+    virtual ~Relocatable() = default;
+
+    // Creates a copy of the resource bound to destination and records the transfer into commandBuffer.
+    // A resource destroyed before the move completes hands both handles to MemoryAllocator::cancelMove().
+    virtual void recordRelocation(VkCommandBuffer commandBuffer, const Allocation &destination) = 0;
+    // Switches the resource over to the copy once the transfer completed.
+    // Returns a function destroying the old handles, called once no frame in flight uses them anymore.
+    virtual std::function<void()> commitRelocation(const Allocation &destination) = 0;
+};
+
+struct MemoryBlockInfo {
+    uint32_t blockId;
+    uint32_t memoryTypeIndex;
+    bool linear;
+    VkDeviceSize size;
+    VkDeviceSize usedBytes;
+    VkDeviceSize relocatableBytes;
+};
+
+struct MemoryStats {
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    VkDeviceSize reservedBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize releasedBytes = 0; // Returned to the driver since creation
+};
+
+class MemoryAllocator {
+public:
+    MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize);
+    ~MemoryAllocator();
+
+    // Not copyable or movable
+    MemoryAllocator(const MemoryAllocator &) = delete;
+    MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+    MemoryAllocator(MemoryAllocator &&) = delete;
+    MemoryAllocator &operator=(MemoryAllocator &&) = delete;
+
+    // Linear resources (buffers) and optimal images never share a block, which keeps
+    // bufferImageGranularity out of the picture.
+    [[nodiscard]] Allocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties,
+                                      bool linear, Relocatable *owner = nullptr);
+    // A source still being copied stays reserved until the Defragmenter's batch completed
+    void free(const Allocation &allocation);
+
+    [[nodiscard]] uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    [[nodiscard]] bool isHostCoherent(uint32_t memoryTypeIndex) const;
+    [[nodiscard]] VkDeviceSize getNonCoherentAtomSize() const { return m_NonCoherentAtomSize; }
+    [[nodiscard]] MemoryStats getStats() const;
+    [[nodiscard]] VkDeviceSize getBlockSize() const { return m_BlockSize; }
+
+    // Defragmentation support
+    [[nodiscard]] std::vector<MemoryBlockInfo> getBlocks() const;
+    [[nodiscard]] std::vector<std::pair<Allocation, Relocatable *>> getRelocatables(uint32_t blockId) const;
+    [[nodiscard]] std::optional<Allocation> allocateForMove(const Allocation &source,
+                                                            std::span<const uint32_t> excludedBlocks);
+    void beginMove(const Allocation &source);
+    // The owner of source goes away while its copy is in flight. Frees source like free(), destroy releases the
+    // owner's handles, both once the copy completed.
+    void cancelMove(const Allocation &source, std::function<void()> destroy);
+    // Returns false when the owner cancelled the move, destroyCancelled then holds what it handed over and the
+    // source is left to free
+    bool completeMove(const Allocation &source, std::function<void()> &destroyCancelled);
+
+private:
+    struct Suballocation {
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        Relocatable *owner;
+        bool moving = false;
+    };
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeIndex = 0;
+        bool linear = true;
+        bool dedicated = false;
+        void *mapped = nullptr;
+        VkDeviceSize usedBytes = 0;
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;     // offset -> size
+        std::map<VkDeviceSize, Suballocation> allocations;   // offset -> suballocation
+    };
+
+    [[nodiscard]] bool isNonCoherent(uint32_t memoryTypeIndex) const;
+    [[nodiscard]] Allocation makeAllocation(uint32_t blockId, const Block &block, VkDeviceSize offset) const;
+    Block &createBlock(uint32_t memoryTypeIndex, bool linear, VkDeviceSize size, bool dedicated);
+    void releaseBlock(uint32_t blockId);
+
+    static std::optional<VkDeviceSize> findFreeRange(const Block &block, VkDeviceSize size, VkDeviceSize alignment);
+    static void takeRange(Block &block, VkDeviceSize offset, VkDeviceSize size);
+    static void returnRange(Block &block, VkDeviceSize offset, VkDeviceSize size);
+
+    VkDevice m_Device;
+    VkDeviceSize m_BlockSize;
+    VkDeviceSize m_NonCoherentAtomSize;
+    VkPhysicalDeviceMemoryProperties m_MemoryProperties{};
+
+    mutable std::mutex m_Mutex;
+    std::map<uint32_t, Block> m_Blocks;
+    std::map<std::pair<uint32_t, VkDeviceSize>, std::function<void()>> m_CancelledMoves; // Sources still reserved
+    uint32_t m_NextBlockId = 0;
+    VkDeviceSize m_ReleasedBytes = 0;
+};
+
+} // Namespace KaguEngine
@@ -16,17 +16,45 @@ module KaguEngine.Model;
 import std;
 
 import KaguEngine.Buffer;
+import KaguEngine.CommandRecorder;
+import KaguEngine.CpuProfiler;
 import KaguEngine.Device;
+import KaguEngine.Residency;
 import KaguEngine.Utils;
 
 namespace KaguEngine {
 
-Model::Model(Device& device, const Builder& builder) : deviceRef{device} {
-    createVertexBuffers(builder.vertices);
-    createIndexBuffers(builder.indices);
+Model::Model(Device& device, const Builder& builder) : deviceRef{device}, m_CpuCopy{builder} {
+    createVertexBuffers(m_CpuCopy.vertices);
+    createIndexBuffers(m_CpuCopy.indices);
+    deviceRef.residency().registerResource(*this);
 }
 
-Model::~Model() = default;
+Model::~Model() {
+    deviceRef.residency().unregisterResource(*this);
+}
+
+VkDeviceSize Model::getResidentSize() const {
+    VkDeviceSize size = m_VertexBuffer ? m_VertexBuffer->getBufferSize() : 0;
+    if (m_IndexBuffer) {
+        size += m_IndexBuffer->getBufferSize();
+    }
+    return size;
+}
+
+bool Model::isBusy() const {
+    return (m_VertexBuffer && m_VertexBuffer->isRelocating()) || (m_IndexBuffer && m_IndexBuffer->isRelocating());
+}
+
+void Model::evict() {
+    m_VertexBuffer.reset();
+    m_IndexBuffer.reset();
+}
+
+void Model::makeResident() {
+    createVertexBuffers(m_CpuCopy.vertices);
+    createIndexBuffers(m_CpuCopy.indices);
+}
 
 std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath) {
     Builder builder{};
@@ -41,22 +69,12 @@ void Model::createVertexBuffers(const std::vector<Vertex> &vertices) {
     const VkDeviceSize bufferSize = sizeof(vertices[0]) * m_VertexCount;
     uint32_t vertexSize = sizeof(vertices[0]);
 
-    Buffer stagingBuffer{
-            deviceRef,
-            vertexSize,
-            m_VertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
-
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer(vertices.data());
-
     m_VertexBuffer = std::make_unique<Buffer>(deviceRef, vertexSize, m_VertexCount,
                                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    deviceRef.copyBuffer(stagingBuffer.getBuffer(), m_VertexBuffer->getBuffer(), bufferSize);
+    deviceRef.uploadBuffer(m_VertexBuffer->getBuffer(), vertices.data(), bufferSize,
+                           VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 }
 
 void Model::createIndexBuffers(const std::vector<uint32_t> &indices) {
@@ -70,39 +88,28 @@ void Model::createIndexBuffers(const std::vector<uint32_t> &indices) {
     const VkDeviceSize bufferSize = sizeof(indices[0]) * m_IndexCount;
     uint32_t indexSize = sizeof(indices[0]);
 
-    Buffer stagingBuffer{
-            deviceRef,
-            indexSize,
-            m_IndexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
-
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer(indices.data());
-
     m_IndexBuffer = std::make_unique<Buffer>(deviceRef, indexSize, m_IndexCount,
                                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    deviceRef.copyBuffer(stagingBuffer.getBuffer(), m_IndexBuffer->getBuffer(), bufferSize);
+    deviceRef.uploadBuffer(m_IndexBuffer->getBuffer(), indices.data(), bufferSize,
+                           VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 }
 
-void Model::draw(const VkCommandBuffer commandBuffer) const {
+void Model::draw(CommandRecorder &recorder) const {
     if (m_HasIndexBuffer) {
-        vkCmdDrawIndexed(commandBuffer, m_IndexCount, 1, 0, 0, 0);
+        recorder.drawIndexed(m_IndexCount);
     } else {
-        vkCmdDraw(commandBuffer, m_VertexCount, 1, 0, 0);
+        recorder.draw(m_VertexCount);
     }
 }
 
-void Model::bind(const VkCommandBuffer commandBuffer) const {
-    const VkBuffer buffers[] = {m_VertexBuffer->getBuffer()};
-    constexpr VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+void Model::bind(CommandRecorder &recorder) const {
+    assert(isResident() && "Model must be touched through the residency manager before binding");
+    recorder.bindVertexBuffer(m_VertexBuffer->getBuffer());
 
     if (m_HasIndexBuffer) {
-        vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        recorder.bindIndexBuffer(m_IndexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
     }
 }
 
@@ -128,6 +135,7 @@ std::vector<VkVertexInputAttributeDescription> Model::Vertex::getAttributeDescri
 }
 
 void Model::Builder::loadModel(const std::string &filepath) {
+    CpuProfiler::Zone zone{"Model::Builder::loadModel"};
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
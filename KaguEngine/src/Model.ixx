@@ -12,12 +12,15 @@ export module KaguEngine.Model;
 import std;
 
 import KaguEngine.Buffer;
+import KaguEngine.CommandRecorder;
 import KaguEngine.Device;
+import KaguEngine.Residency;
 import KaguEngine.Utils;
 
 export namespace KaguEngine {
 
-class Model {
+// Keeps its vertices and indices on the CPU so the residency manager can evict it
+class Model final : public Evictable {
 public:
     struct Vertex {
         glm::vec3 position{};
@@ -44,7 +47,7 @@ public:
     };
 
     Model(Device &device, const Builder &builder);
-    ~Model();
+    ~Model() override;
 
     // Non copyable
     Model(const Model &) = delete;
@@ -52,14 +55,21 @@ public:
 
     static std::unique_ptr<Model> createModelFromFile(Device &device, const std::string &filepath);
 
-    void bind(VkCommandBuffer commandBuffer) const;
-    void draw(VkCommandBuffer commandBuffer) const;
+    void bind(CommandRecorder &recorder) const;
+    void draw(CommandRecorder &recorder) const;
+
+    [[nodiscard]] bool isResident() const override { return m_VertexBuffer != nullptr; }
+    [[nodiscard]] VkDeviceSize getResidentSize() const override;
+    [[nodiscard]] bool isBusy() const override;
+    void evict() override;
+    void makeResident() override;
 
 private:
     void createVertexBuffers(const std::vector<Vertex> &vertices);
     void createIndexBuffers(const std::vector<uint32_t> &indices);
 
     Device& deviceRef;
+    Builder m_CpuCopy;
 
     std::unique_ptr<Buffer> m_VertexBuffer;
     uint32_t m_VertexCount;
@@ -0,0 +1,184 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.ParallelRecorder;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+import KaguEngine.FramePacer;
+import KaguEngine.JobSystem;
+
+namespace KaguEngine {
+
+ParallelRecorder::ParallelRecorder(Device &device, JobSystem &jobSystem) :
+    deviceRef{device}, jobSystemRef{jobSystem}, m_Contexts(jobSystem.getWorkerCount() + 1) {
+    for (auto &context: m_Contexts) {
+        createWorkerContext(context);
+    }
+}
+
+ParallelRecorder::~ParallelRecorder() {
+    for (const auto &context: m_Contexts) {
+        for (const VkCommandPool pool: context.pools) {
+            vkDestroyCommandPool(deviceRef.device(), pool, AllocationTracker::callbacks());
+        }
+        vkDestroyCommandPool(deviceRef.device(), context.benchmarkPool, AllocationTracker::callbacks());
+    }
+}
+
+void ParallelRecorder::createWorkerContext(WorkerContext &context) const {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = deviceRef.graphicsFamily();
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    const auto createPool = [&](VkCommandPool &pool) {
+        if (vkCreateCommandPool(deviceRef.device(), &poolInfo, AllocationTracker::callbacks(), &pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create recording command pool!");
+        }
+    };
+
+    for (VkCommandPool &pool: context.pools) {
+        createPool(pool);
+    }
+    createPool(context.benchmarkPool);
+}
+
+void ParallelRecorder::record(const VkCommandBuffer primary, const uint32_t frameIndex,
+                              const SecondaryTarget &target, const uint32_t count,
+                              const RecordFunction &recordRange) {
+    if (count == 0) {
+        return;
+    }
+
+    // Small batches aren't worth waking the workers for
+    const uint32_t rangeCount = std::clamp(count / Config::recordingDrawsPerThread, 1u, getThreadCount());
+    std::array<VkCommandBuffer, Config::maxRecordingThreads> secondaries{};
+
+    // The frame pacer waited for this frame slot, nothing recorded from these pools is still in use
+    resetContexts(frameIndex);
+    recordRanges(std::span{secondaries}.first(rangeCount), frameIndex, target, count, recordRange);
+    vkCmdExecuteCommands(primary, rangeCount, secondaries.data());
+}
+
+std::vector<double> ParallelRecorder::benchmark(const SecondaryTarget &target, const uint32_t count,
+                                                const RecordFunction &recordRange) {
+    std::vector<double> timings;
+    timings.reserve(getThreadCount());
+
+    std::array<VkCommandBuffer, Config::maxRecordingThreads> secondaries{};
+    for (uint32_t threadCount = 1; threadCount <= getThreadCount(); threadCount++) {
+        resetContexts(std::nullopt);
+
+        const auto start = std::chrono::steady_clock::now();
+        recordRanges(std::span{secondaries}.first(threadCount), std::nullopt, target, count, recordRange);
+        timings.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    for (const auto &context: m_Contexts) {
+        vkResetCommandPool(deviceRef.device(), context.benchmarkPool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+    }
+    return timings;
+}
+
+void ParallelRecorder::resetContexts(const std::optional<uint32_t> frameIndex) {
+    for (auto &context: m_Contexts) {
+        vkResetCommandPool(deviceRef.device(), frameIndex ? context.pools[*frameIndex] : context.benchmarkPool, 0);
+        context.usedCommandBuffers = 0;
+    }
+}
+
+VkCommandBuffer ParallelRecorder::nextCommandBuffer(WorkerContext &context,
+                                                    const std::optional<uint32_t> frameIndex) const {
+    auto &commandBuffers = frameIndex ? context.commandBuffers[*frameIndex] : context.benchmarkCommandBuffers;
+    if (context.usedCommandBuffers == commandBuffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = frameIndex ? context.pools[*frameIndex] : context.benchmarkPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(deviceRef.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate secondary command buffer!");
+        }
+        commandBuffers.push_back(commandBuffer);
+    }
+    return commandBuffers[context.usedCommandBuffers++];
+}
+
+void ParallelRecorder::recordRanges(const std::span<VkCommandBuffer> secondaries,
+                                    const std::optional<uint32_t> frameIndex, const SecondaryTarget &target,
+                                    const uint32_t count, const RecordFunction &recordRange) {
+    const auto rangeCount = static_cast<uint32_t>(secondaries.size());
+    const uint32_t chunk = (count + rangeCount - 1) / rangeCount;
+
+    // One job per range, each recorded into a secondary of the pool owned by the worker running it
+    jobSystemRef.parallelFor(rangeCount, [&](const uint32_t first, const uint32_t last) {
+        const uint32_t worker = JobSystem::getWorkerIndex();
+        WorkerContext &context = m_Contexts[worker != JobSystem::INVALID_WORKER ? worker : m_Contexts.size() - 1];
+        for (uint32_t range = first; range < last; range++) {
+            const uint32_t begin = std::min(range * chunk, count);
+            const uint32_t end = std::min(begin + chunk, count);
+            secondaries[range] = nextCommandBuffer(context, frameIndex);
+            recordSecondary(secondaries[range], target, recordRange, begin, end);
+        }
+    }, 1);
+}
+
+void ParallelRecorder::recordSecondary(const VkCommandBuffer commandBuffer, const SecondaryTarget &target,
+                                       const RecordFunction &recordRange, const uint32_t begin,
+                                       const uint32_t end) const {
+    VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    renderingInfo.flags = target.renderingFlags;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &target.colorFormat;
+    renderingInfo.depthAttachmentFormat = target.depthFormat;
+    renderingInfo.rasterizationSamples = target.samples;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = &renderingInfo;
+    // A superset of the statistics query the profiler may have active in the primary
+    inheritanceInfo.pipelineStatistics = deviceRef.getQuerySupport().pipelineStatistics;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording secondary command buffer!");
+    }
+
+    // Dynamic state isn't inherited from the primary
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(target.extent.width);
+    viewport.height = static_cast<float>(target.extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    const VkRect2D scissor{{0, 0}, target.extent};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    if (begin < end) {
+        recordRange(commandBuffer, begin, end);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record secondary command buffer!");
+    }
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,80 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.ParallelRecorder;
+
+// std
+import std;
+
+import KaguEngine.Device;
+import KaguEngine.FramePacer;
+import KaguEngine.JobSystem;
+
+export namespace KaguEngine {
+
+// What the secondary command buffers inherit from the dynamic rendering pass executing them
+struct SecondaryTarget {
+    VkFormat colorFormat;
+    VkFormat depthFormat;
+    VkSampleCountFlagBits samples;
+    VkExtent2D extent;
+    VkRenderingFlags renderingFlags = 0; // Flags of the pass, without the secondary contents bit
+};
+
+// Records draws on the job system, each worker owning a command pool per frame in flight
+class ParallelRecorder {
+public:
+    // Records the items [begin, end) into commandBuffer
+    using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)>;
+
+    // Records from one thread at a time, a worker of jobSystem or not (the render thread)
+    ParallelRecorder(Device &device, JobSystem &jobSystem);
+    ~ParallelRecorder();
+
+    // Non copyable
+    ParallelRecorder(const ParallelRecorder &) = delete;
+    ParallelRecorder &operator=(const ParallelRecorder &) = delete;
+
+    [[nodiscard]] uint32_t getThreadCount() const {
+        return std::min(jobSystemRef.getWorkerCount(), Config::maxRecordingThreads);
+    }
+
+    // Splits count items in contiguous ranges, one secondary command buffer per range.
+    // primary must be inside a rendering pass begun with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT.
+    void record(VkCommandBuffer primary, uint32_t frameIndex, const SecondaryTarget &target, uint32_t count,
+                const RecordFunction &recordRange);
+    // Milliseconds spent recording count items with 1 to getThreadCount() threads, nothing is submitted
+    [[nodiscard]] std::vector<double> benchmark(const SecondaryTarget &target, uint32_t count,
+                                                const RecordFunction &recordRange);
+
+private:
+    // A worker may pick up several ranges, so it hands out as many secondaries as it recorded this pass
+    struct WorkerContext {
+        std::array<VkCommandPool, FramePacer::MAX_FRAMES_IN_FLIGHT> pools{};
+        std::array<std::vector<VkCommandBuffer>, FramePacer::MAX_FRAMES_IN_FLIGHT> commandBuffers{};
+        VkCommandPool benchmarkPool{};
+        std::vector<VkCommandBuffer> benchmarkCommandBuffers;
+        uint32_t usedCommandBuffers = 0;
+    };
+
+    void createWorkerContext(WorkerContext &context) const;
+    // Resets the pools of frameIndex, or the benchmark pools without one
+    void resetContexts(std::optional<uint32_t> frameIndex);
+    [[nodiscard]] VkCommandBuffer nextCommandBuffer(WorkerContext &context, std::optional<uint32_t> frameIndex) const;
+    // Records count items split in secondaries.size() ranges, secondaries[i] receiving range i
+    void recordRanges(std::span<VkCommandBuffer> secondaries, std::optional<uint32_t> frameIndex,
+                      const SecondaryTarget &target, uint32_t count, const RecordFunction &recordRange);
+    void recordSecondary(VkCommandBuffer commandBuffer, const SecondaryTarget &target,
+                         const RecordFunction &recordRange, uint32_t begin, uint32_t end) const;
+
+    Device &deviceRef;
+    JobSystem &jobSystemRef;
+    std::vector<WorkerContext> m_Contexts; // Indexed by worker, the last one for the recording thread outside
+};
+
+} // Namespace KaguEngine
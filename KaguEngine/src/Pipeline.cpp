@@ -11,66 +11,57 @@ module KaguEngine.Pipeline;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
+import KaguEngine.CommandRecorder;
+import KaguEngine.CpuProfiler;
 import KaguEngine.Device;
 import KaguEngine.Model;
+import KaguEngine.PipelineCache;
 
 namespace KaguEngine {
 
-Pipeline::Pipeline(Device &device, const std::string &vertFilepath, const std::string &fragFilepath,
+Pipeline::Pipeline(Device &device, const VkShaderModule vertShaderModule, const VkShaderModule fragShaderModule,
                    const PipelineConfigInfo &configInfo) : m_Device{device} {
-    createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
+    createGraphicsPipeline(vertShaderModule, fragShaderModule, configInfo);
+    m_DynamicRasterization = configInfo.dynamicRasterization;
+    if (configInfo.dynamicBlendEnable) {
+        m_CmdSetColorBlendEnable = m_Device.getDynamicStateSupport().cmdSetColorBlendEnable;
+    }
 }
 
 Pipeline::~Pipeline() {
-    vkDestroyShaderModule(m_Device.device(), m_vertShaderModule, nullptr);
-    vkDestroyShaderModule(m_Device.device(), m_fragShaderModule, nullptr);
-    vkDestroyPipeline(m_Device.device(), m_graphicsPipeline, nullptr);
+    vkDestroyPipeline(m_Device.device(), m_graphicsPipeline, AllocationTracker::callbacks());
 }
 
-std::vector<char> Pipeline::readFile(const std::string &filepath) {
-    const std::string enginePath = filepath;
-    std::ifstream file{enginePath, std::ios::ate | std::ios::binary};
-
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + enginePath);
-    }
-
-    const size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-    return buffer;
-}
-
-void Pipeline::createGraphicsPipeline(const std::string &vertFilepath, const std::string &fragFilepath,
+void Pipeline::createGraphicsPipeline(const VkShaderModule vertShaderModule, const VkShaderModule fragShaderModule,
                                       const PipelineConfigInfo &configInfo) {
+    CpuProfiler::Zone zone{"Pipeline::createGraphicsPipeline"};
     assert(configInfo.pipelineLayout != VK_NULL_HANDLE &&
     "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
 
-    const auto vertCode = readFile(vertFilepath);
-    const auto fragCode = readFile(fragFilepath);
-
-    createShaderModule(vertCode, &m_vertShaderModule);
-    createShaderModule(fragCode, &m_fragShaderModule);
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.specializationEntries.size());
+    specializationInfo.pMapEntries = configInfo.specializationEntries.data();
+    specializationInfo.dataSize = configInfo.specializationData.size();
+    specializationInfo.pData = configInfo.specializationData.data();
+    const VkSpecializationInfo *pSpecializationInfo =
+        configInfo.specializationEntries.empty() ? nullptr : &specializationInfo;
 
     VkPipelineShaderStageCreateInfo shaderStages[2];
     shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaderStages[0].module = m_vertShaderModule;
+    shaderStages[0].module = vertShaderModule;
     shaderStages[0].pName = "main";
     shaderStages[0].flags = 0;
     shaderStages[0].pNext = nullptr;
-    shaderStages[0].pSpecializationInfo = nullptr;
+    shaderStages[0].pSpecializationInfo = pSpecializationInfo;
     shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaderStages[1].module = m_fragShaderModule;
+    shaderStages[1].module = fragShaderModule;
     shaderStages[1].pName = "main";
     shaderStages[1].flags = 0;
     shaderStages[1].pNext = nullptr;
-    shaderStages[1].pSpecializationInfo = nullptr;
+    shaderStages[1].pSpecializationInfo = pSpecializationInfo;
 
     auto &bindingDescriptions = configInfo.bindingDescriptions;
     auto &attributeDescriptions = configInfo.attributeDescriptions;
@@ -108,25 +99,37 @@ void Pipeline::createGraphicsPipeline(const std::string &vertFilepath, const std
     pipelineInfo.basePipelineIndex = -1;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(m_Device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
+    PipelineCache &cache = m_Device.pipelineCache();
+    const auto start = std::chrono::steady_clock::now();
+    if (vkCreateGraphicsPipelines(m_Device.device(), cache.get(), 1, &pipelineInfo, AllocationTracker::callbacks(),
                                   &m_graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline");
     }
+    cache.recordCreation(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 }
 
-void Pipeline::createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule) const {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-
-    if (vkCreateShaderModule(m_Device.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create shader module");
-    }
+void Pipeline::bind(CommandRecorder &recorder) const {
+    recorder.bindPipeline(m_graphicsPipeline);
 }
 
-void Pipeline::bind(const VkCommandBuffer commandBuffer) const {
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+void Pipeline::setRasterState(const VkCommandBuffer commandBuffer, const RasterState &state,
+                              const RasterState *previous) const {
+    if (m_DynamicRasterization) {
+        if (!previous || previous->cullMode != state.cullMode)
+            vkCmdSetCullMode(commandBuffer, state.cullMode);
+        if (!previous || previous->frontFace != state.frontFace)
+            vkCmdSetFrontFace(commandBuffer, state.frontFace);
+        if (!previous || previous->depthTest != state.depthTest)
+            vkCmdSetDepthTestEnable(commandBuffer, state.depthTest);
+        if (!previous || previous->depthWrite != state.depthWrite)
+            vkCmdSetDepthWriteEnable(commandBuffer, state.depthWrite);
+        if (!previous || previous->depthCompareOp != state.depthCompareOp)
+            vkCmdSetDepthCompareOp(commandBuffer, state.depthCompareOp);
+    }
+    if (m_CmdSetColorBlendEnable && (!previous || previous->blend != state.blend)) {
+        const VkBool32 blendEnable = state.blend;
+        m_CmdSetColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+    }
 }
 
 void Pipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo, bool isTextured) {
@@ -217,4 +220,29 @@ void Pipeline::enableMSAA(PipelineConfigInfo &configInfo, const VkSampleCountFla
     configInfo.multisampleInfo.rasterizationSamples = msaaLevel;
 }
 
+void Pipeline::applyRasterState(PipelineConfigInfo &configInfo, const RasterState &state) {
+    configInfo.rasterizationInfo.cullMode = state.cullMode;
+    configInfo.rasterizationInfo.frontFace = state.frontFace;
+    configInfo.depthStencilInfo.depthTestEnable = state.depthTest;
+    configInfo.depthStencilInfo.depthWriteEnable = state.depthWrite;
+    configInfo.depthStencilInfo.depthCompareOp = state.depthCompareOp;
+    configInfo.colorBlendAttachment.blendEnable = state.blend;
+}
+
+void Pipeline::enableDynamicState(PipelineConfigInfo &configInfo, const DynamicStateSupport &support) {
+    if (support.rasterization) {
+        configInfo.dynamicStateEnables.insert(configInfo.dynamicStateEnables.end(), {
+            VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE, VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+            VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP
+        });
+        configInfo.dynamicRasterization = true;
+    }
+    if (support.colorBlendEnable) {
+        configInfo.dynamicStateEnables.push_back(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+        configInfo.dynamicBlendEnable = true;
+    }
+    configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+    configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
+}
+
 } // Namespace KaguEngine
\ No newline at end of file
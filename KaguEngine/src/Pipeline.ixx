@@ -8,10 +8,23 @@ export module KaguEngine.Pipeline;
 // std
 import std;
 
+import KaguEngine.CommandRecorder;
 import KaguEngine.Device;
 
 export namespace KaguEngine {
 
+// State a draw can change without its own pipeline, when the device supports it as dynamic state
+struct RasterState {
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    bool blend = false; // Equation set by enableAlphaBlending
+
+    bool operator==(const RasterState &) const = default;
+};
+
 struct PipelineConfigInfo {
     PipelineConfigInfo() = default;
     PipelineConfigInfo(const PipelineConfigInfo &) = delete;
@@ -31,35 +44,54 @@ struct PipelineConfigInfo {
     VkPipelineLayout pipelineLayout = nullptr;
     VkFormat colorAttachmentFormat;
     VkFormat depthAttachmentFormat;
+    // Specialization constants of every stage
+    std::vector<VkSpecializationMapEntry> specializationEntries{};
+    std::vector<std::byte> specializationData{};
+    // Set by enableDynamicState, the baked state is ignored for these
+    bool dynamicRasterization = false;
+    bool dynamicBlendEnable = false;
 };
 
 class Pipeline {
 public:
-    Pipeline(Device &device, const std::string &vertFilepath, const std::string &fragFilepath,
+    // The shader modules are kept by the caller, they can go once the constructor returned
+    Pipeline(Device &device, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule,
              const PipelineConfigInfo &configInfo);
     ~Pipeline();
 
     Pipeline(const Pipeline &) = delete;
     Pipeline &operator=(const Pipeline &) = delete;
 
-    void bind(VkCommandBuffer commandBuffer) const;
+    void bind(CommandRecorder &recorder) const;
+    // Sets the dynamic part of state, only what differs from previous unless it's null
+    void setRasterState(VkCommandBuffer commandBuffer, const RasterState &state, const RasterState *previous) const;
+    [[nodiscard]] bool hasDynamicBlendEnable() const { return m_CmdSetColorBlendEnable != nullptr; }
 
     static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo, bool isTextured);
     static void enableAlphaBlending(PipelineConfigInfo &configInfo);
     static void enableMSAA(PipelineConfigInfo &configInfo, const VkSampleCountFlagBits &msaaLevel);
+    // Bakes the state, what's dynamic is then only the value used before the first setRasterState
+    static void applyRasterState(PipelineConfigInfo &configInfo, const RasterState &state);
+    // Makes what the device supports of RasterState dynamic
+    static void enableDynamicState(PipelineConfigInfo &configInfo, const DynamicStateSupport &support);
+    // T must match the constant's type in the shaders, VkBool32 for a bool
+    template<typename T>
+    static void addSpecializationConstant(PipelineConfigInfo &configInfo, const uint32_t constantId, const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto offset = static_cast<uint32_t>(configInfo.specializationData.size());
+        configInfo.specializationEntries.push_back({constantId, offset, sizeof(T)});
+        const auto bytes = std::as_bytes(std::span{&value, 1});
+        configInfo.specializationData.insert(configInfo.specializationData.end(), bytes.begin(), bytes.end());
+    }
 
 private:
-    static std::vector<char> readFile(const std::string &filepath);
-
-    void createGraphicsPipeline(const std::string &vertFilepath, const std::string &fragFilepath,
+    void createGraphicsPipeline(VkShaderModule vertShaderModule, VkShaderModule fragShaderModule,
                                 const PipelineConfigInfo &configInfo);
 
-    void createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule) const;
-
     Device &m_Device;
     VkPipeline m_graphicsPipeline;
-    VkShaderModule m_vertShaderModule;
-    VkShaderModule m_fragShaderModule;
+    bool m_DynamicRasterization = false;
+    PFN_vkCmdSetColorBlendEnableEXT m_CmdSetColorBlendEnable = nullptr;
 };
 
 } // Namespace KaguEngine
\ No newline at end of file
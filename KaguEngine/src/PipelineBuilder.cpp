@@ -0,0 +1,294 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.PipelineBuilder;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+import KaguEngine.JobSystem;
+import KaguEngine.Pipeline;
+import KaguEngine.PipelineLayoutCache;
+import KaguEngine.ShaderCache;
+import KaguEngine.ShaderReflection;
+
+namespace KaguEngine {
+
+const Pipeline *PipelineHandle::get() const {
+    if (!isReady()) {
+        return nullptr;
+    }
+    if (m_State->error) {
+        std::rethrow_exception(m_State->error);
+    }
+    return m_State->pipeline.get();
+}
+
+PipelineBuilder::PipelineBuilder(Device &device, JobSystem &jobSystem) :
+    deviceRef{device}, jobSystemRef{jobSystem}, m_LayoutCache{device},
+    m_ShaderCache{std::filesystem::path{Config::shaderCachePath}} {}
+
+PipelineBuilder::~PipelineBuilder() {
+    waitIdle();
+    jobSystemRef.wait(m_ReloadPending);
+    for (const ReloadedModule &reloaded: m_ReloadedModules) {
+        vkDestroyShaderModule(deviceRef.device(), reloaded.shaderModule.module, AllocationTracker::callbacks());
+    }
+    for (const VkShaderModule shaderModule: m_ReplacedModules) {
+        vkDestroyShaderModule(deviceRef.device(), shaderModule, AllocationTracker::callbacks());
+    }
+    for (const ShaderModule &shaderModule: m_ShaderModules | std::views::values) {
+        vkDestroyShaderModule(deviceRef.device(), shaderModule.module, AllocationTracker::callbacks());
+    }
+}
+
+std::vector<PipelineHandle> PipelineBuilder::submit(std::vector<PipelineDesc> descs) {
+    std::vector<std::string> paths;
+    for (const PipelineDesc &desc: descs) {
+        paths.push_back(desc.vertFilepath);
+        paths.push_back(desc.fragFilepath);
+    }
+    loadShaderModules(std::move(paths));
+    {
+        std::lock_guard lock{m_StatsMutex};
+        if (m_Stats.submitted == m_Stats.compiled) {
+            m_FirstSubmit = std::chrono::steady_clock::now();
+            m_Stats.wallMs = 0.0;
+        }
+        m_Stats.submitted += static_cast<uint32_t>(descs.size());
+    }
+
+    std::erase_if(m_States, [](const auto &state) { return state.expired(); });
+    std::vector<PipelineHandle> handles(descs.size());
+    for (size_t i = 0; i < descs.size(); i++) {
+        auto state = std::make_shared<PipelineHandle::State>();
+        state->desc = std::move(descs[i]);
+        handles[i].m_State = state;
+        m_States.push_back(state);
+        // Looked up here, the map isn't shared with the workers
+        const VkShaderModule vertShaderModule = m_ShaderModules.at(state->desc.vertFilepath).module;
+        const VkShaderModule fragShaderModule = m_ShaderModules.at(state->desc.fragFilepath).module;
+        jobSystemRef.scheduleBackground(m_Pending, [=, this, state = std::move(state)] {
+            compile(*state, vertShaderModule, fragShaderModule);
+        });
+    }
+    return handles;
+}
+
+VkPipelineLayout PipelineBuilder::getPipelineLayout(const std::string &vertFilepath,
+                                                    const std::string &fragFilepath) {
+    loadShaderModules({vertFilepath, fragFilepath});
+    ShaderReflection reflection = m_ShaderModules.at(vertFilepath).reflection;
+    reflection.merge(m_ShaderModules.at(fragFilepath).reflection);
+    return m_LayoutCache.getPipelineLayout(reflection);
+}
+
+void PipelineBuilder::waitIdle() {
+    jobSystemRef.wait(m_Pending);
+}
+
+void PipelineBuilder::reloadShader(const std::string &spvPath) {
+    if (m_ShaderModules.contains(spvPath) && std::ranges::find(m_ReloadQueue, spvPath) == m_ReloadQueue.end()) {
+        m_ReloadQueue.push_back(spvPath);
+    }
+}
+
+void PipelineBuilder::update(const uint64_t frameValue, const uint64_t completedValue) {
+    while (!m_Retired.empty() && m_Retired.front().frameValue <= completedValue) {
+        m_Retired.pop_front();
+    }
+
+    // The startup batch compiles with the modules it was submitted with, reloads wait for it
+    if (!m_ReloadPending.isDone() || !m_Pending.isDone()) {
+        return;
+    }
+    switch (m_ReloadPhase) {
+        case ReloadPhase::Idle:
+            if (!m_ReloadQueue.empty()) {
+                beginReload();
+            }
+            break;
+        case ReloadPhase::Modules:
+            compileReloadedPipelines();
+            break;
+        case ReloadPhase::Pipelines:
+            swapReloadedPipelines(frameValue);
+            break;
+    }
+}
+
+PipelineBuilderStats PipelineBuilder::getStats() const {
+    std::lock_guard lock{m_StatsMutex};
+    return m_Stats;
+}
+
+PipelineBuilder::ShaderModule PipelineBuilder::createShaderModule(const std::string &path) {
+    // Reflected first, nothing to release if it throws
+    const std::vector<uint32_t> code = m_ShaderCache.load(path);
+    ShaderReflection reflection = ShaderReflection::reflect(code);
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size() * sizeof(uint32_t);
+    createInfo.pCode = code.data();
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(deviceRef.device(), &createInfo,
+                             AllocationTracker::callbacks(), &shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader module!");
+    }
+    return {shaderModule, std::move(reflection)};
+}
+
+void PipelineBuilder::loadShaderModules(std::vector<std::string> paths) {
+    std::erase_if(paths, [&](const std::string &path) { return m_ShaderModules.contains(path); });
+    std::ranges::sort(paths);
+    paths.erase(std::ranges::unique(paths).begin(), paths.end());
+
+    std::vector<ShaderModule> shaderModules(paths.size(), ShaderModule{VK_NULL_HANDLE, {}});
+    std::vector<std::exception_ptr> loadErrors(paths.size());
+    jobSystemRef.parallelFor(static_cast<uint32_t>(paths.size()), [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            try {
+                shaderModules[i] = createShaderModule(paths[i]);
+            } catch (...) {
+                loadErrors[i] = std::current_exception();
+            }
+        }
+    }, 1);
+
+    // Kept even when another one failed, the destructor releases them
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (shaderModules[i].module != VK_NULL_HANDLE) {
+            m_ShaderModules.emplace(paths[i], std::move(shaderModules[i]));
+        }
+    }
+    {
+        std::lock_guard lock{m_StatsMutex};
+        m_Stats.shaderModules = static_cast<uint32_t>(m_ShaderModules.size());
+    }
+    for (const auto &error: loadErrors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void PipelineBuilder::compile(PipelineHandle::State &state, const VkShaderModule vertShaderModule,
+                              const VkShaderModule fragShaderModule) {
+    build(state.desc, vertShaderModule, fragShaderModule, state.pipeline, state.error);
+    state.ready.store(true, std::memory_order_release);
+
+    std::lock_guard lock{m_StatsMutex};
+    m_Stats.compiled++;
+    m_Stats.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_FirstSubmit).count();
+}
+
+void PipelineBuilder::build(const PipelineDesc &desc, const VkShaderModule vertShaderModule,
+                            const VkShaderModule fragShaderModule, std::unique_ptr<Pipeline> &pipeline,
+                            std::exception_ptr &error) const {
+    try {
+        PipelineConfigInfo configInfo{};
+        desc.configure(configInfo);
+        pipeline = std::make_unique<Pipeline>(deviceRef, vertShaderModule, fragShaderModule, configInfo);
+    } catch (const std::exception &exception) {
+        error = std::make_exception_ptr(
+            std::runtime_error("Failed to compile pipeline " + desc.name + ": " + exception.what()));
+    }
+}
+
+void PipelineBuilder::beginReload() {
+    m_ReloadedModules.clear();
+    for (std::string &path: m_ReloadQueue) {
+        m_ReloadedModules.push_back({std::move(path)});
+    }
+    m_ReloadQueue.clear();
+
+    // Compiling GLSL is the slow part, one job per shader. The vector isn't resized until they're done.
+    for (ReloadedModule &reloaded: m_ReloadedModules) {
+        jobSystemRef.scheduleBackground(m_ReloadPending, [this, &reloaded] {
+            try {
+                reloaded.shaderModule = createShaderModule(reloaded.path);
+            } catch (...) {
+                reloaded.error = std::current_exception();
+            }
+        });
+    }
+    m_ReloadPhase = ReloadPhase::Modules;
+}
+
+void PipelineBuilder::compileReloadedPipelines() {
+    std::vector<std::string> paths;
+    for (ReloadedModule &reloaded: m_ReloadedModules) {
+        const std::string name = std::filesystem::path{reloaded.path}.filename().string();
+        try {
+            if (reloaded.error) {
+                std::rethrow_exception(reloaded.error);
+            }
+            // The systems keep their pipeline layout, the shader has to fit in it
+            ShaderModule &current = m_ShaderModules.at(reloaded.path);
+            if (!current.reflection.hasSameResources(reloaded.shaderModule.reflection)) {
+                throw std::runtime_error("its descriptors or push constants changed, restart to apply it");
+            }
+            m_ReplacedModules.push_back(current.module);
+            current = std::exchange(reloaded.shaderModule, ShaderModule{VK_NULL_HANDLE, {}});
+            paths.push_back(reloaded.path);
+        } catch (const std::exception &exception) {
+            std::cout << "[ShaderCache] Reload of " << name << " ignored: " << exception.what() << '\n';
+            vkDestroyShaderModule(deviceRef.device(), std::exchange(reloaded.shaderModule.module, VK_NULL_HANDLE),
+                                  AllocationTracker::callbacks());
+        }
+    }
+    m_ReloadedModules.clear();
+
+    // update() waited for the pending batch, so every pipeline using the old modules is compiled
+    m_Reloading.clear();
+    for (const auto &weakState: m_States) {
+        auto state = weakState.lock();
+        if (!state || !state->ready.load(std::memory_order_acquire) ||
+            (std::ranges::find(paths, state->desc.vertFilepath) == paths.end() &&
+             std::ranges::find(paths, state->desc.fragFilepath) == paths.end())) {
+            continue;
+        }
+        const VkShaderModule vertShaderModule = m_ShaderModules.at(state->desc.vertFilepath).module;
+        const VkShaderModule fragShaderModule = m_ShaderModules.at(state->desc.fragFilepath).module;
+        jobSystemRef.scheduleBackground(m_ReloadPending, [=, this, state = state.get()] {
+            build(state->desc, vertShaderModule, fragShaderModule, state->next, state->nextError);
+        });
+        m_Reloading.push_back(std::move(state));
+    }
+    m_ReloadPhase = m_Reloading.empty() ? ReloadPhase::Idle : ReloadPhase::Pipelines;
+}
+
+void PipelineBuilder::swapReloadedPipelines(const uint64_t frameValue) {
+    uint32_t swapped = 0;
+    for (const auto &state: m_Reloading) {
+        if (state->nextError) {
+            try {
+                std::rethrow_exception(std::exchange(state->nextError, nullptr));
+            } catch (const std::exception &exception) {
+                std::cout << "[ShaderCache] " << exception.what() << ", keeping the previous pipeline\n";
+            }
+            continue;
+        }
+        // The frame being handed over still draws with the old pipeline
+        m_Retired.push_back({frameValue + 1, std::exchange(state->pipeline, std::move(state->next))});
+        state->error = nullptr; // A fixed shader recovers a pipeline that failed to compile
+        swapped++;
+    }
+    m_Reloading.clear();
+    m_ReloadPhase = ReloadPhase::Idle;
+
+    std::cout << "[ShaderCache] Reloaded " << swapped << " pipeline(s)\n";
+    std::lock_guard lock{m_StatsMutex};
+    m_Stats.reloaded += swapped;
+}
+
+} // Namespace KaguEngine
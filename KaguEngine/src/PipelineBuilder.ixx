@@ -0,0 +1,147 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.PipelineBuilder;
+
+// std
+import std;
+
+import KaguEngine.Device;
+import KaguEngine.JobSystem;
+import KaguEngine.Pipeline;
+import KaguEngine.PipelineLayoutCache;
+import KaguEngine.ShaderCache;
+import KaguEngine.ShaderReflection;
+
+export namespace KaguEngine {
+
+struct PipelineDesc {
+    std::string name; // For errors
+    std::string vertFilepath;
+    std::string fragFilepath;
+    // Fills the config on the worker compiling the pipeline, the config can't be copied into the job
+    std::function<void(PipelineConfigInfo &configInfo)> configure;
+};
+
+// Pipeline compiled in the background, shared by the handles to it
+class PipelineHandle {
+public:
+    PipelineHandle() = default;
+
+    // Compiled, or failed to
+    [[nodiscard]] bool isReady() const { return m_State && m_State->ready.load(std::memory_order_acquire); }
+    // nullptr while compiling, rethrows the compilation error
+    [[nodiscard]] const Pipeline *get() const;
+
+private:
+    friend class PipelineBuilder;
+
+    struct State {
+        PipelineDesc desc;
+        std::atomic<bool> ready{false};
+        std::unique_ptr<Pipeline> pipeline;
+        std::exception_ptr error;
+        // Hot reload, swapped in between two frames
+        std::unique_ptr<Pipeline> next;
+        std::exception_ptr nextError;
+    };
+
+    std::shared_ptr<State> m_State;
+};
+
+struct PipelineBuilderStats {
+    uint32_t submitted = 0;
+    uint32_t compiled = 0;
+    uint32_t shaderModules = 0; // Each SPIR-V file is read and reflected once
+    double wallMs = 0.0;        // From the first submit to the last pipeline compiled
+    uint32_t reloaded = 0;      // Pipelines swapped by hot reload
+};
+
+// Compiles batches of pipelines on the job system's background queue against the device's pipeline cache, which is
+// internally synchronized. Systems render with whichever pipelines are ready and skip the others.
+// When a shader changes, the pipelines using it are rebuilt in the background and swapped between frames.
+class PipelineBuilder {
+public:
+    PipelineBuilder(Device &device, JobSystem &jobSystem);
+    ~PipelineBuilder(); // Waits for the pipelines still compiling
+
+    // Non copyable
+    PipelineBuilder(const PipelineBuilder &) = delete;
+    PipelineBuilder &operator=(const PipelineBuilder &) = delete;
+
+    // One caller at a time: loads the new shader modules, then returns while the pipelines compile
+    [[nodiscard]] std::vector<PipelineHandle> submit(std::vector<PipelineDesc> descs);
+    // One caller at a time: loads the shaders, their layout is shared by every pipeline declaring the same sets
+    [[nodiscard]] VkPipelineLayout getPipelineLayout(const std::string &vertFilepath, const std::string &fragFilepath);
+    // Runs jobs until every submitted pipeline is ready
+    void waitIdle();
+
+    // Between frames: queues a reload of the pipelines using the shader, ignored if none does
+    void reloadShader(const std::string &spvPath);
+    // Between frames, nothing recording: moves the reload on without blocking. Once every pipeline of a reload
+    // compiled, they're swapped at once. The old ones are destroyed after the GPU reached frameValue + 1,
+    // the first frame submitted after the swap.
+    void update(uint64_t frameValue, uint64_t completedValue);
+
+    [[nodiscard]] bool isIdle() const { return m_Pending.isDone(); }
+    [[nodiscard]] PipelineBuilderStats getStats() const;
+    [[nodiscard]] PipelineLayoutCache &getLayoutCache() { return m_LayoutCache; }
+    [[nodiscard]] ShaderCacheStats getShaderCacheStats() const { return m_ShaderCache.getStats(); }
+
+private:
+    struct ShaderModule {
+        VkShaderModule module;
+        ShaderReflection reflection;
+    };
+
+    enum class ReloadPhase : uint8_t {
+        Idle,
+        Modules,  // Compiling the changed shaders
+        Pipelines // Compiling the pipelines using them
+    };
+
+    struct ReloadedModule {
+        std::string path;
+        ShaderModule shaderModule{VK_NULL_HANDLE, {}};
+        std::exception_ptr error;
+    };
+
+    struct RetiredPipeline {
+        uint64_t frameValue;
+        std::unique_ptr<Pipeline> pipeline;
+    };
+
+    [[nodiscard]] ShaderModule createShaderModule(const std::string &path);
+    void loadShaderModules(std::vector<std::string> paths);
+    void compile(PipelineHandle::State &state, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule);
+    void build(const PipelineDesc &desc, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule,
+               std::unique_ptr<Pipeline> &pipeline, std::exception_ptr &error) const;
+    void beginReload();
+    void compileReloadedPipelines();
+    void swapReloadedPipelines(uint64_t frameValue);
+
+    Device &deviceRef;
+    JobSystem &jobSystemRef;
+
+    PipelineLayoutCache m_LayoutCache;
+    ShaderCache m_ShaderCache;
+    std::unordered_map<std::string, ShaderModule> m_ShaderModules; // Not shared with the workers
+    std::vector<VkShaderModule> m_ReplacedModules; // Jobs may still use them, destroyed with the builder
+    std::vector<std::weak_ptr<PipelineHandle::State>> m_States; // Every pipeline a reload could rebuild
+    JobCounter m_Pending;
+
+    ReloadPhase m_ReloadPhase = ReloadPhase::Idle;
+    std::vector<std::string> m_ReloadQueue;
+    std::vector<ReloadedModule> m_ReloadedModules;
+    std::vector<std::shared_ptr<PipelineHandle::State>> m_Reloading;
+    std::deque<RetiredPipeline> m_Retired;
+    JobCounter m_ReloadPending;
+
+    mutable std::mutex m_StatsMutex;
+    PipelineBuilderStats m_Stats{};
+    std::chrono::steady_clock::time_point m_FirstSubmit{};
+};
+
+} // Namespace KaguEngine
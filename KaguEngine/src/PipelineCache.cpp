@@ -0,0 +1,174 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.PipelineCache;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the file format
+constexpr uint32_t FILE_MAGIC = 0x4350474B; // "KGPC"
+constexpr uint32_t FILE_VERSION = 1;
+
+// Precedes the driver's data, which starts with a VkPipelineCacheHeaderVersionOne
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t dataSize;
+    uint64_t checksum;
+};
+
+uint64_t fnv1a(const std::span<const char> data) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char byte: data) {
+        hash = (hash ^ static_cast<uint8_t>(byte)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+}
+
+PipelineCache::PipelineCache(const VkDevice device, const VkPhysicalDeviceProperties &properties,
+                             std::filesystem::path path) :
+    m_Device{device}, m_Properties{properties}, m_Path{std::move(path)} {
+    const std::vector<char> data = load();
+    m_Stats.warm = !data.empty();
+    m_Stats.loadedBytes = data.size();
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(m_Device, &createInfo, AllocationTracker::callbacks(), &m_Cache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+}
+
+PipelineCache::~PipelineCache() {
+    saveIfChanged();
+    vkDestroyPipelineCache(m_Device, m_Cache, AllocationTracker::callbacks());
+}
+
+void PipelineCache::recordCreation(const double milliseconds) {
+    std::lock_guard lock{m_StatsMutex};
+    m_Stats.pipelineCount++;
+    m_Stats.creationMs += milliseconds;
+}
+
+PipelineCacheStats PipelineCache::getStats() const {
+    std::lock_guard lock{m_StatsMutex};
+    return m_Stats;
+}
+
+std::vector<char> PipelineCache::load() {
+    std::ifstream file{m_Path, std::ios::ate | std::ios::binary};
+    if (!file.is_open()) {
+        return {};
+    }
+
+    const auto reject = [&](const std::string_view reason) {
+        std::cout << "[PipelineCache] Ignoring " << m_Path.string() << ": " << reason << '\n';
+        return std::vector<char>{};
+    };
+
+    const size_t fileSize = static_cast<size_t>(file.tellg());
+    FileHeader header{};
+    if (fileSize < sizeof(header)) {
+        return reject("truncated header");
+    }
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+        return reject("unknown format");
+    }
+    if (header.dataSize != fileSize - sizeof(header)) {
+        return reject("truncated data");
+    }
+
+    std::vector<char> data(header.dataSize);
+    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file || fnv1a(data) != header.checksum) {
+        return reject("checksum mismatch");
+    }
+
+    // Some drivers don't validate the blob themselves
+    VkPipelineCacheHeaderVersionOne cacheHeader{};
+    if (data.size() < sizeof(cacheHeader)) {
+        return reject("truncated driver header");
+    }
+    std::memcpy(&cacheHeader, data.data(), sizeof(cacheHeader));
+    if (cacheHeader.headerSize < sizeof(cacheHeader) ||
+        cacheHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        return reject("unknown driver header");
+    }
+    if (cacheHeader.vendorID != m_Properties.vendorID || cacheHeader.deviceID != m_Properties.deviceID) {
+        return reject("written for another device");
+    }
+    if (std::memcmp(cacheHeader.pipelineCacheUUID, m_Properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        return reject("written by another driver version");
+    }
+    return data;
+}
+
+void PipelineCache::save() {
+    // Taken first, the pipelines created during the save count for the next one
+    uint32_t pipelineCount = 0;
+    {
+        std::lock_guard lock{m_StatsMutex};
+        pipelineCount = m_Stats.pipelineCount;
+    }
+
+    // The builder's workers keep adding pipelines, the cache can grow between the two calls
+    std::vector<char> data;
+    VkResult result = VK_INCOMPLETE;
+    while (result == VK_INCOMPLETE) {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(m_Device, m_Cache, &dataSize, nullptr) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to get pipeline cache size!");
+        }
+        data.resize(dataSize);
+        result = vkGetPipelineCacheData(m_Device, m_Cache, &dataSize, data.data());
+        if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+            throw std::runtime_error("Failed to get pipeline cache data!");
+        }
+        data.resize(dataSize);
+    }
+
+    const FileHeader header{FILE_MAGIC, FILE_VERSION, data.size(), fnv1a(data)};
+    std::filesystem::path temporaryPath = m_Path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file{temporaryPath, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file.flush()) {
+            throw std::runtime_error("Failed to write pipeline cache!");
+        }
+    }
+    std::filesystem::rename(temporaryPath, m_Path);
+
+    std::lock_guard lock{m_StatsMutex};
+    m_SavedPipelineCount = pipelineCount;
+}
+
+void PipelineCache::saveIfChanged() {
+    {
+        std::lock_guard lock{m_StatsMutex};
+        if (m_Stats.pipelineCount == m_SavedPipelineCount) {
+            return;
+        }
+    }
+    // Periodic, a failed save is tried again at the next one
+    try {
+        save();
+    } catch (const std::exception &exception) {
+        std::cerr << "[PipelineCache] " << exception.what() << '\n';
+    }
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,55 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.PipelineCache;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+struct PipelineCacheStats {
+    bool warm = false;          // A valid cache was loaded from disk
+    size_t loadedBytes = 0;
+    uint32_t pipelineCount = 0; // Created through the cache since startup
+    double creationMs = 0.0;    // Summed over those pipelines
+};
+
+// VkPipelineCache kept on disk between runs, shared by every pipeline creation.
+// A file written by another driver, device or a crashed save is ignored and the cache starts empty.
+class PipelineCache {
+public:
+    PipelineCache(VkDevice device, const VkPhysicalDeviceProperties &properties, std::filesystem::path path);
+    ~PipelineCache(); // Saves
+
+    // Non copyable
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+
+    [[nodiscard]] VkPipelineCache get() const { return m_Cache; }
+
+    // Thread safe
+    void recordCreation(double milliseconds);
+    [[nodiscard]] PipelineCacheStats getStats() const;
+
+    // Written to a temporary file renamed over the old one, so the file is always complete
+    void save();
+    // Saves when pipelines were created since the last save, logging a failure instead of throwing
+    void saveIfChanged();
+
+private:
+    [[nodiscard]] std::vector<char> load();
+
+    VkDevice m_Device;
+    VkPhysicalDeviceProperties m_Properties;
+    std::filesystem::path m_Path;
+    VkPipelineCache m_Cache = VK_NULL_HANDLE;
+
+    mutable std::mutex m_StatsMutex;
+    PipelineCacheStats m_Stats{};
+    uint32_t m_SavedPipelineCount = 0;
+};
+
+} // Namespace KaguEngine
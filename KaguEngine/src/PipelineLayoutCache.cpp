@@ -0,0 +1,111 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.PipelineLayoutCache;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+import KaguEngine.ShaderReflection;
+
+namespace KaguEngine {
+
+PipelineLayoutCache::PipelineLayoutCache(Device &device) : deviceRef{device} {}
+
+PipelineLayoutCache::~PipelineLayoutCache() {
+    for (const VkPipelineLayout pipelineLayout: m_PipelineLayouts | std::views::values) {
+        vkDestroyPipelineLayout(deviceRef.device(), pipelineLayout, AllocationTracker::callbacks());
+    }
+    for (const VkDescriptorSetLayout setLayout: m_SetLayouts | std::views::values) {
+        vkDestroyDescriptorSetLayout(deviceRef.device(), setLayout, AllocationTracker::callbacks());
+    }
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(const std::span<const VkDescriptorSetLayoutBinding> bindings) {
+    // The shaders' stages are dropped, they would make the sets of two pipelines incompatible
+    std::vector<VkDescriptorSetLayoutBinding> sortedBindings{bindings.begin(), bindings.end()};
+    std::ranges::sort(sortedBindings, {}, &VkDescriptorSetLayoutBinding::binding);
+    SetLayoutKey key;
+    for (VkDescriptorSetLayoutBinding &binding: sortedBindings) {
+        binding.stageFlags = STAGES;
+        key.push_back({binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount,
+                       binding.stageFlags});
+    }
+
+    std::lock_guard lock{m_Mutex};
+    if (const auto it = m_SetLayouts.find(key); it != m_SetLayouts.end()) {
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(sortedBindings.size());
+    layoutInfo.pBindings = sortedBindings.data();
+
+    VkDescriptorSetLayout setLayout;
+    if (vkCreateDescriptorSetLayout(deviceRef.device(), &layoutInfo,
+                                    AllocationTracker::callbacks(), &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout!");
+    }
+    m_SetLayouts.emplace(std::move(key), setLayout);
+    return setLayout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const std::span<const VkDescriptorSetLayout> setLayouts) {
+    std::vector<VkDescriptorSetLayout> key{setLayouts.begin(), setLayouts.end()};
+
+    std::lock_guard lock{m_Mutex};
+    if (const auto it = m_PipelineLayouts.find(key); it != m_PipelineLayouts.end()) {
+        return it->second;
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = STAGES;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = PUSH_CONSTANT_SIZE;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(key.size());
+    pipelineLayoutInfo.pSetLayouts = key.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkPipelineLayout pipelineLayout;
+    if (vkCreatePipelineLayout(deviceRef.device(), &pipelineLayoutInfo,
+                               AllocationTracker::callbacks(), &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+    m_PipelineLayouts.emplace(std::move(key), pipelineLayout);
+    return pipelineLayout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const ShaderReflection &reflection) {
+    if (reflection.pushConstantSize > PUSH_CONSTANT_SIZE) {
+        throw std::runtime_error(std::format("Failed to lay out push constants: {} bytes, {} at most!",
+                                             reflection.pushConstantSize, PUSH_CONSTANT_SIZE));
+    }
+
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    setLayouts.reserve(reflection.sets.size());
+    for (const auto &bindings: reflection.sets) {
+        setLayouts.push_back(getSetLayout(bindings));
+    }
+    return getPipelineLayout(setLayouts);
+}
+
+size_t PipelineLayoutCache::getSetLayoutCount() const {
+    std::lock_guard lock{m_Mutex};
+    return m_SetLayouts.size();
+}
+
+size_t PipelineLayoutCache::getPipelineLayoutCount() const {
+    std::lock_guard lock{m_Mutex};
+    return m_PipelineLayouts.size();
+}
+
+} // Namespace KaguEngine
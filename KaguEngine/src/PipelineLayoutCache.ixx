@@ -0,0 +1,49 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.PipelineLayoutCache;
+
+// std
+import std;
+
+import KaguEngine.Device;
+import KaguEngine.ShaderReflection;
+
+export namespace KaguEngine {
+
+// Deduplicates the set and pipeline layouts built from shader reflection. Every layout uses the same
+// stages and push constant range, so any two are compatible up to the last set they define identically:
+// a set bound once stays bound across pipelines.
+class PipelineLayoutCache {
+public:
+    static constexpr VkShaderStageFlags STAGES = VK_SHADER_STAGE_ALL_GRAPHICS;
+    static constexpr uint32_t PUSH_CONSTANT_SIZE = 128; // The minimum every device supports
+
+    explicit PipelineLayoutCache(Device &device);
+    ~PipelineLayoutCache();
+
+    // Non copyable
+    PipelineLayoutCache(const PipelineLayoutCache &) = delete;
+    PipelineLayoutCache &operator=(const PipelineLayoutCache &) = delete;
+
+    // Thread safe, the layouts live as long as the cache
+    [[nodiscard]] VkDescriptorSetLayout getSetLayout(std::span<const VkDescriptorSetLayoutBinding> bindings);
+    [[nodiscard]] VkPipelineLayout getPipelineLayout(std::span<const VkDescriptorSetLayout> setLayouts);
+    [[nodiscard]] VkPipelineLayout getPipelineLayout(const ShaderReflection &reflection);
+
+    [[nodiscard]] size_t getSetLayoutCount() const;
+    [[nodiscard]] size_t getPipelineLayoutCount() const;
+
+private:
+    using SetLayoutKey = std::vector<std::array<uint32_t, 4>>; // Binding, type, count, stages
+
+    Device &deviceRef;
+
+    mutable std::mutex m_Mutex;
+    std::map<SetLayoutKey, VkDescriptorSetLayout> m_SetLayouts;
+    std::map<std::vector<VkDescriptorSetLayout>, VkPipelineLayout> m_PipelineLayouts;
+};
+
+} // Namespace KaguEngine
@@ -0,0 +1,624 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.RenderGraph;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.Device;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for internal helpers
+constexpr VkAccessFlags2 WRITE_ACCESS =
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT |
+    VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+VkImageUsageFlags getImageUsageFlags(const ImageUsage usage) {
+    switch (usage) {
+        case ImageUsage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case ImageUsage::DepthAttachment: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case ImageUsage::Sampled:         return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ImageUsage::TransferSource:  return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        default:                          return 0;
+    }
+}
+
+const char *getUsageName(const ImageUsage usage) {
+    switch (usage) {
+        case ImageUsage::ColorAttachment: return "color";
+        case ImageUsage::DepthAttachment: return "depth";
+        case ImageUsage::Sampled:         return "sampled";
+        case ImageUsage::TransferSource:  return "transfer";
+        case ImageUsage::Present:         return "present";
+        default:                          return "unknown";
+    }
+}
+
+VkImageAspectFlags getAspect(const VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+VkImageMemoryBarrier2 makeBarrier(const VkImage image, const VkImageAspectFlags aspect, const ImageState &source,
+                                  const ImageState &destination) {
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = source.stages;
+    barrier.srcAccessMask = source.access & WRITE_ACCESS; // Reads have nothing to make available
+    barrier.dstStageMask = destination.stages;
+    barrier.dstAccessMask = destination.access;
+    barrier.oldLayout = source.layout;
+    barrier.newLayout = destination.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {aspect, 0, 1, 0, 1};
+    return barrier;
+}
+
+// What the barriers of an image have to wait on so far
+struct TrackedState {
+    VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE; // Reads already synchronized with the write
+    VkAccessFlags2 readAccess = VK_ACCESS_2_NONE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    void reset(const ImageState &state) {
+        const bool write = (state.access & WRITE_ACCESS) != 0;
+        writeStages = write ? state.stages : VK_PIPELINE_STAGE_2_NONE;
+        writeAccess = write ? state.access & WRITE_ACCESS : VK_ACCESS_2_NONE;
+        readStages = write ? VK_PIPELINE_STAGE_2_NONE : state.stages;
+        readAccess = write ? VK_ACCESS_2_NONE : state.access;
+        layout = state.layout;
+    }
+    [[nodiscard]] ImageState toState() const {
+        if (readStages != VK_PIPELINE_STAGE_2_NONE) {
+            return {readStages, readAccess, layout};
+        }
+        return {writeStages, writeAccess, layout};
+    }
+};
+}
+
+ImageState getImageState(const ImageUsage usage) {
+    switch (usage) {
+        case ImageUsage::ColorAttachment:
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        case ImageUsage::DepthAttachment:
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        case ImageUsage::Sampled:
+            return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case ImageUsage::TransferSource:
+            return {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        case ImageUsage::Present:
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        default:
+            throw std::runtime_error("Unknown render graph image usage!");
+    }
+}
+
+void cmdImageBarrier(const VkCommandBuffer commandBuffer, const VkImage image, const VkImageAspectFlags aspect,
+                     const ImageState &source, const ImageState &destination) {
+    const VkImageMemoryBarrier2 barrier = makeBarrier(image, aspect, source, destination);
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::read(const RenderResource resource, const ImageUsage usage) {
+    graphRef.addAccess(m_Pass, resource, usage, false);
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::write(const RenderResource resource, const ImageUsage usage) {
+    graphRef.addAccess(m_Pass, resource, usage, true);
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::sideEffect() {
+    graphRef.m_Passes[m_Pass].sideEffect = true;
+    return *this;
+}
+
+RenderGraph::RenderGraph(Device &device, const uint32_t framesInFlight) :
+    deviceRef{device}, m_FramesInFlight{framesInFlight} {}
+
+RenderGraph::~RenderGraph() {
+    destroyHeap(m_Heap);
+    for (auto &heap: m_RetiredHeaps) {
+        destroyHeap(heap);
+    }
+}
+
+void RenderGraph::reset() {
+    m_Passes.clear();
+    m_Resources.clear();
+    m_Barriers.clear();
+    m_SlotStates.clear();
+    m_FinalBarrierBegin = 0;
+}
+
+RenderResource RenderGraph::importImage(std::string name, const VkImage image, const VkImageView view,
+                                        const VkImageAspectFlags aspect, const ImageState &initialState,
+                                        const std::optional<ImageUsage> finalUsage) {
+    Resource &resource = m_Resources.emplace_back();
+    resource.name = std::move(name);
+    resource.imported = true;
+    resource.image = image;
+    resource.view = view;
+    resource.aspect = aspect;
+    resource.initialState = initialState;
+    resource.finalState = initialState;
+    resource.finalUsage = finalUsage;
+    return static_cast<RenderResource>(m_Resources.size() - 1);
+}
+
+RenderResource RenderGraph::createImage(std::string name, const TransientImageDesc &desc) {
+    Resource &resource = m_Resources.emplace_back();
+    resource.name = std::move(name);
+    resource.desc = desc;
+    resource.aspect = getAspect(desc.format);
+    return static_cast<RenderResource>(m_Resources.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(std::string name, PassFunction function) {
+    Pass &pass = m_Passes.emplace_back();
+    pass.name = std::move(name);
+    pass.function = std::move(function);
+    return PassBuilder{*this, static_cast<uint32_t>(m_Passes.size() - 1)};
+}
+
+void RenderGraph::addAccess(const uint32_t pass, const RenderResource resource, const ImageUsage usage,
+                            const bool write) {
+    if (resource >= m_Resources.size()) {
+        throw std::runtime_error("Render graph pass uses an unknown image!");
+    }
+    auto &accesses = m_Passes[pass].accesses;
+    if (std::ranges::any_of(accesses, [&](const Access &access) { return access.resource == resource; })) {
+        throw std::runtime_error("Render graph pass uses an image twice!");
+    }
+    accesses.push_back({resource, usage, write});
+}
+
+void RenderGraph::compile() {
+    // A heap retired that many compiles ago isn't used by any frame in flight anymore
+    std::erase_if(m_RetiredHeaps, [&](TransientHeap &heap) {
+        if (++heap.retiredFrames <= m_FramesInFlight) {
+            return false;
+        }
+        destroyHeap(heap);
+        return true;
+    });
+
+    cullPasses();
+    computeLifetimes();
+    allocateTransients();
+    computeBarriers();
+}
+
+void RenderGraph::execute(const VkCommandBuffer commandBuffer, GpuProfiler *profiler) const {
+    const auto recordBarriers = [&](const uint32_t begin, const uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = count;
+        dependencyInfo.pImageMemoryBarriers = m_Barriers.data() + begin;
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    };
+
+    for (const Pass &pass: m_Passes) {
+        if (pass.culled) {
+            continue;
+        }
+        GpuProfiler::Scope scope{profiler, commandBuffer, pass.name};
+        recordBarriers(pass.barrierBegin, pass.barrierCount);
+        pass.function(commandBuffer);
+    }
+    recordBarriers(m_FinalBarrierBegin, static_cast<uint32_t>(m_Barriers.size()) - m_FinalBarrierBegin);
+}
+
+void RenderGraph::cullPasses() {
+    // A pass stays while something reads one of its images, outputs of the graph count as a reader
+    std::vector<uint32_t> passRefs(m_Passes.size(), 0);
+    std::vector<uint32_t> resourceRefs(m_Resources.size(), 0);
+    for (uint32_t i = 0; i < m_Passes.size(); i++) {
+        for (const Access &access: m_Passes[i].accesses) {
+            (access.write ? passRefs[i] : resourceRefs[access.resource])++;
+        }
+    }
+
+    std::vector<RenderResource> unreferenced;
+    for (RenderResource i = 0; i < m_Resources.size(); i++) {
+        if (m_Resources[i].finalUsage) {
+            resourceRefs[i]++;
+        }
+        if (resourceRefs[i] == 0) {
+            unreferenced.push_back(i);
+        }
+    }
+
+    const auto cull = [&](const uint32_t passIndex) {
+        Pass &pass = m_Passes[passIndex];
+        pass.culled = true;
+        for (const Access &access: pass.accesses) {
+            if (!access.write && --resourceRefs[access.resource] == 0) {
+                unreferenced.push_back(access.resource);
+            }
+        }
+    };
+
+    for (uint32_t i = 0; i < m_Passes.size(); i++) {
+        if (passRefs[i] == 0 && !m_Passes[i].sideEffect) {
+            cull(i);
+        }
+    }
+    while (!unreferenced.empty()) {
+        const RenderResource resource = unreferenced.back();
+        unreferenced.pop_back();
+        for (uint32_t i = 0; i < m_Passes.size(); i++) {
+            const Pass &pass = m_Passes[i];
+            if (pass.culled || pass.sideEffect) {
+                continue;
+            }
+            const bool writes = std::ranges::any_of(pass.accesses, [&](const Access &access) {
+                return access.write && access.resource == resource;
+            });
+            if (writes && --passRefs[i] == 0) {
+                cull(i);
+            }
+        }
+    }
+}
+
+void RenderGraph::computeLifetimes() {
+    for (uint32_t i = 0; i < m_Passes.size(); i++) {
+        if (m_Passes[i].culled) {
+            continue;
+        }
+        for (const Access &access: m_Passes[i].accesses) {
+            Resource &resource = m_Resources[access.resource];
+            resource.firstPass = std::min(resource.firstPass, i);
+            resource.lastPass = std::max(resource.lastPass, i);
+            resource.usage |= getImageUsageFlags(access.usage);
+        }
+    }
+
+    // Attachments that are never sampled don't need to be backed by memory on tiled GPUs
+    for (Resource &resource: m_Resources) {
+        constexpr VkImageUsageFlags attachmentUsage =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if (!resource.imported && resource.usage != 0 && (resource.usage & ~attachmentUsage) == 0) {
+            resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+    }
+}
+
+void RenderGraph::allocateTransients() {
+    std::vector<RenderResource> transients;
+    std::vector<TransientKey> keys;
+    for (RenderResource i = 0; i < m_Resources.size(); i++) {
+        const Resource &resource = m_Resources[i];
+        if (!resource.imported && resource.usage != 0) {
+            transients.push_back(i);
+            keys.push_back({resource.desc, resource.usage, resource.firstPass, resource.lastPass});
+        }
+    }
+
+    // Same images with the same lifetimes as last frame, which is almost always the case
+    if (keys != m_Heap.keys) {
+        if (m_Heap.memory != VK_NULL_HANDLE) {
+            m_RetiredHeaps.push_back(std::exchange(m_Heap, {}));
+        }
+        m_Heap.keys = std::move(keys);
+        buildHeap(m_Heap, transients);
+    }
+
+    uint32_t slotCount = 0;
+    for (uint32_t i = 0; i < transients.size(); i++) {
+        Resource &resource = m_Resources[transients[i]];
+        resource.image = m_Heap.images[i];
+        resource.view = m_Heap.views[i];
+        resource.slot = m_Heap.slots[i];
+        slotCount = std::max(slotCount, resource.slot + 1);
+    }
+
+    // The first use of a slot's memory waits for everything that used it, earlier in this frame or in the last
+    m_SlotStates.assign(slotCount, {});
+    for (uint32_t i = 0; i < m_Passes.size(); i++) {
+        if (m_Passes[i].culled) {
+            continue;
+        }
+        for (const Access &access: m_Passes[i].accesses) {
+            const Resource &resource = m_Resources[access.resource];
+            if (resource.imported) {
+                continue;
+            }
+            const ImageState state = getImageState(access.usage);
+            m_SlotStates[resource.slot].stages |= state.stages;
+            m_SlotStates[resource.slot].access |= state.access & WRITE_ACCESS;
+        }
+    }
+    m_Stats = m_Heap.stats;
+}
+
+void RenderGraph::buildHeap(TransientHeap &heap, const std::vector<RenderResource> &transients) const {
+    const auto device = deviceRef.device();
+
+    heap.images.resize(transients.size());
+    heap.views.resize(transients.size());
+    heap.slots.resize(transients.size());
+    heap.stats = {};
+    heap.stats.imageCount = static_cast<uint32_t>(transients.size());
+    if (transients.empty()) {
+        return;
+    }
+
+    std::vector<VkMemoryRequirements> requirements(transients.size());
+    for (size_t i = 0; i < transients.size(); i++) {
+        const Resource &resource = m_Resources[transients[i]];
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {resource.desc.extent.width, resource.desc.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = resource.desc.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = resource.usage;
+        imageInfo.samples = resource.desc.samples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(device, &imageInfo, AllocationTracker::callbacks(), &heap.images[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create transient image!");
+        }
+        vkGetImageMemoryRequirements(device, heap.images[i], &requirements[i]);
+        heap.stats.unaliasedBytes += requirements[i].size;
+    }
+
+    // Largest first, each image goes to the first slot big enough whose images all live in other passes
+    struct Slot {
+        VkDeviceSize size = 0;
+        VkDeviceSize alignment = 1;
+        VkDeviceSize offset = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+    };
+    std::vector<Slot> slots;
+    std::vector<size_t> order(transients.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::ranges::stable_sort(order, std::greater{}, [&](const size_t i) { return requirements[i].size; });
+
+    uint32_t memoryTypeBits = ~0u;
+    for (const size_t i: order) {
+        const Resource &resource = m_Resources[transients[i]];
+        const auto overlaps = [&](const std::pair<uint32_t, uint32_t> &lifetime) {
+            return resource.firstPass <= lifetime.second && lifetime.first <= resource.lastPass;
+        };
+        const auto slot = std::ranges::find_if(slots, [&](const Slot &candidate) {
+            return candidate.size >= requirements[i].size && std::ranges::none_of(candidate.lifetimes, overlaps);
+        });
+        Slot &target = slot != slots.end() ? *slot : slots.emplace_back(Slot{requirements[i].size});
+        target.alignment = std::max(target.alignment, requirements[i].alignment);
+        target.lifetimes.emplace_back(resource.firstPass, resource.lastPass);
+        heap.slots[i] = static_cast<uint32_t>(&target - slots.data());
+        memoryTypeBits &= requirements[i].memoryTypeBits;
+    }
+    if (memoryTypeBits == 0) {
+        throw std::runtime_error("Failed to find a memory type shared by the transient images!");
+    }
+
+    VkDeviceSize heapSize = 0;
+    for (Slot &slot: slots) {
+        slot.offset = (heapSize + slot.alignment - 1) / slot.alignment * slot.alignment;
+        heapSize = slot.offset + slot.size;
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = heapSize;
+    allocInfo.memoryTypeIndex = deviceRef.findMemoryType(memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (vkAllocateMemory(device, &allocInfo, AllocationTracker::callbacks(), &heap.memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate transient image memory!");
+    }
+    heap.stats.heapBytes = heapSize;
+
+    for (size_t i = 0; i < transients.size(); i++) {
+        const Resource &resource = m_Resources[transients[i]];
+        if (vkBindImageMemory(device, heap.images[i], heap.memory, slots[heap.slots[i]].offset) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to bind transient image memory!");
+        }
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = heap.images[i];
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = resource.desc.format;
+        // Depth/stencil attachments are viewed through their depth aspect
+        viewInfo.subresourceRange.aspectMask = resource.aspect & VK_IMAGE_ASPECT_DEPTH_BIT
+                                                   ? VK_IMAGE_ASPECT_DEPTH_BIT
+                                                   : resource.aspect;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(device, &viewInfo, AllocationTracker::callbacks(), &heap.views[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create transient image view!");
+        }
+    }
+}
+
+void RenderGraph::destroyHeap(TransientHeap &heap) const {
+    const auto device = deviceRef.device();
+    for (const auto view: heap.views) {
+        vkDestroyImageView(device, view, AllocationTracker::callbacks());
+    }
+    for (const auto image: heap.images) {
+        vkDestroyImage(device, image, AllocationTracker::callbacks());
+    }
+    if (heap.memory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, heap.memory, AllocationTracker::callbacks());
+    }
+    heap = {};
+}
+
+void RenderGraph::computeBarriers() {
+    std::vector<TrackedState> states(m_Resources.size());
+    std::vector<bool> touched(m_Resources.size(), false);
+    for (RenderResource i = 0; i < m_Resources.size(); i++) {
+        states[i].reset(m_Resources[i].initialState);
+    }
+
+    for (Pass &pass: m_Passes) {
+        pass.barrierBegin = static_cast<uint32_t>(m_Barriers.size());
+        pass.barrierCount = 0;
+        if (pass.culled) {
+            continue;
+        }
+
+        for (const Access &access: pass.accesses) {
+            Resource &resource = m_Resources[access.resource];
+            TrackedState &state = states[access.resource];
+            const ImageState target = getImageState(access.usage);
+
+            std::optional<ImageState> source;
+            if (!resource.imported && !touched[access.resource]) {
+                // Whatever the memory held is discarded
+                source = ImageState{m_SlotStates[resource.slot].stages, m_SlotStates[resource.slot].access,
+                                    VK_IMAGE_LAYOUT_UNDEFINED};
+            } else if (state.layout != target.layout) {
+                source = ImageState{state.writeStages | state.readStages, state.writeAccess, state.layout};
+            } else if (access.write) {
+                // Reads since the last write only need to be done, that write was already waited on
+                if (state.readStages != VK_PIPELINE_STAGE_2_NONE) {
+                    source = ImageState{state.readStages, VK_ACCESS_2_NONE, state.layout};
+                } else if (state.writeStages != VK_PIPELINE_STAGE_2_NONE) {
+                    source = ImageState{state.writeStages, state.writeAccess, state.layout};
+                }
+            } else if (state.writeStages != VK_PIPELINE_STAGE_2_NONE &&
+                       ((target.stages & ~state.readStages) != 0 || (target.access & ~state.readAccess) != 0)) {
+                source = ImageState{state.writeStages, state.writeAccess, state.layout};
+            }
+            touched[access.resource] = true;
+
+            if (source) {
+                m_Barriers.push_back(makeBarrier(resource.image, resource.aspect, *source, target));
+                pass.barrierCount++;
+            }
+
+            if (access.write) {
+                state.writeStages = target.stages;
+                state.writeAccess = target.access & WRITE_ACCESS;
+                state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                state.readAccess = VK_ACCESS_2_NONE;
+            } else if (state.layout != target.layout) {
+                // Later reads from other stages chain on the transition
+                state.writeStages = target.stages;
+                state.writeAccess = VK_ACCESS_2_NONE;
+                state.readStages = target.stages;
+                state.readAccess = target.access;
+            } else {
+                state.readStages |= target.stages;
+                state.readAccess |= target.access;
+            }
+            state.layout = target.layout;
+        }
+    }
+
+    m_FinalBarrierBegin = static_cast<uint32_t>(m_Barriers.size());
+    for (RenderResource i = 0; i < m_Resources.size(); i++) {
+        Resource &resource = m_Resources[i];
+        if (!resource.imported) {
+            continue;
+        }
+        if (resource.finalUsage) {
+            const ImageState target = getImageState(*resource.finalUsage);
+            const TrackedState &state = states[i];
+            const bool unsynchronizedWrite = state.writeAccess != VK_ACCESS_2_NONE &&
+                ((target.stages & ~state.readStages) != 0 || (target.access & ~state.readAccess) != 0);
+            if (state.layout != target.layout || unsynchronizedWrite) {
+                const ImageState source{state.writeStages | state.readStages, state.writeAccess, state.layout};
+                m_Barriers.push_back(makeBarrier(resource.image, resource.aspect, source, target));
+            }
+            states[i].reset(target);
+        }
+        resource.finalState = states[i].toState();
+    }
+}
+
+std::string RenderGraph::dumpGraphviz() const {
+    constexpr double MIB = 1024.0 * 1024.0;
+    const auto culledCount = std::ranges::count_if(m_Passes, [](const Pass &pass) { return pass.culled; });
+
+    std::string graph = std::format("digraph RenderGraph {{\n"
+                                    "    label=\"{} passes, {} culled | {} barriers | transient heap {:.1f} MiB, "
+                                    "{:.1f} MiB without aliasing\";\n"
+                                    "    rankdir=LR;\n"
+                                    "    node [fontname=\"monospace\"];\n",
+                                    m_Passes.size(), culledCount, m_Barriers.size(),
+                                    static_cast<double>(m_Stats.heapBytes) / MIB,
+                                    static_cast<double>(m_Stats.unaliasedBytes) / MIB);
+    for (uint32_t i = 0; i < m_Passes.size(); i++) {
+        const Pass &pass = m_Passes[i];
+        graph += std::format("    p{} [shape=box, label=\"{}\\n{}\"{}];\n", i, pass.name,
+                             pass.culled ? "culled" : std::format("{} barrier(s)", pass.barrierCount),
+                             pass.culled ? ", style=dashed, color=gray" : "");
+    }
+    for (RenderResource i = 0; i < m_Resources.size(); i++) {
+        const Resource &resource = m_Resources[i];
+        if (resource.imported) {
+            graph += std::format("    r{} [shape=ellipse, style=bold, label=\"{}\\nimported{}\"];\n", i, resource.name,
+                                 resource.finalUsage ? std::format(", then {}", getUsageName(*resource.finalUsage))
+                                                     : "");
+        } else if (resource.usage == 0) {
+            graph += std::format("    r{} [shape=ellipse, style=dashed, color=gray, label=\"{}\\nunused\"];\n", i,
+                                 resource.name);
+        } else {
+            graph += std::format("    r{} [shape=ellipse, label=\"{}\\n{}x{} x{} samples\\nslot {}, passes {}-{}\"];\n",
+                                 i, resource.name, resource.desc.extent.width, resource.desc.extent.height,
+                                 static_cast<uint32_t>(resource.desc.samples), resource.slot, resource.firstPass,
+                                 resource.lastPass);
+        }
+    }
+    for (uint32_t i = 0; i < m_Passes.size(); i++) {
+        for (const Access &access: m_Passes[i].accesses) {
+            if (access.write) {
+                graph += std::format("    p{} -> r{} [label=\"{}\"];\n", i, access.resource,
+                                     getUsageName(access.usage));
+            } else {
+                graph += std::format("    r{} -> p{} [label=\"{}\"];\n", access.resource, i,
+                                     getUsageName(access.usage));
+            }
+        }
+    }
+    graph += "}\n";
+    return graph;
+}
+
+} // Namespace KaguEngine
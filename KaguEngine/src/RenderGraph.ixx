@@ -0,0 +1,181 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.RenderGraph;
+
+// std
+import std;
+
+import KaguEngine.Device;
+import KaguEngine.GpuProfiler;
+
+export namespace KaguEngine {
+
+using RenderResource = uint32_t;
+constexpr RenderResource INVALID_RENDER_RESOURCE = std::numeric_limits<RenderResource>::max();
+
+// How a pass uses an image, decides the layout and the stages the barriers wait on
+enum class ImageUsage : uint8_t {
+    ColorAttachment, // Also the resolve target of a multisampled attachment
+    DepthAttachment,
+    Sampled,         // Read by the fragment shader
+    TransferSource,  // Copied from, the captures read the scene back
+    Present
+};
+
+// Where an image was last used, the source of the next barrier
+struct ImageState {
+    VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+[[nodiscard]] ImageState getImageState(ImageUsage usage);
+// One-off barrier outside a graph
+void cmdImageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageAspectFlags aspect,
+                     const ImageState &source, const ImageState &destination);
+
+// Image owned by the graph, it only lives between its first and its last pass
+struct TransientImageDesc {
+    VkExtent2D extent{};
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+    bool operator==(const TransientImageDesc &other) const {
+        return extent.width == other.extent.width && extent.height == other.extent.height && format == other.format &&
+               samples == other.samples;
+    }
+};
+
+struct TransientStats {
+    uint32_t imageCount = 0;
+    VkDeviceSize heapBytes = 0;      // Memory actually allocated
+    VkDeviceSize unaliasedBytes = 0; // What the images would take without aliasing
+};
+
+// Built again every frame: passes declare the images they read and write, compile() culls the passes nothing
+// depends on, places the transient images in one heap where lifetimes don't overlap and works out the barriers.
+// execute() then records everything with one vkCmdPipelineBarrier2 per pass at most.
+class RenderGraph {
+public:
+    using PassFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+    class PassBuilder {
+    public:
+        PassBuilder &read(RenderResource resource, ImageUsage usage);
+        PassBuilder &write(RenderResource resource, ImageUsage usage);
+        // Kept even when nothing reads what it writes
+        PassBuilder &sideEffect();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph &graph, const uint32_t pass) : graphRef{graph}, m_Pass{pass} {}
+
+        RenderGraph &graphRef;
+        uint32_t m_Pass;
+    };
+
+    // framesInFlight: compiles to wait before the memory of an older heap is reused
+    RenderGraph(Device &device, uint32_t framesInFlight);
+    ~RenderGraph();
+
+    // Non copyable
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    void reset();
+    // An image kept by its owner. With a final usage, it's an output of the graph and transitioned to it at the end.
+    RenderResource importImage(std::string name, VkImage image, VkImageView view, VkImageAspectFlags aspect,
+                               const ImageState &initialState, std::optional<ImageUsage> finalUsage = std::nullopt);
+    RenderResource createImage(std::string name, const TransientImageDesc &desc);
+    PassBuilder addPass(std::string name, PassFunction function);
+
+    void compile();
+    // Every pass, with its barriers, is a top level scope of profiler when there's one
+    void execute(VkCommandBuffer commandBuffer, GpuProfiler *profiler = nullptr) const;
+
+    // Valid after compile()
+    [[nodiscard]] VkImageView getImageView(RenderResource resource) const { return m_Resources[resource].view; }
+    // State an imported image is left in, the initial state of the next frame
+    [[nodiscard]] ImageState getFinalState(RenderResource resource) const { return m_Resources[resource].finalState; }
+    [[nodiscard]] const TransientStats &getTransientStats() const { return m_Stats; }
+    [[nodiscard]] std::string dumpGraphviz() const;
+
+private:
+    struct Access {
+        RenderResource resource;
+        ImageUsage usage;
+        bool write;
+    };
+
+    struct Pass {
+        std::string name;
+        PassFunction function;
+        std::vector<Access> accesses;
+        bool sideEffect = false;
+        bool culled = false;
+        uint32_t barrierBegin = 0; // Range in m_Barriers recorded before the pass
+        uint32_t barrierCount = 0;
+    };
+
+    struct Resource {
+        std::string name;
+        bool imported = false;
+        TransientImageDesc desc{};
+        VkImageUsageFlags usage = 0; // Transient images, from the passes using them
+        VkImageAspectFlags aspect = 0;
+        std::optional<ImageUsage> finalUsage;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        ImageState initialState{};
+        ImageState finalState{};
+        uint32_t firstPass = std::numeric_limits<uint32_t>::max();
+        uint32_t lastPass = 0;
+        uint32_t slot = 0; // Transient images sharing a slot share memory
+    };
+
+    // What a heap was built for, an identical one is reused by the next frames
+    struct TransientKey {
+        TransientImageDesc desc;
+        VkImageUsageFlags usage;
+        uint32_t firstPass;
+        uint32_t lastPass;
+
+        bool operator==(const TransientKey &) const = default;
+    };
+
+    struct TransientHeap {
+        std::vector<TransientKey> keys;
+        std::vector<VkImage> images;
+        std::vector<VkImageView> views;
+        std::vector<uint32_t> slots;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        TransientStats stats{};
+        uint32_t retiredFrames = 0;
+    };
+
+    void addAccess(uint32_t pass, RenderResource resource, ImageUsage usage, bool write);
+    void cullPasses();
+    void computeLifetimes();
+    void allocateTransients();
+    void buildHeap(TransientHeap &heap, const std::vector<RenderResource> &transients) const;
+    void destroyHeap(TransientHeap &heap) const;
+    void computeBarriers();
+
+    Device &deviceRef;
+    uint32_t m_FramesInFlight;
+
+    std::vector<Pass> m_Passes;
+    std::vector<Resource> m_Resources;
+    std::vector<VkImageMemoryBarrier2> m_Barriers;
+    uint32_t m_FinalBarrierBegin = 0;
+    std::vector<ImageState> m_SlotStates; // Every use of a slot's memory this frame
+
+    TransientHeap m_Heap;
+    std::vector<TransientHeap> m_RetiredHeaps; // Still used by frames in flight
+    TransientStats m_Stats{};
+};
+
+} // Namespace KaguEngine
@@ -0,0 +1,60 @@
+module KaguEngine.RenderThread;
+
+// std
+import std;
+
+import KaguEngine.CpuProfiler;
+import KaguEngine.FrameInfo;
+import KaguEngine.ImGuiContext;
+
+namespace KaguEngine {
+
+RenderThread::RenderThread(RenderFunction function) :
+    m_Function{std::move(function)}, m_Thread{[this] { renderLoop(); }} {}
+
+RenderThread::~RenderThread() {
+    // Frames submitted but not started are dropped
+    m_Stopping.store(true, std::memory_order_relaxed);
+    m_Submitted.fetch_add(1, std::memory_order_release);
+    m_Submitted.notify_one();
+}
+
+void RenderThread::submit() {
+    // With two slots, the one acquired next is the one the previous frame read
+    waitIdle();
+    m_Submitted.fetch_add(1, std::memory_order_release);
+    m_Submitted.notify_one();
+}
+
+void RenderThread::waitIdle() {
+    const uint64_t submitted = m_Submitted.load(std::memory_order_relaxed);
+    for (uint64_t completed = m_Completed.load(std::memory_order_acquire); completed != submitted;
+         completed = m_Completed.load(std::memory_order_acquire)) {
+        m_Completed.wait(completed, std::memory_order_acquire);
+    }
+
+    if (m_Error) {
+        std::rethrow_exception(std::exchange(m_Error, nullptr));
+    }
+}
+
+void RenderThread::renderLoop() {
+    CpuProfiler::setThreadName("Render");
+    for (uint64_t frame = 0;; frame++) {
+        m_Submitted.wait(frame, std::memory_order_acquire);
+        if (m_Stopping.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        try {
+            m_Function(m_Slots[frame % SLOT_COUNT]);
+        } catch (...) {
+            m_Error = std::current_exception();
+        }
+
+        m_Completed.store(frame + 1, std::memory_order_release);
+        m_Completed.notify_one();
+    }
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,51 @@
+export module KaguEngine.RenderThread;
+
+// std
+import std;
+
+import KaguEngine.FrameInfo;
+import KaguEngine.ImGuiContext;
+
+export namespace KaguEngine {
+
+// Everything the main thread hands over for one frame
+struct RenderSlot {
+    RenderPacket packet;
+    UiDrawData ui;
+};
+
+// Records and submits the frames on its own thread. The main thread fills one slot while the render thread
+// consumes the other, so simulating frame N+1 overlaps recording frame N. The handoff is two counters.
+class RenderThread {
+public:
+    static constexpr uint32_t SLOT_COUNT = 2;
+    using RenderFunction = std::function<void(RenderSlot &slot)>;
+
+    explicit RenderThread(RenderFunction function);
+    ~RenderThread();
+
+    // Non copyable
+    RenderThread(const RenderThread &) = delete;
+    RenderThread &operator=(const RenderThread &) = delete;
+
+    // Slot of the next frame, the render thread doesn't touch it before submit()
+    [[nodiscard]] RenderSlot &acquireSlot() { return m_Slots[m_Submitted.load(std::memory_order_relaxed) % SLOT_COUNT]; }
+    // Hands the acquired slot over, after waiting for the previous frame
+    void submit();
+    // Blocks until every submitted frame was recorded, rethrows what the render thread threw
+    void waitIdle();
+
+private:
+    void renderLoop();
+
+    RenderFunction m_Function;
+    std::array<RenderSlot, SLOT_COUNT> m_Slots;
+    std::atomic<uint64_t> m_Submitted{0};
+    std::atomic<uint64_t> m_Completed{0};
+    std::atomic<bool> m_Stopping{false};
+    std::exception_ptr m_Error; // Published by m_Completed
+
+    std::jthread m_Thread; // Last, so it's stopped before anything else goes away
+};
+
+} // Namespace KaguEngine
@@ -1,6 +1,10 @@
 module;
 
+// config
+#include "include/config.hpp"
+
 // libs
+#include <glm/vec4.hpp>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
@@ -12,85 +16,100 @@ module KaguEngine.Renderer;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
 import KaguEngine.Device;
+import KaguEngine.FrameCapture;
+import KaguEngine.FramePacer;
+import KaguEngine.GpuProfiler;
+import KaguEngine.RenderGraph;
 import KaguEngine.SwapChain;
 import KaguEngine.Window;
 
 namespace KaguEngine {
 
-namespace { // Anonymous namespace for internal helpers
-void cmdTransitionImage(
-    VkCommandBuffer commandBuffer,
-    VkImage image,
-    VkImageLayout oldLayout,
-    VkImageLayout newLayout,
-    VkImageSubresourceRange subresourceRange,
-    VkPipelineStageFlags srcStageMask,
-    VkPipelineStageFlags dstStageMask,
-    VkAccessFlags srcAccessMask,
-    VkAccessFlags dstAccessMask) {
-
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange = subresourceRange;
-    barrier.srcAccessMask = srcAccessMask;
-    barrier.dstAccessMask = dstAccessMask;
-
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        srcStageMask, dstStageMask,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier);
+namespace { // Anonymous namespace for the profiler
+std::unique_ptr<GpuProfiler> createGpuProfiler(Device &device) {
+    if (!Config::gpuProfiler || !GpuProfiler::isSupported(device)) {
+        return nullptr;
+    }
+    return std::make_unique<GpuProfiler>(device, FramePacer::MAX_FRAMES_IN_FLIGHT);
 }
 }
 
-Renderer::Renderer(Window &window, Device &device) : windowRef{window}, deviceRef{device} {
+Renderer::Renderer(Window &window, Device &device) :
+    m_Window{&window}, deviceRef{device}, m_FramePacer{std::make_unique<FramePacer>(device)},
+    m_GpuProfiler{createGpuProfiler(device)},
+    m_RenderGraph{std::make_unique<RenderGraph>(device, SwapChain::MAX_FRAMES_IN_FLIGHT)} {
     m_currentImageIndex = 0;
     recreateSwapChain();
     createCommandBuffers();
 }
 
+Renderer::Renderer(Device &device, const VkExtent2D extent) :
+    m_Window{nullptr}, deviceRef{device}, m_FramePacer{std::make_unique<FramePacer>(device)},
+    m_GpuProfiler{createGpuProfiler(device)}, m_HeadlessExtent{extent},
+    m_RenderGraph{std::make_unique<RenderGraph>(device, SwapChain::MAX_FRAMES_IN_FLIGHT)} {
+    m_currentImageIndex = 0;
+    createOffscreenResources();
+    createCommandBuffers();
+}
+
 Renderer::~Renderer() {
     freeCommandBuffers();
     cleanupOffscreenResources(true);
 }
 
 void Renderer::recreateSwapChain() {
-    auto extent = windowRef.getExtent();
+    auto extent = m_Window->getExtent();
     while (extent.width == 0 || extent.height == 0) {
-        extent = windowRef.getExtent();
+        extent = m_Window->getExtent();
         glfwWaitEvents();
     }
-    vkDeviceWaitIdle(deviceRef.device());
+    {
+        const auto queueLock = deviceRef.lockGraphicsQueue();
+        vkDeviceWaitIdle(deviceRef.device());
+    }
     m_OldSwapChain = std::move(m_SwapChain);
     if (m_OldSwapChain == nullptr) {
-        m_SwapChain = std::make_unique<SwapChain>(deviceRef, extent);
+        m_SwapChain = std::make_unique<SwapChain>(deviceRef, extent, *m_FramePacer);
     } else {
         m_OldSwapChainCleanupTimer = 3;
-        m_SwapChain = std::make_unique<SwapChain>(deviceRef, extent, m_OldSwapChain);
+        m_SwapChain = std::make_unique<SwapChain>(deviceRef, extent, *m_FramePacer, m_OldSwapChain);
         if (!m_OldSwapChain->compareSwapFormats(*m_SwapChain)) {
             throw std::runtime_error("Swap chain image(or depth) format has changed!");
         }
     }
-    m_currentFrameIndex = 0;
     m_currentImageIndex = 0;
     createOffscreenResources();
 }
 
+bool Renderer::refreshSwapChain() {
+    // A new pacing mode needs another present mode
+    const bool modeChanged = m_FramePacer->consumeModeChange();
+    if (isHeadless() || (!modeChanged && !m_Window->windowResized())) {
+        return false;
+    }
+    recreateSwapChain();
+    m_Window->resetWindowResizedFlag();
+    return true;
+}
+
 void Renderer::createCommandBuffers() {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = deviceRef.graphicsFamily();
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(deviceRef.device(), &poolInfo,
+                            AllocationTracker::callbacks(), &m_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create frame command pool!");
+    }
+
     m_commandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = deviceRef.getCommandPool();
+    allocInfo.commandPool = m_commandPool;
     allocInfo.commandBufferCount = static_cast<uint32_t>(m_commandBuffers.size());
 
     if (vkAllocateCommandBuffers(deviceRef.device(), &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
@@ -99,56 +118,48 @@ void Renderer::createCommandBuffers() {
 }
 
 void Renderer::freeCommandBuffers() {
-    vkFreeCommandBuffers(deviceRef.device(), deviceRef.getCommandPool(),
+    vkFreeCommandBuffers(deviceRef.device(), m_commandPool,
                          static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
     m_commandBuffers.clear();
+    vkDestroyCommandPool(deviceRef.device(), m_commandPool, AllocationTracker::callbacks());
+    m_commandPool = VK_NULL_HANDLE;
 }
 
 void Renderer::createOffscreenResources() {
     cleanupOffscreenResources();
     static bool persistent = false;
 
-    // Create color attachment
-    VkImageCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    createInfo.imageType = VK_IMAGE_TYPE_2D;
-    createInfo.extent.width = m_SwapChain->getSwapChainExtent().width;
-    createInfo.extent.height = m_SwapChain->getSwapChainExtent().height;
-    createInfo.extent.depth = 1;
-    createInfo.mipLevels = 1;
-    createInfo.arrayLayers = 1;
-    createInfo.format = getFormat();
-    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    createInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    createInfo.samples = deviceRef.getSampleCount();
-    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.flags = 0;
-
     // Create color resolve attachment
     VkImageCreateInfo colorResolveCreateInfo{};
     colorResolveCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     colorResolveCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    colorResolveCreateInfo.extent.width = m_SwapChain->getSwapChainExtent().width;
-    colorResolveCreateInfo.extent.height = m_SwapChain->getSwapChainExtent().height;
+    colorResolveCreateInfo.extent.width = getExtent().width;
+    colorResolveCreateInfo.extent.height = getExtent().height;
     colorResolveCreateInfo.extent.depth = 1;
     colorResolveCreateInfo.mipLevels = 1;
     colorResolveCreateInfo.arrayLayers = 1;
     colorResolveCreateInfo.format = getFormat();
     colorResolveCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     colorResolveCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorResolveCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    colorResolveCreateInfo.usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     colorResolveCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     colorResolveCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     colorResolveCreateInfo.flags = 0;
 
-    // Multi sampled color
-    deviceRef.createImageWithInfo(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_offscreenImage, m_offscreenImageMemory);
-    m_offscreenImageView = m_SwapChain->createImageView(m_offscreenImage, getFormat(), VK_IMAGE_ASPECT_COLOR_BIT, 1);
-
     // Resolve (single sampled)
     deviceRef.createImageWithInfo(colorResolveCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_offscreenResolveImage, m_offscreenResolveMemory);
-    m_offscreenResolveImageView = m_SwapChain->createImageView(m_offscreenResolveImage, getFormat(), VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = m_offscreenResolveImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = getFormat();
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    if (vkCreateImageView(deviceRef.device(), &viewInfo,
+                          AllocationTracker::callbacks(), &m_offscreenResolveImageView) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create offscreen image view!");
+    }
 
     if (!persistent) {
         // Create sampler
@@ -165,116 +176,51 @@ void Renderer::createOffscreenResources() {
         samplerInfo.unnormalizedCoordinates = VK_FALSE;
         samplerInfo.compareEnable = VK_FALSE;
         samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        if (vkCreateSampler(deviceRef.device(), &samplerInfo, nullptr, &m_offscreenSampler) != VK_SUCCESS) {
+        if (vkCreateSampler(deviceRef.device(), &samplerInfo,
+                            AllocationTracker::callbacks(), &m_offscreenSampler) != VK_SUCCESS) {
             throw std::runtime_error("failed to create offscreen sampler!");
         }
         persistent = true;
     }
 
-    // Create depth image
-    VkImageCreateInfo imageInfo{};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = m_SwapChain->getSwapChainExtent().width;
-    imageInfo.extent.height = m_SwapChain->getSwapChainExtent().height;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = getDepthFormat();
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    imageInfo.samples = deviceRef.getSampleCount();
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageInfo.flags = 0;
-
-    deviceRef.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_offscreenDepthImage, m_offscreenDepthMemory);
-
-    VkImageViewCreateInfo viewInfo{};
-    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    viewInfo.image = m_offscreenDepthImage;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = getDepthFormat();
-    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
-    viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
-
-    if (vkCreateImageView(deviceRef.device(), &viewInfo, nullptr, &m_offscreenDepthView) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create texture image view!");
-    }
-
-    // Initial layout transition
+    // ImGui may sample it before the first graph ran
     auto cmd = deviceRef.beginSingleTimeCommands();
-    VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-    cmdTransitionImage(
-        cmd,
-        m_offscreenResolveImage,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        subresourceRange,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        VK_ACCESS_NONE, VK_ACCESS_SHADER_READ_BIT);
+    m_offscreenResolveState = getImageState(ImageUsage::Sampled);
+    cmdImageBarrier(cmd, m_offscreenResolveImage, VK_IMAGE_ASPECT_COLOR_BIT, ImageState{}, m_offscreenResolveState);
     deviceRef.endSingleTimeCommands(cmd);
 
-    m_offscreenCurrentLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     createOffscreenDescriptorSet();
 }
 
 void Renderer::cleanupOffscreenResources(bool lastCall) {
     const auto device = deviceRef.device();
 
-    if (m_offscreenImGuiDescriptorSet) {
-        // ImGui will clean up its descriptor set, do not free here
-        m_offscreenImGuiDescriptorSet = VK_NULL_HANDLE;
-    }
-
-    if (m_offscreenDescriptorPool) {
-        vkDestroyDescriptorPool(device, m_offscreenDescriptorPool, nullptr);
-        m_offscreenDescriptorPool = VK_NULL_HANDLE;
-    }
-    if (m_offscreenDescriptorSetLayout) {
-        vkDestroyDescriptorSetLayout(device, m_offscreenDescriptorSetLayout, nullptr);
-        m_offscreenDescriptorSetLayout = VK_NULL_HANDLE;
-    }
-    if (m_offscreenImageView) {
-        vkDestroyImageView(device, m_offscreenImageView, nullptr);
-        m_offscreenImageView = VK_NULL_HANDLE;
+    // The descriptor set outlives the swap chains, ImGui may still hold it in a frame it built
+    if (lastCall) {
+        m_offscreenImGuiDescriptorSet = VK_NULL_HANDLE; // Freed with its pool
+        if (m_offscreenDescriptorPool) {
+            vkDestroyDescriptorPool(device, m_offscreenDescriptorPool, AllocationTracker::callbacks());
+            m_offscreenDescriptorPool = VK_NULL_HANDLE;
+        }
+        if (m_offscreenDescriptorSetLayout) {
+            vkDestroyDescriptorSetLayout(device, m_offscreenDescriptorSetLayout, AllocationTracker::callbacks());
+            m_offscreenDescriptorSetLayout = VK_NULL_HANDLE;
+        }
     }
     if (m_offscreenResolveImageView) {
-        vkDestroyImageView(device, m_offscreenResolveImageView, nullptr);
+        vkDestroyImageView(device, m_offscreenResolveImageView, AllocationTracker::callbacks());
         m_offscreenResolveImageView = VK_NULL_HANDLE;
     }
     if (m_offscreenResolveImage) {
-        vkDestroyImage(device, m_offscreenResolveImage, nullptr);
+        vkDestroyImage(device, m_offscreenResolveImage, AllocationTracker::callbacks());
         m_offscreenResolveImage = VK_NULL_HANDLE;
     }
-    if (m_offscreenImage) {
-        vkDestroyImage(device, m_offscreenImage, nullptr);
-        m_offscreenImage = VK_NULL_HANDLE;
-    }
     if (m_offscreenResolveMemory) {
-        vkFreeMemory(device, m_offscreenResolveMemory, nullptr);
+        vkFreeMemory(device, m_offscreenResolveMemory, AllocationTracker::callbacks());
         m_offscreenResolveMemory = VK_NULL_HANDLE;
     }
-    if (m_offscreenImageMemory) {
-        vkFreeMemory(device, m_offscreenImageMemory, nullptr);
-        m_offscreenImageMemory = VK_NULL_HANDLE;
-    }
-    if (m_offscreenDepthView) {
-        vkDestroyImageView(device, m_offscreenDepthView, nullptr);
-        m_offscreenDepthView = VK_NULL_HANDLE;
-    }
-    if (m_offscreenDepthImage) {
-        vkDestroyImage(device, m_offscreenDepthImage, nullptr);
-        m_offscreenDepthImage = VK_NULL_HANDLE;
-    }
-    if (m_offscreenDepthMemory) {
-        vkFreeMemory(device, m_offscreenDepthMemory, nullptr);
-        m_offscreenDepthMemory = VK_NULL_HANDLE;
-    }
     if (lastCall && m_offscreenSampler) {
-        vkDestroySampler(device, m_offscreenSampler, nullptr);
+        vkDestroySampler(device, m_offscreenSampler, AllocationTracker::callbacks());
         m_offscreenSampler = VK_NULL_HANDLE;
     }
 }
@@ -282,44 +228,49 @@ void Renderer::cleanupOffscreenResources(bool lastCall) {
 void Renderer::createOffscreenDescriptorSet() {
     const auto device = deviceRef.device();
 
-    // Descriptor pool for one sampled image
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSize.descriptorCount = 1;
-
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = 1;
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &m_offscreenDescriptorPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor pool for offscreen image!");
-    }
+    // Allocated once and only rewritten afterwards, so the handle ImGui draws stays valid
+    if (m_offscreenImGuiDescriptorSet == VK_NULL_HANDLE) {
+        // Descriptor pool for one sampled image
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(device, &poolInfo,
+                                   AllocationTracker::callbacks(), &m_offscreenDescriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool for offscreen image!");
+        }
 
-    // Descriptor set layout for one combined sampler
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 0;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &samplerLayoutBinding;
-    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_offscreenDescriptorSetLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor set layout for offscreen image!");
-    }
+        // Descriptor set layout for one combined sampler
+        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+        samplerLayoutBinding.binding = 0;
+        samplerLayoutBinding.descriptorCount = 1;
+        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerLayoutBinding.pImmutableSamplers = nullptr;
+        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &samplerLayoutBinding;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, AllocationTracker::callbacks(),
+                                        &m_offscreenDescriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout for offscreen image!");
+        }
 
-    // Allocate descriptor set
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_offscreenDescriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &m_offscreenDescriptorSetLayout;
-    if (vkAllocateDescriptorSets(device, &allocInfo, &m_offscreenImGuiDescriptorSet) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate descriptor set for offscreen image!");
+        // Allocate descriptor set
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_offscreenDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_offscreenDescriptorSetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &m_offscreenImGuiDescriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor set for offscreen image!");
+        }
     }
 
     // Update descriptor set for the offscreen image
@@ -351,8 +302,12 @@ VkCommandBuffer Renderer::beginFrame() {
         }
     }
 
-    const auto result = m_SwapChain->acquireNextImage(&m_currentImageIndex);
+    m_FramePacer->waitForFrameSlot();
+    // Headless, the frame slot is all there is to wait for
+    const auto result = isHeadless() ? VK_SUCCESS : m_SwapChain->acquireNextImage(&m_currentImageIndex);
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        // Recreated by the main thread between two frames
+        m_Window->setFramebufferResizedFlag(true);
         return nullptr;
     }
 
@@ -369,6 +324,10 @@ VkCommandBuffer Renderer::beginFrame() {
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
+    if (m_GpuProfiler) {
+        // Before any rendering, the frame signals the next timeline value
+        m_GpuProfiler->beginFrame(commandBuffer, m_FramePacer->frameIndex(), m_FramePacer->submittedValue() + 1);
+    }
     return commandBuffer;
 }
 
@@ -380,10 +339,20 @@ bool Renderer::endFrame() {
         throw std::runtime_error("failed to record command buffer!");
     }
 
-    const auto result = m_SwapChain->submitCommandBuffers(&commandBuffer, &m_currentImageIndex);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || windowRef.windowResized()) {
+    const uint64_t uploadValue = deviceRef.submitPendingAcquires();
+    VkResult result = VK_SUCCESS;
+    if (isHeadless()) {
+        submitHeadless(commandBuffer, uploadValue);
+    } else {
+        result = m_SwapChain->submitCommandBuffers(&commandBuffer, &m_currentImageIndex, uploadValue);
+    }
+    // Submitted even when presenting failed
+    if (m_Capture) {
+        m_Capture->submit();
+    }
+    if (!isHeadless() && (result == VK_ERROR_OUT_OF_DATE_KHR || m_Window->windowResized())) {
         m_isFrameStarted = false;
-        windowRef.setFramebufferResizedFlag(true);
+        m_Window->setFramebufferResizedFlag(true);
         return false;
     }
     if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
@@ -391,116 +360,117 @@ bool Renderer::endFrame() {
     }
 
     m_isFrameStarted = false;
-    m_currentFrameIndex = (m_currentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
 
     return true;
 }
 
-void Renderer::beginOffscreenRendering(VkCommandBuffer commandBuffer) {
-    if (m_offscreenCurrentLayout != VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-        VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-        cmdTransitionImage(
-            commandBuffer,
-            m_offscreenResolveImage,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-            subresourceRange,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
-        m_offscreenCurrentLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+void Renderer::enableCapture(std::filesystem::path directory, const uint32_t interval, const CaptureFormat format) {
+    if (!FrameCapture::isSupported(getFormat())) {
+        throw std::runtime_error("Failed to enable capture: unsupported scene image format!");
     }
-
-    VkRenderingAttachmentInfo colorAttachment{};
-    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    colorAttachment.imageView = m_offscreenImageView;
-    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
-    colorAttachment.resolveImageView = m_offscreenResolveImageView;
-    colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.clearValue.color = { clearColor.r, clearColor.g, clearColor.b, clearColor.a };
-
-    VkRenderingAttachmentInfo depthAttachment{};
-    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    depthAttachment.imageView = m_offscreenDepthView;
-    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthAttachment.clearValue.depthStencil = {1.0f, 0};
-
-    VkRenderingInfo renderingInfo{};
-    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    renderingInfo.renderArea = {{0, 0}, m_SwapChain->getSwapChainExtent()};
-    renderingInfo.layerCount = 1;
-    renderingInfo.colorAttachmentCount = 1;
-    renderingInfo.pColorAttachments = &colorAttachment;
-    renderingInfo.pDepthAttachment = &depthAttachment;
-    renderingInfo.pStencilAttachment = nullptr;
-
-    vkCmdBeginRendering(commandBuffer, &renderingInfo);
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(m_SwapChain->getSwapChainExtent().width);
-    viewport.height = static_cast<float>(m_SwapChain->getSwapChainExtent().height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    const VkRect2D scissor{{0, 0}, m_SwapChain->getSwapChainExtent()};
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    m_Capture = std::make_unique<FrameCapture>(deviceRef, m_FramePacer->semaphore(), std::move(directory), interval,
+                                               format);
 }
 
-void Renderer::endOffscreenRendering(VkCommandBuffer commandBuffer) {
-    vkCmdEndRendering(commandBuffer);
-    if (m_offscreenCurrentLayout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-        cmdTransitionImage(
-            commandBuffer,
-            m_offscreenResolveImage,
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresourceRange,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
-        m_offscreenCurrentLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+void Renderer::submitHeadless(const VkCommandBuffer commandBuffer, const uint64_t uploadValue) const {
+    const uint64_t frameValue = m_FramePacer->beginSubmit();
+
+    // Uploads are only read as vertex input and by the shaders
+    const VkSemaphore waitSemaphore = deviceRef.uploadSemaphore();
+    constexpr VkPipelineStageFlags waitStage =
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    const VkSemaphore signalSemaphore = m_FramePacer->semaphore();
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &uploadValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frameValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+
+    const auto queueLock = deviceRef.lockGraphicsQueue();
+    if (vkQueueSubmit(deviceRef.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer!");
     }
 }
 
-void Renderer::beginRendering(const VkCommandBuffer commandBuffer) const {
-    assert(m_isFrameStarted && "Can't call beginRendering if frame is not in progress");
-    assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin rendering on command buffer from a different frame");
+RenderGraph &Renderer::beginGraph() {
+    assert(m_isFrameStarted && "Can't build a render graph if frame is not in progress");
+
+    m_RenderGraph->reset();
+    // The submit waits for the acquire at the color attachment stage, the first barrier chains on it
+    m_BackBuffer = isHeadless() ? INVALID_RENDER_RESOURCE : m_RenderGraph->importImage(
+        "Swap chain image",
+        m_SwapChain->getImage(m_currentImageIndex), m_SwapChain->getImageView(m_currentImageIndex),
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        ImageState{VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED},
+        ImageUsage::Present);
+    // ImGui's platform windows sample it outside of the graph
+    m_SceneImage = m_RenderGraph->importImage(
+        "Scene",
+        m_offscreenResolveImage, m_offscreenResolveImageView,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        m_offscreenResolveState,
+        ImageUsage::Sampled);
+    return *m_RenderGraph;
+}
 
-    VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-    cmdTransitionImage(
-        commandBuffer,
-        m_SwapChain->getImage(m_currentImageIndex),
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        subresourceRange,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_ACCESS_NONE, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+void Renderer::executeGraph(const VkCommandBuffer commandBuffer) {
+    assert(commandBuffer == getCurrentCommandBuffer() && "Can't record the graph on command buffer from a different frame");
+
+    // The value this frame signals, captures are numbered with it
+    const uint64_t frameValue = m_FramePacer->submittedValue() + 1;
+    if (m_Capture && m_Capture->isDue(frameValue)) {
+        m_RenderGraph->addPass("Capture", [this, frameValue](const VkCommandBuffer passCommandBuffer) {
+            m_Capture->record(passCommandBuffer, m_offscreenResolveImage, getExtent(), getFormat(), frameValue);
+        })
+            .read(m_SceneImage, ImageUsage::TransferSource)
+            .sideEffect();
+    }
 
+    m_RenderGraph->compile();
+    m_RenderGraph->execute(commandBuffer, m_GpuProfiler.get());
+    m_offscreenResolveState = m_RenderGraph->getFinalState(m_SceneImage);
+}
+
+void Renderer::beginRendering(const VkCommandBuffer commandBuffer, const VkImageView color, const VkImageView resolve,
+                              const VkImageView depth, const glm::vec4 &clearValue,
+                              const VkRenderingFlags flags) const {
+    // Only the resolved color is kept
     VkRenderingAttachmentInfo colorAttachment{};
     colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    colorAttachment.imageView = m_SwapChain->getMultisampleColorImageView(m_currentImageIndex);
+    colorAttachment.imageView = color;
     colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
-    colorAttachment.resolveImageView = m_SwapChain->getImageView(m_currentImageIndex);
+    colorAttachment.resolveImageView = resolve;
     colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.clearValue.color = { 0, 0, 0, 0 };
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.clearValue.color = { clearValue.r, clearValue.g, clearValue.b, clearValue.a };
 
     VkRenderingAttachmentInfo depthAttachment{};
     depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    depthAttachment.imageView = m_SwapChain->getDepthImageView(m_currentImageIndex);
+    depthAttachment.imageView = depth;
     depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.clearValue.depthStencil = {1.0f, 0};
 
     VkRenderingInfo renderingInfo{};
     renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    renderingInfo.renderArea = {{0, 0}, m_SwapChain->getSwapChainExtent()};
+    renderingInfo.flags = flags;
+    renderingInfo.renderArea = {{0, 0}, getExtent()};
     renderingInfo.layerCount = 1;
     renderingInfo.colorAttachmentCount = 1;
     renderingInfo.pColorAttachments = &colorAttachment;
@@ -509,32 +479,25 @@ void Renderer::beginRendering(const VkCommandBuffer commandBuffer) const {
 
     vkCmdBeginRendering(commandBuffer, &renderingInfo);
 
+    // Only vkCmdExecuteCommands is allowed, the secondaries set their own viewport
+    if (flags & VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT) {
+        return;
+    }
+
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(m_SwapChain->getSwapChainExtent().width);
-    viewport.height = static_cast<float>(m_SwapChain->getSwapChainExtent().height);
+    viewport.width = static_cast<float>(getExtent().width);
+    viewport.height = static_cast<float>(getExtent().height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    const VkRect2D scissor{{0, 0}, m_SwapChain->getSwapChainExtent()};
+    const VkRect2D scissor{{0, 0}, getExtent()};
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 
-void Renderer::endRendering(const VkCommandBuffer commandBuffer) const {
-    assert(m_isFrameStarted && "Can't call endRendering if frame is not in progress");
-    assert(commandBuffer == getCurrentCommandBuffer() && "Can't end rendering on command buffer from a different frame");
-
+void Renderer::endRendering(const VkCommandBuffer commandBuffer) {
     vkCmdEndRendering(commandBuffer);
-
-    VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-    cmdTransitionImage(
-        commandBuffer,
-        m_SwapChain->getImage(m_currentImageIndex),
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        subresourceRange,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_NONE);
 }
 
 } // Namespace KaguEngine
\ No newline at end of file
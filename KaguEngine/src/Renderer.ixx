@@ -13,6 +13,10 @@ export module KaguEngine.Renderer;
 import std;
 
 import KaguEngine.Device;
+import KaguEngine.FrameCapture;
+import KaguEngine.FramePacer;
+import KaguEngine.GpuProfiler;
+import KaguEngine.RenderGraph;
 import KaguEngine.SwapChain;
 import KaguEngine.Window;
 
@@ -20,79 +24,117 @@ export namespace KaguEngine {
 
 class Renderer {
 public:
+    // Color format of the headless frames, the one the swap chain prefers
+    static constexpr VkFormat HEADLESS_FORMAT = VK_FORMAT_B8G8R8A8_UNORM;
+
     Renderer(Window &window, Device &device);
+    // Headless: no swap chain, the frames end in the offscreen scene image and are never presented
+    Renderer(Device &device, VkExtent2D extent);
     ~Renderer();
 
     Renderer(const Renderer &) = delete;
     Renderer &operator=(const Renderer &) = delete;
 
-    [[nodiscard]] float getAspectRatio() const { return m_SwapChain->extentAspectRatio(); }
+    [[nodiscard]] float getAspectRatio() const {
+        return static_cast<float>(getExtent().width) / static_cast<float>(getExtent().height);
+    }
     [[nodiscard]] bool isFrameInProgress() const { return m_isFrameStarted; }
+    [[nodiscard]] bool isHeadless() const { return m_Window == nullptr; }
 
     [[nodiscard]] VkCommandBuffer getCurrentCommandBuffer() const {
         assert(m_isFrameStarted &&"Cannot get command buffer when frame not in progress");
-        return m_commandBuffers[m_currentFrameIndex];
+        return m_commandBuffers[m_FramePacer->frameIndex()];
     }
 
     [[nodiscard]] int getFrameIndex() const {
         assert(m_isFrameStarted && "Cannot get frame index when frame not in progress");
-        return m_currentFrameIndex;
+        return static_cast<int>(m_FramePacer->frameIndex());
     }
 
+    [[nodiscard]] FramePacer& getFramePacer() const { return *m_FramePacer; }
+    // Null when disabled or without timestamps on the graphics queue
+    [[nodiscard]] GpuProfiler *getGpuProfiler() const { return m_GpuProfiler.get(); }
+    // Null until enableCapture()
+    [[nodiscard]] const FrameCapture *getFrameCapture() const { return m_Capture.get(); }
+
+    // Reads the scene image back every interval-th frame and writes it to directory, no frame may be recording
+    void enableCapture(std::filesystem::path directory, uint32_t interval, CaptureFormat format);
+
+    // Call before polling input, beginFrame waits on its own otherwise
+    void waitForFrameSlot() const { m_FramePacer->waitForFrameSlot(); }
+    // The frame functions may run on a render thread, the rest belongs to the main thread
     VkCommandBuffer beginFrame();
     bool endFrame();
 
-    // Off-screen rendering
-    void beginOffscreenRendering(VkCommandBuffer commandBuffer);
-    void endOffscreenRendering(VkCommandBuffer commandBuffer);
-
-    //
-    void beginRendering(VkCommandBuffer commandBuffer) const;
-    void endRendering(VkCommandBuffer commandBuffer) const;
+    // Render graph, built by the render thread every frame
+    // Resets the graph and imports the swap chain image and the scene image ImGui samples.
+    // Headless, only the scene image is imported and there is no back buffer.
+    RenderGraph &beginGraph();
+    // Compiles the graph and records it into the frame's command buffer, with the capture's copy when one is due.
+    // Every pass is timed by the GPU profiler.
+    void executeGraph(VkCommandBuffer commandBuffer);
+    [[nodiscard]] RenderResource getBackBuffer()          const { return m_BackBuffer; }
+    [[nodiscard]] RenderResource getSceneImage()          const { return m_SceneImage; }
+    // The render thread must be idle
+    [[nodiscard]] const RenderGraph &getRenderGraph()     const { return *m_RenderGraph; }
+
+    // Multisampled color and depth, the color is resolved into resolve.
+    // A pass begun with VK_RENDERING_SUSPENDING_BIT is suspended, then resumed with VK_RENDERING_RESUMING_BIT
+    void beginRendering(VkCommandBuffer commandBuffer, VkImageView color, VkImageView resolve, VkImageView depth,
+                        const glm::vec4 &clearValue, VkRenderingFlags flags = 0) const;
+    static void endRendering(VkCommandBuffer commandBuffer);
 
     [[nodiscard]] VkDescriptorSet getSceneDescriptorSet() const { return m_offscreenImGuiDescriptorSet; }
-    [[nodiscard]] VkExtent2D getExtent()                  const { return m_SwapChain->getSwapChainExtent(); }
-    [[nodiscard]] VkFormat getFormat()                    const { return *m_SwapChain->getSwapChainImageFormat(); }
-    [[nodiscard]] VkFormat getDepthFormat()               const { return m_SwapChain->findDepthFormat(); }
+    [[nodiscard]] VkExtent2D getExtent()                  const {
+        return m_SwapChain ? m_SwapChain->getSwapChainExtent() : m_HeadlessExtent;
+    }
+    [[nodiscard]] VkFormat getFormat()                    const {
+        return m_SwapChain ? *m_SwapChain->getSwapChainImageFormat() : HEADLESS_FORMAT;
+    }
+    [[nodiscard]] VkFormat getDepthFormat()               const { return SwapChain::findDepthFormat(deviceRef); }
 
-    std::unique_ptr<SwapChain>& getSwapChain() { return m_SwapChain; }
+    std::unique_ptr<SwapChain>& getSwapChain() { return m_SwapChain; } // Null when headless
     glm::vec4 clearColor = { 0.1f, 0.1f, 0.15f, 1.0f };
     void recreateSwapChain();
+    // Recreates the swap chain after a resize or a pacing mode change, no frame may be recording.
+    // Returns true when it did, never when headless.
+    bool refreshSwapChain();
 
 private:
     void createCommandBuffers();
     void freeCommandBuffers();
+    // Headless replacement of SwapChain::submitCommandBuffers, only signals the frame timeline
+    void submitHeadless(VkCommandBuffer commandBuffer, uint64_t uploadValue) const;
 
-    Window &windowRef;
+    Window *m_Window; // Null when headless
     Device &deviceRef;
+    std::unique_ptr<FramePacer> m_FramePacer; // Outlives the swap chains
+    std::unique_ptr<GpuProfiler> m_GpuProfiler;
+    std::unique_ptr<FrameCapture> m_Capture; // Waits on the frame pacer's semaphore
     std::unique_ptr<SwapChain> m_SwapChain;
     std::shared_ptr<SwapChain> m_OldSwapChain;
     uint32_t m_OldSwapChainCleanupTimer = 0;
+    VkExtent2D m_HeadlessExtent{};
+    VkCommandPool m_commandPool = VK_NULL_HANDLE; // Own pool, frames aren't recorded on the main thread
     std::vector<VkCommandBuffer> m_commandBuffers;
 
     uint32_t m_currentImageIndex;
-    int m_currentFrameIndex{0};
     bool m_isFrameStarted{false};
 
     VkDescriptorSet m_offscreenImGuiDescriptorSet = VK_NULL_HANDLE;
     VkDescriptorPool m_offscreenDescriptorPool = VK_NULL_HANDLE;
-    VkImageLayout m_offscreenCurrentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     VkDescriptorSetLayout m_offscreenDescriptorSetLayout = VK_NULL_HANDLE;
     VkSampler m_offscreenSampler = VK_NULL_HANDLE;
 
-    // Multi sampled color image
-    VkImage m_offscreenImage = VK_NULL_HANDLE;
-    VkDeviceMemory m_offscreenImageMemory = VK_NULL_HANDLE;
-    VkImageView m_offscreenImageView = VK_NULL_HANDLE;
-    // Resolve image - Not multi sampled
+    // Resolve image - Not multi sampled, the attachments rendered into it are render graph transients
     VkImage m_offscreenResolveImage = VK_NULL_HANDLE;
     VkDeviceMemory m_offscreenResolveMemory = VK_NULL_HANDLE;
     VkImageView m_offscreenResolveImageView = VK_NULL_HANDLE;
+    ImageState m_offscreenResolveState{}; // Left by the last graph
 
-    // Depth attachment
-    VkImage m_offscreenDepthImage = VK_NULL_HANDLE;
-    VkDeviceMemory m_offscreenDepthMemory = VK_NULL_HANDLE;
-    VkImageView m_offscreenDepthView = VK_NULL_HANDLE;
+    std::unique_ptr<RenderGraph> m_RenderGraph;
+    RenderResource m_BackBuffer = INVALID_RENDER_RESOURCE;
+    RenderResource m_SceneImage = INVALID_RENDER_RESOURCE;
 
     void createOffscreenResources();
     void cleanupOffscreenResources(bool lastCall = false);
@@ -0,0 +1,121 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.Residency;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+ResidencyManager::ResidencyManager(const VkDeviceSize budget) : m_Budget{budget} {}
+
+void ResidencyManager::registerResource(Evictable &resource) {
+    std::scoped_lock lock{m_Mutex};
+
+    m_Lru.push_front({&resource, m_FrameCount});
+    m_Entries.emplace(&resource, m_Lru.begin());
+    if (resource.isResident()) {
+        m_ResidentBytes += resource.getResidentSize();
+    }
+}
+
+void ResidencyManager::unregisterResource(Evictable &resource) {
+    std::scoped_lock lock{m_Mutex};
+
+    const auto it = m_Entries.find(&resource);
+    if (it == m_Entries.end()) {
+        return;
+    }
+    if (resource.isResident()) {
+        m_ResidentBytes -= resource.getResidentSize();
+    }
+    m_Lru.erase(it->second);
+    m_Entries.erase(it);
+}
+
+void ResidencyManager::touch(Evictable &resource) {
+    std::scoped_lock lock{m_Mutex};
+
+    const auto it = m_Entries.find(&resource);
+    if (it == m_Entries.end()) {
+        return;
+    }
+
+    it->second->lastUsedFrame = m_FrameCount;
+    m_Lru.splice(m_Lru.begin(), m_Lru, it->second);
+
+    if (!resource.isResident()) {
+        resource.makeResident();
+        m_ResidentBytes += resource.getResidentSize();
+        m_Refaults++;
+        m_RefaultedBytes += resource.getResidentSize();
+    }
+}
+
+uint64_t ResidencyManager::getFrame() const {
+    std::scoped_lock lock{m_Mutex};
+    return m_FrameCount;
+}
+
+void ResidencyManager::frameSubmitted(const uint64_t frame, const uint64_t timelineValue) {
+    std::scoped_lock lock{m_Mutex};
+    m_Submitted.emplace_back(frame, timelineValue);
+}
+
+void ResidencyManager::endFrame(const uint64_t completedValue) {
+    std::scoped_lock lock{m_Mutex};
+
+    // Frames are submitted in order, once one completed every earlier frame did too
+    while (!m_Submitted.empty() && m_Submitted.front().second <= completedValue) {
+        m_CompletedFrame = m_Submitted.front().first;
+        m_Submitted.pop_front();
+    }
+
+    // Walk from the least recently used end, stopping at resources a frame in flight may still read
+    for (auto it = m_Lru.rbegin(); it != m_Lru.rend() && m_ResidentBytes > m_Budget; ++it) {
+        if (!m_CompletedFrame || it->lastUsedFrame > *m_CompletedFrame) {
+            break;
+        }
+        if (!it->resource->isResident() || it->resource->isBusy()) {
+            continue;
+        }
+
+        const VkDeviceSize size = it->resource->getResidentSize();
+        it->resource->evict();
+        m_ResidentBytes -= size;
+        m_Evictions++;
+        m_EvictedBytes += size;
+    }
+
+    m_FrameCount++;
+}
+
+void ResidencyManager::setBudget(const VkDeviceSize budget) {
+    std::scoped_lock lock{m_Mutex};
+    m_Budget = budget;
+}
+
+ResidencyStats ResidencyManager::getStats() const {
+    std::scoped_lock lock{m_Mutex};
+
+    ResidencyStats stats{};
+    stats.budget = m_Budget;
+    stats.residentBytes = m_ResidentBytes;
+    stats.evictions = m_Evictions;
+    stats.refaults = m_Refaults;
+    stats.evictedBytes = m_EvictedBytes;
+    stats.refaultedBytes = m_RefaultedBytes;
+    for (const auto &entry: m_Lru) {
+        if (entry.resource->isResident()) {
+            stats.residentCount++;
+        } else {
+            stats.evictedCount++;
+        }
+    }
+    return stats;
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,88 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.Residency;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+// Implemented by GPU resources keeping a CPU side copy they can be rebuilt from
+class Evictable {
+public:
+    virtual ~Evictable() = default;
+
+    [[nodiscard]] virtual bool isResident() const = 0;
+    // Device memory held while resident
+    [[nodiscard]] virtual VkDeviceSize getResidentSize() const = 0;
+    // GPU work outside of frames still uses the resource, a relocation for instance
+    [[nodiscard]] virtual bool isBusy() const { return false; }
+    // Releases every GPU object, only called once no frame in flight uses them
+    virtual void evict() = 0;
+    // Uploads the CPU copy again
+    virtual void makeResident() = 0;
+};
+
+struct ResidencyStats {
+    VkDeviceSize budget = 0;
+    VkDeviceSize residentBytes = 0;
+    uint32_t residentCount = 0;
+    uint32_t evictedCount = 0;
+    uint64_t evictions = 0;
+    uint64_t refaults = 0; // Evicted resources needed again
+    VkDeviceSize evictedBytes = 0;
+    VkDeviceSize refaultedBytes = 0;
+};
+
+// Keeps meshes and textures under a device memory budget, evicting the least recently used ones
+class ResidencyManager {
+public:
+    explicit ResidencyManager(VkDeviceSize budget);
+
+    // Non copyable
+    ResidencyManager(const ResidencyManager &) = delete;
+    ResidencyManager &operator=(const ResidencyManager &) = delete;
+
+    void registerResource(Evictable &resource);
+    void unregisterResource(Evictable &resource);
+
+    // Marks the resource as used by the frame being built, uploading it again if it was evicted
+    void touch(Evictable &resource);
+    // Frame the touches go to, carried by the packet to the thread submitting it
+    [[nodiscard]] uint64_t getFrame() const;
+    // Submitting thread: the packet built in frame signals timelineValue on the frame pacer's semaphore.
+    // A frame never submitted can be given the last value submitted, nothing of it reaches the GPU.
+    void frameSubmitted(uint64_t frame, uint64_t timelineValue);
+    // Evicts until back under budget, then moves on to the next frame. Only the resources of frames the GPU
+    // finished are evicted, the render thread can lag any number of frames behind.
+    void endFrame(uint64_t completedValue);
+
+    void setBudget(VkDeviceSize budget);
+    [[nodiscard]] ResidencyStats getStats() const;
+
+private:
+    struct Entry {
+        Evictable *resource;
+        uint64_t lastUsedFrame;
+    };
+    using Lru = std::list<Entry>; // Most recently used first
+
+    VkDeviceSize m_Budget;
+    uint64_t m_FrameCount = 0;
+    std::deque<std::pair<uint64_t, uint64_t>> m_Submitted; // Frame and timeline value, oldest first
+    std::optional<uint64_t> m_CompletedFrame; // Last frame the GPU finished
+
+    mutable std::mutex m_Mutex;
+    Lru m_Lru;
+    std::unordered_map<Evictable *, Lru::iterator> m_Entries;
+    VkDeviceSize m_ResidentBytes = 0;
+    uint64_t m_Evictions = 0;
+    uint64_t m_Refaults = 0;
+    VkDeviceSize m_EvictedBytes = 0;
+    VkDeviceSize m_RefaultedBytes = 0;
+};
+
+} // Namespace KaguEngine
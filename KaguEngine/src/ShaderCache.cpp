@@ -0,0 +1,366 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+// libs
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(KAGU_HAS_GLSLANG)
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#endif
+
+module KaguEngine.ShaderCache;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the file format and the compiler
+constexpr uint32_t FILE_MAGIC = 0x4353474B; // "KGSC"
+constexpr uint32_t FILE_VERSION = 1;         // Bumped when the compiler settings change
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t entryCount;
+};
+
+// Followed by the SPIR-V of every entry, offsets are from the start of the file
+struct FileEntry {
+    uint64_t key;
+    uint64_t offset;
+    uint64_t wordCount;
+};
+
+void fnv1a(uint64_t &hash, const std::string_view data) {
+    for (const char byte: data) {
+        hash = (hash ^ static_cast<uint8_t>(byte)) * 0x100000001b3ull;
+    }
+}
+
+std::string readText(const std::filesystem::path &path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+    return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+#if defined(KAGU_HAS_GLSLANG)
+EShLanguage getStage(const std::filesystem::path &source) {
+    const std::string extension = source.extension().string();
+    if (extension == ".vert") return EShLangVertex;
+    if (extension == ".frag") return EShLangFragment;
+    if (extension == ".geom") return EShLangGeometry;
+    if (extension == ".tesc") return EShLangTessControl;
+    if (extension == ".tese") return EShLangTessEvaluation;
+    if (extension == ".comp") return EShLangCompute;
+    throw std::runtime_error("Failed to compile shader: unknown stage of " + source.string());
+}
+
+// Same target as glslangValidator -V, so the runtime and the build produce the same SPIR-V
+std::vector<uint32_t> compile(const std::filesystem::path &source, const std::string &text,
+                              const std::string &preamble) {
+    const EShLanguage stage = getStage(source);
+    const std::string name = source.filename().string();
+    const char *strings = text.c_str();
+    const char *names = name.c_str();
+
+    glslang::TShader shader{stage};
+    shader.setStringsWithLengthsAndNames(&strings, nullptr, &names, 1);
+    shader.setPreamble(preamble.c_str());
+    shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+    shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_0);
+    shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_0);
+    const auto messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+    if (!shader.parse(GetDefaultResources(), 100, false, messages)) {
+        throw std::runtime_error(std::format("Failed to compile {}: {}", name, shader.getInfoLog()));
+    }
+
+    glslang::TProgram program;
+    program.addShader(&shader);
+    if (!program.link(messages)) {
+        throw std::runtime_error(std::format("Failed to link {}: {}", name, program.getInfoLog()));
+    }
+
+    std::vector<uint32_t> spirv;
+    glslang::GlslangToSpv(*program.getIntermediate(stage), spirv);
+    return spirv;
+}
+#endif
+}
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+#if defined(_WIN32)
+    m_File = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE) {
+        m_File = nullptr;
+        return;
+    }
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0) {
+        unmap();
+        return;
+    }
+    m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = m_Mapping ? MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        unmap();
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+    m_Data = static_cast<const std::byte *>(view);
+    m_Size = static_cast<size_t>(size.QuadPart);
+#else
+    const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return;
+    }
+    struct stat status{};
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        close(file);
+        return;
+    }
+    // The mapping outlives the descriptor
+    void *view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+    m_Data = static_cast<const std::byte *>(view);
+    m_Size = static_cast<size_t>(status.st_size);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept :
+    m_Data{std::exchange(other.m_Data, nullptr)}, m_Size{std::exchange(other.m_Size, 0)},
+    m_File{std::exchange(other.m_File, nullptr)}, m_Mapping{std::exchange(other.m_Mapping, nullptr)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        unmap();
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+        m_File = std::exchange(other.m_File, nullptr);
+        m_Mapping = std::exchange(other.m_Mapping, nullptr);
+    }
+    return *this;
+}
+
+void MappedFile::unmap() {
+#if defined(_WIN32)
+    if (m_Data) UnmapViewOfFile(m_Data);
+    if (m_Mapping) CloseHandle(m_Mapping);
+    if (m_File) CloseHandle(m_File);
+#else
+    if (m_Data) munmap(const_cast<std::byte *>(m_Data), m_Size);
+#endif
+    m_Data = nullptr;
+    m_Size = 0;
+    m_File = nullptr;
+    m_Mapping = nullptr;
+}
+
+ShaderCache::ShaderCache(std::filesystem::path path) : m_Path{std::move(path)} {
+#if defined(KAGU_HAS_GLSLANG)
+    glslang::InitializeProcess();
+#endif
+    if constexpr (CAN_COMPILE) {
+        loadIndex();
+    }
+}
+
+ShaderCache::~ShaderCache() {
+    try {
+        save();
+    } catch (const std::exception &exception) {
+        std::cerr << "[ShaderCache] " << exception.what() << '\n';
+    }
+#if defined(KAGU_HAS_GLSLANG)
+    glslang::FinalizeProcess();
+#endif
+}
+
+std::vector<uint32_t> ShaderCache::load(const std::string &spvPath, const std::span<const ShaderDefine> defines) {
+    const std::filesystem::path source = getWatchedDirectory() / std::filesystem::path{spvPath}.stem();
+    if (!CAN_COMPILE || !std::filesystem::exists(source)) {
+        return readSpirv(spvPath);
+    }
+
+    const std::string text = readText(source);
+    std::string preamble;
+    for (const auto &[name, value]: defines) {
+        preamble += std::format("#define {} {}\n", name, value);
+    }
+    uint64_t key = 0xcbf29ce484222325ull;
+    fnv1a(key, source.extension().string()); // The stage
+    fnv1a(key, preamble);
+    fnv1a(key, text);
+
+    {
+        std::lock_guard lock{m_Mutex};
+        if (const auto it = m_Entries.find(key); it != m_Entries.end()) {
+            it->second.used = true;
+            m_Stats.hits++;
+            return {it->second.words.begin(), it->second.words.end()};
+        }
+    }
+
+#if defined(KAGU_HAS_GLSLANG)
+    // Outside the lock, the other threads keep loading while this one compiles
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> spirv = compile(source, text, preamble);
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard lock{m_Mutex};
+    if (!m_Entries.contains(key)) {
+        const std::vector<uint32_t> &words = m_Compiled.emplace_back(spirv);
+        m_Entries.emplace(key, Entry{words, true, false});
+        m_Changed = true;
+    }
+    m_Stats.compiled++;
+    m_Stats.compileMs += milliseconds;
+    return spirv;
+#else
+    return readSpirv(spvPath);
+#endif
+}
+
+std::filesystem::path ShaderCache::getWatchedDirectory() {
+    return CAN_COMPILE ? Config::shaderSourcePath : Config::shaderPath;
+}
+
+std::string ShaderCache::getSpirvPath(const std::filesystem::path &changedFile) {
+    std::string filename = changedFile.filename().string();
+    if (changedFile.extension() != ".spv") {
+        filename += ".spv";
+    }
+    return std::string{Config::shaderPath} + filename;
+}
+
+ShaderCacheStats ShaderCache::getStats() const {
+    std::lock_guard lock{m_Mutex};
+    return m_Stats;
+}
+
+void ShaderCache::save() {
+    std::lock_guard lock{m_Mutex};
+    // Rewritten when a shader changed or wasn't used, the entries of old sources are dropped
+    const size_t usedCount = static_cast<size_t>(std::ranges::count_if(m_Entries | std::views::values, &Entry::used));
+    if (!m_Changed && usedCount == m_Entries.size()) {
+        return;
+    }
+
+    std::vector<FileEntry> fileEntries;
+    std::vector<std::span<const uint32_t>> words;
+    uint64_t offset = sizeof(FileHeader) + usedCount * sizeof(FileEntry);
+    for (const auto &[key, entry]: m_Entries) {
+        if (entry.used) {
+            fileEntries.push_back({key, offset, entry.words.size()});
+            words.push_back(entry.words);
+            offset += entry.words.size_bytes();
+        }
+    }
+
+    // Written beside the mapped file, then swapped in once complete
+    std::filesystem::path temporaryPath = m_Path;
+    temporaryPath += ".tmp";
+    {
+        const FileHeader header{FILE_MAGIC, FILE_VERSION, fileEntries.size()};
+        std::ofstream file{temporaryPath, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(fileEntries.data()),
+                   static_cast<std::streamsize>(fileEntries.size() * sizeof(FileEntry)));
+        for (const auto &entryWords: words) {
+            file.write(reinterpret_cast<const char *>(entryWords.data()),
+                       static_cast<std::streamsize>(entryWords.size_bytes()));
+        }
+        if (!file.flush()) {
+            throw std::runtime_error("Failed to write shader cache!");
+        }
+    }
+
+    // The mapped entries move to memory first, Windows can't replace a mapped file
+    for (Entry &entry: m_Entries | std::views::values) {
+        if (entry.mapped) {
+            entry.words = m_Compiled.emplace_back(entry.words.begin(), entry.words.end());
+            entry.mapped = false;
+        }
+    }
+    m_File = MappedFile{};
+    std::filesystem::rename(temporaryPath, m_Path);
+    m_Changed = false;
+}
+
+void ShaderCache::loadIndex() {
+    m_File = MappedFile{m_Path};
+    const std::span<const std::byte> data = m_File.data();
+    m_Stats.mappedBytes = data.size();
+    if (data.empty()) {
+        return;
+    }
+
+    const auto reject = [&](const std::string_view reason) {
+        std::cout << "[ShaderCache] Ignoring " << m_Path.string() << ": " << reason << '\n';
+        m_Entries.clear();
+        m_File = MappedFile{};
+        m_Changed = true;
+    };
+
+    FileHeader header{};
+    if (data.size() < sizeof(header)) {
+        return reject("truncated header");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+        return reject("unknown format");
+    }
+    if (header.entryCount > (data.size() - sizeof(header)) / sizeof(FileEntry)) {
+        return reject("truncated entries");
+    }
+
+    // Only the bounds and the SPIR-V magic are checked, the entries are read in place
+    for (uint64_t i = 0; i < header.entryCount; i++) {
+        FileEntry fileEntry{};
+        std::memcpy(&fileEntry, data.data() + sizeof(header) + i * sizeof(FileEntry), sizeof(fileEntry));
+        if (fileEntry.offset % sizeof(uint32_t) != 0 || fileEntry.wordCount == 0 || fileEntry.offset > data.size() ||
+            fileEntry.wordCount > (data.size() - fileEntry.offset) / sizeof(uint32_t)) {
+            return reject("entry out of bounds");
+        }
+        const auto *words = reinterpret_cast<const uint32_t *>(data.data() + fileEntry.offset);
+        if (words[0] != SPIRV_MAGIC) {
+            return reject("corrupted entry");
+        }
+        m_Entries.emplace(fileEntry.key, Entry{{words, static_cast<size_t>(fileEntry.wordCount)}, false, true});
+    }
+}
+
+std::vector<uint32_t> ShaderCache::readSpirv(const std::string &path) {
+    const std::string code = readText(path);
+    if (code.empty() || code.size() % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("Failed to read SPIR-V: " + path);
+    }
+    std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+    std::memcpy(words.data(), code.data(), code.size());
+    return words;
+}
+
+} // Namespace KaguEngine
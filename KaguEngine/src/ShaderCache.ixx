@@ -0,0 +1,92 @@
+module;
+
+// config
+#include "include/config.hpp"
+
+export module KaguEngine.ShaderCache;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+using ShaderDefine = std::pair<std::string, std::string>; // Name, value
+
+// Read-only view of a whole file, empty when it doesn't exist
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    [[nodiscard]] std::span<const std::byte> data() const { return {m_Data, m_Size}; }
+
+private:
+    void unmap();
+
+    const std::byte *m_Data = nullptr;
+    size_t m_Size = 0;
+    void *m_File = nullptr;    // Only kept on Windows
+    void *m_Mapping = nullptr; // Only kept on Windows
+};
+
+struct ShaderCacheStats {
+    uint32_t hits = 0;
+    uint32_t compiled = 0;
+    double compileMs = 0.0;
+    size_t mappedBytes = 0; // Size of the cache file found at startup
+};
+
+// SPIR-V compiled at runtime from the GLSL sources with glslang, keyed by the source's hash and its defines.
+// The file of a previous run is mapped, so known shaders load without compiling. Without glslang, or
+// without the sources next to the build, the .spv files of the compile_shaders target are read instead.
+class ShaderCache {
+public:
+#if defined(KAGU_HAS_GLSLANG)
+    static constexpr bool CAN_COMPILE = true;
+#else
+    static constexpr bool CAN_COMPILE = false;
+#endif
+
+    explicit ShaderCache(std::filesystem::path path);
+    ~ShaderCache(); // Saves the entries used during the run
+
+    // Non copyable
+    ShaderCache(const ShaderCache &) = delete;
+    ShaderCache &operator=(const ShaderCache &) = delete;
+
+    // Thread safe: SPIR-V of a .spv path of the assets, compiled from its source when possible
+    [[nodiscard]] std::vector<uint32_t> load(const std::string &spvPath, std::span<const ShaderDefine> defines = {});
+
+    // Where the files load() reads live, watched for hot reload
+    [[nodiscard]] static std::filesystem::path getWatchedDirectory();
+    // .spv path of the assets a changed file of the watched directory produces
+    [[nodiscard]] static std::string getSpirvPath(const std::filesystem::path &changedFile);
+
+    [[nodiscard]] ShaderCacheStats getStats() const;
+    void save();
+
+private:
+    struct Entry {
+        std::span<const uint32_t> words; // In the mapping or in m_Compiled
+        bool used = false;
+        bool mapped = false;
+    };
+
+    void loadIndex();
+    [[nodiscard]] static std::vector<uint32_t> readSpirv(const std::string &path);
+
+    std::filesystem::path m_Path;
+    MappedFile m_File;
+
+    mutable std::mutex m_Mutex;
+    std::unordered_map<uint64_t, Entry> m_Entries;
+    std::deque<std::vector<uint32_t>> m_Compiled; // Deque, the entries point into it
+    bool m_Changed = false;
+    ShaderCacheStats m_Stats{};
+};
+
+} // Namespace KaguEngine
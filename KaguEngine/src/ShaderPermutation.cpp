@@ -0,0 +1,87 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.ShaderPermutation;
+
+// std
+import std;
+
+import KaguEngine.FrameInfo;
+import KaguEngine.Pipeline;
+import KaguEngine.PipelineBuilder;
+
+namespace KaguEngine {
+
+void ShaderPermutation::specialize(PipelineConfigInfo &configInfo) const {
+    const auto add = [&](const SpecializationConstant constant, const auto &value) {
+        Pipeline::addSpecializationConstant(configInfo, static_cast<uint32_t>(constant), value);
+    };
+    add(SpecializationConstant::MaxLights, static_cast<int32_t>(MAX_LIGHTS));
+    add(SpecializationConstant::LightCount, lightCount);
+    add(SpecializationConstant::Textured, static_cast<VkBool32>(hasFeature(features, ShaderFeature::Textured)));
+    add(SpecializationConstant::AlphaBlend, static_cast<VkBool32>(hasFeature(features, ShaderFeature::AlphaBlend)));
+    add(SpecializationConstant::Gamma, gamma);
+}
+
+std::string ShaderPermutation::describe() const {
+    std::string description = hasFeature(features, ShaderFeature::Textured) ? "textured" : "untextured";
+    if (hasFeature(features, ShaderFeature::AlphaBlend)) {
+        description += ", alpha";
+    }
+    description += lightCount == DYNAMIC_LIGHT_COUNT ? ", dynamic lights" : std::format(", {} lights", lightCount);
+    return description;
+}
+
+size_t ShaderPermutation::Hash::operator()(const ShaderPermutation &permutation) const {
+    const uint64_t key = static_cast<uint64_t>(permutation.features) << 32 |
+                         static_cast<uint32_t>(permutation.lightCount);
+    return std::hash<uint64_t>{}(key) ^ std::hash<float>{}(permutation.gamma) * 31;
+}
+
+PipelinePermutations::PipelinePermutations(PipelineBuilder &pipelineBuilder, std::string name,
+                                           std::string vertFilepath, std::string fragFilepath,
+                                           ConfigureFunction configure) :
+    pipelineBuilderRef{pipelineBuilder}, m_Name{std::move(name)}, m_VertFilepath{std::move(vertFilepath)},
+    m_FragFilepath{std::move(fragFilepath)}, m_Configure{std::move(configure)} {}
+
+void PipelinePermutations::precompile(const std::span<const ShaderPermutation> permutations) {
+    std::vector<ShaderPermutation> missing;
+    std::vector<PipelineDesc> descs;
+    for (const ShaderPermutation &permutation: permutations) {
+        if (!m_Pipelines.contains(permutation) && std::ranges::find(missing, permutation) == missing.end()) {
+            missing.push_back(permutation);
+            descs.push_back(makeDesc(permutation));
+        }
+    }
+
+    std::vector<PipelineHandle> handles = pipelineBuilderRef.submit(std::move(descs));
+    for (size_t i = 0; i < missing.size(); i++) {
+        m_Pipelines.emplace(missing[i], std::move(handles[i]));
+    }
+}
+
+const Pipeline *PipelinePermutations::request(const ShaderPermutation &permutation) {
+    auto it = m_Pipelines.find(permutation);
+    if (it == m_Pipelines.end()) {
+        std::vector<PipelineDesc> descs;
+        descs.push_back(makeDesc(permutation));
+        it = m_Pipelines.emplace(permutation, std::move(pipelineBuilderRef.submit(std::move(descs)).front())).first;
+    }
+    return it->second.get();
+}
+
+PipelineDesc PipelinePermutations::makeDesc(const ShaderPermutation &permutation) const {
+    return {
+        std::format("{} ({})", m_Name, permutation.describe()),
+        m_VertFilepath,
+        m_FragFilepath,
+        [configure = m_Configure, permutation](PipelineConfigInfo &configInfo) {
+            configure(configInfo, permutation);
+            permutation.specialize(configInfo);
+        }
+    };
+}
+
+} // Namespace KaguEngine
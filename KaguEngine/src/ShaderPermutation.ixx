@@ -0,0 +1,91 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.ShaderPermutation;
+
+// std
+import std;
+
+import KaguEngine.Pipeline;
+import KaguEngine.PipelineBuilder;
+
+export namespace KaguEngine {
+
+// Features a shader is specialized on, each one is a boolean specialization constant
+enum class ShaderFeature : uint32_t {
+    None       = 0,
+    Textured   = 1 << 0, // Samples the material's texture
+    AlphaBlend = 1 << 1  // Blended with the model's alpha, opaque otherwise
+};
+
+constexpr ShaderFeature operator|(const ShaderFeature a, const ShaderFeature b) {
+    return static_cast<ShaderFeature>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+constexpr bool hasFeature(const ShaderFeature features, const ShaderFeature feature) {
+    return (static_cast<uint32_t>(features) & static_cast<uint32_t>(feature)) != 0;
+}
+
+// constant_id of the specialization constants, the same in every shader
+enum class SpecializationConstant : uint32_t {
+    MaxLights  = 0, // int, size of the ubo's light array
+    LightCount = 1, // int, lights looped over
+    Textured   = 2, // bool
+    AlphaBlend = 3, // bool
+    Gamma      = 4  // float
+};
+
+// One specialized variant of a shader pair. Once specialized, the driver folds the constants:
+// the light loop has a fixed trip count and the branches of disabled features are gone.
+struct ShaderPermutation {
+    static constexpr int32_t DYNAMIC_LIGHT_COUNT = -1; // Loops over the ubo's light count
+
+    ShaderFeature features = ShaderFeature::None;
+    int32_t lightCount = DYNAMIC_LIGHT_COUNT;
+    float gamma = 2.2f;
+
+    bool operator==(const ShaderPermutation &) const = default;
+
+    // Every constant is added, a shader ignores the ones it doesn't declare
+    void specialize(PipelineConfigInfo &configInfo) const;
+    [[nodiscard]] std::string describe() const;
+
+    struct Hash {
+        size_t operator()(const ShaderPermutation &permutation) const;
+    };
+};
+
+// The pipelines of one shader pair, one per permutation, compiled the first time it's requested
+class PipelinePermutations {
+public:
+    // Fills everything but the specialization constants
+    using ConfigureFunction = std::function<void(PipelineConfigInfo &configInfo, const ShaderPermutation &permutation)>;
+
+    PipelinePermutations(PipelineBuilder &pipelineBuilder, std::string name, std::string vertFilepath,
+                         std::string fragFilepath, ConfigureFunction configure);
+
+    // Non copyable
+    PipelinePermutations(const PipelinePermutations &) = delete;
+    PipelinePermutations &operator=(const PipelinePermutations &) = delete;
+
+    // One caller at a time: submits the known permutations as one batch
+    void precompile(std::span<const ShaderPermutation> permutations);
+    // One caller at a time: nullptr until the permutation compiled, the first request submits it.
+    // The pipeline lives as long as this object.
+    [[nodiscard]] const Pipeline *request(const ShaderPermutation &permutation);
+    [[nodiscard]] size_t getPermutationCount() const { return m_Pipelines.size(); }
+
+private:
+    [[nodiscard]] PipelineDesc makeDesc(const ShaderPermutation &permutation) const;
+
+    PipelineBuilder &pipelineBuilderRef;
+    std::string m_Name;
+    std::string m_VertFilepath;
+    std::string m_FragFilepath;
+    ConfigureFunction m_Configure;
+
+    std::unordered_map<ShaderPermutation, PipelineHandle, ShaderPermutation::Hash> m_Pipelines;
+};
+
+} // Namespace KaguEngine
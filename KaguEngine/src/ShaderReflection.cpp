@@ -0,0 +1,353 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+module KaguEngine.ShaderReflection;
+
+// std
+import std;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the SPIR-V subset the engine's shaders use
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+constexpr size_t SPIRV_HEADER_WORDS = 5;
+
+enum Op : uint32_t {
+    OpEntryPoint = 15,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstant = 50,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72
+};
+
+enum Decoration : uint32_t {
+    BufferBlock = 3,
+    ArrayStride = 6,
+    MatrixStride = 7,
+    Binding = 33,
+    DescriptorSet = 34,
+    Offset = 35
+};
+
+enum StorageClass : uint32_t {
+    UniformConstant = 0,
+    Uniform = 2,
+    PushConstant = 9,
+    StorageBuffer = 12
+};
+
+enum Dim : uint32_t {
+    DimBuffer = 5,
+    DimSubpassData = 6
+};
+
+// Every id a result can be, only the fields of its opcode are set
+struct Id {
+    uint32_t opcode = 0;
+    std::vector<uint32_t> operands; // The words after the result id
+    std::optional<uint32_t> set;
+    std::optional<uint32_t> binding;
+    uint32_t arrayStride = 0;
+    bool bufferBlock = false;
+    std::vector<uint32_t> memberOffsets;
+    std::vector<uint32_t> memberMatrixStrides;
+};
+
+VkShaderStageFlagBits getStage(const uint32_t executionModel) {
+    switch (executionModel) {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+        default: throw std::runtime_error("Failed to reflect shader: unsupported execution model!");
+    }
+}
+
+class Reflector {
+public:
+    explicit Reflector(const std::span<const uint32_t> code) {
+        if (code.size() < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+            throw std::runtime_error("Failed to reflect shader: not SPIR-V!");
+        }
+        m_Ids.resize(code[3]); // Bound, every id is below it
+
+        for (size_t word = SPIRV_HEADER_WORDS; word < code.size();) {
+            const uint32_t wordCount = code[word] >> 16;
+            if (wordCount == 0 || word + wordCount > code.size()) {
+                throw std::runtime_error("Failed to reflect shader: truncated instruction!");
+            }
+            parse(code[word] & 0xFFFF, code.subspan(word + 1, wordCount - 1));
+            word += wordCount;
+        }
+    }
+
+    ShaderReflection reflect() {
+        ShaderReflection reflection{};
+        reflection.stages = m_Stages;
+        for (const uint32_t variable: m_Variables) {
+            const Id &id = m_Ids[variable];
+            const uint32_t storageClass = id.operands[1];
+            const uint32_t type = at(id.operands[0]).operands.at(1); // Variables are pointers to their type
+
+            if (storageClass == PushConstant) {
+                reflection.pushConstantSize = std::max(reflection.pushConstantSize, getSize(type));
+                continue;
+            }
+            if (!id.set || !id.binding) {
+                continue; // Inputs, outputs and other variables without a descriptor
+            }
+
+            VkDescriptorSetLayoutBinding binding{};
+            binding.binding = *id.binding;
+            binding.descriptorCount = 1;
+            binding.stageFlags = m_Stages;
+            binding.descriptorType = getDescriptorType(storageClass, type, binding.descriptorCount);
+
+            if (reflection.sets.size() <= *id.set) {
+                reflection.sets.resize(*id.set + 1);
+            }
+            reflection.sets[*id.set].push_back(binding);
+        }
+        return reflection;
+    }
+
+private:
+    const Id &at(const uint32_t id) const {
+        if (id >= m_Ids.size()) {
+            throw std::runtime_error("Failed to reflect shader: id out of bounds!");
+        }
+        return m_Ids[id];
+    }
+
+    void parse(const uint32_t opcode, const std::span<const uint32_t> operands) {
+        const auto need = [&](const size_t count) {
+            if (operands.size() < count) {
+                throw std::runtime_error("Failed to reflect shader: truncated instruction!");
+            }
+        };
+        const auto define = [&](const uint32_t result, const std::span<const uint32_t> rest) -> Id & {
+            if (result >= m_Ids.size()) {
+                throw std::runtime_error("Failed to reflect shader: id out of bounds!");
+            }
+            Id &id = m_Ids[result];
+            id.opcode = opcode;
+            id.operands.assign(rest.begin(), rest.end());
+            return id;
+        };
+
+        switch (opcode) {
+            case OpEntryPoint:
+                need(1);
+                m_Stages |= getStage(operands[0]);
+                break;
+            case OpTypeBool: case OpTypeInt: case OpTypeFloat: case OpTypeVector: case OpTypeMatrix:
+            case OpTypeImage: case OpTypeSampler: case OpTypeSampledImage: case OpTypeArray:
+            case OpTypeRuntimeArray: case OpTypeStruct: case OpTypePointer:
+                need(1);
+                define(operands[0], operands.subspan(1));
+                break;
+            case OpConstant: case OpSpecConstant:
+                // Result type first, a spec constant array length counts with its default value
+                need(2);
+                define(operands[1], operands.subspan(2));
+                break;
+            case OpVariable:
+                need(3);
+                define(operands[1], std::array{operands[0], operands[2]});
+                m_Variables.push_back(operands[1]);
+                break;
+            case OpDecorate:
+                need(2);
+                decorate(operands[0], operands[1], operands.subspan(2));
+                break;
+            case OpMemberDecorate:
+                need(3);
+                decorateMember(operands[0], operands[1], operands[2], operands.subspan(3));
+                break;
+            default:
+                break;
+        }
+    }
+
+    void decorate(const uint32_t target, const uint32_t decoration, const std::span<const uint32_t> values) {
+        if (target >= m_Ids.size()) {
+            throw std::runtime_error("Failed to reflect shader: id out of bounds!");
+        }
+        Id &id = m_Ids[target];
+        const uint32_t value = values.empty() ? 0 : values[0];
+        switch (decoration) {
+            case DescriptorSet: id.set = value; break;
+            case Binding: id.binding = value; break;
+            case ArrayStride: id.arrayStride = value; break;
+            case BufferBlock: id.bufferBlock = true; break;
+            default: break;
+        }
+    }
+
+    void decorateMember(const uint32_t target, const uint32_t member, const uint32_t decoration,
+                        const std::span<const uint32_t> values) {
+        if (target >= m_Ids.size() || values.empty()) {
+            return;
+        }
+        Id &id = m_Ids[target];
+        const auto set = [&](std::vector<uint32_t> &memberValues) {
+            if (memberValues.size() <= member) {
+                memberValues.resize(member + 1);
+            }
+            memberValues[member] = values[0];
+        };
+        if (decoration == Offset) {
+            set(id.memberOffsets);
+        } else if (decoration == MatrixStride) {
+            set(id.memberMatrixStrides);
+        }
+    }
+
+    // Arrays of descriptors multiply the count, the type is the element's
+    VkDescriptorType getDescriptorType(const uint32_t storageClass, uint32_t type, uint32_t &count) const {
+        while (at(type).opcode == OpTypeArray || at(type).opcode == OpTypeRuntimeArray) {
+            if (at(type).opcode == OpTypeRuntimeArray) {
+                throw std::runtime_error("Failed to reflect shader: unsized descriptor arrays aren't supported!");
+            }
+            count *= getConstant(at(type).operands[1]);
+            type = at(type).operands[0];
+        }
+
+        const Id &id = at(type);
+        if (storageClass == Uniform) {
+            return id.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+        if (storageClass == StorageBuffer) {
+            return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        if (storageClass == UniformConstant) {
+            switch (id.opcode) {
+                case OpTypeSampledImage: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                case OpTypeSampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+                case OpTypeImage: {
+                    // Sampled type, dim, depth, arrayed, multisampled, sampled
+                    const uint32_t dim = id.operands.at(1);
+                    const bool sampled = id.operands.at(5) == 1;
+                    if (dim == DimBuffer) {
+                        return sampled ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+                    }
+                    if (dim == DimSubpassData) {
+                        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                    }
+                    return sampled ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                }
+                default: break;
+            }
+        }
+        throw std::runtime_error("Failed to reflect shader: unsupported descriptor type!");
+    }
+
+    uint32_t getConstant(const uint32_t constant) const {
+        const Id &id = at(constant);
+        if ((id.opcode != OpConstant && id.opcode != OpSpecConstant) || id.operands.empty()) {
+            throw std::runtime_error("Failed to reflect shader: array length isn't a constant!");
+        }
+        return id.operands[0];
+    }
+
+    // Bytes a block member spans, from its layout decorations
+    uint32_t getSize(const uint32_t type, const uint32_t matrixStride = 0) const {
+        const Id &id = at(type);
+        switch (id.opcode) {
+            case OpTypeBool: return 4;
+            case OpTypeInt: case OpTypeFloat: return id.operands.at(0) / 8;
+            case OpTypeVector: return getSize(id.operands.at(0)) * id.operands.at(1);
+            case OpTypeMatrix: {
+                const uint32_t columns = id.operands.at(1);
+                return matrixStride != 0 ? matrixStride * columns : getSize(id.operands.at(0)) * columns;
+            }
+            case OpTypeArray: {
+                const uint32_t length = getConstant(id.operands.at(1));
+                const uint32_t stride = id.arrayStride != 0 ? id.arrayStride : getSize(id.operands.at(0));
+                return stride * length;
+            }
+            case OpTypeStruct: {
+                uint32_t size = 0;
+                for (size_t member = 0; member < id.operands.size(); member++) {
+                    const uint32_t offset = member < id.memberOffsets.size() ? id.memberOffsets[member] : 0;
+                    const uint32_t stride = member < id.memberMatrixStrides.size() ? id.memberMatrixStrides[member] : 0;
+                    size = std::max(size, offset + getSize(id.operands[member], stride));
+                }
+                return size;
+            }
+            default:
+                throw std::runtime_error("Failed to reflect shader: unsupported push constant member!");
+        }
+    }
+
+    std::vector<Id> m_Ids;
+    std::vector<uint32_t> m_Variables;
+    VkShaderStageFlags m_Stages = 0;
+};
+}
+
+ShaderReflection ShaderReflection::reflect(const std::span<const uint32_t> code) {
+    return Reflector{code}.reflect();
+}
+
+void ShaderReflection::merge(const ShaderReflection &other) {
+    stages |= other.stages;
+    pushConstantSize = std::max(pushConstantSize, other.pushConstantSize);
+    if (sets.size() < other.sets.size()) {
+        sets.resize(other.sets.size());
+    }
+
+    for (size_t set = 0; set < other.sets.size(); set++) {
+        for (const VkDescriptorSetLayoutBinding &otherBinding: other.sets[set]) {
+            const auto it = std::ranges::find(sets[set], otherBinding.binding, &VkDescriptorSetLayoutBinding::binding);
+            if (it == sets[set].end()) {
+                sets[set].push_back(otherBinding);
+                continue;
+            }
+            if (it->descriptorType != otherBinding.descriptorType ||
+                it->descriptorCount != otherBinding.descriptorCount) {
+                throw std::runtime_error(std::format("Failed to merge shader resources: set {} binding {} differs!",
+                                                     set, otherBinding.binding));
+            }
+            it->stageFlags |= otherBinding.stageFlags;
+        }
+    }
+}
+
+bool ShaderReflection::hasSameResources(const ShaderReflection &other) const {
+    if (pushConstantSize != other.pushConstantSize || sets.size() != other.sets.size()) {
+        return false;
+    }
+    const auto key = [](const VkDescriptorSetLayoutBinding &binding) {
+        return std::tuple{binding.binding, binding.descriptorType, binding.descriptorCount};
+    };
+    for (size_t set = 0; set < sets.size(); set++) {
+        auto bindings = sets[set] | std::views::transform(key) | std::ranges::to<std::vector>();
+        auto otherBindings = other.sets[set] | std::views::transform(key) | std::ranges::to<std::vector>();
+        std::ranges::sort(bindings);
+        std::ranges::sort(otherBindings);
+        if (bindings != otherBindings) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,28 @@
+module;
+
+// libs
+#include <vulkan/vulkan.h>
+
+export module KaguEngine.ShaderReflection;
+
+// std
+import std;
+
+export namespace KaguEngine {
+
+// Resources a shader stage (or a merged pipeline) declares, read from its SPIR-V
+struct ShaderReflection {
+    VkShaderStageFlags stages = 0;
+    // Indexed by set, a set the shaders skip has no bindings
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+    uint32_t pushConstantSize = 0; // 0 when there's no push constant block
+
+    // Throws when the SPIR-V is malformed or declares a resource the engine can't lay out
+    [[nodiscard]] static ShaderReflection reflect(std::span<const uint32_t> code);
+    // Throws when both declare the same binding differently
+    void merge(const ShaderReflection &other);
+    // Same bindings and push constant size, whatever the stages using them
+    [[nodiscard]] bool hasSameResources(const ShaderReflection &other) const;
+};
+
+} // Namespace KaguEngine
@@ -8,78 +8,58 @@ module KaguEngine.SwapChain;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
 import KaguEngine.Device;
+import KaguEngine.FramePacer;
 
 namespace KaguEngine {
 
-SwapChain::SwapChain(Device &deviceRef, const VkExtent2D windowExtent) :
-    deviceRef{deviceRef}, m_WindowExtent{windowExtent} {
+SwapChain::SwapChain(Device &deviceRef, const VkExtent2D windowExtent, FramePacer &framePacer) :
+    deviceRef{deviceRef}, framePacerRef{framePacer}, m_WindowExtent{windowExtent} {
     init();
 }
 
-SwapChain::SwapChain(Device &deviceRef, const VkExtent2D windowExtent, const std::shared_ptr<SwapChain> previous) :
-    m_OldSwapChain{previous}, m_WindowExtent{windowExtent}, deviceRef{deviceRef} {
+SwapChain::SwapChain(Device &deviceRef, const VkExtent2D windowExtent, FramePacer &framePacer,
+                     const std::shared_ptr<SwapChain> previous) :
+    deviceRef{deviceRef}, framePacerRef{framePacer}, m_WindowExtent{windowExtent}, m_OldSwapChain{previous} {
     init();
 }
 
 void SwapChain::init() {
     createSwapChain();
     createImageViews();
-    createDepthResources();
-    createColorResources();
+    // The multisampled color and depth attachments are transient render graph images
+    m_SwapChainDepthFormat = findDepthFormat(deviceRef);
     createSyncObjects();
 }
 
 SwapChain::~SwapChain() {
     // Destroy swapchain image views
     for (const auto imageView: m_SwapChainImageViews) {
-        vkDestroyImageView(deviceRef.device(), imageView, nullptr);
+        vkDestroyImageView(deviceRef.device(), imageView, AllocationTracker::callbacks());
     }
     m_SwapChainImageViews.clear();
 
-    // Destroy multisample color image views, images, and memories
-    for (size_t i = 0; i < m_MultisampleColorImages.size(); i++) {
-        vkDestroyImageView(deviceRef.device(), m_MultisampleColorImageViews[i], nullptr);
-        vkDestroyImage(deviceRef.device(), m_MultisampleColorImages[i], nullptr);
-        vkFreeMemory(deviceRef.device(), m_MultisampleColorImageMemories[i], nullptr);
-    }
-    m_MultisampleColorImageViews.clear();
-    m_MultisampleColorImages.clear();
-    m_MultisampleColorImageMemories.clear();
-
-    // Destroy depth image views, images, and memories
-    for (size_t i = 0; i < m_DepthImages.size(); i++) {
-        vkDestroyImageView(deviceRef.device(), m_DepthImageViews[i], nullptr);
-        vkDestroyImage(deviceRef.device(), m_DepthImages[i], nullptr);
-        vkFreeMemory(deviceRef.device(), m_DepthImageMemories[i], nullptr);
-    }
-    m_DepthImageViews.clear();
-    m_DepthImages.clear();
-    m_DepthImageMemories.clear();
-
     // Destroy synchronization objects
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(deviceRef.device(), m_AcquireSemaphores[i], nullptr);
-        vkDestroyFence(deviceRef.device(), m_InFlightFences[i], nullptr);
+        vkDestroySemaphore(deviceRef.device(), m_AcquireSemaphores[i], AllocationTracker::callbacks());
     }
     for (uint32_t i = 0; i < m_ImageCount; i++) {
-        vkDestroySemaphore(deviceRef.device(), m_RenderFinishedSemaphores[i], nullptr);
+        vkDestroySemaphore(deviceRef.device(), m_RenderFinishedSemaphores[i], AllocationTracker::callbacks());
     }
     m_RenderFinishedSemaphores.clear();
     m_AcquireSemaphores.clear();
-    m_InFlightFences.clear();
-    m_ImagesInFlight.clear();
+    m_ImageFrameValues.clear();
 
     // Destroy the swapchain
     if (m_SwapChain != nullptr) {
-        vkDestroySwapchainKHR(deviceRef.device(), m_SwapChain, nullptr);
+        vkDestroySwapchainKHR(deviceRef.device(), m_SwapChain, AllocationTracker::callbacks());
         m_SwapChain = nullptr;
     }
 }
 
 VkResult SwapChain::acquireNextImage(uint32_t *imageIndex) const {
-    vkWaitForFences(deviceRef.device(), 1, &m_InFlightFences[m_CurrentFrame], VK_TRUE, UINT64_MAX);
-
+    // The frame pacer already waited for the frame slot
     // On AMD GPUs, this call takes exactly two seconds to acquire the next [imageCount()] images after recreating
     // the swap chain.
     const VkResult result =
@@ -90,31 +70,47 @@ VkResult SwapChain::acquireNextImage(uint32_t *imageIndex) const {
     return result;
 }
 
-VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer* buffers, const uint32_t* imageIndex) {
-    if (m_ImagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-        vkWaitForFences(deviceRef.device(), 1, &m_ImagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-    }
-    m_ImagesInFlight[*imageIndex] = m_InFlightFences[m_CurrentFrame];
+VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer* buffers, const uint32_t* imageIndex,
+                                         const uint64_t uploadValue) {
+    // An image can be handed out again before the frame that last rendered to it is done
+    framePacerRef.waitForValue(m_ImageFrameValues[*imageIndex]);
+    const uint64_t frameValue = framePacerRef.beginSubmit();
+    m_ImageFrameValues[*imageIndex] = frameValue;
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphore   = m_AcquireSemaphores[m_CurrentFrame];
+    const VkSemaphore waitSemaphores[] = {m_AcquireSemaphores[m_CurrentFrame], deviceRef.uploadSemaphore()};
     VkSemaphore signalSemaphore = m_RenderFinishedSemaphores[*imageIndex];
-
-    constexpr VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &waitSemaphore;
+    const VkSemaphore signalSemaphores[] = {signalSemaphore, framePacerRef.semaphore()};
+    const uint64_t signalValues[] = {0, frameValue};
+
+    // Uploads are only read as vertex input and by the shaders
+    constexpr VkPipelineStageFlags waitStages[] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+    };
+    const uint64_t waitValues[] = {0, uploadValue}; // The binary semaphore's value is ignored
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 2;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 2;
+    submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = buffers;
 
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &signalSemaphore;
+    submitInfo.signalSemaphoreCount = 2;
+    submitInfo.pSignalSemaphores = signalSemaphores;
 
-    vkResetFences(deviceRef.device(), 1, &m_InFlightFences[m_CurrentFrame]);
-    if (vkQueueSubmit(deviceRef.graphicsQueue(), 1, &submitInfo, m_InFlightFences[m_CurrentFrame]) != VK_SUCCESS) {
+    const auto queueLock = deviceRef.lockGraphicsQueue();
+    if (vkQueueSubmit(deviceRef.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
         throw std::runtime_error("failed to submit draw command buffer!");
     }
 
@@ -138,7 +134,7 @@ void SwapChain::createSwapChain() {
     const auto [capabilities, formats, presentModes] = deviceRef.getSwapChainSupport();
 
     const auto [format, colorSpace] = chooseSwapSurfaceFormat(formats);
-    const VkPresentModeKHR presentMode = chooseSwapPresentMode(presentModes);
+    const VkPresentModeKHR presentMode = chooseSwapPresentMode(presentModes, framePacerRef.getMode());
     const VkExtent2D extent = chooseSwapExtent(capabilities);
 
     uint32_t imageCount = capabilities.minImageCount + 1;
@@ -179,7 +175,8 @@ void SwapChain::createSwapChain() {
 
     createInfo.oldSwapchain = m_OldSwapChain == nullptr ? VK_NULL_HANDLE : m_OldSwapChain->m_SwapChain;
 
-    if (vkCreateSwapchainKHR(deviceRef.device(), &createInfo, nullptr, &m_SwapChain) != VK_SUCCESS) {
+    if (vkCreateSwapchainKHR(deviceRef.device(), &createInfo,
+                             AllocationTracker::callbacks(), &m_SwapChain) != VK_SUCCESS) {
         throw std::runtime_error("failed to create swap chain!");
     }
 
@@ -204,7 +201,7 @@ VkImageView SwapChain::createImageView(const VkImage image, const VkFormat forma
     viewInfo.subresourceRange.layerCount = 1;
 
     VkImageView imageView;
-    if (vkCreateImageView(deviceRef.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+    if (vkCreateImageView(deviceRef.device(), &viewInfo, AllocationTracker::callbacks(), &imageView) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture image view!");
     }
 
@@ -219,104 +216,24 @@ void SwapChain::createImageViews() {
     }
 }
 
-void SwapChain::createDepthResources() {
-    const VkFormat depthFormat = findDepthFormat();
-    m_SwapChainDepthFormat = depthFormat;
-    const auto [width, height] = getSwapChainExtent();
-
-    m_DepthImages.resize(imageCount());
-    m_DepthImageMemories.resize(imageCount());
-    m_DepthImageViews.resize(imageCount());
-
-    for (int i = 0; i < m_DepthImages.size(); i++) {
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = width;
-        imageInfo.extent.height = height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = depthFormat;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-        imageInfo.samples = deviceRef.getSampleCount();
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        imageInfo.flags = 0;
-
-        deviceRef.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_DepthImages[i],
-                                      m_DepthImageMemories[i]);
-
-        VkImageViewCreateInfo viewInfo{};
-        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        viewInfo.image = m_DepthImages[i];
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = depthFormat;
-        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
-
-        if (vkCreateImageView(deviceRef.device(), &viewInfo, nullptr, &m_DepthImageViews[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture image view!");
-        }
-    }
-}
-
-void SwapChain::createColorResources() {
-    const VkFormat colorFormat = m_SwapChainImageFormat;
-
-    m_MultisampleColorImages.resize(imageCount());
-    m_MultisampleColorImageMemories.resize(imageCount());
-    m_MultisampleColorImageViews.resize(imageCount());
-
-    for (size_t i = 0; i < imageCount(); i++) {
-        VkImageCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        createInfo.imageType = VK_IMAGE_TYPE_2D;
-        createInfo.extent.width = m_SwapChainExtent.width;
-        createInfo.extent.height = m_SwapChainExtent.height;
-        createInfo.extent.depth = 1;
-        createInfo.mipLevels = 1;
-        createInfo.arrayLayers = 1;
-        createInfo.format = colorFormat;
-        createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        createInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-        createInfo.samples = deviceRef.getSampleCount();
-        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        createInfo.flags = 0;
-        deviceRef.createImageWithInfo(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        m_MultisampleColorImages[i], m_MultisampleColorImageMemories[i]);
-        m_MultisampleColorImageViews[i] = createImageView(
-        m_MultisampleColorImages[i], colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-    }
-}
-
 void SwapChain::createSyncObjects() {
     m_AcquireSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     m_RenderFinishedSemaphores.resize(m_ImageCount);
-    m_InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    m_ImagesInFlight.assign(m_ImageCount, VK_NULL_HANDLE);
+    m_ImageFrameValues.assign(m_ImageCount, 0);
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateSemaphore(deviceRef.device(), &semaphoreInfo, nullptr, &m_AcquireSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(deviceRef.device(), &fenceInfo, nullptr, &m_InFlightFences[i]) != VK_SUCCESS) {
+        if (vkCreateSemaphore(deviceRef.device(), &semaphoreInfo,
+                              AllocationTracker::callbacks(), &m_AcquireSemaphores[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create per-frame synchronization objects");
         }
     }
 
     for (uint32_t i = 0; i < m_ImageCount; i++) {
-        if (vkCreateSemaphore(deviceRef.device(), &semaphoreInfo, nullptr, &m_RenderFinishedSemaphores[i]) != VK_SUCCESS) {
+        if (vkCreateSemaphore(deviceRef.device(), &semaphoreInfo,
+                              AllocationTracker::callbacks(), &m_RenderFinishedSemaphores[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create per-image renderFinished semaphore");
         }
     }
@@ -334,22 +251,22 @@ VkSurfaceFormatKHR SwapChain::chooseSwapSurfaceFormat(const std::vector<VkSurfac
     return availableFormats[0];
 }
 
-VkPresentModeKHR SwapChain::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes) {
-    for (const auto &availablePresentMode: availablePresentModes) {
-        // Lower latency, but frames might be dropped
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return availablePresentMode;
-        }
-    }
+VkPresentModeKHR SwapChain::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes,
+                                                  const PacingMode mode) {
+    const auto isAvailable = [&](const VkPresentModeKHR presentMode) {
+        return std::ranges::find(availablePresentModes, presentMode) != availablePresentModes.end();
+    };
 
-    for (const auto &availablePresentMode : availablePresentModes) {
-        // V-Sync off
-        if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-          return availablePresentMode;
-        }
+    // V-Sync off, tearing allowed
+    if (mode == PacingMode::Uncapped && isAvailable(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+        return VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    // Lower latency, but frames might be dropped
+    if (mode != PacingMode::LowLatency && isAvailable(VK_PRESENT_MODE_MAILBOX_KHR)) {
+        return VK_PRESENT_MODE_MAILBOX_KHR;
     }
 
-    // No frames dropped, higher latency
+    // No frames dropped, always supported. Paced by the CPU waiting before input in low latency mode
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -366,8 +283,8 @@ VkExtent2D SwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilit
     return actualExtent;
 }
 
-VkFormat SwapChain::findDepthFormat() const {
-    return deviceRef.findSupportedFormat(
+VkFormat SwapChain::findDepthFormat(const Device &device) {
+    return device.findSupportedFormat(
             {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
             VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 }
@@ -9,15 +9,17 @@ export module KaguEngine.SwapChain;
 import std;
 
 import KaguEngine.Device;
+import KaguEngine.FramePacer;
 
 export namespace KaguEngine {
 
 class SwapChain {
 public:
-    static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+    // Upper bound, the frame pacer decides how many frames are actually in flight
+    static constexpr int MAX_FRAMES_IN_FLIGHT = FramePacer::MAX_FRAMES_IN_FLIGHT;
 
-    SwapChain(Device &deviceRef, VkExtent2D windowExtent);
-    SwapChain(Device &deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
+    SwapChain(Device &deviceRef, VkExtent2D windowExtent, FramePacer &framePacer);
+    SwapChain(Device &deviceRef, VkExtent2D windowExtent, FramePacer &framePacer, std::shared_ptr<SwapChain> previous);
 
     ~SwapChain();
 
@@ -26,8 +28,6 @@ public:
 
     [[nodiscard]] VkImageView getImageView(const uint32_t index) const     { return m_SwapChainImageViews[index]; }
     [[nodiscard]] VkImage getImage(const uint32_t index) const             { return m_SwapChainImages[index]; }
-    [[nodiscard]] VkImageView getDepthImageView(const uint32_t index) const { return m_DepthImageViews[index]; }
-    [[nodiscard]] VkImageView getMultisampleColorImageView(const uint32_t index) const { return m_MultisampleColorImageViews[index]; }
     [[nodiscard]] size_t imageCount() const                           { return m_SwapChainImages.size(); }
     [[nodiscard]] VkFormat* getSwapChainImageFormat()                 { return &m_SwapChainImageFormat; }
     [[nodiscard]] VkExtent2D getSwapChainExtent() const               { return m_SwapChainExtent; }
@@ -37,10 +37,11 @@ public:
     [[nodiscard]] float extentAspectRatio() const {
         return static_cast<float>(m_SwapChainExtent.width) / static_cast<float>(m_SwapChainExtent.height);
     }
-    [[nodiscard]] VkFormat findDepthFormat() const;
+    [[nodiscard]] static VkFormat findDepthFormat(const Device &device);
 
     VkResult acquireNextImage(uint32_t *imageIndex) const;
-    VkResult submitCommandBuffers(const VkCommandBuffer *buffers, const uint32_t *imageIndex);
+    // The frame also waits until the upload semaphore reached uploadValue
+    VkResult submitCommandBuffers(const VkCommandBuffer *buffers, const uint32_t *imageIndex, uint64_t uploadValue = 0);
 
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) const;
     [[nodiscard]] bool compareSwapFormats(const SwapChain &swapChain) const {
@@ -52,29 +53,23 @@ private:
     void init();
     void createSwapChain();
     void createImageViews();
-    void createDepthResources();
-    void createColorResources();
     void createSyncObjects();
 
     // Helper functions
     static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
-    static VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
+    static VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes,
+                                                  PacingMode mode);
     [[nodiscard]] VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) const;
 
     VkFormat m_SwapChainImageFormat;
     VkFormat m_SwapChainDepthFormat;
     VkExtent2D m_SwapChainExtent;
 
-    std::vector<VkImage> m_DepthImages;
-    std::vector<VkDeviceMemory> m_DepthImageMemories;
-    std::vector<VkImageView> m_DepthImageViews;
     std::vector<VkImage> m_SwapChainImages;
     std::vector<VkImageView> m_SwapChainImageViews;
-    std::vector<VkImage> m_MultisampleColorImages;
-    std::vector<VkDeviceMemory> m_MultisampleColorImageMemories;
-    std::vector<VkImageView> m_MultisampleColorImageViews;
 
     Device &deviceRef;
+    FramePacer &framePacerRef;
     VkExtent2D m_WindowExtent;
 
     VkSwapchainKHR m_SwapChain;
@@ -82,8 +77,7 @@ private:
 
     std::vector<VkSemaphore> m_AcquireSemaphores;
     std::vector<VkSemaphore> m_RenderFinishedSemaphores;
-    std::vector<VkFence> m_InFlightFences;
-    std::vector<VkFence> m_ImagesInFlight;
+    std::vector<uint64_t> m_ImageFrameValues; // Frame timeline value that last rendered to each image
     size_t m_CurrentFrame = 0;
     uint32_t m_ImageCount;
 };
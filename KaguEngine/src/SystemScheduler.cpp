@@ -0,0 +1,207 @@
+module KaguEngine.SystemScheduler;
+
+// std
+import std;
+
+import KaguEngine.AllocationTracker;
+import KaguEngine.JobSystem;
+
+namespace KaguEngine {
+
+namespace { // Anonymous namespace for the allocation tags
+// Never freed, a tag outlives the scheduler that used it
+const char *internTag(const std::string &name) {
+    static std::mutex mutex;
+    static std::set<std::string, std::less<>> tags;
+    std::scoped_lock lock{mutex};
+    return tags.insert(name).first->c_str();
+}
+}
+
+SystemScheduler::SystemScheduler(JobSystem &jobSystem) : jobSystemRef{jobSystem} {}
+
+uint32_t SystemScheduler::addSystem(std::string name, const ComponentSet reads, const ComponentSet writes,
+                                    SystemFunction function, const SystemAffinity affinity) {
+    const auto index = static_cast<uint32_t>(m_Systems.size());
+    System &system = m_Systems.emplace_back();
+    system.name = std::move(name);
+    system.tag = internTag(system.name);
+    system.reads = reads;
+    system.writes = writes;
+    system.function = std::move(function);
+    system.affinity = affinity;
+
+    // Read/write and write/write conflicts order the pair, two readers don't
+    for (uint32_t i = 0; i < index; i++) {
+        System &earlier = m_Systems[i];
+        if (writes.intersects(earlier.reads | earlier.writes) || reads.intersects(earlier.writes)) {
+            system.dependencies.push_back(i);
+            earlier.dependents.push_back(index);
+        }
+    }
+    return index;
+}
+
+void SystemScheduler::run() {
+    if (m_Systems.empty()) {
+        return;
+    }
+
+    m_FrameStart = std::chrono::steady_clock::now();
+    m_SystemsLeft.store(getSystemCount(), std::memory_order_relaxed);
+    for (System &system: m_Systems) {
+        system.remainingDependencies.store(static_cast<uint32_t>(system.dependencies.size()),
+                                           std::memory_order_relaxed);
+    }
+
+    JobCounter counter;
+    for (uint32_t i = 0; i < getSystemCount(); i++) {
+        if (m_Systems[i].dependencies.empty()) {
+            launch(i, counter);
+        }
+    }
+
+    // This thread runs the main thread systems as they become ready and helps with the rest meanwhile
+    while (m_SystemsLeft.load(std::memory_order_acquire) != 0) {
+        std::optional<uint32_t> ready;
+        {
+            std::scoped_lock lock{m_MainThreadMutex};
+            if (!m_MainThreadReady.empty()) {
+                ready = m_MainThreadReady.back();
+                m_MainThreadReady.pop_back();
+            }
+        }
+
+        if (ready) {
+            execute(*ready, counter);
+        } else if (!jobSystemRef.tryRunJob()) {
+            std::this_thread::yield();
+        }
+    }
+    jobSystemRef.wait(counter);
+
+    m_FrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_FrameStart).count();
+}
+
+void SystemScheduler::launch(const uint32_t index, JobCounter &counter) {
+    if (m_Systems[index].affinity == SystemAffinity::MainThread) {
+        std::scoped_lock lock{m_MainThreadMutex};
+        m_MainThreadReady.push_back(index);
+        return;
+    }
+    jobSystemRef.schedule(counter, [this, index, &counter] { execute(index, counter); });
+}
+
+void SystemScheduler::execute(const uint32_t index, JobCounter &counter) {
+    System &system = m_Systems[index];
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        AllocationTracker::Tag tag{system.tag};
+        system.function();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    system.timing.startMs = std::chrono::duration<double, std::milli>(start - m_FrameStart).count();
+    system.timing.durationMs = std::chrono::duration<double, std::milli>(end - start).count();
+    system.timing.worker = JobSystem::getWorkerIndex();
+
+    for (const uint32_t dependent: system.dependents) {
+        if (m_Systems[dependent].remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            launch(dependent, counter);
+        }
+    }
+    m_SystemsLeft.fetch_sub(1, std::memory_order_release);
+}
+
+CriticalPath SystemScheduler::getCriticalPath() const {
+    CriticalPath path{};
+    if (m_Systems.empty()) {
+        return path;
+    }
+
+    // Dependencies always point to earlier systems, registration order is a topological order
+    std::vector<double> longest(m_Systems.size());
+    std::vector<uint32_t> previous(m_Systems.size(), ~0u);
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < getSystemCount(); i++) {
+        double before = 0.0;
+        for (const uint32_t dependency: m_Systems[i].dependencies) {
+            if (longest[dependency] > before) {
+                before = longest[dependency];
+                previous[i] = dependency;
+            }
+        }
+        longest[i] = before + m_Systems[i].timing.durationMs;
+        if (longest[i] > longest[last]) {
+            last = i;
+        }
+    }
+
+    path.durationMs = longest[last];
+    for (uint32_t i = last; i != ~0u; i = previous[i]) {
+        path.systems.push_back(i);
+    }
+    std::ranges::reverse(path.systems);
+    return path;
+}
+
+std::string SystemScheduler::dumpGraphviz() const {
+    const CriticalPath criticalPath = getCriticalPath();
+    std::vector<bool> critical(m_Systems.size(), false);
+    for (const uint32_t index: criticalPath.systems) {
+        critical[index] = true;
+    }
+
+    std::string graph = std::format("digraph Schedule {{\n"
+                                    "    label=\"Frame {:.3f} ms | critical path {:.3f} ms\";\n"
+                                    "    rankdir=LR;\n"
+                                    "    node [shape=box, fontname=\"monospace\"];\n",
+                                    m_FrameMs, criticalPath.durationMs);
+    for (uint32_t i = 0; i < getSystemCount(); i++) {
+        const System &system = m_Systems[i];
+        graph += std::format("    s{} [label=\"{}\\n{:.3f} ms at +{:.3f} ms on worker {}{}\\nreads: {}\\nwrites: {}\"{}];\n",
+                             i, system.name, system.timing.durationMs, system.timing.startMs, system.timing.worker,
+                             system.affinity == SystemAffinity::MainThread ? " (main thread)" : "",
+                             describe(system.reads), describe(system.writes),
+                             critical[i] ? ", color=red, penwidth=2" : "");
+    }
+    for (uint32_t i = 0; i < getSystemCount(); i++) {
+        for (const uint32_t dependent: m_Systems[i].dependents) {
+            graph += std::format("    s{} -> s{}{};\n", i, dependent,
+                                 critical[i] && critical[dependent] ? " [color=red, penwidth=2]" : "");
+        }
+    }
+    graph += "}\n";
+    return graph;
+}
+
+const char *SystemScheduler::getComponentName(const Component component) {
+    switch (component) {
+        case Component::Camera:        return "Camera";
+        case Component::Transforms:    return "Transforms";
+        case Component::Lights:        return "Lights";
+        case Component::Models:        return "Models";
+        case Component::GlobalUbo:     return "GlobalUbo";
+        case Component::RenderPacket:  return "RenderPacket";
+        case Component::Ui:            return "Ui";
+        default:                       return "Unknown";
+    }
+}
+
+std::string SystemScheduler::describe(const ComponentSet components) {
+    std::string description;
+    for (uint32_t bit = 0; bit < static_cast<uint32_t>(Component::Count); bit++) {
+        const auto component = static_cast<Component>(1u << bit);
+        if (!components.contains(component)) {
+            continue;
+        }
+        if (!description.empty()) {
+            description += ", ";
+        }
+        description += getComponentName(component);
+    }
+    return description.empty() ? "-" : description;
+}
+
+} // Namespace KaguEngine
@@ -0,0 +1,121 @@
+export module KaguEngine.SystemScheduler;
+
+// std
+import std;
+
+import KaguEngine.JobSystem;
+
+export namespace KaguEngine {
+
+// Engine data a system can read or write, two systems conflict when one of them writes what the other touches
+enum class Component : uint32_t {
+    Camera        = 1 << 0, // Camera and the views driving it
+    Transforms    = 1 << 1,
+    Lights        = 1 << 2,
+    Models        = 1 << 3, // Meshes, textures and their residency
+    GlobalUbo     = 1 << 4,
+    RenderPacket  = 1 << 5, // The snapshot handed to the render thread
+    Ui            = 1 << 6, // Settings edited from ImGui
+    Count         = 7
+};
+
+struct ComponentSet {
+    uint32_t bits = 0;
+
+    constexpr ComponentSet() = default;
+    constexpr ComponentSet(const Component component) : bits{static_cast<uint32_t>(component)} {}
+
+    [[nodiscard]] constexpr bool intersects(const ComponentSet other) const { return (bits & other.bits) != 0; }
+    [[nodiscard]] constexpr bool contains(const Component component) const {
+        return (bits & static_cast<uint32_t>(component)) != 0;
+    }
+    constexpr ComponentSet operator|(const ComponentSet other) const {
+        ComponentSet result{};
+        result.bits = bits | other.bits;
+        return result;
+    }
+};
+
+constexpr ComponentSet operator|(const Component a, const Component b) { return ComponentSet{a} | b; }
+
+constexpr ComponentSet ALL_COMPONENTS = Component::Camera | Component::Transforms | Component::Lights |
+                                        Component::Models | Component::GlobalUbo | Component::RenderPacket |
+                                        Component::Ui;
+
+enum class SystemAffinity : uint8_t {
+    Any,
+    MainThread // Windowing, input and ImGui calls
+};
+
+// Last frame of a system
+struct SystemTiming {
+    double startMs = 0.0; // From the start of run()
+    double durationMs = 0.0;
+    uint32_t worker = 0;
+};
+
+struct CriticalPath {
+    std::vector<uint32_t> systems; // In execution order
+    double durationMs = 0.0;
+};
+
+// Runs the per-frame systems on the job system. A system depends on every earlier one it conflicts with,
+// so registration order is the frame order and systems without conflicts run concurrently.
+class SystemScheduler {
+public:
+    using SystemFunction = std::function<void()>;
+
+    explicit SystemScheduler(JobSystem &jobSystem);
+
+    // Non copyable
+    SystemScheduler(const SystemScheduler &) = delete;
+    SystemScheduler &operator=(const SystemScheduler &) = delete;
+
+    // Returns the index of the system, which can't be removed
+    uint32_t addSystem(std::string name, ComponentSet reads, ComponentSet writes, SystemFunction function,
+                       SystemAffinity affinity = SystemAffinity::Any);
+
+    // Runs every system once, from the thread that created the job system
+    void run();
+
+    [[nodiscard]] uint32_t getSystemCount()                  const { return static_cast<uint32_t>(m_Systems.size()); }
+    [[nodiscard]] const std::string &getName(uint32_t index) const { return m_Systems[index].name; }
+    [[nodiscard]] const SystemTiming &getTiming(uint32_t index) const { return m_Systems[index].timing; }
+    [[nodiscard]] double getFrameMs()                        const { return m_FrameMs; }
+    // Longest chain of dependent systems in the last frame, the frame can't be shorter than it
+    [[nodiscard]] CriticalPath getCriticalPath() const;
+    // Graphviz graph of the last frame, the critical path in red
+    [[nodiscard]] std::string dumpGraphviz() const;
+
+    [[nodiscard]] static const char *getComponentName(Component component);
+
+private:
+    struct System {
+        std::string name;
+        const char *tag = nullptr; // Interned name, AllocationTracker keeps tags for the whole process
+        ComponentSet reads{};
+        ComponentSet writes{};
+        SystemFunction function;
+        SystemAffinity affinity = SystemAffinity::Any;
+
+        std::vector<uint32_t> dependencies;
+        std::vector<uint32_t> dependents;
+        std::atomic<uint32_t> remainingDependencies{0};
+        SystemTiming timing{};
+    };
+
+    void launch(uint32_t index, JobCounter &counter);
+    void execute(uint32_t index, JobCounter &counter);
+    [[nodiscard]] static std::string describe(ComponentSet components);
+
+    JobSystem &jobSystemRef;
+    std::deque<System> m_Systems; // Stable addresses, System isn't movable
+
+    std::chrono::steady_clock::time_point m_FrameStart{};
+    double m_FrameMs = 0.0;
+    std::atomic<uint32_t> m_SystemsLeft{0};
+    std::mutex m_MainThreadMutex;
+    std::vector<uint32_t> m_MainThreadReady;
+};
+
+} // Namespace KaguEngine
@@ -11,43 +11,91 @@ module KaguEngine.Texture;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
+import KaguEngine.CpuProfiler;
 import KaguEngine.Device;
-import KaguEngine.SwapChain;
+import KaguEngine.Memory;
+import KaguEngine.Residency;
 
 namespace KaguEngine {
 
-Texture::Texture(Device &device, SwapChain &swapChain, const std::string &filepath,
+Texture::Texture(Device &device, const std::string &filepath,
                  VkDescriptorSetLayout descriptorSetLayout, VkDescriptorPool descriptorPool) :
-    deviceRef{device}, swapChainRef{swapChain} {
+    deviceRef{device}, m_DescriptorSetLayout{descriptorSetLayout}, m_DescriptorPool{descriptorPool} {
     loadTexture(filepath);
-    createTextureImageView();
     createTextureSampler();
-    createMaterial(descriptorSetLayout, descriptorPool);
+    makeResident();
+    deviceRef.residency().registerResource(*this);
+}
+
+Texture::Texture(Device &device, const uint32_t width, const uint32_t height, std::vector<uint8_t> pixels,
+                 VkDescriptorSetLayout descriptorSetLayout, VkDescriptorPool descriptorPool) :
+    deviceRef{device}, m_DescriptorSetLayout{descriptorSetLayout}, m_DescriptorPool{descriptorPool} {
+    setPixels(width, height, std::move(pixels));
+    createTextureSampler();
+    makeResident();
+    deviceRef.residency().registerResource(*this);
 }
 
 Texture::~Texture() {
+    deviceRef.residency().unregisterResource(*this);
+    evict();
     if (m_TextureSampler != VK_NULL_HANDLE) {
-        vkDestroySampler(deviceRef.device(), m_TextureSampler, nullptr);
+        vkDestroySampler(deviceRef.device(), m_TextureSampler, AllocationTracker::callbacks());
+    }
+}
+
+void Texture::evict() {
+    if (m_Material.descriptorSet != VK_NULL_HANDLE) {
+        vkFreeDescriptorSets(deviceRef.device(), m_DescriptorPool, 1, &m_Material.descriptorSet);
+        m_Material.descriptorSet = VK_NULL_HANDLE;
     }
     if (m_TextureImageView != VK_NULL_HANDLE) {
-        vkDestroyImageView(deviceRef.device(), m_TextureImageView, nullptr);
+        vkDestroyImageView(deviceRef.device(), m_TextureImageView, AllocationTracker::callbacks());
+        m_TextureImageView = VK_NULL_HANDLE;
     }
-    if (m_TextureImage != VK_NULL_HANDLE) {
-        vkDestroyImage(deviceRef.device(), m_TextureImage, nullptr);
+    // The Defragmenter's copy still uses both images, they go once its batch completed
+    if (m_RelocatedImage != VK_NULL_HANDLE) {
+        deviceRef.allocator().cancelMove(m_TextureAllocation, [device = deviceRef.device(), source = m_TextureImage,
+                                                               destination = m_RelocatedImage] {
+            vkDestroyImage(device, source, AllocationTracker::callbacks());
+            vkDestroyImage(device, destination, AllocationTracker::callbacks());
+        });
+        m_TextureImage = VK_NULL_HANDLE;
+        m_RelocatedImage = VK_NULL_HANDLE;
+        m_TextureAllocation = {};
+        return;
     }
-    if (m_TextureImageMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(deviceRef.device(), m_TextureImageMemory, nullptr);
+    if (m_TextureImage != VK_NULL_HANDLE) {
+        vkDestroyImage(deviceRef.device(), m_TextureImage, AllocationTracker::callbacks());
+        m_TextureImage = VK_NULL_HANDLE;
     }
+    deviceRef.allocator().free(m_TextureAllocation);
+    m_TextureAllocation = {};
+}
+
+void Texture::makeResident() {
+    uploadTexture();
+    m_TextureImageView = createTextureImageView(m_TextureImage);
+    createMaterial();
 }
 
-std::unique_ptr<Texture> Texture::createTextureFromFile(Device &device, SwapChain &swapChain,
+std::unique_ptr<Texture> Texture::createTextureFromFile(Device &device,
                                                         const std::string &filepath,
                                                         VkDescriptorSetLayout descriptorSetLayout,
                                                         VkDescriptorPool descriptorPool) {
-    return std::make_unique<Texture>(device, swapChain, filepath, descriptorSetLayout, descriptorPool);
+    return std::make_unique<Texture>(device, filepath, descriptorSetLayout, descriptorPool);
 }
 
-void Texture::createMaterial(VkDescriptorSetLayout layout, VkDescriptorPool pool) {
+std::unique_ptr<Texture> Texture::createSolidTexture(Device &device,
+                                                     const std::array<uint8_t, 4> &color,
+                                                     VkDescriptorSetLayout descriptorSetLayout,
+                                                     VkDescriptorPool descriptorPool) {
+    return std::make_unique<Texture>(device, 1, 1, std::vector<uint8_t>(color.begin(), color.end()),
+                                     descriptorSetLayout, descriptorPool);
+}
+
+void Texture::createMaterial() {
     if (m_TextureImage == VK_NULL_HANDLE) {
         m_Material.descriptorSet = VK_NULL_HANDLE;
         return;
@@ -58,9 +106,9 @@ void Texture::createMaterial(VkDescriptorSetLayout layout, VkDescriptorPool pool
 
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorPool = m_DescriptorPool;
     allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &layout;
+    allocInfo.pSetLayouts = &m_DescriptorSetLayout;
 
     if (vkAllocateDescriptorSets(deviceRef.device(), &allocInfo, &m_Material.descriptorSet) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor set for material!");
@@ -84,6 +132,7 @@ void Texture::createMaterial(VkDescriptorSetLayout layout, VkDescriptorPool pool
 }
 
 void Texture::loadTexture(const std::string &filepath) {
+    CpuProfiler::Zone zone{"Texture::loadTexture"};
     int texWidth, texHeight, texChannels;
     stbi_uc *pixels = stbi_load(filepath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
@@ -91,82 +140,126 @@ void Texture::loadTexture(const std::string &filepath) {
         throw std::runtime_error("Failed to load texture image!");
     }
 
-    m_MipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-    const VkDeviceSize imageSize = texWidth * texHeight * 4;
+    // Kept around to upload the texture again after an eviction
+    setPixels(static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight),
+              std::vector<uint8_t>(pixels, pixels + static_cast<size_t>(texWidth) * texHeight * 4));
+    stbi_image_free(pixels);
+}
+
+void Texture::setPixels(const uint32_t width, const uint32_t height, std::vector<uint8_t> pixels) {
+    if (pixels.size() != static_cast<size_t>(width) * height * 4) {
+        throw std::runtime_error("Texture pixels don't match its size!");
+    }
+    m_Width = width;
+    m_Height = height;
+    m_MipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    m_Pixels = std::move(pixels);
+}
+
+void Texture::uploadTexture() {
+    const auto texWidth = static_cast<int32_t>(m_Width);
+    const auto texHeight = static_cast<int32_t>(m_Height);
+    const VkDeviceSize imageSize = m_Pixels.size();
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(deviceRef.getPhysicalDevice(), VK_FORMAT_R8G8B8A8_SRGB, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        throw std::runtime_error("Texture image format does not support linear blitting!");
+    }
 
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    Allocation stagingAllocation;
     deviceRef.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                           stagingBuffer, stagingBufferMemory);
-
-    void *data;
-    vkMapMemory(deviceRef.device(), stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, imageSize);
-    vkUnmapMemory(deviceRef.device(), stagingBufferMemory);
-
-    stbi_image_free(pixels);
+                           stagingBuffer, stagingAllocation);
+    memcpy(stagingAllocation.mapped, m_Pixels.data(), imageSize);
 
     createImage(texWidth, texHeight, m_MipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
                 VK_IMAGE_TILING_OPTIMAL,
                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_TextureImage, m_TextureImageMemory);
-
-    transitionImageLayout(m_TextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_MipLevels);
-    deviceRef.copyBufferToImage(stagingBuffer, m_TextureImage, static_cast<uint32_t>(texWidth),
-                                static_cast<uint32_t>(texHeight), 1);
-    generateMipmaps(m_TextureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, m_MipLevels);
-
-    vkDestroyBuffer(deviceRef.device(), stagingBuffer, nullptr);
-    vkFreeMemory(deviceRef.device(), stagingBufferMemory, nullptr);
-}
-
-void Texture::transitionImageLayout(VkImage image, VkFormat format, const VkImageLayout oldLayout,
-                                         const VkImageLayout newLayout, const uint32_t mipLevels) const {
-    VkCommandBuffer commandBuffer = deviceRef.beginSingleTimeCommands();
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_TextureImage, m_TextureAllocation);
 
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
+    barrier.image = m_TextureImage;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.levelCount = m_MipLevels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-               newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        throw std::invalid_argument("Unsupported layout transition!");
-    }
-
-    vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    deviceRef.endSingleTimeCommands(commandBuffer);
+    // Transfer queues can't blit, so only the base level is copied there and the mips are generated on
+    // the graphics queue once it acquired the image
+    const bool dedicated = deviceRef.hasDedicatedTransferQueue();
+    VkImageMemoryBarrier ownership = barrier;
+    ownership.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    ownership.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    ownership.srcQueueFamilyIndex = deviceRef.transferFamily();
+    ownership.dstQueueFamilyIndex = deviceRef.graphicsFamily();
+
+    deviceRef.submitUpload(
+        [&](const VkCommandBuffer commandBuffer) {
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+            VkBufferImageCopy region{};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {m_Width, m_Height, 1};
+            vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, m_TextureImage,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+            if (dedicated) {
+                VkImageMemoryBarrier release = ownership;
+                release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                release.dstAccessMask = 0;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+            }
+        },
+        [ownership, dedicated, image = m_TextureImage, texWidth, texHeight,
+         mipLevels = m_MipLevels](const VkCommandBuffer commandBuffer) {
+            if (dedicated) {
+                VkImageMemoryBarrier acquire = ownership;
+                acquire.srcAccessMask = 0;
+                acquire.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     0, 0, nullptr, 0, nullptr, 1, &acquire);
+            }
+            generateMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels);
+        },
+        [&device = deviceRef, stagingBuffer, stagingAllocation] {
+            vkDestroyBuffer(device.device(), stagingBuffer, AllocationTracker::callbacks());
+            device.allocator().free(stagingAllocation);
+        });
 }
 
-void Texture::createTextureImageView() {
-    m_TextureImageView = swapChainRef.createImageView(m_TextureImage, VK_FORMAT_R8G8B8A8_SRGB,
-                                                      VK_IMAGE_ASPECT_COLOR_BIT, m_MipLevels);
+VkImageView Texture::createTextureImageView(const VkImage image) const {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = m_MipLevels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkImageView imageView;
+    if (vkCreateImageView(deviceRef.device(), &viewInfo, AllocationTracker::callbacks(), &imageView) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image view!");
+    }
+    return imageView;
 }
 
 void Texture::createTextureSampler() {
@@ -188,7 +281,8 @@ void Texture::createTextureSampler() {
     samplerInfo.maxLod = static_cast<float>(m_MipLevels);
     samplerInfo.mipLodBias = 0.0f; // Optional
 
-    if (vkCreateSampler(deviceRef.device(), &samplerInfo, nullptr, &m_TextureSampler) != VK_SUCCESS) {
+    if (vkCreateSampler(deviceRef.device(), &samplerInfo,
+                        AllocationTracker::callbacks(), &m_TextureSampler) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture sampler!");
     }
 }
@@ -197,7 +291,7 @@ void Texture::createImage(const uint32_t width, const uint32_t height, const uin
                           const VkSampleCountFlagBits numSamples, const VkFormat format,
                           const VkImageTiling tiling, const VkImageUsageFlags usage,
                           const VkMemoryPropertyFlags properties, VkImage &image,
-                          VkDeviceMemory &imageMemory) const {
+                          Allocation &allocation) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -213,36 +307,13 @@ void Texture::createImage(const uint32_t width, const uint32_t height, const uin
     imageInfo.samples = numSamples;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateImage(deviceRef.device(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create image!");
-    }
-
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(deviceRef.device(), image, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = deviceRef.findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(deviceRef.device(), &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate image memory!");
-    }
-
-    vkBindImageMemory(deviceRef.device(), image, imageMemory, 0);
+    // Kept around to create an identical image when relocating
+    m_ImageInfo = imageInfo;
+    deviceRef.createImageWithInfo(imageInfo, properties, image, allocation, this);
 }
 
-void Texture::generateMipmaps(const VkImage image, VkFormat imageFormat, const int32_t texWidth,
-                                   const int32_t texHeight, const uint32_t mipLevels) const {
-    const VkCommandBuffer commandBuffer = deviceRef.beginSingleTimeCommands();
-
-    VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(deviceRef.getPhysicalDevice(), imageFormat, &formatProperties);
-
-    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-        throw std::runtime_error("Texture image format does not support linear blitting!");
-    }
-
+void Texture::generateMipmaps(const VkCommandBuffer commandBuffer, const VkImage image, const int32_t texWidth,
+                              const int32_t texHeight, const uint32_t mipLevels) {
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image;
@@ -305,8 +376,90 @@ void Texture::generateMipmaps(const VkImage image, VkFormat imageFormat, const i
 
     vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                          0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void Texture::recordRelocation(const VkCommandBuffer commandBuffer, const Allocation &destination) {
+    if (vkCreateImage(deviceRef.device(), &m_ImageInfo,
+                      AllocationTracker::callbacks(), &m_RelocatedImage) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create relocated image!");
+    }
+    if (vkBindImageMemory(deviceRef.device(), m_RelocatedImage, destination.memory, destination.offset) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind relocated image memory!");
+    }
+
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (auto &barrier: barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = m_MipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+
+    barriers[0].image = m_TextureImage;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    barriers[1].image = m_RelocatedImage;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    std::vector<VkImageCopy> regions(m_MipLevels);
+    for (uint32_t i = 0; i < m_MipLevels; i++) {
+        VkImageCopy &region = regions[i];
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel = i;
+        region.srcSubresource.baseArrayLayer = 0;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource = region.srcSubresource;
+        region.extent = {std::max(m_Width >> i, 1u), std::max(m_Height >> i, 1u), 1};
+    }
+    vkCmdCopyImage(commandBuffer, m_TextureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_RelocatedImage,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    // Both images go back to being sampled, the old one stays in use until the switch
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+std::function<void()> Texture::commitRelocation(const Allocation &destination) {
+    const VkImage oldImage = m_TextureImage;
+    const VkImageView oldView = m_TextureImageView;
+    const VkDescriptorSet oldSet = m_Material.descriptorSet;
+
+    m_TextureImage = m_RelocatedImage;
+    m_RelocatedImage = VK_NULL_HANDLE;
+    m_TextureAllocation = destination;
+    m_TextureImageView = createTextureImageView(m_TextureImage);
+
+    // The old set may still be bound by a frame in flight, so a new one is written instead of updating it
+    createMaterial();
 
-    deviceRef.endSingleTimeCommands(commandBuffer);
+    return [device = deviceRef.device(), pool = m_DescriptorPool, oldSet, oldView, oldImage] {
+        vkFreeDescriptorSets(device, pool, 1, &oldSet);
+        vkDestroyImageView(device, oldView, AllocationTracker::callbacks());
+        vkDestroyImage(device, oldImage, AllocationTracker::callbacks());
+    };
 }
 
 } // Namespace KaguEngine
\ No newline at end of file
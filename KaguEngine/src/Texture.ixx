@@ -9,11 +9,12 @@ export module KaguEngine.Texture;
 import std;
 
 import KaguEngine.Device;
-import KaguEngine.SwapChain;
+import KaguEngine.Memory;
+import KaguEngine.Residency;
 
 export namespace KaguEngine {
 
-class Texture {
+class Texture final : public Relocatable, public Evictable {
 public:
     struct Material {
         VkDescriptorSet descriptorSet{};
@@ -21,44 +22,71 @@ public:
         VkSampler textureSampler{};
     };
 
-    Texture(Device &device, SwapChain &swapChain, const std::string &filepath,
+    Texture(Device &device, const std::string &filepath,
             VkDescriptorSetLayout descriptorSetLayout, VkDescriptorPool descriptorPool);
-    ~Texture();
+    // RGBA8 pixels, in sRGB
+    Texture(Device &device, uint32_t width, uint32_t height, std::vector<uint8_t> pixels,
+            VkDescriptorSetLayout descriptorSetLayout, VkDescriptorPool descriptorPool);
+    ~Texture() override;
+
+    // Non copyable
+    Texture(const Texture &) = delete;
+    Texture &operator=(const Texture &) = delete;
 
     // Personalized texture
-    static std::unique_ptr<Texture> createTextureFromFile(Device &device, SwapChain &swapChain,
+    static std::unique_ptr<Texture> createTextureFromFile(Device &device,
                                                           const std::string &filepath,
                                                           VkDescriptorSetLayout descriptorSetLayout,
                                                           VkDescriptorPool descriptorPool);
+    // 1x1 texture, bound where a material has no texture
+    static std::unique_ptr<Texture> createSolidTexture(Device &device,
+                                                       const std::array<uint8_t, 4> &color,
+                                                       VkDescriptorSetLayout descriptorSetLayout,
+                                                       VkDescriptorPool descriptorPool);
 
     [[nodiscard]] const VkImage& getTextureImage()         const { return m_TextureImage; }
-    [[nodiscard]] const VkDeviceMemory& getTextureMemory() const { return m_TextureImageMemory; }
+    [[nodiscard]] const Allocation& getAllocation()        const { return m_TextureAllocation; }
     [[nodiscard]] const VkImageView& getTextureImageView() const { return m_TextureImageView; }
     [[nodiscard]] const VkSampler& getTextureSampler()     const { return m_TextureSampler; }
     [[nodiscard]] const Material& getMaterial()            const { return m_Material; }
 
+    void recordRelocation(VkCommandBuffer commandBuffer, const Allocation &destination) override;
+    std::function<void()> commitRelocation(const Allocation &destination) override;
+
+    [[nodiscard]] bool isResident() const override { return m_TextureImage != VK_NULL_HANDLE; }
+    [[nodiscard]] VkDeviceSize getResidentSize() const override { return m_TextureAllocation.size; }
+    [[nodiscard]] bool isBusy() const override { return m_RelocatedImage != VK_NULL_HANDLE; }
+    void evict() override;
+    void makeResident() override;
+
 private:
     void loadTexture(const std::string &filepath);
+    void setPixels(uint32_t width, uint32_t height, std::vector<uint8_t> pixels);
+    void uploadTexture();
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
                      VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-                     VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory) const;
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight,
-                         uint32_t mipLevels) const;
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout,
-                               uint32_t mipLevels) const;
-    void createTextureImageView();
+                     VkMemoryPropertyFlags properties, VkImage &image, Allocation &allocation);
+    static void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, int32_t texWidth, int32_t texHeight,
+                                uint32_t mipLevels);
+    [[nodiscard]] VkImageView createTextureImageView(VkImage image) const;
     void createTextureSampler();
-    void createMaterial(VkDescriptorSetLayout layout, VkDescriptorPool pool);
+    void createMaterial();
 
+    uint32_t m_Width;
+    uint32_t m_Height;
     uint32_t m_MipLevels;
+    std::vector<uint8_t> m_Pixels;
 
-    VkDeviceMemory m_TextureImageMemory{};
+    VkImageCreateInfo m_ImageInfo{};
+    Allocation m_TextureAllocation{};
     VkImage m_TextureImage{};
     VkImageView m_TextureImageView{};
     VkSampler m_TextureSampler{};
+    VkImage m_RelocatedImage{};
 
     Device &deviceRef;
-    SwapChain &swapChainRef;
+    VkDescriptorSetLayout m_DescriptorSetLayout;
+    VkDescriptorPool m_DescriptorPool;
 
     Material m_Material;
 };
@@ -9,6 +9,8 @@ module KaguEngine.Window;
 // std
 import std;
 
+import KaguEngine.AllocationTracker;
+
 namespace KaguEngine {
 
 Window::Window(const int w, const int h, std::string name) : m_Width{w}, m_Height{h}, m_WindowName{std::move(name)} {
@@ -42,7 +44,7 @@ void Window::initWindow() {
 }
 
 void Window::createWindowSurface(const VkInstance instance, VkSurfaceKHR* surface) const {
-    if (glfwCreateWindowSurface(instance, m_Window, nullptr, surface) != VK_SUCCESS) {
+    if (glfwCreateWindowSurface(instance, m_Window, AllocationTracker::callbacks(), surface) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create window surface");
     }
 }
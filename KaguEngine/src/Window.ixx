@@ -39,7 +39,7 @@ private:
 
     int m_Width;
     int m_Height;
-    bool m_FramebufferResized = false;
+    std::atomic<bool> m_FramebufferResized{false}; // Also raised by the render thread when presenting fails
 
     std::string m_WindowName;
     GLFWwindow* m_Window;
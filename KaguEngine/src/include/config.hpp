@@ -93,8 +93,45 @@ namespace Config {
     constexpr bool enableValidationLayers = isDebug;
     constexpr uint32_t vulkanApiVersion = VK_API_VERSION_1_3;
 
+    // --- Memory ---
+    constexpr VkDeviceSize memoryBlockSize = 64ull * 1024 * 1024;
+    constexpr VkDeviceSize defragBytesPerFrame = 4ull * 1024 * 1024; // Copy budget of the defragmenter
+    constexpr float defragSparseThreshold = 0.5f; // Blocks used below this ratio get compacted
+    constexpr uint32_t defragPassCooldown = 600; // Frames between two automatic passes
+    constexpr VkDeviceSize residencyBudget = 512ull * 1024 * 1024; // Meshes and textures kept on the GPU
+    constexpr size_t frameArenaSize = 256 * 1024; // Initial scratch memory per thread, grows when exceeded
+
+    // --- Threading ---
+    constexpr uint32_t jobWorkerCount = 0; // Including the main thread, 0 uses every hardware thread
+    constexpr uint32_t maxRecordingThreads = 8; // Secondaries recorded in parallel per pass
+    constexpr uint32_t recordingDrawsPerThread = 256; // Smaller batches are recorded by fewer threads
+    constexpr uint32_t recordingBenchmarkDraws = 100000;
+
+    // --- Pipelines ---
+    constexpr std::string_view pipelineCachePath = "pipeline_cache.bin";
+    constexpr float pipelineCacheSaveInterval = 30.f; // Seconds, only saved when pipelines were created since
+    constexpr float gammaCorrection = 2.2f; // Specialization constant of the mesh shaders
+    constexpr bool extendedDynamicState = true; // Depth, cull and blend state set per draw, static pipelines if false
+    constexpr std::string_view shaderCachePath = "shader_cache.bin"; // SPIR-V compiled at runtime, needs glslang
+    constexpr bool shaderHotReload = true; // Pipelines rebuilt when a shader changes on disk
+
+    // --- Profiling ---
+    constexpr bool gpuProfiler = true; // Timestamps and pipeline statistics around every render graph pass
+    constexpr std::string_view gpuProfileCsvPath = "gpu_profile.csv";
+    constexpr uint32_t cpuTraceFrames = 120; // Frames in a CPU trace, opened with Perfetto or chrome://tracing
+    constexpr std::string_view cpuTracePath = "cpu_trace.json";
+    constexpr uint32_t allocationHotSpotFrames = 60; // Tags allocating this many frames in a row are flagged
+
+    // --- Captures ---
+    constexpr uint32_t captureInterval = 60; // Frames between two captures written by --capture
+
     // --- File Paths ---
     constexpr std::string_view assetPath = "assets/";
     constexpr std::string_view shaderPath = "assets/shaders/";
+#if defined(KAGU_SHADER_SOURCE_DIR)
+    constexpr std::string_view shaderSourcePath = KAGU_SHADER_SOURCE_DIR; // The GLSL in the source tree
+#else
+    constexpr std::string_view shaderSourcePath = "assets/shaders/";
+#endif
 
 } // Namespace Config
\ No newline at end of file
@@ -1,13 +1,55 @@
+// config
+#include "include/config.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
 import App;
+import KaguEngine.CpuProfiler;
+import KaguEngine.FrameCapture;
 
 import std;
 
-int main() {
+int main(const int argc, char **argv) {
     try {
-        KaguEngine::App Engine{};
-        Engine.run();
+        // --headless [frames]: no window, for machines without a display (lavapipe on CI)
+        // --capture <directory> [--raw]: writes a frame every Config::captureInterval frames
+        // --trace [frames]: CPU trace of the first frames, to Config::cpuTracePath
+        const std::vector<std::string_view> args(argv + 1, argv + argc);
+        std::optional<uint32_t> headlessFrames;
+        std::optional<std::filesystem::path> captureDirectory;
+        auto captureFormat = KaguEngine::CaptureFormat::Png;
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i] == "--headless") {
+                const bool hasCount = i + 1 < args.size() && !args[i + 1].starts_with("--");
+                headlessFrames = hasCount ? static_cast<uint32_t>(std::stoul(std::string{args[++i]})) : 600;
+            } else if (args[i] == "--capture" && i + 1 < args.size()) {
+                captureDirectory = args[++i];
+            } else if (args[i] == "--trace") {
+                const bool hasCount = i + 1 < args.size() && !args[i + 1].starts_with("--");
+                const uint32_t frames = hasCount ? static_cast<uint32_t>(std::stoul(std::string{args[++i]}))
+                                                 : Config::cpuTraceFrames;
+                KaguEngine::CpuProfiler::requestCapture(frames, Config::cpuTracePath);
+            } else if (args[i] == "--raw") {
+                captureFormat = KaguEngine::CaptureFormat::Raw;
+            }
+        }
+
+        if (headlessFrames) {
+            KaguEngine::App Engine{VkExtent2D{KaguEngine::App::WIDTH, KaguEngine::App::HEIGHT}};
+            if (captureDirectory) {
+                Engine.enableCapture(*captureDirectory, captureFormat);
+            }
+            Engine.runHeadless(*headlessFrames);
+        } else {
+            KaguEngine::App Engine{};
+            if (captureDirectory) {
+                Engine.enableCapture(*captureDirectory, captureFormat);
+            }
+            Engine.run();
+        }
     }
     catch (std::exception& error) {
         std::cerr << error.what() << '\n';
     }
-}
\ No newline at end of file
+}
@@ -13,10 +13,16 @@ module KaguEngine.System.PointLight;
 // std
 import std;
 
+import KaguEngine.CommandRecorder;
+import KaguEngine.CpuProfiler;
 import KaguEngine.Device;
 import KaguEngine.Entity;
+import KaguEngine.FrameArena;
 import KaguEngine.FrameInfo;
 import KaguEngine.Pipeline;
+import KaguEngine.PipelineBuilder;
+import KaguEngine.PipelineLayoutCache;
+import KaguEngine.ShaderPermutation;
 
 namespace KaguEngine {
 
@@ -26,108 +32,116 @@ struct PointLightPushConstants {
     float radius;
 };
 
-PointLightSystem::PointLightSystem(Device &device, const VkFormat colorFormat, const VkFormat depthFormat,
-                                   const VkDescriptorSetLayout globalSetLayout) : m_Device{device} {
-    createPipelineLayout(globalSetLayout);
+constexpr auto POINT_LIGHT_VERT_SHADER = "assets/shaders/point_light.vert.spv";
+constexpr auto POINT_LIGHT_FRAG_SHADER = "assets/shaders/point_light.frag.spv";
+
+PointLightSystem::PointLightSystem(Device &device, PipelineBuilder &pipelineBuilder, const VkFormat colorFormat,
+                                   const VkFormat depthFormat) :
+    m_Device{device}, m_PipelineBuilder{pipelineBuilder} {
     createPipeline(colorFormat, depthFormat);
 }
 
-PointLightSystem::~PointLightSystem() {
-    vkDestroyPipelineLayout(m_Device.device(), m_pipelineLayout, nullptr);
+void PointLightSystem::createPipeline(const VkFormat colorFormat, const VkFormat depthFormat) {
+    m_pipelineLayout = m_PipelineBuilder.getPipelineLayout(POINT_LIGHT_VERT_SHADER, POINT_LIGHT_FRAG_SHADER);
+
+    const VkPipelineLayout pipelineLayout = m_pipelineLayout;
+    const VkSampleCountFlagBits sampleCount = m_Device.getSampleCount();
+
+    std::vector<PipelineDesc> descs;
+    descs.push_back({
+        "Point light",
+        POINT_LIGHT_VERT_SHADER,
+        POINT_LIGHT_FRAG_SHADER,
+        [=](PipelineConfigInfo &configInfo) {
+            Pipeline::defaultPipelineConfigInfo(configInfo, false);
+            Pipeline::enableAlphaBlending(configInfo);
+            Pipeline::enableMSAA(configInfo, sampleCount);
+            configInfo.attributeDescriptions.clear();
+            configInfo.bindingDescriptions.clear();
+            configInfo.pipelineLayout = pipelineLayout;
+            configInfo.colorAttachmentFormat = colorFormat;
+            configInfo.depthAttachmentFormat = depthFormat;
+            // Only sizes the ubo's light array
+            ShaderPermutation{}.specialize(configInfo);
+        }
+    });
+    m_Pipeline = std::move(m_PipelineBuilder.submit(std::move(descs)).front());
 }
 
-void PointLightSystem::createPipelineLayout(const VkDescriptorSetLayout globalSetLayout) {
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(PointLightPushConstants);
-
-    const std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-    if (vkCreatePipelineLayout(m_Device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-}
+void PointLightSystem::update(Entity::Map &entities, const float frameTime) {
+    CpuProfiler::Zone zone{"PointLightSystem::update"};
+    const auto rotateLight = glm::rotate(glm::mat4(1.f), 0.5f * frameTime, {0.f, -1.f, 0.f});
+    for (auto &obj: entities | std::views::values) {
+        if (obj.pointLight == nullptr)
+            continue;
 
-void PointLightSystem::createPipeline(const VkFormat colorFormat, const VkFormat depthFormat) {
-    assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
-
-    PipelineConfigInfo pipelineConfig{};
-    Pipeline::defaultPipelineConfigInfo(pipelineConfig, false);
-    Pipeline::enableAlphaBlending(pipelineConfig);
-    Pipeline::enableMSAA(pipelineConfig, m_Device.getSampleCount());
-    pipelineConfig.attributeDescriptions.clear();
-    pipelineConfig.bindingDescriptions.clear();
-    pipelineConfig.pipelineLayout = m_pipelineLayout;
-    pipelineConfig.colorAttachmentFormat = colorFormat;
-    pipelineConfig.depthAttachmentFormat = depthFormat;
-
-    m_Pipeline = std::make_unique<Pipeline>(m_Device,
-        "assets/shaders/point_light.vert.spv",
-        "assets/shaders/point_light.frag.spv", pipelineConfig);
+        obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
+    }
 }
 
-void PointLightSystem::update(const FrameInfo &frameInfo, GlobalUbo &ubo) {
-    const auto rotateLight = glm::rotate(glm::mat4(1.f), 0.5f * frameInfo.frameTime, {0.f, -1.f, 0.f});
+void PointLightSystem::snapshot(const Entity::Map &entities, RenderPacket &packet) {
+    CpuProfiler::Zone zone{"PointLightSystem::snapshot"};
+    packet.lights.clear();
     int lightIndex = 0;
-    for (auto &val: frameInfo.sceneEntitiesRef | std::views::values) {
-        auto &obj = val;
+    for (const auto &obj: entities | std::views::values) {
         if (obj.pointLight == nullptr)
             continue;
 
         assert(lightIndex < MAX_LIGHTS && "Point lights exceed maximum specified");
 
-        // update light position
-        obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
+        LightItem &light = packet.lights.emplace_back();
+        light.position = obj.transform.translation;
+        light.color = obj.color;
+        light.intensity = obj.pointLight->lightIntensity;
+        light.radius = obj.transform.scale.x;
 
         // copy light to ubo
-        ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
-        ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
+        packet.ubo.pointLights[lightIndex].position = glm::vec4(light.position, 1.f);
+        packet.ubo.pointLights[lightIndex].color = glm::vec4(light.color, light.intensity);
 
         lightIndex++;
     }
-    ubo.numLights = lightIndex;
+    packet.ubo.numLights = lightIndex;
 }
 
-void PointLightSystem::render(const FrameInfo &frameInfo) const {
-    // sort lights
-    std::map<float, Entity::id_t> sorted;
-    for (const auto &val: frameInfo.sceneEntitiesRef | std::views::values) {
-        auto &obj = val;
-        if (obj.pointLight == nullptr)
-            continue;
-
+std::pmr::vector<std::pair<float, const LightItem *>>
+PointLightSystem::sortBackToFront(const RenderPacket &packet, std::pmr::memory_resource *memory) {
+    std::pmr::vector<std::pair<float, const LightItem *>> sorted{memory};
+    sorted.reserve(packet.lights.size());
+    for (const LightItem &light: packet.lights) {
         // calculate distance
-        auto offset = frameInfo.cameraRef.getPosition() - obj.transform.translation;
+        auto offset = packet.cameraPosition - light.position;
         float disSquared = glm::dot(offset, offset);
-        sorted[disSquared] = obj.getId();
+        sorted.emplace_back(disSquared, &light);
     }
+    std::ranges::sort(sorted, std::greater{}, [](const auto &light) { return light.first; });
+    return sorted;
+}
 
-    m_Pipeline->bind(frameInfo.commandBuffer);
+void PointLightSystem::render(const FrameInfo &frameInfo) const {
+    CpuProfiler::Zone zone{"PointLightSystem::render"};
+    const Pipeline *pipeline = m_Pipeline.get();
+    if (pipeline == nullptr) {
+        return;
+    }
 
-    vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1,
-                            &frameInfo.globalDescriptorSet, 0, nullptr);
+    // sort lights, the scratch vector lives in the frame arena
+    const auto sorted = sortBackToFront(frameInfo.packet, &FrameArena::get());
 
-    // iterate through sorted lights in reverse order (furthest -> nearest)
-    for (auto &[first, second] : std::ranges::reverse_view(sorted)) {
-        // use scene entities reference id to find light object
-        auto &obj = frameInfo.sceneEntitiesRef.at(second);
+    // The global set is already bound, the layouts are compatible
+    CommandRecorder recorder{frameInfo.commandBuffer};
+    pipeline->bind(recorder);
 
+    // iterate through sorted lights (furthest -> nearest)
+    for (const auto &[distance, light] : sorted) {
         PointLightPushConstants push{};
-        push.position = glm::vec4(obj.transform.translation, 1.f);
-        push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-        push.radius = obj.transform.scale.x;
-
-        vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                           sizeof(PointLightPushConstants), &push);
-        vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
+        push.position = glm::vec4(light->position, 1.f);
+        push.color = glm::vec4(light->color, light->intensity);
+        push.radius = light->radius;
+
+        recorder.pushConstants(m_pipelineLayout, PipelineLayoutCache::STAGES, 0, sizeof(PointLightPushConstants),
+                               &push);
+        recorder.draw(6);
     }
 }
 
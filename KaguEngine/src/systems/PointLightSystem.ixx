@@ -11,29 +11,34 @@ import std;
 import KaguEngine.Device;
 import KaguEngine.Entity;
 import KaguEngine.FrameInfo;
-import KaguEngine.Pipeline;
+import KaguEngine.PipelineBuilder;
 
 export namespace KaguEngine {
 
 class PointLightSystem {
 public:
-    PointLightSystem(Device &device, VkFormat colorFormat, VkFormat depthFormat, VkDescriptorSetLayout globalSetLayout);
-    ~PointLightSystem();
+    PointLightSystem(Device &device, PipelineBuilder &pipelineBuilder, VkFormat colorFormat, VkFormat depthFormat);
 
     PointLightSystem(const PointLightSystem &) = delete;
     PointLightSystem &operator=(const PointLightSystem &) = delete;
 
-    static void update(const FrameInfo &frameInfo, GlobalUbo &ubo);
+    // Main thread: moves the lights, then copies them to the frame's packet
+    static void update(Entity::Map &entities, float frameTime);
+    static void snapshot(const Entity::Map &entities, RenderPacket &packet);
+    // Farthest from the camera first, the order they blend in. Paired with their squared distance.
+    [[nodiscard]] static std::pmr::vector<std::pair<float, const LightItem *>>
+    sortBackToFront(const RenderPacket &packet, std::pmr::memory_resource *memory);
+    // Render thread, nothing is drawn until the pipeline is ready. Expects the global set bound.
     void render(const FrameInfo &frameInfo) const;
 
 private:
-    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
     void createPipeline(VkFormat colorFormat, VkFormat depthFormat);
 
     Device &m_Device;
+    PipelineBuilder &m_PipelineBuilder;
 
-    std::unique_ptr<Pipeline> m_Pipeline;
-    VkPipelineLayout m_pipelineLayout;
+    PipelineHandle m_Pipeline;
+    VkPipelineLayout m_pipelineLayout; // Owned by the builder's layout cache
 };
 
 } // Namespace KaguEngine
\ No newline at end of file
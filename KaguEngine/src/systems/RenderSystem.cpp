@@ -1,5 +1,8 @@
 module;
 
+// config
+#include "../include/config.hpp"
+
 // libs
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -12,11 +15,20 @@ module KaguEngine.System.Render;
 // std
 import std;
 
-import KaguEngine.Camera;
+import KaguEngine.CommandRecorder;
+import KaguEngine.CpuProfiler;
 import KaguEngine.Device;
 import KaguEngine.Entity;
 import KaguEngine.FrameInfo;
+import KaguEngine.JobSystem;
+import KaguEngine.Model;
+import KaguEngine.ParallelRecorder;
 import KaguEngine.Pipeline;
+import KaguEngine.PipelineBuilder;
+import KaguEngine.PipelineLayoutCache;
+import KaguEngine.ShaderPermutation;
+import KaguEngine.Residency;
+import KaguEngine.Texture;
 
 namespace KaguEngine {
 
@@ -24,141 +36,207 @@ struct SimplePushConstantData {
     glm::mat4 modelMatrix{1.f};
     glm::vec3 modelColor{1.f};
     float modelAlpha{1.f};
-    float gammaCorrection{2.2f};
+};
+
+constexpr auto MESH_VERT_SHADER = "assets/shaders/mesh.vert.spv";
+constexpr auto MESH_FRAG_SHADER = "assets/shaders/mesh.frag.spv";
+
+namespace { // Anonymous namespace for the draw state
+// Blended draws test depth without writing it, so the ones behind them still show
+RasterState getRasterState(const bool blend) {
+    RasterState state{};
+    state.blend = blend;
+    state.depthWrite = !blend;
+    return state;
+}
+}
+
+// Compiled at startup, with the light loop left dynamic so they suit any scene
+constexpr std::array PRECOMPILED_FEATURES{
+    ShaderFeature::None,
+    ShaderFeature::Textured,
+    ShaderFeature::AlphaBlend,
+    ShaderFeature::Textured | ShaderFeature::AlphaBlend
 };
 
 RenderSystem::RenderSystem(
     Device &device,
+    JobSystem &jobSystem,
+    PipelineBuilder &pipelineBuilder,
     const VkFormat colorFormat,
     const VkFormat depthFormat,
-    const VkDescriptorSetLayout globalSetLayout,
-    const VkDescriptorSetLayout materialSetLayout
-) : m_Device{device}
+    const VkDescriptorSetLayout materialSetLayout,
+    const VkDescriptorPool materialPool
+) : m_Device{device}, m_PipelineBuilder{pipelineBuilder}, m_ColorFormat{colorFormat}, m_DepthFormat{depthFormat},
+    m_Recorder{device, jobSystem}
 {
-    createPipelineNoTexturesLayout(globalSetLayout);
-    createPipelineTexturesLayout(globalSetLayout, materialSetLayout);
+    m_WhiteTexture = Texture::createSolidTexture(device, {255, 255, 255, 255}, materialSetLayout, materialPool);
     createPipeline(colorFormat, depthFormat);
 }
 
-RenderSystem::~RenderSystem() {
-    vkDestroyPipelineLayout(m_Device.device(), m_pipelineTexturesLayout, nullptr);
-    vkDestroyPipelineLayout(m_Device.device(), m_pipelineNoTexturesLayout, nullptr);
-}
-
-void RenderSystem::createPipelineNoTexturesLayout(const VkDescriptorSetLayout globalSetLayout) {
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(SimplePushConstantData);
-
-    const std::vector<VkDescriptorSetLayout> descriptorSetLayouts{
-        globalSetLayout,      // set = 0
-    };
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-    if (vkCreatePipelineLayout(m_Device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineNoTexturesLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create pipeline layout!");
+void RenderSystem::createPipeline(const VkFormat colorFormat, const VkFormat depthFormat) {
+    // Compatible with every layout sharing the global set, see PipelineLayoutCache
+    m_pipelineLayout = m_PipelineBuilder.getPipelineLayout(MESH_VERT_SHADER, MESH_FRAG_SHADER);
+
+    const VkPipelineLayout pipelineLayout = m_pipelineLayout;
+    const VkSampleCountFlagBits sampleCount = m_Device.getSampleCount();
+    const DynamicStateSupport dynamicState = m_Device.getDynamicStateSupport();
+    m_Pipelines = std::make_unique<PipelinePermutations>(
+        m_PipelineBuilder,
+        "Mesh",
+        MESH_VERT_SHADER,
+        MESH_FRAG_SHADER,
+        [=](PipelineConfigInfo &configInfo, const ShaderPermutation &permutation) {
+            // Every vertex carries texture coordinates, the untextured permutations ignore them
+            Pipeline::defaultPipelineConfigInfo(configInfo, true);
+            const bool blend = hasFeature(permutation.features, ShaderFeature::AlphaBlend);
+            if (blend) {
+                Pipeline::enableAlphaBlending(configInfo);
+            }
+            Pipeline::applyRasterState(configInfo, getRasterState(blend));
+            Pipeline::enableDynamicState(configInfo, dynamicState);
+            Pipeline::enableMSAA(configInfo, sampleCount);
+            configInfo.pipelineLayout = pipelineLayout;
+            configInfo.colorAttachmentFormat = colorFormat;
+            configInfo.depthAttachmentFormat = depthFormat;
+        });
+
+    std::vector<ShaderPermutation> permutations;
+    for (const ShaderFeature features: PRECOMPILED_FEATURES) {
+        permutations.push_back({getShaderFeatures(features), ShaderPermutation::DYNAMIC_LIGHT_COUNT,
+                                Config::gammaCorrection});
     }
+    m_Pipelines->precompile(permutations);
 }
 
-void RenderSystem::createPipelineTexturesLayout(const VkDescriptorSetLayout globalSetLayout,
-                                              const VkDescriptorSetLayout materialSetLayout) {
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(SimplePushConstantData);
-
-    const std::vector<VkDescriptorSetLayout> descriptorSetLayouts{
-        globalSetLayout,      // set = 0
-        materialSetLayout     // set = 1
-    };
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-    if (vkCreatePipelineLayout(m_Device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineTexturesLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create pipeline layout!");
+ShaderFeature RenderSystem::getShaderFeatures(const ShaderFeature features) const {
+    // With blending toggled per draw, every draw outputs its alpha and opaque ones share the blended pipelines
+    if (m_Device.getDynamicStateSupport().colorBlendEnable) {
+        return features | ShaderFeature::AlphaBlend;
     }
+    return features;
 }
 
-void RenderSystem::createPipeline(const VkFormat colorFormat, const VkFormat depthFormat) {
-    assert(m_pipelineTexturesLayout != nullptr && "Cannot create pipeline before pipeline layout");
-    assert(m_pipelineNoTexturesLayout != nullptr && "Cannot create pipeline before pipeline layout");
-
-    PipelineConfigInfo pipelineConfigTextures{};
-    Pipeline::defaultPipelineConfigInfo(pipelineConfigTextures, true);
-    Pipeline::enableAlphaBlending(pipelineConfigTextures);
-    Pipeline::enableMSAA(pipelineConfigTextures, m_Device.getSampleCount());
-    // ---
-    PipelineConfigInfo pipelineConfigNoTextures{};
-    Pipeline::defaultPipelineConfigInfo(pipelineConfigNoTextures, false);
-    Pipeline::enableAlphaBlending(pipelineConfigNoTextures);
-    Pipeline::enableMSAA(pipelineConfigNoTextures, m_Device.getSampleCount());
-
-    pipelineConfigTextures.pipelineLayout = m_pipelineTexturesLayout;
-    pipelineConfigTextures.colorAttachmentFormat = colorFormat;
-    pipelineConfigTextures.depthAttachmentFormat = depthFormat;
-    // ---
-    pipelineConfigNoTextures.pipelineLayout = m_pipelineNoTexturesLayout;
-    pipelineConfigNoTextures.colorAttachmentFormat = colorFormat;
-    pipelineConfigNoTextures.depthAttachmentFormat = depthFormat;
-
-    m_PipelineTextures = std::make_unique<Pipeline>(
-        m_Device,
-        "assets/shaders/with_textures.vert.spv",
-        "assets/shaders/with_textures.frag.spv",
-        pipelineConfigTextures);
-    m_PipelineNoTextures = std::make_unique<Pipeline>(
-        m_Device,
-        "assets/shaders/without_textures.vert.spv",
-        "assets/shaders/without_textures.frag.spv",
-        pipelineConfigNoTextures
-    );
+const Pipeline *RenderSystem::getPipeline(const ShaderFeature features, const int32_t lightCount) {
+    // The permutation for this light count is compiled on first use, the dynamic one draws meanwhile
+    if (const Pipeline *pipeline = m_Pipelines->request({features, lightCount, Config::gammaCorrection})) {
+        return pipeline;
+    }
+    return m_Pipelines->request({features, ShaderPermutation::DYNAMIC_LIGHT_COUNT, Config::gammaCorrection});
 }
 
-void RenderSystem::renderGameObjects(const FrameInfo &frameInfo) const {
-    for (auto &[id, entity]: frameInfo.sceneEntitiesRef) {
+void RenderSystem::snapshot(const Entity::Map &entities, RenderPacket &packet) {
+    CpuProfiler::Zone zone{"RenderSystem::snapshot"};
+    const auto lightCount = static_cast<int32_t>(std::min<std::ptrdiff_t>(
+        std::ranges::count_if(entities | std::views::values,
+                              [](const Entity &entity) { return entity.pointLight != nullptr; }),
+        MAX_LIGHTS));
+    // Resolved once per frame for each feature combination
+    std::array<const Pipeline *, 4> pipelines{};
+    std::array<bool, 4> resolved{};
+
+    // Bringing back evicted meshes and textures uploads and allocates descriptor sets, the caller runs it on the main
+    // thread
+    packet.draws.clear();
+    packet.residencyFrame = m_Device.residency().getFrame();
+    for (auto &[id, entity]: entities) {
         if (!entity.model) continue;
 
-        SimplePushConstantData push{};
-        push.modelMatrix     = entity.transform.mat4();
-        push.modelColor      = entity.color;
-        push.modelAlpha      = entity.transform.alpha;
-        push.gammaCorrection = 2.2f;
-
-        // With textures
+        ShaderFeature features = ShaderFeature::None;
         if (entity.texture != nullptr) {
-            m_PipelineTextures->bind(frameInfo.commandBuffer);
-            vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    m_pipelineTexturesLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
-            vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    m_pipelineTexturesLayout, 1, 1, &entity.material.descriptorSet, 0, nullptr);
-            vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineTexturesLayout,
-                               VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                               sizeof(SimplePushConstantData), &push);
+            features = features | ShaderFeature::Textured;
         }
-        // Without textures
-        else {
-            m_PipelineNoTextures->bind(frameInfo.commandBuffer);
-            vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    m_pipelineNoTexturesLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
-            vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineNoTexturesLayout,
-                               VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                               sizeof(SimplePushConstantData), &push);
+        const bool blend = entity.transform.alpha < 1.f;
+        if (blend) {
+            features = features | ShaderFeature::AlphaBlend;
         }
+        const auto index = static_cast<uint32_t>(features);
+        if (!resolved[index]) {
+            pipelines[index] = getPipeline(getShaderFeatures(features), lightCount);
+            resolved[index] = true;
+        }
+        if (pipelines[index] == nullptr) continue;
+
+        m_Device.residency().touch(*entity.model);
+        Texture *texture = entity.texture != nullptr ? entity.texture.get() : m_WhiteTexture.get();
+        m_Device.residency().touch(*texture);
+
+        DrawItem &draw = packet.draws.emplace_back();
+        draw.modelMatrix = entity.transform.mat4();
+        draw.color = entity.color;
+        draw.alpha = entity.transform.alpha;
+        draw.model = entity.model.get();
+        draw.texture = texture;
+        draw.pipeline = pipelines[index];
+        draw.rasterState = getRasterState(blend);
+    }
+
+    // Opaque draws first, then grouped by pipeline and material so recording doesn't bind them again
+    std::ranges::sort(packet.draws, {}, [](const DrawItem &draw) {
+        return std::tuple{draw.rasterState.blend, draw.pipeline, draw.texture};
+    });
+}
 
-        entity.model->bind(frameInfo.commandBuffer);
-        entity.model->draw(frameInfo.commandBuffer);
+void RenderSystem::renderGameObjects(const FrameInfo &frameInfo) {
+    CpuProfiler::Zone zone{"RenderSystem::renderGameObjects"};
+    const std::span<const DrawItem> draws = frameInfo.packet.draws;
+    m_Recorder.record(frameInfo.commandBuffer, frameInfo.frameIndex, getSecondaryTarget(frameInfo),
+                      static_cast<uint32_t>(draws.size()),
+                      [&](const VkCommandBuffer commandBuffer, const uint32_t begin, const uint32_t end) {
+                          recordDraws(commandBuffer, frameInfo.globalDescriptorSet, draws, begin, end);
+                      });
+}
+
+std::vector<double> RenderSystem::benchmarkRecording(const FrameInfo &frameInfo, const uint32_t drawCount) {
+    const std::span<const DrawItem> draws = frameInfo.packet.draws;
+    if (draws.empty()) {
+        return {};
+    }
+    return m_Recorder.benchmark(getSecondaryTarget(frameInfo), drawCount,
+                                [&](const VkCommandBuffer commandBuffer, const uint32_t begin, const uint32_t end) {
+                                    recordDraws(commandBuffer, frameInfo.globalDescriptorSet, draws, begin, end);
+                                });
+}
+
+SecondaryTarget RenderSystem::getSecondaryTarget(const FrameInfo &frameInfo) const {
+    SecondaryTarget target{};
+    target.colorFormat = m_ColorFormat;
+    target.depthFormat = m_DepthFormat;
+    target.samples = m_Device.getSampleCount();
+    target.extent = frameInfo.extent;
+    target.renderingFlags = RENDERING_FLAGS & ~VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    return target;
+}
+
+void RenderSystem::recordDraws(const VkCommandBuffer commandBuffer, const VkDescriptorSet globalDescriptorSet,
+                               const std::span<const DrawItem> draws, const uint32_t begin,
+                               const uint32_t end) const {
+    CpuProfiler::Zone zone{"RenderSystem::recordDraws"};
+    // Secondaries don't inherit the primary's bindings, the recorder starts with nothing bound
+    CommandRecorder recorder{commandBuffer};
+    recorder.bindDescriptorSet(m_pipelineLayout, 0, globalDescriptorSet);
+
+    // Indices wrap around the draw list, so benchmarks can record more draws than the scene has.
+    // The draws are sorted by pipeline and material, the recorder skips binding them again.
+    const RasterState *rasterState = nullptr;
+    for (uint32_t i = begin; i < end; i++) {
+        const DrawItem &draw = draws[i % draws.size()];
+
+        // The permutations share their dynamic state, it carries over a pipeline change
+        draw.pipeline->bind(recorder);
+        draw.pipeline->setRasterState(commandBuffer, draw.rasterState, rasterState);
+        rasterState = &draw.rasterState;
+        recorder.bindDescriptorSet(m_pipelineLayout, 1, draw.texture->getMaterial().descriptorSet);
+
+        SimplePushConstantData push{};
+        push.modelMatrix = draw.modelMatrix;
+        push.modelColor  = draw.color;
+        push.modelAlpha  = draw.alpha;
+        recorder.pushConstants(m_pipelineLayout, PipelineLayoutCache::STAGES, 0, sizeof(SimplePushConstantData),
+                               &push);
+
+        draw.model->bind(recorder);
+        draw.model->draw(recorder);
     }
 }
 
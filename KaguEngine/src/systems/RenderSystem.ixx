@@ -8,37 +8,58 @@ export module KaguEngine.System.Render;
 // std
 import std;
 
-import KaguEngine.Camera;
 import KaguEngine.Device;
 import KaguEngine.Entity;
 import KaguEngine.FrameInfo;
+import KaguEngine.JobSystem;
+import KaguEngine.ParallelRecorder;
 import KaguEngine.Pipeline;
+import KaguEngine.PipelineBuilder;
+import KaguEngine.ShaderPermutation;
+import KaguEngine.Texture;
 
 export namespace KaguEngine {
 
 class RenderSystem {
 public:
-    RenderSystem(Device &device, VkFormat colorFormat, VkFormat depthFormat,
-                   VkDescriptorSetLayout globalSetLayout,
-                   VkDescriptorSetLayout materialSetLayout);
-    ~RenderSystem();
+    // The scene pass only executes secondaries, it's suspended so other systems can resume it inline
+    static constexpr VkRenderingFlags RENDERING_FLAGS =
+        VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT | VK_RENDERING_SUSPENDING_BIT;
+
+    // The pipelines compile in the background, draws are skipped until theirs is ready
+    RenderSystem(Device &device, JobSystem &jobSystem, PipelineBuilder &pipelineBuilder,
+                   VkFormat colorFormat, VkFormat depthFormat,
+                   VkDescriptorSetLayout materialSetLayout,
+                   VkDescriptorPool materialPool);
 
     RenderSystem(const RenderSystem &) = delete;
     RenderSystem &operator=(const RenderSystem &) = delete;
 
-    void renderGameObjects(const FrameInfo &frameInfo) const;
+    // Main thread: copies the drawable entities to the packet, bringing back the evicted ones.
+    // Picks the permutation of each draw, requesting the ones that don't exist yet.
+    void snapshot(const Entity::Map &entities, RenderPacket &packet);
+    // Render thread
+    void renderGameObjects(const FrameInfo &frameInfo);
+    // Recording time of drawCount draws for every thread count, repeating the frame's draws
+    [[nodiscard]] std::vector<double> benchmarkRecording(const FrameInfo &frameInfo, uint32_t drawCount);
 
 private:
-    void createPipelineTexturesLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout materialSetLayout);
-    void createPipelineNoTexturesLayout(VkDescriptorSetLayout globalSetLayout);
     void createPipeline(VkFormat colorFormat, VkFormat depthFormat);
+    [[nodiscard]] ShaderFeature getShaderFeatures(ShaderFeature features) const;
+    [[nodiscard]] const Pipeline *getPipeline(ShaderFeature features, int32_t lightCount);
+    [[nodiscard]] SecondaryTarget getSecondaryTarget(const FrameInfo &frameInfo) const;
+    void recordDraws(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet,
+                     std::span<const DrawItem> draws, uint32_t begin, uint32_t end) const;
 
     Device &m_Device;
+    PipelineBuilder &m_PipelineBuilder;
+    VkFormat m_ColorFormat;
+    VkFormat m_DepthFormat;
+    ParallelRecorder m_Recorder;
 
-    std::unique_ptr<Pipeline> m_PipelineNoTextures;
-    std::unique_ptr<Pipeline> m_PipelineTextures;
-    VkPipelineLayout m_pipelineTexturesLayout;
-    VkPipelineLayout m_pipelineNoTexturesLayout;
+    std::unique_ptr<Texture> m_WhiteTexture; // Bound for untextured draws, the layout always has the material set
+    std::unique_ptr<PipelinePermutations> m_Pipelines;
+    VkPipelineLayout m_pipelineLayout; // Owned by the builder's layout cache
 };
 
 } // Namespace KaguEngine
\ No newline at end of file